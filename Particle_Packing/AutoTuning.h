@@ -0,0 +1,202 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   AutoTuning.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/mpi/Reduce.h"
+#include "core/timing/TimingTree.h"
+
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+struct AutoTuningParameters
+{
+   uint_t probeSteps = uint_t(100); // timed steps per candidate, in total over all rounds
+   uint_t probeRounds = uint_t(5); // the candidates are probed round-robin, probeSteps / probeRounds steps per visit
+   std::vector<real_t> cellWidthFactors = {real_t(1.01), real_t(1.25), real_t(1.5)}; // linked cells width relative to the max. particle diameter
+   std::vector<int> sortingSpacings = {0, 100, 1000}; // non-positive: no sorting
+   bool probeHashGrids = true;
+
+   template<typename T>
+   static std::vector<T> parseList(const std::string & list)
+   {
+      std::vector<T> values;
+      std::istringstream stream(list);
+      T value;
+      while(stream >> value) values.push_back(value);
+      return values;
+   }
+
+   static AutoTuningParameters fromConfig(const Config::BlockHandle & autoTuningConf)
+   {
+      AutoTuningParameters parameters;
+      parameters.probeSteps = autoTuningConf.getParameter<uint_t>("probeSteps", parameters.probeSteps);
+      parameters.probeRounds = autoTuningConf.getParameter<uint_t>("probeRounds", parameters.probeRounds);
+      if(autoTuningConf.isDefined("cellWidthFactors"))
+         parameters.cellWidthFactors = parseList<real_t>(autoTuningConf.getParameter<std::string>("cellWidthFactors"));
+      if(autoTuningConf.isDefined("sortingSpacings"))
+         parameters.sortingSpacings = parseList<int>(autoTuningConf.getParameter<std::string>("sortingSpacings"));
+      parameters.probeHashGrids = autoTuningConf.getParameter<bool>("probeHashGrids", parameters.probeHashGrids);
+      WALBERLA_CHECK_GREATER(parameters.probeSteps, uint_t(0));
+      WALBERLA_CHECK(parameters.probeRounds > uint_t(0) && parameters.probeRounds <= parameters.probeSteps, "Auto-tuning: probeRounds has to be in [1, probeSteps].");
+      WALBERLA_CHECK(!parameters.cellWidthFactors.empty() && !parameters.sortingSpacings.empty(), "Auto-tuning: empty candidate list.");
+      for(auto factor : parameters.cellWidthFactors) WALBERLA_CHECK_GREATER_EQUAL(factor, real_t(1), "Auto-tuning: the linked cells width has to cover the max. particle diameter.");
+      return parameters;
+   }
+};
+
+struct TuningCandidate
+{
+   bool useHashGrids = false;
+   real_t cellWidthFactor = real_t(1.01); // not used with hash grids
+   int sortingSpacing = 0; // not used with hash grids
+
+   std::string getName() const
+   {
+      std::ostringstream name;
+      if(useHashGrids) name << "hash grids";
+      else name << "linked cells " << std::setprecision(3) << cellWidthFactor << ", sorting " << sortingSpacing;
+      return name.str();
+   }
+};
+
+/*
+ * Probes the contact detection setups that can be changed at runtime (hash grids or linked cells with a given cell width,
+ * particle sorting interval) on the first time steps of the simulation, i.e., on the first generation slab, and selects the fastest one.
+ * The simulation itself continues unchanged during probing, since the setups only differ in performance.
+ * As the bed evolves during probing (more particles and contacts), the candidates are probed round-robin in probeRounds rounds,
+ * such that all of them are timed on the same sequence of states up to the interleaving.
+ * Each visit of a candidate runs one warm-up step, in which its setup is applied, and probeSteps / probeRounds timed steps,
+ * timed with a WcTimingTree.
+ * Sorting candidates sort in the warm-up step of each visit, the sorting time is accounted for as amortized over the sorting interval.
+ * The decision is based on the max. time over all processes and thus identical on all of them.
+ */
+class AutoTuner
+{
+public:
+   AutoTuner(const AutoTuningParameters & parameters, bool allowHashGrids)
+      : parameters_(parameters), stepsPerVisit_(parameters.probeSteps / parameters.probeRounds)
+   {
+      for(auto factor : parameters_.cellWidthFactors)
+      {
+         for(auto spacing : parameters_.sortingSpacings)
+         {
+            TuningCandidate candidate;
+            candidate.cellWidthFactor = factor;
+            candidate.sortingSpacing = spacing;
+            candidates_.push_back(candidate);
+         }
+      }
+      if(allowHashGrids && parameters_.probeHashGrids)
+      {
+         TuningCandidate candidate;
+         candidate.useHashGrids = true;
+         candidates_.push_back(candidate);
+      }
+   }
+
+   bool isProbing() const { return currentRound_ < parameters_.probeRounds; }
+   const TuningCandidate & getCurrentCandidate() const { return candidates_[currentCandidate_]; }
+   const std::vector<TuningCandidate> & getCandidates() const { return candidates_; }
+
+   // true in the first step of a visit of a candidate, where its setup has to be applied
+   bool isFirstStep() const { return currentStep_ == 0; }
+   // sorting candidates sort in the warm-up step of each visit
+   bool requiresSorting() const { return isFirstStep() && !getCurrentCandidate().useHashGrids && getCurrentCandidate().sortingSpacing > 0; }
+
+   void beginStep()
+   {
+      timing_.start(getTimerName(currentCandidate_, currentStep_ == 0 ? "warm-up" : "step"));
+   }
+
+   // collective at the end of the probing, returns true if the probing has finished with this step
+   bool endStep()
+   {
+      timing_.stop(getTimerName(currentCandidate_, currentStep_ == 0 ? "warm-up" : "step"));
+      if(++currentStep_ <= stepsPerVisit_) return false;
+      currentStep_ = 0;
+      if(++currentCandidate_ < candidates_.size()) return false;
+      currentCandidate_ = 0;
+      if(++currentRound_ < parameters_.probeRounds) return false;
+      select();
+      return true;
+   }
+
+   void addSortingTime(double time) { sortingTimes_.resize(candidates_.size(), 0.0); sortingTimes_[currentCandidate_] += time; }
+
+   const TuningCandidate & getBest() const { return candidates_[best_]; }
+   double getBestTimePerStep() const { return timesPerStep_[best_]; }
+   uint_t getNumberOfProbeSteps() const { return uint_c(candidates_.size()) * parameters_.probeRounds * (stepsPerVisit_ + uint_t(1)); }
+
+   std::string getReport() const
+   {
+      std::ostringstream report;
+      report << "Auto-tuning results (max. wall time per time step over all processes):\n";
+      for(size_t i = 0; i < candidates_.size(); ++i)
+      {
+         report << "  " << std::setw(36) << std::left << candidates_[i].getName() << std::right << std::setw(14) << std::scientific << std::setprecision(4)
+                << timesPerStep_[i] << " s" << ((i == best_) ? "  <- selected" : "") << "\n";
+      }
+      return report.str();
+   }
+
+private:
+   static std::string getTimerName(size_t candidate, const std::string & part) { return "candidate " + std::to_string(candidate) + " " + part; }
+
+   void select()
+   {
+      sortingTimes_.resize(candidates_.size(), 0.0);
+      timesPerStep_.assign(candidates_.size(), 0.0);
+      for(size_t i = 0; i < candidates_.size(); ++i)
+      {
+         timesPerStep_[i] = timing_[getTimerName(i, "step")].total() / double(stepsPerVisit_ * parameters_.probeRounds);
+         if(!candidates_[i].useHashGrids && candidates_[i].sortingSpacing > 0)
+            timesPerStep_[i] += sortingTimes_[i] / double(parameters_.probeRounds) / double(candidates_[i].sortingSpacing);
+      }
+      walberla::mpi::allReduceInplace(timesPerStep_, walberla::mpi::MAX);
+      best_ = 0;
+      for(size_t i = 1; i < candidates_.size(); ++i)
+      {
+         if(timesPerStep_[i] < timesPerStep_[best_]) best_ = i;
+      }
+   }
+
+   AutoTuningParameters parameters_;
+   std::vector<TuningCandidate> candidates_;
+   uint_t stepsPerVisit_;
+   size_t currentCandidate_ = 0;
+   uint_t currentRound_ = 0;
+   uint_t currentStep_ = 0;
+   WcTimingTree timing_;
+   std::vector<double> sortingTimes_;
+   std::vector<double> timesPerStep_;
+   size_t best_ = 0;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
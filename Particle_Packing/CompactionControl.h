@@ -0,0 +1,185 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   CompactionControl.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+struct CompactionControlParameters
+{
+   real_t rateThreshold = real_t(1e-4); // porosity decrease per shaking period below which the compaction has plateaued
+   uint_t windowPeriods = uint_t(10); // shaking periods over which the compaction rate is measured
+   real_t minDuration = real_t(0.25); // s
+   real_t maxDuration = real_t(5); // s
+   bool annealing = false; // on a plateau, continue with a reduced amplitude instead of stopping
+   real_t annealingFactor = real_t(0.5);
+   real_t minAmplitudeRatio = real_t(0.1); // relative to the initial amplitude, smallest annealed amplitude
+
+   static CompactionControlParameters fromConfig(const Config::BlockHandle & controlConf)
+   {
+      CompactionControlParameters parameters;
+      parameters.rateThreshold = controlConf.getParameter<real_t>("rateThreshold", parameters.rateThreshold);
+      parameters.windowPeriods = controlConf.getParameter<uint_t>("windowPeriods", parameters.windowPeriods);
+      parameters.minDuration = controlConf.getParameter<real_t>("minDuration", parameters.minDuration);
+      parameters.maxDuration = controlConf.getParameter<real_t>("maxDuration", parameters.maxDuration);
+      parameters.annealing = controlConf.getParameter<bool>("annealing", parameters.annealing);
+      parameters.annealingFactor = controlConf.getParameter<real_t>("annealingFactor", parameters.annealingFactor);
+      parameters.minAmplitudeRatio = controlConf.getParameter<real_t>("minAmplitudeRatio", parameters.minAmplitudeRatio);
+      WALBERLA_CHECK_GREATER(parameters.windowPeriods, uint_t(0));
+      WALBERLA_CHECK_GREATER_EQUAL(parameters.maxDuration, parameters.minDuration);
+      WALBERLA_CHECK(parameters.annealingFactor > real_t(0) && parameters.annealingFactor < real_t(1), "Compaction control: annealing factor has to be in (0,1).");
+      return parameters;
+   }
+};
+
+/*
+ * Feedback control of the shaking phase after the generation, replacing the fixed shaking duration.
+ * The bulk porosity is estimated online from the (globally reduced) particle volume and mass-averaged height h_m,
+ * as 1 - V / (A * 2 h_m) for a bed of constant porosity on the bottom plane with the cross section A.
+ * h_m is averaged over each full shaking period, which removes the oscillation of the bed.
+ * Once minDuration has passed, the compaction rate is the porosity decrease per period over the last windowPeriods periods.
+ * If it drops below rateThreshold, the shaking is stopped or, with annealing, continued with the amplitude reduced by
+ * annealingFactor, until the amplitude would fall below minAmplitudeRatio times the initial one.
+ * The shaking is stopped after maxDuration in any case.
+ * Amplitude changes are only applied at period boundaries, where the shaking displacement is zero.
+ * All inputs are global, so all processes take the same decisions.
+ */
+class CompactionController
+{
+public:
+   CompactionController(const CompactionControlParameters & parameters, real_t period, real_t amplitude, real_t crossSectionArea, real_t bottomHeight)
+      : parameters_(parameters), period_(period), initialAmplitude_(amplitude), amplitude_(amplitude),
+        crossSectionArea_(crossSectionArea), bottomHeight_(bottomHeight) {}
+
+   // phaseOrigin: time at which the shaking displacement started, periods are counted from there
+   void begin(real_t time, real_t phaseOrigin)
+   {
+      timeBegin_ = time;
+      timeLast_ = time;
+      phaseOrigin_ = phaseOrigin;
+      currentPeriod_ = getPeriodIndex(time);
+      isPeriodComplete_ = false; // the period in progress has not been sampled from its beginning
+      heightSum_ = 0.0;
+      volumeSum_ = 0.0;
+      numSamples_ = 0;
+      porosities_.clear();
+   }
+
+   // every time step of the shaking phase, returns true if the shaking is to be stopped
+   bool update(real_t time, real_t heightOfMass, real_t particleVolume)
+   {
+      timeLast_ = time;
+      const int64_t period = getPeriodIndex(time);
+      if(period != currentPeriod_)
+      {
+         if(isPeriodComplete_ && numSamples_ > 0)
+         {
+            const double meanHeight = heightSum_ / double(numSamples_) - double(bottomHeight_);
+            const double meanVolume = volumeSum_ / double(numSamples_);
+            estimatedPorosity_ = (meanHeight > 0.0) ? real_c(1.0 - meanVolume / (double(crossSectionArea_) * 2.0 * meanHeight)) : real_t(1);
+            porosities_.push_back(estimatedPorosity_);
+            WALBERLA_LOG_DEVEL_ON_ROOT("Compaction control: estimated porosity " << estimatedPorosity_ << " after " << time - timeBegin_ << " s of shaking.");
+            if(evaluate(time)) return true;
+         }
+         currentPeriod_ = period;
+         isPeriodComplete_ = true;
+         heightSum_ = 0.0;
+         volumeSum_ = 0.0;
+         numSamples_ = 0;
+      }
+      heightSum_ += double(heightOfMass);
+      volumeSum_ += double(particleVolume);
+      ++numSamples_;
+
+      if(time - timeBegin_ >= parameters_.maxDuration)
+      {
+         stopReason_ = "maxDuration";
+         WALBERLA_LOG_INFO_ON_ROOT("Compaction control: reached maximal shaking duration of " << parameters_.maxDuration << " s.");
+         return true;
+      }
+      return false;
+   }
+
+   real_t getAmplitude() const { return amplitude_; }
+   real_t getDuration() const { return timeLast_ - timeBegin_; }
+   real_t getEstimatedPorosity() const { return estimatedPorosity_; }
+   real_t getCompactionRate() const { return compactionRate_; }
+   uint_t getNumberOfAnnealingSteps() const { return numAnnealingSteps_; }
+   const std::string & getStopReason() const { return stopReason_; }
+
+private:
+   int64_t getPeriodIndex(real_t time) const { return int64_c(std::floor((time - phaseOrigin_) / period_)); }
+
+   // at the end of each fully sampled period
+   bool evaluate(real_t time)
+   {
+      if(time - timeBegin_ < parameters_.minDuration || porosities_.size() <= parameters_.windowPeriods) return false;
+      compactionRate_ = (porosities_[porosities_.size() - 1 - parameters_.windowPeriods] - porosities_.back()) / real_c(parameters_.windowPeriods);
+      if(compactionRate_ >= parameters_.rateThreshold) return false;
+
+      if(parameters_.annealing && amplitude_ * parameters_.annealingFactor >= parameters_.minAmplitudeRatio * initialAmplitude_)
+      {
+         amplitude_ *= parameters_.annealingFactor;
+         ++numAnnealingSteps_;
+         porosities_.clear(); // new measurement window for the reduced amplitude
+         WALBERLA_LOG_INFO_ON_ROOT("Compaction control: compaction rate " << compactionRate_ << " per period at porosity " << estimatedPorosity_
+                                   << ", reducing the shaking amplitude to " << amplitude_ << " at time " << time << " s.");
+         return false;
+      }
+      stopReason_ = "plateau";
+      WALBERLA_LOG_INFO_ON_ROOT("Compaction control: compaction rate " << compactionRate_ << " per period below threshold at porosity "
+                                << estimatedPorosity_ << " after " << time - timeBegin_ << " s of shaking.");
+      return true;
+   }
+
+   CompactionControlParameters parameters_;
+   real_t period_;
+   real_t initialAmplitude_;
+   real_t amplitude_;
+   real_t crossSectionArea_;
+   real_t bottomHeight_;
+
+   real_t timeBegin_ = real_t(0);
+   real_t timeLast_ = real_t(0);
+   real_t phaseOrigin_ = real_t(0);
+   int64_t currentPeriod_ = 0;
+   bool isPeriodComplete_ = false;
+   double heightSum_ = 0.0;
+   double volumeSum_ = 0.0;
+   uint_t numSamples_ = 0;
+   std::vector<real_t> porosities_;
+
+   real_t estimatedPorosity_ = real_t(1);
+   real_t compactionRate_ = real_t(0);
+   uint_t numAnnealingSteps_ = 0;
+   std::string stopReason_ = "none";
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,243 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   ContactNetworkEvaluation.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/math/AABB.h"
+#include "core/mpi/MPIManager.h"
+#include "core/mpi/Reduce.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Periodic evaluation of the contact network during the run:
+ * - coordination number, globally and per horizontal layer (contact ends per particle, particle-particle contacts only),
+ * - fabric tensor of the contact normals <n x n>, globally and its zz component per layer,
+ * - orientation tensor <a x a> of the particles' long axes (not for spheres),
+ * - distribution of the normal contact forces (mean, standard deviation, histogram over logarithmic bins).
+ * The contacts are added from the solver's existing contact loop (addContact) and the particles from a particle loop,
+ * both into per-thread partial sums. evaluate() reduces all partial sums with a single reduction to root,
+ * which appends one line to the time series file and one line per layer to the layer file.
+ * Each contact is handled by exactly one process (contact filtering), so the global sums are exact.
+ */
+class ContactNetworkEvaluator
+{
+public:
+   ContactNetworkEvaluator(real_t layerHeight, const math::AABB & simulationDomain, const std::string & fileName, const std::string & layerFileName,
+                           real_t minForceExponent = real_t(-12), real_t maxForceExponent = real_t(4), uint_t binsPerDecade = uint_t(4))
+      : layerHeight_(layerHeight), zMin_(simulationDomain.zMin()), numLayers_(std::max(uint_t(1), uint_c(std::ceil(simulationDomain.zSize() / layerHeight)))),
+        minForceExponent_(minForceExponent), binsPerDecade_(binsPerDecade),
+        numForceBins_(uint_c(std::ceil((maxForceExponent - minForceExponent) * real_c(binsPerDecade)))),
+        fileName_(fileName), layerFileName_(layerFileName)
+   {
+      numValues_ = LAYERS + numForceBins_ + uint_t(2) + numLayers_ * VALUES_PER_LAYER;
+      WALBERLA_ROOT_SECTION()
+      {
+         std::ofstream file(fileName_.c_str());
+         file << "# t num_particles num_contacts coordination_number fabric_xx fabric_yy fabric_zz fabric_xy fabric_xz fabric_yz fabric_anisotropy"
+              << " orientation_xx orientation_yy orientation_zz orientation_xy orientation_xz orientation_yz orientation_anisotropy"
+              << " mean_normal_force std_normal_force, then the fraction of contacts per normal force bin: below 1e" << minForceExponent_;
+         for(uint_t i = 0; i < numForceBins_; ++i) file << " <1e" << minForceExponent_ + real_c(i + 1) / real_c(binsPerDecade_);
+         file << " above\n";
+         std::ofstream layerFile(layerFileName_.c_str());
+         layerFile << "# t layer_center_height num_particles coordination_number fabric_zz\n";
+      }
+      clear();
+   }
+
+   // before the contact and particle loops of an evaluation step
+   void clear()
+   {
+#ifdef _OPENMP
+      partials_.resize(size_t(omp_get_max_threads()));
+#else
+      partials_.resize(1);
+#endif
+      for(auto & partial : partials_) partial.assign(numValues_, 0.0);
+   }
+
+   // from the contact loop, thread-safe; normalForce is the magnitude of the normal contact force
+   template<typename Accessor_T>
+   void addContact(size_t idx1, size_t idx2, const Accessor_T & ac, const Vec3 & normal, real_t normalForce)
+   {
+      if(data::particle_flags::isSet(ac.getFlags(idx1), data::particle_flags::INFINITE) ||
+         data::particle_flags::isSet(ac.getFlags(idx2), data::particle_flags::INFINITE)) return;
+      auto & values = getPartial();
+      values[NUM_CONTACTS] += 1.0;
+      addTensor(values, FABRIC, normal);
+      values[FORCE_SUM] += double(normalForce);
+      values[FORCE_SQR_SUM] += double(normalForce) * double(normalForce);
+      values[LAYERS + getForceBin(normalForce)] += 1.0;
+      for(size_t idx : {idx1, idx2})
+      {
+         const size_t layer = LAYERS + numForceBins_ + uint_t(2) + getLayer(ac.getPosition(idx)[2]) * VALUES_PER_LAYER;
+         values[layer + LAYER_CONTACT_ENDS] += 1.0;
+         values[layer + LAYER_FABRIC_ZZ] += double(normal[2] * normal[2]);
+      }
+   }
+
+   // particle loop over the local particles
+   template<typename Accessor_T>
+   void operator()(size_t idx, Accessor_T & ac)
+   {
+      if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE)) return;
+      auto & values = getPartial();
+      values[NUM_PARTICLES] += 1.0;
+      values[LAYERS + numForceBins_ + uint_t(2) + getLayer(ac.getPosition(idx)[2]) * VALUES_PER_LAYER + LAYER_PARTICLES] += 1.0;
+
+      // long axis in the body frame: largest semi-axis of ellipsoids, otherwise the principal axis with the smallest moment of inertia
+      const auto * shape = ac.getShape(idx);
+      if(shape->getShapeType() == data::Sphere::SHAPE_TYPE) return;
+      uint_t longAxis = 0;
+      if(shape->getShapeType() == data::Ellipsoid::SHAPE_TYPE)
+      {
+         const Vec3 & semiAxes = static_cast<const data::Ellipsoid *>(shape)->getSemiAxes();
+         for(uint_t i = 1; i < 3; ++i) if(semiAxes[i] > semiAxes[longAxis]) longAxis = i;
+      } else
+      {
+         const Mat3 & inertia = shape->getInertiaBF();
+         for(uint_t i = 1; i < 3; ++i) if(inertia(i, i) < inertia(longAxis, longAxis)) longAxis = i;
+      }
+      Vec3 axisBF(real_t(0));
+      axisBF[longAxis] = real_t(1);
+      values[NUM_ORIENTED] += 1.0;
+      addTensor(values, ORIENTATION, ac.getRotation(idx).getMatrix() * axisBF);
+   }
+
+   // collective, one reduction, writes on root
+   void evaluate(real_t time)
+   {
+      std::vector<double> values(numValues_, 0.0);
+      for(const auto & partial : partials_)
+         for(size_t i = 0; i < numValues_; ++i) values[i] += partial[i];
+      walberla::mpi::reduceInplace(values, walberla::mpi::SUM);
+
+      WALBERLA_ROOT_SECTION()
+      {
+         const double numContacts = values[NUM_CONTACTS];
+         const double numParticles = values[NUM_PARTICLES];
+         const double meanForce = (numContacts > 0.0) ? values[FORCE_SUM] / numContacts : 0.0;
+         const double forceVariance = (numContacts > 0.0) ? std::max(0.0, values[FORCE_SQR_SUM] / numContacts - meanForce * meanForce) : 0.0;
+
+         std::ofstream file(fileName_.c_str(), std::ofstream::app);
+         file << std::setprecision(8) << time << " " << numParticles << " " << numContacts << " " << ((numParticles > 0.0) ? 2.0 * numContacts / numParticles : 0.0);
+         writeTensor(file, values, FABRIC, numContacts);
+         writeTensor(file, values, ORIENTATION, values[NUM_ORIENTED]);
+         file << " " << meanForce << " " << std::sqrt(forceVariance);
+         for(uint_t i = 0; i < numForceBins_ + uint_t(2); ++i) file << " " << ((numContacts > 0.0) ? values[LAYERS + i] / numContacts : 0.0);
+         file << "\n";
+
+         std::ofstream layerFile(layerFileName_.c_str(), std::ofstream::app);
+         layerFile << std::setprecision(8);
+         for(uint_t l = 0; l < numLayers_; ++l)
+         {
+            const size_t layer = LAYERS + numForceBins_ + uint_t(2) + l * VALUES_PER_LAYER;
+            const double contactEnds = values[layer + LAYER_CONTACT_ENDS];
+            const double layerParticles = values[layer + LAYER_PARTICLES];
+            if(layerParticles <= 0.0) continue;
+            layerFile << time << " " << zMin_ + (real_c(l) + real_t(0.5)) * layerHeight_ << " " << layerParticles << " " << contactEnds / layerParticles
+                      << " " << ((contactEnds > 0.0) ? values[layer + LAYER_FABRIC_ZZ] / contactEnds : 0.0) << "\n";
+         }
+      }
+      clear();
+   }
+
+private:
+   // value layout: global values, force histogram (with under- and overflow bin), then per layer
+   enum : uint_t { NUM_CONTACTS = 0, FABRIC = 1, FORCE_SUM = 7, FORCE_SQR_SUM = 8, NUM_PARTICLES = 9, NUM_ORIENTED = 10, ORIENTATION = 11, LAYERS = 17 };
+   enum : uint_t { LAYER_CONTACT_ENDS = 0, LAYER_PARTICLES = 1, LAYER_FABRIC_ZZ = 2, VALUES_PER_LAYER = 3 };
+
+   std::vector<double> & getPartial()
+   {
+#ifdef _OPENMP
+      return partials_[size_t(omp_get_thread_num())];
+#else
+      return partials_[0];
+#endif
+   }
+
+   uint_t getLayer(real_t z) const
+   {
+      return std::min(numLayers_ - uint_t(1), uint_c(std::max(real_t(0), (z - zMin_) / layerHeight_)));
+   }
+
+   uint_t getForceBin(real_t force) const
+   {
+      if(force <= real_t(0)) return 0;
+      const real_t bin = (std::log10(force) - minForceExponent_) * real_c(binsPerDecade_);
+      if(bin < real_t(0)) return 0;
+      return std::min(numForceBins_ + uint_t(1), uint_c(bin) + uint_t(1));
+   }
+
+   // symmetric tensor v x v as xx yy zz xy xz yz
+   static void addTensor(std::vector<double> & values, uint_t offset, const Vec3 & v)
+   {
+      values[offset + 0] += double(v[0] * v[0]);
+      values[offset + 1] += double(v[1] * v[1]);
+      values[offset + 2] += double(v[2] * v[2]);
+      values[offset + 3] += double(v[0] * v[1]);
+      values[offset + 4] += double(v[0] * v[2]);
+      values[offset + 5] += double(v[1] * v[2]);
+   }
+
+   // averaged tensor and the anisotropy sqrt(3/2 D:D) of its deviator D, 0 for isotropic, 1 for perfect alignment
+   static void writeTensor(std::ofstream & file, const std::vector<double> & values, uint_t offset, double count)
+   {
+      double tensor[6];
+      for(uint_t i = 0; i < 6; ++i) tensor[i] = (count > 0.0) ? values[offset + i] / count : 0.0;
+      const double mean = (tensor[0] + tensor[1] + tensor[2]) / 3.0;
+      double deviatorNormSqr = 0.0;
+      for(uint_t i = 0; i < 3; ++i) deviatorNormSqr += (tensor[i] - mean) * (tensor[i] - mean);
+      for(uint_t i = 3; i < 6; ++i) deviatorNormSqr += 2.0 * tensor[i] * tensor[i];
+      for(uint_t i = 0; i < 6; ++i) file << " " << tensor[i];
+      file << " " << std::sqrt(1.5 * deviatorNormSqr);
+   }
+
+   real_t layerHeight_;
+   real_t zMin_;
+   uint_t numLayers_;
+   real_t minForceExponent_;
+   uint_t binsPerDecade_;
+   uint_t numForceBins_;
+   std::string fileName_;
+   std::string layerFileName_;
+   size_t numValues_;
+   std::vector<std::vector<double>> partials_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
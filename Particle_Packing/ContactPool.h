@@ -0,0 +1,288 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   ContactPool.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/debug/Debug.h"
+
+#include "mesa_pd/data/ContactAccessor.h"
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/IContactAccessor.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+// contact properties, with the types of data::ContactStorage, (member, accessor suffix)
+#define CONTACT_POOL_DETECTION_FIELDS(X) \
+   X(id1, Id1) X(id2, Id2) X(distance, Distance) X(normal, Normal) X(position, Position)
+#define CONTACT_POOL_HCSITS_FIELDS(X) \
+   X(t, T) X(o, O) X(r1, R1) X(r2, R2) X(mu, Mu) X(p, P) \
+   X(diag_nto, Diag_nto) X(diag_nto_inv, Diag_nto_inv) X(diag_to_inv, Diag_to_inv) X(diag_n_inv, Diag_n_inv)
+
+/*
+ * Replacement for data::ContactStorage in the time loop, which is refilled in every time step.
+ * - The per-property arrays keep their capacity across time steps and are sized from the contact count of the previous step,
+ *   so reallocations only happen while the number of contacts grows.
+ * - The contact detection appends via append(), which is thread-safe: each thread claims chunks of consecutive slots
+ *   in the shared arrays via an atomic counter and fills them without further synchronization.
+ *   The chunks thus form the final storage directly. finalize() only moves the few contacts behind the partially filled
+ *   last chunks of the threads into their gaps, and appends the contacts that did not fit into the preallocated capacity.
+ * - The HCSITS properties (contact frame, impulse, ...) are only allocated if the HCSITS solver is used.
+ * Contacts have no uid, there is no uid lookup.
+ */
+class ContactPool
+{
+public:
+   explicit ContactPool(bool withHCSITSFields, size_t chunkSize = size_t(256))
+      : withHCSITSFields_(withHCSITSFields), chunkSize_(chunkSize) {}
+
+   bool hasHCSITSFields() const { return withHCSITSFields_; }
+
+   // begin of the contact detection, removes all contacts but keeps the capacity
+   void clear()
+   {
+#ifdef _OPENMP
+      const size_t numThreads = size_t(omp_get_max_threads());
+#else
+      const size_t numThreads = size_t(1);
+#endif
+      threadBuffers_.resize(numThreads);
+      for(auto & buffer : threadBuffers_) buffer = ThreadBuffer();
+      // margin for the growth of the contact count and the partially filled chunks
+      reserve(size_ + size_ / size_t(4) + numThreads * chunkSize_);
+      size_ = 0;
+      next_.store(0, std::memory_order_relaxed);
+      isFinalized_ = false;
+   }
+
+   // thread-safe, during the contact detection
+   void append(size_t id1, size_t id2, real_t distance, const Vec3 & normal, const Vec3 & position)
+   {
+#ifdef _OPENMP
+      auto & buffer = threadBuffers_[size_t(omp_get_thread_num())];
+#else
+      auto & buffer = threadBuffers_[0];
+#endif
+      if(buffer.current == buffer.end && !claimChunk(buffer))
+      {
+         buffer.overflow.push_back({id1, id2, distance, normal, position});
+         return;
+      }
+      const size_t c = buffer.current++;
+      id1_[c] = id1;
+      id2_[c] = id2;
+      distance_[c] = distance;
+      normal_[c] = normal;
+      position_[c] = position;
+   }
+
+   // end of the contact detection, not thread-safe
+   void finalize()
+   {
+      const size_t claimed = std::min(next_.load(std::memory_order_relaxed), capacity_);
+      std::vector<size_t> gaps;
+      for(auto & buffer : threadBuffers_)
+      {
+         for(size_t c = buffer.current; c < buffer.end; ++c) gaps.push_back(c);
+      }
+      size_ = claimed - gaps.size();
+
+      // gaps below size_ are filled with the contacts at and above size_
+      std::sort(gaps.begin(), gaps.end());
+      auto gapIt = gaps.begin();
+      auto sourceGapIt = std::lower_bound(gaps.begin(), gaps.end(), size_);
+      for(size_t source = size_; source < claimed && gapIt != gaps.end() && *gapIt < size_; ++source)
+      {
+         if(sourceGapIt != gaps.end() && *sourceGapIt == source) { ++sourceGapIt; continue; }
+         moveContact(*gapIt++, source);
+      }
+
+      size_t numOverflow = 0;
+      for(const auto & buffer : threadBuffers_) numOverflow += buffer.overflow.size();
+      if(numOverflow > 0)
+      {
+         reserve(size_ + numOverflow);
+         for(auto & buffer : threadBuffers_)
+         {
+            for(const auto & contact : buffer.overflow)
+            {
+               id1_[size_] = contact.id1;
+               id2_[size_] = contact.id2;
+               distance_[size_] = contact.distance;
+               normal_[size_] = contact.normal;
+               position_[size_] = contact.position;
+               ++size_;
+            }
+            buffer.overflow = std::vector<OverflowContact>();
+         }
+      }
+      isFinalized_ = true;
+   }
+
+   size_t size() const
+   {
+      WALBERLA_ASSERT(isFinalized_, "Contact pool accessed during the contact detection.");
+      return size_;
+   }
+
+   template <typename Selector, typename Accessor, typename Func, typename... Args>
+   void forEachContact(const bool openmp, const Selector & selector, Accessor & acForPS, Func && func, Args &&... args)
+   {
+      WALBERLA_UNUSED(openmp);
+      const int64_t len = int64_c(size());
+#ifdef _OPENMP
+      #pragma omp parallel for schedule(static) firstprivate(selector, func) if (openmp)
+#endif
+      for(int64_t i = 0; i < len; ++i)
+      {
+         if(selector(uint64_c(i), acForPS)) func(uint64_c(i), std::forward<Args>(args)...);
+      }
+   }
+
+   size_t getCapacity() const { return capacity_; }
+   uint_t getNumberOfAllocations() const { return numAllocations_; }
+
+   // heap memory of the per-property arrays
+   size_t getMemory() const
+   {
+      size_t bytesPerContact = 0;
+#define CONTACT_POOL_SIZE(NAME, SUFFIX) bytesPerContact += sizeof(SUFFIX##_type);
+      CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_SIZE)
+      if(withHCSITSFields_) { CONTACT_POOL_HCSITS_FIELDS(CONTACT_POOL_SIZE) }
+#undef CONTACT_POOL_SIZE
+      return capacity_ * bytesPerContact;
+   }
+
+#define CONTACT_POOL_ACCESS(NAME, SUFFIX) \
+   using SUFFIX##_type = std::decay_t<decltype(std::declval<const data::ContactAccessor &>().get##SUFFIX(0))>; \
+   const SUFFIX##_type & get##SUFFIX(size_t c) const { WALBERLA_ASSERT_LESS(c, NAME##_.size()); return NAME##_[c]; } \
+   SUFFIX##_type & get##SUFFIX##Ref(size_t c) { WALBERLA_ASSERT_LESS(c, NAME##_.size()); return NAME##_[c]; } \
+   void set##SUFFIX(size_t c, const SUFFIX##_type & value) { WALBERLA_ASSERT_LESS(c, NAME##_.size()); NAME##_[c] = value; }
+   CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_ACCESS)
+   CONTACT_POOL_HCSITS_FIELDS(CONTACT_POOL_ACCESS)
+#undef CONTACT_POOL_ACCESS
+
+private:
+   struct OverflowContact
+   {
+      size_t id1;
+      size_t id2;
+      real_t distance;
+      Vec3 normal;
+      Vec3 position;
+   };
+
+   // claimed slots [current, end), padded to avoid false sharing of the counters
+   struct alignas(64) ThreadBuffer
+   {
+      size_t current = 0;
+      size_t end = 0;
+      bool isOverflowing = false;
+      std::vector<OverflowContact> overflow;
+   };
+
+   bool claimChunk(ThreadBuffer & buffer)
+   {
+      if(buffer.isOverflowing) return false;
+      const size_t begin = next_.fetch_add(chunkSize_, std::memory_order_relaxed);
+      if(begin >= capacity_)
+      {
+         buffer.isOverflowing = true;
+         return false;
+      }
+      buffer.current = begin;
+      buffer.end = std::min(begin + chunkSize_, capacity_);
+      return true;
+   }
+
+   void reserve(size_t numContacts)
+   {
+      if(numContacts <= capacity_) return;
+      capacity_ = std::max(numContacts, capacity_ + capacity_ / size_t(2));
+#define CONTACT_POOL_RESIZE(NAME, SUFFIX) NAME##_.resize(capacity_);
+      CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_RESIZE)
+      if(withHCSITSFields_) { CONTACT_POOL_HCSITS_FIELDS(CONTACT_POOL_RESIZE) }
+#undef CONTACT_POOL_RESIZE
+      ++numAllocations_;
+   }
+
+   // only the detection properties are set at this point
+   void moveContact(size_t destination, size_t source)
+   {
+#define CONTACT_POOL_MOVE(NAME, SUFFIX) NAME##_[destination] = NAME##_[source];
+      CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_MOVE)
+#undef CONTACT_POOL_MOVE
+   }
+
+   bool withHCSITSFields_;
+   size_t chunkSize_;
+
+#define CONTACT_POOL_MEMBER(NAME, SUFFIX) std::vector<SUFFIX##_type> NAME##_;
+   CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_MEMBER)
+   CONTACT_POOL_HCSITS_FIELDS(CONTACT_POOL_MEMBER)
+#undef CONTACT_POOL_MEMBER
+
+   size_t size_ = 0;
+   size_t capacity_ = 0;
+   std::atomic<size_t> next_{0};
+   std::vector<ThreadBuffer> threadBuffers_;
+   bool isFinalized_ = true;
+   uint_t numAllocations_ = 0;
+};
+
+/*
+ * Contact accessor for the ContactPool, with the interface of data::ContactAccessor as used by the mesa_pd kernels.
+ */
+class ContactPoolAccessor : public data::IContactAccessor
+{
+public:
+   explicit ContactPoolAccessor(const std::shared_ptr<ContactPool> & pool) : pool_(pool) {}
+   ~ContactPoolAccessor() override = default;
+
+   size_t size() const { return pool_->size(); }
+
+#define CONTACT_POOL_FORWARD(NAME, SUFFIX) \
+   using SUFFIX##_type = ContactPool::SUFFIX##_type; \
+   const SUFFIX##_type & get##SUFFIX(size_t c) const { return pool_->get##SUFFIX(c); } \
+   SUFFIX##_type & get##SUFFIX##Ref(size_t c) { return pool_->get##SUFFIX##Ref(c); } \
+   void set##SUFFIX(size_t c, const SUFFIX##_type & value) { pool_->set##SUFFIX(c, value); }
+   CONTACT_POOL_DETECTION_FIELDS(CONTACT_POOL_FORWARD)
+   CONTACT_POOL_HCSITS_FIELDS(CONTACT_POOL_FORWARD)
+#undef CONTACT_POOL_FORWARD
+
+private:
+   std::shared_ptr<ContactPool> pool_;
+};
+
+#undef CONTACT_POOL_DETECTION_FIELDS
+#undef CONTACT_POOL_HCSITS_FIELDS
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,380 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   DeltaGhostSync.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/mpi/BufferDataTypeExtensions.h"
+#include "core/mpi/BufferSystem.h"
+#include "core/mpi/MPIManager.h"
+#include "core/mpi/Reduce.h"
+
+#include "mesa_pd/data/ContactHistory.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/ParticleStorage.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ParticleStorageLayout.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+struct DeltaGhostSyncParameters
+{
+   real_t skin = real_t(0.2); // additional ghost layer width, relative to the max. particle diameter
+   uint_t maxStepsBetweenFullSyncs = uint_t(1000);
+   // quantization of the deltas against the last sent state, zero: deltas are sent as exact values
+   real_t positionResolution = real_t(0);
+   real_t velocityResolution = real_t(0);
+   real_t rotationResolution = real_t(0); // threshold per quaternion component, the rotation itself is always sent exactly
+
+   static DeltaGhostSyncParameters fromConfig(const Config::BlockHandle & ghostSyncConf)
+   {
+      DeltaGhostSyncParameters parameters;
+      parameters.skin = ghostSyncConf.getParameter<real_t>("skin", parameters.skin);
+      parameters.maxStepsBetweenFullSyncs = ghostSyncConf.getParameter<uint_t>("maxStepsBetweenFullSyncs", parameters.maxStepsBetweenFullSyncs);
+      parameters.positionResolution = ghostSyncConf.getParameter<real_t>("positionResolution", parameters.positionResolution);
+      parameters.velocityResolution = ghostSyncConf.getParameter<real_t>("velocityResolution", parameters.velocityResolution);
+      parameters.rotationResolution = ghostSyncConf.getParameter<real_t>("rotationResolution", parameters.rotationResolution);
+      WALBERLA_CHECK_GREATER(parameters.skin, real_t(0), "Delta ghost sync requires a positive ghost layer skin.");
+      // ghosts have to stay within the linked cells domain, which is extended by one cell width >= max. particle diameter
+      WALBERLA_CHECK_LESS_EQUAL(parameters.skin, real_t(0.5), "Delta ghost sync: skin must not exceed half the max. particle diameter.");
+      WALBERLA_CHECK_GREATER(parameters.maxStepsBetweenFullSyncs, uint_t(0));
+      WALBERLA_CHECK(parameters.positionResolution >= real_t(0) && parameters.velocityResolution >= real_t(0) && parameters.rotationResolution >= real_t(0),
+                     "Delta ghost sync: negative resolution.");
+      return parameters;
+   }
+};
+
+/*
+ * Ghost synchronization that only sends the properties that changed since they were last sent.
+ * The ghost layer itself (creation and removal of ghosts, migration) is maintained by the regular next neighbor sync,
+ * which is run with an additional skin and thus only has to be repeated ("full sync") once any local particle has moved
+ * by more than half the skin since the last full sync, the particle storage was reordered or resized, or after maxStepsBetweenFullSyncs.
+ * Newly ghosted particles therefore always receive their full record from the full sync.
+ * In between, each local particle with ghost copies sends a bit mask of its changed properties (position, rotation, linear and angular velocity,
+ * DEM contact history) to its ghost owners, followed by these properties. Positions and velocities are sent as deltas against the
+ * last sent state, optionally quantized to int32 multiples of the given resolution. The sender tracks the state the ghosts hold,
+ * i.e., including the quantization error, such that the error does not accumulate.
+ * Particles outside of their block by less than half the skin stay on their owner until the next full sync.
+ * The GhostSyncLayout selects the properties that are compared and sent at all, e.g. no rotation for spheres (lean layout),
+ * the reference state is stored as structure of arrays with only these properties.
+ */
+class DeltaGhostSync
+{
+public:
+   explicit DeltaGhostSync(const DeltaGhostSyncParameters & parameters, real_t maxParticleDiameter, const GhostSyncLayout & layout)
+      : parameters_(parameters), skin_(parameters.skin * maxParticleDiameter), layout_(layout) {}
+
+   real_t getSkin() const { return skin_; }
+   const GhostSyncLayout & getLayout() const { return layout_; }
+
+   // forces a full sync, e.g. after the ghost layer was rebuilt without the skin
+   void invalidate() { isValid_ = false; }
+
+   // collective, true if the ghost layer has to be rebuilt by a full sync with getSkin() as additional ghost layer width
+   bool isFullSyncRequired(data::ParticleStorage & ps)
+   {
+      real_t maxDisplacementSqr = real_t(0);
+      bool isConsistent = isValid_ && stepsSinceFullSync_ < parameters_.maxStepsBetweenFullSyncs && reference_.uid.size() == ps.size();
+      for(size_t idx = 0; isConsistent && idx < ps.size(); ++idx)
+      {
+         if(reference_.uid[idx] != ps.getUidRef(idx)) { isConsistent = false; break; }
+         if(data::particle_flags::isSet(ps.getFlagsRef(idx), data::particle_flags::GHOST)) continue;
+         maxDisplacementSqr = std::max(maxDisplacementSqr, (ps.getPositionRef(idx) - reference_.positionAtFullSync[idx]).sqrLength());
+      }
+      real_t criterion = isConsistent ? std::sqrt(maxDisplacementSqr) : std::numeric_limits<real_t>::infinity();
+      walberla::mpi::allReduceInplace(criterion, walberla::mpi::MAX);
+      return criterion > real_t(0.5) * skin_;
+   }
+
+   // to be called directly after each full sync, stores the state the ghosts hold now
+   void resetReferenceState(data::ParticleStorage & ps, int64_t bytesSentByFullSync)
+   {
+      reference_.resize(ps.size(), layout_);
+      for(size_t idx = 0; idx < ps.size(); ++idx)
+      {
+         reference_.uid[idx] = ps.getUidRef(idx);
+         reference_.position[idx] = ps.getPositionRef(idx);
+         reference_.positionAtFullSync[idx] = ps.getPositionRef(idx);
+         reference_.linearVelocity[idx] = ps.getLinearVelocityRef(idx);
+         if(layout_.rotation) reference_.rotation[idx] = ps.getRotationRef(idx).getQuaternion();
+         if(layout_.angularVelocity) reference_.angularVelocity[idx] = ps.getAngularVelocityRef(idx);
+         if(layout_.contactHistory) reference_.hasContactHistory[idx] = !ps.getOldContactHistoryRef(idx).empty();
+      }
+      isValid_ = true;
+      stepsSinceFullSync_ = 0;
+      lastSyncWasFull_ = true;
+      bytesSent_ = bytesSentByFullSync;
+      bytesSentFull_ += bytesSentByFullSync;
+      ++numFullSyncs_;
+   }
+
+   // collective, sends the changed properties of all local particles with ghost copies and applies the received ones
+   void operator()(data::ParticleStorage & ps)
+   {
+      const int ownRank = walberla::mpi::MPIManager::instance()->rank();
+
+      // the ghost layer is unchanged since the last full sync, so the communication partners are known on both sides
+      std::set<walberla::mpi::MPIRank> senderRanks;
+      std::map<walberla::mpi::MPIRank, std::vector<size_t>> updatesPerRank; // indices into updates
+      std::vector<Update> updates;
+      for(size_t idx = 0; idx < ps.size(); ++idx)
+      {
+         if(data::particle_flags::isSet(ps.getFlagsRef(idx), data::particle_flags::GHOST))
+         {
+            if(ps.getOwnerRef(idx) != ownRank) senderRanks.insert(ps.getOwnerRef(idx));
+            continue;
+         }
+         if(ps.getGhostOwnersRef(idx).empty()) continue;
+         Update update;
+         const bool hasUpdate = createUpdate(ps, idx, update);
+         if(hasUpdate) updates.push_back(update);
+         // ranks without updates still receive an (empty) message
+         for(auto rank : ps.getGhostOwnersRef(idx))
+         {
+            if(rank == ownRank) continue;
+            auto & rankUpdates = updatesPerRank[rank];
+            if(hasUpdate) rankUpdates.push_back(updates.size() - 1);
+         }
+      }
+
+      walberla::mpi::BufferSystem bufferSystem(walberla::mpi::MPIManager::instance()->comm(), 563);
+      int64_t bytesSent = 0;
+      for(const auto & rankUpdates : updatesPerRank)
+      {
+         auto & buffer = bufferSystem.sendBuffer(rankUpdates.first);
+         buffer << uint32_t(rankUpdates.second.size());
+         for(auto updateIdx : rankUpdates.second) packUpdate(ps, updates[updateIdx], buffer);
+         bytesSent += int64_c(buffer.size());
+      }
+      bufferSystem.setReceiverInfo(senderRanks, true);
+      bufferSystem.sendAll();
+      for(auto recv = bufferSystem.begin(); recv != bufferSystem.end(); ++recv)
+      {
+         uint32_t numUpdates;
+         recv.buffer() >> numUpdates;
+         for(uint32_t i = 0; i < numUpdates; ++i) unpackUpdate(ps, recv.buffer());
+      }
+
+      ++stepsSinceFullSync_;
+      lastSyncWasFull_ = false;
+      bytesSent_ = bytesSent;
+      bytesSentDelta_ += bytesSent;
+      ++numDeltaSyncs_;
+   }
+
+   bool lastSyncWasFull() const { return lastSyncWasFull_; }
+   int64_t getBytesSent() const { return bytesSent_; } // by the last sync, process-local
+   int64_t getBytesSentByFullSyncs() const { return bytesSentFull_; }
+   int64_t getBytesSentByDeltaSyncs() const { return bytesSentDelta_; }
+   uint_t getNumberOfFullSyncs() const { return numFullSyncs_; }
+   uint_t getNumberOfDeltaSyncs() const { return numDeltaSyncs_; }
+
+private:
+   enum UpdateBits : uint8_t
+   {
+      POSITION = 1,
+      ROTATION = 2,
+      LINEAR_VELOCITY = 4,
+      ANGULAR_VELOCITY = 8,
+      CONTACT_HISTORY = 16,
+      QUANTIZED = 32
+   };
+
+   // state held by the ghosts, indexed like the particle storage, arrays of properties outside the layout stay empty
+   struct ReferenceState
+   {
+      std::vector<id_t> uid;
+      std::vector<Vec3> position; // without the periodic shift
+      std::vector<Vec3> positionAtFullSync;
+      std::vector<Vec3> linearVelocity;
+      std::vector<Quat> rotation;
+      std::vector<Vec3> angularVelocity;
+      std::vector<uint8_t> hasContactHistory;
+
+      void resize(size_t size, const GhostSyncLayout & layout)
+      {
+         uid.resize(size);
+         position.resize(size);
+         positionAtFullSync.resize(size);
+         linearVelocity.resize(size);
+         rotation.resize(layout.rotation ? size : 0);
+         angularVelocity.resize(layout.angularVelocity ? size : 0);
+         hasContactHistory.resize(layout.contactHistory ? size : 0);
+      }
+   };
+
+   struct Update
+   {
+      size_t idx;
+      uint8_t bits;
+      Vec3 deltaPosition;
+      Vec3 deltaLinearVelocity;
+      Vec3 deltaAngularVelocity;
+      int32_t quantizedPosition[3];
+      int32_t quantizedLinearVelocity[3];
+      int32_t quantizedAngularVelocity[3];
+   };
+
+   static bool quantize(const Vec3 & delta, real_t resolution, int32_t (&quantized)[3])
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         real_t value = std::round(delta[i] / resolution);
+         if(std::abs(value) > real_t(std::numeric_limits<int32_t>::max())) return false;
+         quantized[i] = int32_t(value);
+      }
+      return true;
+   }
+
+   // determines the changed properties and advances the reference state to the one the ghosts will hold, returns false if nothing changed
+   bool createUpdate(data::ParticleStorage & ps, size_t idx, Update & update)
+   {
+      update.idx = idx;
+      update.deltaPosition = ps.getPositionRef(idx) - reference_.position[idx];
+      update.deltaLinearVelocity = ps.getLinearVelocityRef(idx) - reference_.linearVelocity[idx];
+      update.deltaAngularVelocity = layout_.angularVelocity ? Vec3(ps.getAngularVelocityRef(idx) - reference_.angularVelocity[idx]) : Vec3();
+
+      bool isQuantized = parameters_.positionResolution > real_t(0) && parameters_.velocityResolution > real_t(0)
+                         && quantize(update.deltaPosition, parameters_.positionResolution, update.quantizedPosition)
+                         && quantize(update.deltaLinearVelocity, parameters_.velocityResolution, update.quantizedLinearVelocity)
+                         && quantize(update.deltaAngularVelocity, parameters_.velocityResolution, update.quantizedAngularVelocity);
+
+      auto isNonZero = [](const int32_t (&quantized)[3]){ return quantized[0] != 0 || quantized[1] != 0 || quantized[2] != 0; };
+      update.bits = isQuantized ? uint8_t(QUANTIZED) : uint8_t(0);
+      if(isQuantized ? isNonZero(update.quantizedPosition) : update.deltaPosition != Vec3()) update.bits |= POSITION;
+      if(isQuantized ? isNonZero(update.quantizedLinearVelocity) : update.deltaLinearVelocity != Vec3()) update.bits |= LINEAR_VELOCITY;
+      if(isQuantized ? isNonZero(update.quantizedAngularVelocity) : update.deltaAngularVelocity != Vec3()) update.bits |= ANGULAR_VELOCITY;
+      if(layout_.rotation)
+      {
+         const Quat rotation = ps.getRotationRef(idx).getQuaternion();
+         real_t maxRotationChange = real_t(0);
+         for(uint_t i = 0; i < 4; ++i) maxRotationChange = std::max(maxRotationChange, std::abs(rotation[i] - reference_.rotation[idx][i]));
+         if(maxRotationChange > parameters_.rotationResolution || (parameters_.rotationResolution <= real_t(0) && maxRotationChange > real_t(0)))
+         {
+            update.bits |= ROTATION;
+            reference_.rotation[idx] = rotation;
+         }
+      }
+      // the contact history changes in every step of an active contact, an emptied history has to be sent once
+      if(layout_.contactHistory)
+      {
+         const bool hasContactHistory = !ps.getOldContactHistoryRef(idx).empty();
+         if(hasContactHistory || reference_.hasContactHistory[idx]) update.bits |= CONTACT_HISTORY;
+         reference_.hasContactHistory[idx] = hasContactHistory ? 1 : 0;
+      }
+
+      if((update.bits & ~uint8_t(QUANTIZED)) == 0) return false;
+
+      auto advance = [&](UpdateBits bit, const Vec3 & delta, const int32_t (&quantized)[3], real_t resolution, Vec3 & referenceValue)
+      {
+         if(!(update.bits & bit)) return;
+         if(isQuantized) referenceValue += Vec3(real_c(quantized[0]), real_c(quantized[1]), real_c(quantized[2])) * resolution;
+         else referenceValue += delta;
+      };
+      advance(POSITION, update.deltaPosition, update.quantizedPosition, parameters_.positionResolution, reference_.position[idx]);
+      advance(LINEAR_VELOCITY, update.deltaLinearVelocity, update.quantizedLinearVelocity, parameters_.velocityResolution, reference_.linearVelocity[idx]);
+      if(layout_.angularVelocity)
+         advance(ANGULAR_VELOCITY, update.deltaAngularVelocity, update.quantizedAngularVelocity, parameters_.velocityResolution, reference_.angularVelocity[idx]);
+      return true;
+   }
+
+   static void packUpdate(data::ParticleStorage & ps, const Update & update, walberla::mpi::SendBuffer & buffer)
+   {
+      buffer << ps.getUidRef(update.idx) << update.bits;
+      const bool isQuantized = update.bits & QUANTIZED;
+      auto packVector = [&](UpdateBits bit, const Vec3 & delta, const int32_t (&quantized)[3])
+      {
+         if(!(update.bits & bit)) return;
+         if(isQuantized) buffer << quantized[0] << quantized[1] << quantized[2];
+         else buffer << delta;
+      };
+      packVector(POSITION, update.deltaPosition, update.quantizedPosition);
+      packVector(LINEAR_VELOCITY, update.deltaLinearVelocity, update.quantizedLinearVelocity);
+      packVector(ANGULAR_VELOCITY, update.deltaAngularVelocity, update.quantizedAngularVelocity);
+      if(update.bits & ROTATION) buffer << ps.getRotationRef(update.idx).getQuaternion();
+      if(update.bits & CONTACT_HISTORY) buffer << ps.getOldContactHistoryRef(update.idx);
+   }
+
+   void unpackUpdate(data::ParticleStorage & ps, walberla::mpi::RecvBuffer & buffer) const
+   {
+      id_t uid;
+      uint8_t bits;
+      buffer >> uid >> bits;
+      auto it = ps.find(uid);
+      WALBERLA_CHECK(it != ps.end(), "Delta ghost sync: update for unknown ghost particle " << uid << ".");
+      auto p = *it;
+      WALBERLA_CHECK(data::particle_flags::isSet(p.getFlags(), data::particle_flags::GHOST), "Delta ghost sync: update for local particle " << uid << ".");
+
+      const bool isQuantized = bits & QUANTIZED;
+      auto unpackVector = [&](UpdateBits bit, real_t resolution, Vec3 & value)
+      {
+         if(!(bits & bit)) return;
+         if(isQuantized)
+         {
+            int32_t quantized[3];
+            buffer >> quantized[0] >> quantized[1] >> quantized[2];
+            value += Vec3(real_c(quantized[0]), real_c(quantized[1]), real_c(quantized[2])) * resolution;
+         } else
+         {
+            Vec3 delta;
+            buffer >> delta;
+            value += delta;
+         }
+      };
+      // the delta of the position keeps the periodic shift of the ghost
+      unpackVector(POSITION, parameters_.positionResolution, p.getPositionRef());
+      unpackVector(LINEAR_VELOCITY, parameters_.velocityResolution, p.getLinearVelocityRef());
+      unpackVector(ANGULAR_VELOCITY, parameters_.velocityResolution, p.getAngularVelocityRef());
+      if(bits & ROTATION)
+      {
+         Quat rotation;
+         buffer >> rotation;
+         p.getRotationRef() = Rot3(rotation);
+      }
+      if(bits & CONTACT_HISTORY) buffer >> p.getOldContactHistoryRef();
+   }
+
+   DeltaGhostSyncParameters parameters_;
+   real_t skin_;
+   GhostSyncLayout layout_;
+
+   ReferenceState reference_; // validated via the uid
+   bool isValid_ = false;
+   uint_t stepsSinceFullSync_ = 0;
+   bool lastSyncWasFull_ = false;
+
+   int64_t bytesSent_ = 0;
+   int64_t bytesSentFull_ = 0;
+   int64_t bytesSentDelta_ = 0;
+   uint_t numFullSyncs_ = 0;
+   uint_t numDeltaSyncs_ = 0;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,219 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   DistributedStatistics.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/mpi/Reduce.h"
+
+#include "mesa_pd/data/ParticleStorage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Mergeable quantile sketch with a fixed number of bins, replacement of math::DistributedSample for particle-wise quantities.
+ * The bins are spaced logarithmically in [lowerBound, upperBound] (linearly if lowerBound <= 0), such that all quantiles
+ * within the range are resolved with the given relative accuracy, values outside are counted in an under-/overflow bin.
+ * Count, mean, standard deviation, minimum and maximum are exact.
+ * The memory is independent of the number of samples and the sketches of all processes are combined by a single reduction
+ * of the bin counts, instead of gathering all samples on all processes.
+ */
+class DistributedQuantileSketch
+{
+public:
+   DistributedQuantileSketch(real_t lowerBound, real_t upperBound, real_t relativeAccuracy = real_t(0.01), uint_t maxNumBins = uint_t(4096))
+      : lowerBound_(double(lowerBound)), upperBound_(std::max(double(upperBound), double(lowerBound))), isLogarithmic_(lowerBound > real_t(0))
+   {
+      WALBERLA_CHECK(relativeAccuracy > real_t(0) && relativeAccuracy < real_t(1), "Quantile sketch: relative accuracy has to be in (0,1).");
+      WALBERLA_CHECK_GREATER_EQUAL(maxNumBins, uint_t(1));
+      const double upper = upperBound_;
+      uint_t numBins = 1;
+      if(isLogarithmic_)
+      {
+         // bin [l, l*gamma) represented by 2 l gamma / (1 + gamma) has a relative error of at most relativeAccuracy
+         gamma_ = (1.0 + double(relativeAccuracy)) / (1.0 - double(relativeAccuracy));
+         numBins = uint_c(std::ceil(std::log(upper / lowerBound_) / std::log(gamma_)));
+         if(numBins > maxNumBins) gamma_ = std::pow(upper / lowerBound_, 1.0 / double(maxNumBins));
+         numBins = std::max(uint_t(1), std::min(numBins, maxNumBins));
+         logGamma_ = std::log(gamma_);
+      } else
+      {
+         const double accuracy = double(relativeAccuracy) * std::max(std::abs(upper), std::abs(lowerBound_));
+         numBins = std::min(maxNumBins, std::max(uint_t(1), uint_c(std::ceil((upper - lowerBound_) / std::max(2.0 * accuracy, std::numeric_limits<double>::min())))));
+      }
+      binWidth_ = isLogarithmic_ ? 0.0 : (upper - lowerBound_) / double(numBins);
+      counts_.assign(numBins + 2, 0.0); // underflow, bins, overflow
+   }
+
+   void insert(real_t value)
+   {
+      const double v = double(value);
+      counts_[getBin(v)] += 1.0;
+      ++count_;
+      sum_ += v;
+      sqrSum_ += v * v;
+      min_ = std::min(min_, v);
+      max_ = std::max(max_, v);
+   }
+
+   // requires identical bounds and accuracy
+   void merge(const DistributedQuantileSketch & other)
+   {
+      WALBERLA_CHECK_EQUAL(counts_.size(), other.counts_.size(), "Quantile sketch: cannot merge sketches with different binning.");
+      for(size_t i = 0; i < counts_.size(); ++i) counts_[i] += other.counts_[i];
+      count_ += other.count_;
+      sum_ += other.sum_;
+      sqrSum_ += other.sqrSum_;
+      min_ = std::min(min_, other.min_);
+      max_ = std::max(max_, other.max_);
+   }
+
+   // collective, afterwards all processes hold the global sketch
+   void mpiAllReduce()
+   {
+      std::vector<double> values(counts_);
+      values.push_back(double(count_));
+      values.push_back(sum_);
+      values.push_back(sqrSum_);
+      walberla::mpi::allReduceInplace(values, walberla::mpi::SUM);
+      std::copy(values.begin(), values.begin() + std::ptrdiff_t(counts_.size()), counts_.begin());
+      count_ = uint64_c(values[counts_.size()] + 0.5);
+      sum_ = values[counts_.size() + 1];
+      sqrSum_ = values[counts_.size() + 2];
+
+      std::vector<double> extrema{-min_, max_};
+      walberla::mpi::allReduceInplace(extrema, walberla::mpi::MAX);
+      min_ = -extrema[0];
+      max_ = extrema[1];
+   }
+
+   uint64_t size() const { return count_; }
+   real_t min() const { return real_c(count_ > 0 ? min_ : 0.0); }
+   real_t max() const { return real_c(count_ > 0 ? max_ : 0.0); }
+   real_t mean() const { return real_c(count_ > 0 ? sum_ / double(count_) : 0.0); }
+   real_t stdDeviation() const
+   {
+      if(count_ == 0) return real_t(0);
+      const double mean = sum_ / double(count_);
+      return real_c(std::sqrt(std::max(0.0, sqrSum_ / double(count_) - mean * mean)));
+   }
+   real_t median() const { return quantile(real_t(0.5)); }
+
+   // p in [0,1], nearest rank, within the range accurate up to the relative accuracy
+   real_t quantile(real_t p) const
+   {
+      if(count_ == 0) return real_t(0);
+      const double rank = std::max(1.0, std::ceil(std::min(std::max(double(p), 0.0), 1.0) * double(count_)));
+      double cumulativeCount = 0.0;
+      for(size_t i = 0; i < counts_.size(); ++i)
+      {
+         cumulativeCount += counts_[i];
+         if(cumulativeCount >= rank)
+         {
+            if(i == 0) return real_c(min_);
+            if(i == counts_.size() - 1) return real_c(max_);
+            return real_c(std::min(max_, std::max(min_, getBinValue(i - 1))));
+         }
+      }
+      return real_c(max_);
+   }
+
+   std::string format() const
+   {
+      std::ostringstream oss;
+      oss << "[" << count_ << " samples] min = " << min() << ", q10 = " << quantile(real_t(0.1)) << ", median = " << median()
+          << ", q90 = " << quantile(real_t(0.9)) << ", max = " << max() << ", mean = " << mean() << ", std. dev. = " << stdDeviation();
+      return oss.str();
+   }
+
+private:
+   size_t getBin(double v) const
+   {
+      const size_t numBins = counts_.size() - 2;
+      if(v < lowerBound_ || std::isnan(v)) return 0;
+      if(v > upperBound_) return numBins + 1;
+      double index = 0.0;
+      if(isLogarithmic_) index = std::floor(std::log(v / lowerBound_) / logGamma_);
+      else if(binWidth_ > 0.0) index = std::floor((v - lowerBound_) / binWidth_);
+      return std::min(size_t(std::max(index, 0.0)), numBins - 1) + 1; // the upper bound itself belongs to the last bin
+   }
+
+   double getBinLowerEdge(size_t bin) const
+   {
+      return isLogarithmic_ ? lowerBound_ * std::pow(gamma_, double(bin)) : lowerBound_ + double(bin) * binWidth_;
+   }
+
+   double getBinValue(size_t bin) const
+   {
+      const double lower = getBinLowerEdge(bin);
+      const double upper = getBinLowerEdge(bin + 1);
+      return isLogarithmic_ ? 2.0 * lower * upper / (lower + upper) : 0.5 * (lower + upper);
+   }
+
+   double lowerBound_;
+   double upperBound_;
+   bool isLogarithmic_;
+   double gamma_ = 1.0;
+   double logGamma_ = 0.0;
+   double binWidth_ = 0.0;
+   std::vector<double> counts_;
+
+   uint64_t count_ = 0;
+   double sum_ = 0.0;
+   double sqrSum_ = 0.0;
+   double min_ = std::numeric_limits<double>::max();
+   double max_ = std::numeric_limits<double>::lowest();
+};
+
+/*
+ * Collective: sketch of a particle-wise quantity over all selected particles of all processes.
+ * Two passes over the local particles, the first one determines the global range with a single reduction.
+ */
+template<typename Selector_T, typename Accessor_T, typename Value_T>
+DistributedQuantileSketch evaluateDistributedQuantileSketch(data::ParticleStorage & ps, const Selector_T & selector, Accessor_T & ac,
+                                                            const Value_T & getValue, real_t relativeAccuracy = real_t(0.01))
+{
+   std::vector<double> extrema{-std::numeric_limits<double>::max(), std::numeric_limits<double>::lowest()};
+   ps.forEachParticle(false, selector, ac, [&extrema, &getValue](const size_t idx, Accessor_T & accessor){
+      const double value = double(getValue(idx, accessor));
+      extrema[0] = std::max(extrema[0], -value);
+      extrema[1] = std::max(extrema[1], value);
+   }, ac);
+   walberla::mpi::allReduceInplace(extrema, walberla::mpi::MAX);
+
+   const bool isEmpty = extrema[1] < -extrema[0];
+   DistributedQuantileSketch sketch(isEmpty ? real_t(0) : real_c(-extrema[0]), isEmpty ? real_t(0) : real_c(extrema[1]), relativeAccuracy);
+   ps.forEachParticle(false, selector, ac, [&sketch, &getValue](const size_t idx, Accessor_T & accessor){
+      sketch.insert(real_c(getValue(idx, accessor)));
+   }, ac);
+   sketch.mpiAllReduce();
+   return sketch;
+}
+
+} // namespace mesa_pd
+} // namespace walberla
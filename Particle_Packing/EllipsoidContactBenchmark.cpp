@@ -0,0 +1,169 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   EllipsoidContactBenchmark.cpp
+//
+//======================================================================================================================
+
+#include "core/Environment.h"
+#include "core/math/all.h"
+#include "core/timing/Timer.h"
+
+#include "mesa_pd/collision_detection/GeneralContactDetection.h"
+#include "mesa_pd/data/ParticleAccessorWithBaseShape.h"
+#include "mesa_pd/data/ParticleStorage.h"
+#include "mesa_pd/kernel/DoubleCast.h"
+
+#include <random>
+
+#include "EllipsoidContactDetection.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Correctness and performance comparison of the analytic ellipsoid contact detection (EllipsoidContactDetection)
+ * with the GJK/EPA-based GeneralContactDetection.
+ *
+ * Random ellipsoid pairs (and ellipsoid-plane pairs) close to contact are generated with a fixed seed.
+ * For all pairs that both approaches classify as contact, deviations of penetration depth (relative to the smallest semi-axis),
+ * contact normal and contact point are reported, together with the average run time per call.
+ *
+ * Usage: EllipsoidContactBenchmark [numSamples] [maxAspectRatio]
+ */
+int main(int argc, char **argv)
+{
+   Environment env(argc, argv);
+
+   uint_t numSamples = (argc > 1) ? uint_c(std::stoul(argv[1])) : uint_t(10000);
+   real_t maxAspectRatio = (argc > 2) ? real_c(std::stod(argv[2])) : real_t(3);
+
+   std::mt19937 gen(42);
+   const real_t referenceSemiAxis = real_t(1e-3);
+
+   auto particleStorage = std::make_shared<data::ParticleStorage>(3);
+   data::ParticleAccessorWithBaseShape ac(particleStorage);
+
+   auto createEllipsoid = [&]()
+   {
+      Vec3 semiAxes(referenceSemiAxis,
+                    referenceSemiAxis * math::realRandom(real_t(1), maxAspectRatio, gen),
+                    referenceSemiAxis * math::realRandom(real_t(1), maxAspectRatio, gen));
+      auto p = particleStorage->create();
+      p->getBaseShapeRef() = std::make_shared<data::Ellipsoid>(semiAxes);
+      p->getBaseShapeRef()->updateMassAndInertia(real_t(1000));
+      p->getInteractionRadiusRef() = std::max(semiAxes[0], std::max(semiAxes[1], semiAxes[2]));
+      return p->getIdx();
+   };
+   auto randomizeRotation = [&](size_t idx)
+   {
+      Vec3 axis(math::realRandom(real_t(-1), real_t(1), gen), math::realRandom(real_t(-1), real_t(1), gen), math::realRandom(real_t(-1), real_t(1), gen));
+      if(axis.sqrLength() < real_t(1e-6)) axis = Vec3(0_r,0_r,1_r);
+      ac.setRotation(idx, Rot3(Quat(axis.getNormalized(), math::realRandom(real_t(0), real_t(2) * math::pi, gen))));
+   };
+
+   auto createPlane = [&]()
+   {
+      auto p = particleStorage->create(true);
+      p->getBaseShapeRef() = std::make_shared<data::HalfSpace>(Vec3(0_r,0_r,1_r));
+      p->getBaseShapeRef()->updateMassAndInertia(real_t(1));
+      p->setPosition(Vec3(0_r));
+      data::particle_flags::set(p->getFlagsRef(), data::particle_flags::INFINITE);
+      return p->getIdx();
+   };
+
+   kernel::DoubleCast double_cast;
+
+   for(const std::string & pairType : {std::string("Ellipsoid-Ellipsoid"), std::string("Ellipsoid-HalfSpace")})
+   {
+      uint_t numContactsGJK = 0;
+      uint_t numContactsAnalytic = 0;
+      uint_t numContactsBoth = 0;
+      real_t maxRelDepthError = 0_r;
+      real_t avgRelDepthError = 0_r;
+      real_t maxNormalAngle = 0_r;
+      real_t maxRelPointDistance = 0_r;
+      uint_t totalIterations = 0;
+      WcTimer timerGJK;
+      WcTimer timerAnalytic;
+
+      for(uint_t sample = 0; sample < numSamples; ++sample)
+      {
+         particleStorage->clear();
+         auto idxPlane = createPlane();
+
+         auto idx1 = createEllipsoid();
+         randomizeRotation(idx1);
+         size_t idx2 = idxPlane;
+
+         if(pairType == "Ellipsoid-Ellipsoid")
+         {
+            idx2 = createEllipsoid();
+            randomizeRotation(idx2);
+            Vec3 dir(math::realRandom(real_t(-1), real_t(1), gen), math::realRandom(real_t(-1), real_t(1), gen), math::realRandom(real_t(-1), real_t(1), gen));
+            if(dir.sqrLength() < real_t(1e-6)) dir = Vec3(1_r,0_r,0_r);
+            real_t maxDist = ac.getInteractionRadius(idx1) + ac.getInteractionRadius(idx2);
+            ac.setPosition(idx1, Vec3(0_r));
+            ac.setPosition(idx2, dir.getNormalized() * math::realRandom(real_t(0.3) * maxDist, real_t(1.05) * maxDist, gen));
+         } else
+         {
+            ac.setPosition(idx1, Vec3(0_r, 0_r, math::realRandom(real_t(0.5), real_t(1.05), gen) * ac.getInteractionRadius(idx1)));
+         }
+
+         collision_detection::GeneralContactDetection gjk;
+         collision_detection::EllipsoidContactDetection analytic;
+
+         timerGJK.start();
+         bool contactGJK = double_cast(idx1, idx2, ac, gjk, ac);
+         timerGJK.end();
+
+         timerAnalytic.start();
+         bool contactAnalytic = double_cast(idx1, idx2, ac, analytic, ac);
+         timerAnalytic.end();
+         totalIterations += analytic.getNumberOfIterations();
+
+         if(contactGJK) ++numContactsGJK;
+         if(contactAnalytic) ++numContactsAnalytic;
+         if(contactGJK && contactAnalytic)
+         {
+            ++numContactsBoth;
+            real_t relDepthError = std::abs(gjk.getPenetrationDepth() - analytic.getPenetrationDepth()) / referenceSemiAxis;
+            maxRelDepthError = std::max(maxRelDepthError, relDepthError);
+            avgRelDepthError += relDepthError;
+            real_t cosAngle = std::min(real_t(1), std::max(real_t(-1), gjk.getContactNormal() * analytic.getContactNormal()));
+            maxNormalAngle = std::max(maxNormalAngle, std::acos(cosAngle));
+            maxRelPointDistance = std::max(maxRelPointDistance, (gjk.getContactPoint() - analytic.getContactPoint()).length() / referenceSemiAxis);
+         }
+      }
+
+      if(numContactsBoth > 0) avgRelDepthError /= real_c(numContactsBoth);
+
+      WALBERLA_LOG_INFO_ON_ROOT(pairType << " with " << numSamples << " samples:");
+      WALBERLA_LOG_INFO_ON_ROOT(" - contacts: GJK/EPA = " << numContactsGJK << ", analytic = " << numContactsAnalytic << ", both = " << numContactsBoth);
+      WALBERLA_LOG_INFO_ON_ROOT(" - penetration depth error (rel. to smallest semi-axis): max = " << maxRelDepthError << ", avg = " << avgRelDepthError);
+      WALBERLA_LOG_INFO_ON_ROOT(" - max normal deviation = " << maxNormalAngle * real_t(180) / math::pi << " deg, max contact point deviation (rel.) = " << maxRelPointDistance);
+      WALBERLA_LOG_INFO_ON_ROOT(" - avg iterations of analytic kernel = " << real_c(totalIterations) / real_c(numSamples));
+      WALBERLA_LOG_INFO_ON_ROOT(" - avg time per call: GJK/EPA = " << timerGJK.average() * 1e6 << " us, analytic = " << timerAnalytic.average() * 1e6
+                                << " us => speedup " << timerGJK.total() / timerAnalytic.total());
+   }
+
+   return EXIT_SUCCESS;
+}
+} // namespace mesa_pd
+} // namespace walberla
+
+int main( int argc, char* argv[] ) {
+   return walberla::mesa_pd::main( argc, argv );
+}
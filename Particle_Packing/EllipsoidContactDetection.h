@@ -0,0 +1,333 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   EllipsoidContactDetection.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "mesa_pd/collision_detection/GeneralContactDetection.h"
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+namespace collision_detection {
+
+/*
+ * Stores the Perram-Wertheim parameter lambda of each ellipsoid pair found in the previous time step.
+ * Used as starting value for the root search in the next time step, where it typically is already (almost) converged.
+ * Keys are the (ordered) particle uids, such that the cache is independent of particle sorting and of the local index.
+ * New values are appended to per-thread vectors (contact detection runs in OpenMP loops), swap() merges and sorts them
+ * for the binary search in get(). All vectors keep their capacity, such that no allocations occur in the steady state.
+ */
+class EllipsoidContactWarmStart
+{
+public:
+   EllipsoidContactWarmStart() { resizePartials(); }
+
+   real_t get(id_t uid1, id_t uid2) const
+   {
+      const auto k = key(uid1, uid2);
+      auto it = std::lower_bound(old_.begin(), old_.end(), k, [](const Entry & entry, const Key & value){ return entry.first < value; });
+      if(it == old_.end() || it->first != k) return real_t(-1);
+      return (uid1 < uid2) ? it->second : real_t(1) - it->second;
+   }
+
+   // thread-safe
+   void store(id_t uid1, id_t uid2, real_t lambda)
+   {
+#ifdef _OPENMP
+      auto & partial = new_[size_t(omp_get_thread_num())];
+#else
+      auto & partial = new_[0];
+#endif
+      partial.emplace_back(key(uid1, uid2), (uid1 < uid2) ? lambda : real_t(1) - lambda);
+   }
+
+   // to be called once per time step, before contact detection
+   void swap()
+   {
+      resizePartials();
+      if(new_.size() == 1)
+      {
+         std::swap(old_, new_[0]);
+      } else
+      {
+         old_.clear();
+         for(const auto & partial : new_) old_.insert(old_.end(), partial.begin(), partial.end());
+      }
+      for(auto & partial : new_) partial.clear();
+      std::sort(old_.begin(), old_.end(), [](const Entry & a, const Entry & b){ return a.first < b.first; });
+   }
+
+   size_t size() const { return old_.size(); }
+
+private:
+   using Key = std::pair<id_t, id_t>;
+   using Entry = std::pair<Key, real_t>;
+
+   static Key key(id_t uid1, id_t uid2) { return (uid1 < uid2) ? std::make_pair(uid1, uid2) : std::make_pair(uid2, uid1); }
+
+   void resizePartials()
+   {
+#ifdef _OPENMP
+      new_.resize(size_t(omp_get_max_threads()));
+#else
+      new_.resize(1);
+#endif
+   }
+
+   std::vector<Entry> old_;               // sorted by key
+   std::vector<std::vector<Entry>> new_;  // per thread
+};
+
+/*
+ * Contact detection with dedicated kernels for ellipsoids:
+ * - ellipsoid-ellipsoid: Perram-Wertheim contact function F(lambda) = lambda (1-lambda) r^T C(lambda)^-1 r,
+ *   with C(lambda) = (1-lambda) A_1^-1 + lambda A_2^-1 and A_i the shape matrices (F < 1 <=> overlap).
+ *   The maximizing lambda determines the common normal, the contact distance is then evaluated exactly along this normal
+ *   from the support points of both ellipsoids (exact for spheres).
+ * - ellipsoid-HalfSpace and ellipsoid-CylindricalBoundary: via support points in (radial) normal direction.
+ * All other shape combinations fall back to GeneralContactDetection (GJK/EPA).
+ * In contrast to the GJK/EPA approach, the contact threshold is taken into account.
+ */
+class EllipsoidContactDetection : public GeneralContactDetection
+{
+public:
+   EllipsoidContactDetection() = default;
+   explicit EllipsoidContactDetection(EllipsoidContactWarmStart* warmStart) : warmStart_(warmStart) {}
+
+   using GeneralContactDetection::operator();
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::Ellipsoid& geo1, const data::Ellipsoid& geo2, Accessor& ac );
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::Ellipsoid& geo1, const data::HalfSpace& geo2, Accessor& ac );
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::HalfSpace& geo1, const data::Ellipsoid& geo2, Accessor& ac );
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::Ellipsoid& geo1, const data::CylindricalBoundary& geo2, Accessor& ac );
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::CylindricalBoundary& geo1, const data::Ellipsoid& geo2, Accessor& ac );
+
+   uint_t getNumberOfIterations() const { return numIterations_; }
+   real_t getLambda() const { return lambda_; }
+
+   real_t lambdaTolerance = real_t(1e-10);
+   uint_t maxIterations = uint_t(50);
+   uint_t cylinderRefinementSteps = uint_t(3);
+
+private:
+   // inverse shape matrix A^-1 = R diag(a^2) R^T in world frame
+   static Mat3 getInverseShapeMatrix(const data::Ellipsoid& geo, const Mat3& rotationMatrix)
+   {
+      const auto& a = geo.getSemiAxes();
+      return rotationMatrix * Mat3::makeDiagonalMatrix(a[0]*a[0], a[1]*a[1], a[2]*a[2]) * rotationMatrix.getTranspose();
+   }
+
+   // support point of the ellipsoid with center 'position' and inverse shape matrix 'invShape' in world frame direction 'dir'
+   static Vec3 support(const Vec3& position, const Mat3& invShape, const Vec3& dir)
+   {
+      Vec3 tmp = invShape * dir;
+      return position + tmp / std::sqrt(dir * tmp);
+   }
+
+   EllipsoidContactWarmStart* warmStart_ = nullptr;
+   uint_t numIterations_ = uint_t(0);
+   real_t lambda_ = real_t(0.5);
+};
+
+template <typename Accessor>
+inline bool EllipsoidContactDetection::operator()( const size_t idx1, const size_t idx2,
+                                                   const data::Ellipsoid& geo1, const data::Ellipsoid& geo2, Accessor& ac )
+{
+   idx1_ = idx1;
+   idx2_ = idx2;
+
+   const Vec3 pos1 = ac.getPosition(idx1);
+   const Vec3 pos2 = ac.getPosition(idx2);
+   const Vec3 r = pos2 - pos1;
+   if(r.sqrLength() <= real_t(0)) return false;
+
+   const Mat3 invA1 = getInverseShapeMatrix(geo1, ac.getRotation(idx1).getMatrix());
+   const Mat3 invA2 = getInverseShapeMatrix(geo2, ac.getRotation(idx2).getMatrix());
+   const Mat3 diffInvA = invA1 - invA2;
+
+   // derivative of the contact function, its root in (0,1) maximizes F
+   // F'(lambda) = (1-2 lambda) r^T s + lambda (1-lambda) s^T (A_1^-1 - A_2^-1) s, with s = C(lambda)^-1 r
+   auto evaluate = [&](real_t lambda, Vec3 & s)
+   {
+      Mat3 C = (real_t(1) - lambda) * invA1 + lambda * invA2;
+      s = C.getInverse() * r;
+      return (real_t(1) - real_t(2) * lambda) * (r * s) + lambda * (real_t(1) - lambda) * (s * (diffInvA * s));
+   };
+
+   // F'(0) > 0 and F'(1) < 0, i.e. the root is bracketed in (0,1)
+   // safeguarded secant (regula falsi with bisection fallback), started from the previous solution if available
+   real_t lambdaLow = real_t(0);
+   real_t lambdaHigh = real_t(1);
+   real_t lambda = real_t(0.5);
+   if(warmStart_ != nullptr)
+   {
+      real_t lambdaOld = warmStart_->get(ac.getUid(idx1), ac.getUid(idx2));
+      if(lambdaOld > real_t(0) && lambdaOld < real_t(1)) lambda = lambdaOld;
+   }
+
+   Vec3 s;
+   real_t dF = evaluate(lambda, s);
+   real_t dFLow = r * (invA1.getInverse() * r);
+   real_t dFHigh = - (r * (invA2.getInverse() * r));
+
+   numIterations_ = uint_t(0);
+   while(numIterations_ < maxIterations && std::abs(lambdaHigh - lambdaLow) > lambdaTolerance && std::abs(dF) > real_t(0))
+   {
+      ++numIterations_;
+      if(dF > real_t(0))
+      {
+         lambdaLow = lambda; dFLow = dF;
+      } else
+      {
+         lambdaHigh = lambda; dFHigh = dF;
+      }
+
+      real_t lambdaNew = lambdaLow - dFLow * (lambdaHigh - lambdaLow) / (dFHigh - dFLow);
+      // fall back to bisection if the secant step does not sufficiently shrink the bracket
+      real_t bracketWidth = lambdaHigh - lambdaLow;
+      if(lambdaNew - lambdaLow < real_t(0.01) * bracketWidth || lambdaHigh - lambdaNew < real_t(0.01) * bracketWidth)
+      {
+         lambdaNew = real_t(0.5) * (lambdaLow + lambdaHigh);
+      }
+      if(std::abs(lambdaNew - lambda) < lambdaTolerance) { lambda = lambdaNew; dF = evaluate(lambda, s); break; }
+      lambda = lambdaNew;
+      dF = evaluate(lambda, s);
+   }
+   lambda_ = lambda;
+
+   const real_t contactFunction = lambda * (real_t(1) - lambda) * (r * s);
+
+   // scaling factor sqrt(F) > 1: scaled ellipsoids touch, i.e. no overlap
+   if(contactFunction >= real_t(1) && contactThreshold_ <= real_t(0)) return false;
+
+   // the common normal is parallel to s (gradient of both scaled ellipsoids at the touching point)
+   const Vec3 normal12 = s.getNormalized();
+   const Vec3 surfacePoint1 = support(pos1, invA1, normal12);
+   const Vec3 surfacePoint2 = support(pos2, invA2, -normal12);
+
+   penetrationDepth_ = (surfacePoint2 - surfacePoint1) * normal12;
+   if(penetrationDepth_ >= contactThreshold_) return false;
+
+   contactNormal_ = -normal12; // pointing from 2 to 1, as in the analytic kernels
+   contactPoint_ = real_t(0.5) * (surfacePoint1 + surfacePoint2);
+
+   if(warmStart_ != nullptr) warmStart_->store(ac.getUid(idx1), ac.getUid(idx2), lambda);
+
+   return true;
+}
+
+template <typename Accessor>
+inline bool EllipsoidContactDetection::operator()( const size_t idx1, const size_t idx2,
+                                                   const data::Ellipsoid& geo1, const data::HalfSpace& geo2, Accessor& ac )
+{
+   idx1_ = idx1;
+   idx2_ = idx2;
+   numIterations_ = uint_t(0);
+
+   const Vec3& normal = geo2.getNormal();
+   const Mat3 invA1 = getInverseShapeMatrix(geo1, ac.getRotation(idx1).getMatrix());
+   const Vec3 deepestPoint = support(ac.getPosition(idx1), invA1, -normal);
+
+   const real_t dist = (deepestPoint - ac.getPosition(idx2)) * normal;
+   if(dist >= contactThreshold_) return false;
+
+   contactNormal_ = normal;
+   penetrationDepth_ = dist;
+   contactPoint_ = deepestPoint - real_t(0.5) * dist * normal;
+   return true;
+}
+
+template <typename Accessor>
+inline bool EllipsoidContactDetection::operator()( const size_t idx1, const size_t idx2,
+                                                   const data::HalfSpace& geo1, const data::Ellipsoid& geo2, Accessor& ac )
+{
+   return operator()(idx2, idx1, geo2, geo1, ac);
+}
+
+template <typename Accessor>
+inline bool EllipsoidContactDetection::operator()( const size_t idx1, const size_t idx2,
+                                                   const data::Ellipsoid& geo1, const data::CylindricalBoundary& geo2, Accessor& ac )
+{
+   idx1_ = idx1;
+   idx2_ = idx2;
+
+   const Vec3& axis = geo2.getAxis();
+   const Vec3& cylinderPosition = ac.getPosition(idx2);
+   auto radialPart = [&](const Vec3& pt){ Vec3 d = pt - cylinderPosition; return d - (d * axis) * axis; };
+
+   const Mat3 invA1 = getInverseShapeMatrix(geo1, ac.getRotation(idx1).getMatrix());
+
+   Vec3 radialDirection = radialPart(ac.getPosition(idx1));
+   if(radialDirection.sqrLength() <= real_t(0))
+   {
+      // center on axis: any radial direction is equally good as initial guess
+      radialDirection = (std::abs(axis[0]) < real_t(0.9)) ? Vec3(1_r,0_r,0_r) : Vec3(0_r,1_r,0_r);
+      radialDirection = radialDirection - (radialDirection * axis) * axis;
+   }
+   radialDirection = radialDirection.getNormalized();
+
+   // the outermost point is reached where the ellipsoid normal is radial, found by fixed-point iteration
+   Vec3 outermostPoint = support(ac.getPosition(idx1), invA1, radialDirection);
+   for(numIterations_ = uint_t(0); numIterations_ < cylinderRefinementSteps; ++numIterations_)
+   {
+      Vec3 newDirection = radialPart(outermostPoint);
+      if(newDirection.sqrLength() <= real_t(0)) break;
+      radialDirection = newDirection.getNormalized();
+      outermostPoint = support(ac.getPosition(idx1), invA1, radialDirection);
+   }
+
+   const real_t dist = geo2.getRadius() - radialPart(outermostPoint) * radialDirection;
+   if(dist >= contactThreshold_) return false;
+
+   contactNormal_ = -radialDirection;
+   penetrationDepth_ = dist;
+   contactPoint_ = outermostPoint + real_t(0.5) * dist * radialDirection;
+   return true;
+}
+
+template <typename Accessor>
+inline bool EllipsoidContactDetection::operator()( const size_t idx1, const size_t idx2,
+                                                   const data::CylindricalBoundary& geo1, const data::Ellipsoid& geo2, Accessor& ac )
+{
+   return operator()(idx2, idx1, geo2, geo1, ac);
+}
+
+} // namespace collision_detection
+} // namespace mesa_pd
+} // namespace walberla
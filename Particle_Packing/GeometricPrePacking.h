@@ -0,0 +1,176 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   GeometricPrePacking.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+
+#include "mesa_pd/collision_detection/AnalyticContactDetection.h"
+#include "mesa_pd/common/ParticleFunctions.h"
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+#include "mesa_pd/data/shape/Sphere.h"
+#include "mesa_pd/domain/IDomain.h"
+#include "mesa_pd/mpi/ContactFilter.h"
+
+#include <algorithm>
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Geometric pre-packing by collective rearrangement of bounding spheres.
+ * Instead of simulating the free fall, all particles are moved downwards by a fraction of their bounding radius per iteration,
+ * and overlaps (with other particles and the walls) are removed by pushing the particles apart along the contact normal (Jacobi-like).
+ * As a result, the particles settle into a dense, nearly overlap-free bed near the bottom plane, which the physical
+ * simulation only has to relax.
+ *
+ * The displacements are accumulated in the force property, such that the usual force reduction (ForceTorqueNotification)
+ * collects the contributions of ghost particles on the owners. Each pair is handled by one process only (ContactFilter).
+ */
+class GeometricPrePacking
+{
+public:
+   struct Parameters
+   {
+      real_t settlingStepRatio = real_t(0.1);    // downward displacement per iteration, relative to the bounding radius
+      real_t relaxationParameter = real_t(0.5);  // fraction of the overlap that is removed per iteration
+      real_t overlapTolerance = real_t(0.01);    // maximum overlap relative to the smaller bounding radius after pre-packing
+      real_t proxyRadiusScaling = real_t(1);     // bounding sphere radius = scaling * interaction radius
+      uint_t maxIterations = uint_t(10000);      // per created layer of particles
+   };
+
+   explicit GeometricPrePacking(const Parameters & parameters) : parameters_(parameters) {}
+
+   static Parameters parametersFromConfig(const Config::BlockHandle & prePackingConf)
+   {
+      Parameters parameters;
+      parameters.settlingStepRatio = prePackingConf.getParameter<real_t>("settlingStepRatio", parameters.settlingStepRatio);
+      parameters.relaxationParameter = prePackingConf.getParameter<real_t>("relaxationParameter", parameters.relaxationParameter);
+      parameters.overlapTolerance = prePackingConf.getParameter<real_t>("overlapTolerance", parameters.overlapTolerance);
+      parameters.proxyRadiusScaling = prePackingConf.getParameter<real_t>("proxyRadiusScaling", parameters.proxyRadiusScaling);
+      parameters.maxIterations = prePackingConf.getParameter<uint_t>("maxIterations", parameters.maxIterations);
+      return parameters;
+   }
+
+   const Parameters & getParameters() const { return parameters_; }
+
+   void resetMaximumOverlap() { maxRelativeOverlap_ = real_t(0); }
+   real_t getMaximumOverlap() const { return maxRelativeOverlap_; } // process local
+
+   // pair kernel, to be used with ExcludeInfiniteInfinite
+   template<typename Accessor_T>
+   void operator()(size_t idx1, size_t idx2, Accessor_T & ac, const domain::IDomain & domain)
+   {
+      collision_detection::AnalyticContactDetection contactDetection;
+      if(!detectBoundingSphereContact(idx1, idx2, ac, contactDetection)) return;
+
+      mpi::ContactFilter contactFilter;
+      if(!contactFilter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), domain)) return;
+
+      displace(ac, contactDetection);
+   }
+
+   // pair kernel without contact filtering, for a single process without ghost particles (see MinimumImage.h)
+   template<typename Accessor_T>
+   void operator()(size_t idx1, size_t idx2, Accessor_T & ac)
+   {
+      collision_detection::AnalyticContactDetection contactDetection;
+      if(!detectBoundingSphereContact(idx1, idx2, ac, contactDetection)) return;
+
+      displace(ac, contactDetection);
+   }
+
+   // applies the accumulated displacements (and the settling step) to a local particle, velocities are set to zero
+   template<typename Accessor_T>
+   void move(size_t idx, Accessor_T & ac, bool settle) const
+   {
+      if(isSet(ac.getFlags(idx), data::particle_flags::INFINITE) || isSet(ac.getFlags(idx), data::particle_flags::FIXED)) return;
+      Vec3 displacement = ac.getForce(idx);
+      if(settle) displacement[2] -= parameters_.settlingStepRatio * parameters_.proxyRadiusScaling * ac.getInteractionRadius(idx);
+      ac.getPositionRef(idx) += displacement;
+      ac.setForce(idx, Vec3(real_t(0)));
+      ac.setTorque(idx, Vec3(real_t(0)));
+      ac.setLinearVelocity(idx, Vec3(real_t(0)));
+      ac.setAngularVelocity(idx, Vec3(real_t(0)));
+   }
+
+private:
+   template<typename Accessor_T>
+   void displace(Accessor_T & ac, const collision_detection::AnalyticContactDetection & contactDetection)
+   {
+      // the contact detection may swap the particles (e.g. walls first), normal and penetration refer to its ordering
+      const size_t idx1 = contactDetection.getIdx1();
+      const size_t idx2 = contactDetection.getIdx2();
+      real_t overlap = -contactDetection.getPenetrationDepth();
+      const Vec3 & normal = contactDetection.getContactNormal(); // from particle 2 to particle 1
+      bool isInfinite1 = isSet(ac.getFlags(idx1), data::particle_flags::INFINITE);
+      bool isInfinite2 = isSet(ac.getFlags(idx2), data::particle_flags::INFINITE);
+
+      real_t smallerRadius = std::min(isInfinite1 ? ac.getInteractionRadius(idx2) : ac.getInteractionRadius(idx1),
+                                      isInfinite2 ? ac.getInteractionRadius(idx1) : ac.getInteractionRadius(idx2));
+      maxRelativeOverlap_ = std::max(maxRelativeOverlap_, overlap / (parameters_.proxyRadiusScaling * smallerRadius));
+
+      real_t shareOfParticle1 = isInfinite2 ? real_t(1) : (isInfinite1 ? real_t(0) : real_t(0.5));
+      Vec3 displacement = parameters_.relaxationParameter * overlap * normal;
+      if(!isInfinite1) addForceAtomic(idx1, ac, shareOfParticle1 * displacement);
+      if(!isInfinite2) addForceAtomic(idx2, ac, -(real_t(1) - shareOfParticle1) * displacement);
+   }
+
+   // contact of the bounding spheres of finite particles with each other or with a wall
+   template<typename Accessor_T>
+   bool detectBoundingSphereContact(size_t idx1, size_t idx2, Accessor_T & ac, collision_detection::AnalyticContactDetection & contactDetection) const
+   {
+      using data::CylindricalBoundary;
+      using data::HalfSpace;
+
+      const auto * shape1 = ac.getShape(idx1);
+      const auto * shape2 = ac.getShape(idx2);
+      bool isInfinite1 = isSet(ac.getFlags(idx1), data::particle_flags::INFINITE);
+      bool isInfinite2 = isSet(ac.getFlags(idx2), data::particle_flags::INFINITE);
+
+      if(!isInfinite1 && !isInfinite2)
+      {
+         data::Sphere sphere1(parameters_.proxyRadiusScaling * ac.getInteractionRadius(idx1));
+         data::Sphere sphere2(parameters_.proxyRadiusScaling * ac.getInteractionRadius(idx2));
+         return contactDetection(idx1, idx2, sphere1, sphere2, ac);
+      }
+      if(isInfinite2)
+      {
+         data::Sphere sphere1(parameters_.proxyRadiusScaling * ac.getInteractionRadius(idx1));
+         if(shape2->getShapeType() == HalfSpace::SHAPE_TYPE) return contactDetection(idx1, idx2, sphere1, *static_cast<const HalfSpace*>(shape2), ac);
+         if(shape2->getShapeType() == CylindricalBoundary::SHAPE_TYPE) return contactDetection(idx1, idx2, sphere1, *static_cast<const CylindricalBoundary*>(shape2), ac);
+      } else
+      {
+         data::Sphere sphere2(parameters_.proxyRadiusScaling * ac.getInteractionRadius(idx2));
+         if(shape1->getShapeType() == HalfSpace::SHAPE_TYPE) return contactDetection(idx1, idx2, *static_cast<const HalfSpace*>(shape1), sphere2, ac);
+         if(shape1->getShapeType() == CylindricalBoundary::SHAPE_TYPE) return contactDetection(idx1, idx2, *static_cast<const CylindricalBoundary*>(shape1), sphere2, ac);
+      }
+      return false;
+   }
+
+   Parameters parameters_;
+   real_t maxRelativeOverlap_ = real_t(0);
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,217 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   HullSimplification.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/math/Vector3.h"
+
+#include "mesh_common/MatrixVectorOperations.h"
+#include "mesh_common/QHull.h"
+#include "mesh_common/TriangleMeshes.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+struct HullSimplificationParameters
+{
+   uint_t targetNumberOfVertices = 0; // 0: no target, only limited by error
+   real_t maxRelativeError = real_t(0); // Hausdorff distance relative to volume-equivalent diameter, non-positive: no limit
+
+   bool isActive() const { return targetNumberOfVertices > 0 || maxRelativeError > real_t(0); }
+
+   // identifies the simplified version of a mesh in the shape cache
+   std::string getKeySuffix() const
+   {
+      std::ostringstream os;
+      os << "#simplified_v" << targetNumberOfVertices << "_e" << maxRelativeError;
+      return os.str();
+   }
+};
+
+// deviations of a simplified hull from the original one, all relative
+struct HullSimplificationError
+{
+   uint32_t originalNumberOfVertices = 0;
+   double hausdorffError = 0.0; // relative to volume-equivalent diameter
+   double volumeError = 0.0;
+   double formError = 0.0; // max. of relative change in elongation (I/L) and flatness (S/I) of the inertia-equivalent ellipsoid
+};
+
+// distance of point p to triangle (a,b,c), closest point computation from Ericson, Real-Time Collision Detection, 5.1.5
+inline double computePointTriangleDistance(const Vector3<double> & p, const Vector3<double> & a, const Vector3<double> & b, const Vector3<double> & c)
+{
+   Vector3<double> ab = b - a;
+   Vector3<double> ac = c - a;
+   Vector3<double> ap = p - a;
+   double d1 = ab * ap;
+   double d2 = ac * ap;
+   if(d1 <= 0.0 && d2 <= 0.0) return ap.length();
+
+   Vector3<double> bp = p - b;
+   double d3 = ab * bp;
+   double d4 = ac * bp;
+   if(d3 >= 0.0 && d4 <= d3) return bp.length();
+
+   double vc = d1 * d4 - d3 * d2;
+   if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) return (p - (a + d1 / (d1 - d3) * ab)).length();
+
+   Vector3<double> cp = p - c;
+   double d5 = ab * cp;
+   double d6 = ac * cp;
+   if(d6 >= 0.0 && d5 <= d6) return cp.length();
+
+   double vb = d5 * d2 - d1 * d6;
+   if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) return (p - (a + d2 / (d2 - d6) * ac)).length();
+
+   double va = d3 * d6 - d5 * d4;
+   if(va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) return (p - (b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b))).length();
+
+   double denom = 1.0 / (va + vb + vc);
+   return (p - (a + ab * (vb * denom) + ac * (vc * denom))).length();
+}
+
+// distance of p to the convex polytope given by its boundary triangles (0 if inside)
+inline double computeDistanceToConvexHull(const Vector3<double> & p, const std::vector<Vector3<double>> & vertices, const std::vector<uint32_t> & faces)
+{
+   bool isInside = true;
+   for(size_t f = 0; f + 2 < faces.size() && isInside; f += 3)
+   {
+      const auto & a = vertices[faces[f]];
+      Vector3<double> normal = (vertices[faces[f+1]] - a) % (vertices[faces[f+2]] - a); // outward for counter-clockwise faces
+      if((p - a) * normal > 0.0) isInside = false;
+   }
+   if(isInside) return 0.0;
+
+   double minDistance = std::numeric_limits<double>::max();
+   for(size_t f = 0; f + 2 < faces.size(); f += 3)
+   {
+      minDistance = std::min(minDistance, computePointTriangleDistance(p, vertices[faces[f]], vertices[faces[f+1]], vertices[faces[f+2]]));
+   }
+   return minDistance;
+}
+
+// convex hull of a point set via QHull, returned as vertex list and triangle list
+inline void computeConvexHull(const std::vector<Vector3<double>> & points, std::vector<Vector3<double>> & hullVertices, std::vector<uint32_t> & hullFaces)
+{
+   std::vector<Vector3<real_t>> pts;
+   for(const auto & p : points) pts.emplace_back(real_c(p[0]), real_c(p[1]), real_c(p[2]));
+   auto hull = mesh::convexHull<mesh::TriangleMesh>(pts);
+
+   hullVertices.clear();
+   hullFaces.clear();
+   for(auto vh : hull->vertices())
+   {
+      auto pt = mesh::toWalberla(hull->point(vh));
+      hullVertices.emplace_back(double(pt[0]), double(pt[1]), double(pt[2]));
+   }
+   for(auto fh : hull->faces())
+   {
+      for(auto fvIt = hull->cfv_iter(fh); fvIt.is_valid(); ++fvIt) hullFaces.push_back(uint32_t(fvIt->idx()));
+   }
+}
+
+/*
+ * Greedy vertex decimation of a convex hull.
+ * In each step, the vertices are ranked by how far they stick out of their one-ring (along their area-weighted normal),
+ * and the first one whose removal keeps the Hausdorff distance to the original hull below the error bound is removed.
+ * As the simplified hull is spanned by a subset of the original vertices, it is contained in the original hull and
+ * the Hausdorff distance is the maximum distance of the original vertices to the simplified hull.
+ * Stops when the target number of vertices is reached or no vertex can be removed anymore.
+ */
+inline void simplifyConvexHull(std::vector<Vector3<double>> & vertices, std::vector<uint32_t> & faces,
+                               uint_t targetNumberOfVertices, double maxAbsoluteError, double & hausdorffError)
+{
+   const std::vector<Vector3<double>> originalVertices = vertices;
+   const uint_t minNumberOfVertices = std::max(targetNumberOfVertices, uint_t(4));
+   hausdorffError = 0.0;
+
+   auto computeError = [&originalVertices](const std::vector<Vector3<double>> & v, const std::vector<uint32_t> & f)
+   {
+      double error = 0.0;
+      for(const auto & p : originalVertices) error = std::max(error, computeDistanceToConvexHull(p, v, f));
+      return error;
+   };
+
+   // identified by all three coordinates, as indices change with every hull update (e.g. top and bottom vertices of a cylinder share (x,y))
+   std::set<std::array<double, 3>> lockedVertices;
+   auto isLocked = [&lockedVertices](const Vector3<double> & v){ return lockedVertices.count({v[0], v[1], v[2]}) > 0; };
+
+   while(vertices.size() > minNumberOfVertices)
+   {
+      // rank vertices by their local height above the one-ring
+      std::vector<Vector3<double>> vertexNormals(vertices.size(), Vector3<double>(0.0));
+      std::vector<std::set<uint32_t>> neighbors(vertices.size());
+      for(size_t f = 0; f + 2 < faces.size(); f += 3)
+      {
+         Vector3<double> normal = (vertices[faces[f+1]] - vertices[faces[f]]) % (vertices[faces[f+2]] - vertices[faces[f]]);
+         for(uint_t i = 0; i < 3; ++i)
+         {
+            vertexNormals[faces[f+i]] += normal;
+            neighbors[faces[f+i]].insert(faces[f+(i+1)%3]);
+            neighbors[faces[f+i]].insert(faces[f+(i+2)%3]);
+         }
+      }
+      std::vector<std::pair<double, uint32_t>> ranking;
+      for(uint32_t v = 0; v < vertices.size(); ++v)
+      {
+         if(isLocked(vertices[v])) continue;
+         auto n = vertexNormals[v].getNormalized();
+         double height = 0.0;
+         for(auto nb : neighbors[v]) height = std::max(height, (vertices[v] - vertices[nb]) * n);
+         ranking.emplace_back(height, v);
+      }
+      std::sort(ranking.begin(), ranking.end());
+
+      bool removedVertex = false;
+      for(const auto & candidate : ranking)
+      {
+         std::vector<Vector3<double>> trialPoints;
+         for(uint32_t v = 0; v < vertices.size(); ++v) if(v != candidate.second) trialPoints.push_back(vertices[v]);
+         std::vector<Vector3<double>> trialVertices;
+         std::vector<uint32_t> trialFaces;
+         computeConvexHull(trialPoints, trialVertices, trialFaces);
+         if(trialVertices.size() < 4) break;
+
+         double error = computeError(trialVertices, trialFaces);
+         if(error <= maxAbsoluteError)
+         {
+            vertices = trialVertices;
+            faces = trialFaces;
+            hausdorffError = error;
+            removedVertex = true;
+            break;
+         }
+         const auto & lockedVertex = vertices[candidate.second];
+         lockedVertices.insert({lockedVertex[0], lockedVertex[1], lockedVertex[2]});
+      }
+      if(!removedVertex) break;
+   }
+}
+
+} // namespace mesa_pd
+} // namespace walberla
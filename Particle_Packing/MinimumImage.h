@@ -0,0 +1,304 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   MinimumImage.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/math/AABB.h"
+#include "core/math/Vector3.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/ParticleAccessorWithBaseShape.h"
+#include "mesa_pd/data/ParticleStorage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "WallCells.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Single-process fast path: instead of ghost particles for the periodic images, all particles stay inside the domain
+ * (positions are wrapped after the integration) and interacting pairs are evaluated at their minimum image.
+ * Valid as long as the interaction range is below half the domain length, which is ensured by the maximum allowed interaction radius.
+ */
+class MinimumImage
+{
+public:
+   MinimumImage(const math::AABB & domain, const Vector3<bool> & isPeriodic) : domain_(domain), isPeriodic_(isPeriodic) {}
+
+   // shift that moves p2 to its image closest to p1
+   Vec3 getShift(const Vec3 & p1, const Vec3 & p2) const
+   {
+      Vec3 shift(real_t(0));
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         if(!isPeriodic_[i]) continue;
+         real_t length = domain_.max(i) - domain_.min(i);
+         shift[i] = -length * std::round((p2[i] - p1[i]) / length);
+      }
+      return shift;
+   }
+
+   void wrap(Vec3 & p) const
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         if(!isPeriodic_[i]) continue;
+         real_t length = domain_.max(i) - domain_.min(i);
+         p[i] -= length * std::floor((p[i] - domain_.min(i)) / length);
+      }
+   }
+
+   const math::AABB & getDomain() const { return domain_; }
+   const Vector3<bool> & isPeriodic() const { return isPeriodic_; }
+
+private:
+   math::AABB domain_;
+   Vector3<bool> isPeriodic_;
+};
+
+/*
+ * Particle accessor that presents one particle (the image particle) at a shifted position,
+ * such that all kernels (contact detection, DEM, HCSITS contact setup) see the pair at its minimum image.
+ * Not thread-safe, every thread uses its own copy.
+ */
+class MinimumImageAccessor : public data::ParticleAccessorWithBaseShape
+{
+public:
+   MinimumImageAccessor(std::shared_ptr<data::ParticleStorage> & ps, const MinimumImage & minimumImage)
+      : data::ParticleAccessorWithBaseShape(ps), minimumImage_(&minimumImage) {}
+
+   const Vec3 & getPosition(const size_t p_idx) const
+   {
+      return (p_idx == imageIdx_) ? imagePosition_ : data::ParticleAccessorWithBaseShape::getPosition(p_idx);
+   }
+
+   // presents idx2 at its image closest to idx1, walls are never shifted
+   void setImage(size_t idx1, size_t idx2)
+   {
+      imageIdx_ = std::numeric_limits<size_t>::max();
+      if(data::particle_flags::isSet(getFlags(idx1), data::particle_flags::INFINITE) ||
+         data::particle_flags::isSet(getFlags(idx2), data::particle_flags::INFINITE)) return;
+      const Vec3 & position2 = data::ParticleAccessorWithBaseShape::getPosition(idx2);
+      Vec3 shift = minimumImage_->getShift(data::ParticleAccessorWithBaseShape::getPosition(idx1), position2);
+      if(shift.sqrLength() <= real_t(0)) return;
+      imageIdx_ = idx2;
+      imagePosition_ = position2 + shift;
+   }
+
+private:
+   const MinimumImage * minimumImage_;
+   size_t imageIdx_ = std::numeric_limits<size_t>::max();
+   Vec3 imagePosition_;
+};
+
+// calls func(c, ca, ac) for all contacts, with particle 2 presented at its minimum image w.r.t. particle 1
+template<typename ContactAccessor_T, typename Func_T>
+void forEachContactAtMinimumImage(bool openmp, ContactAccessor_T & ca, const MinimumImageAccessor & prototype, Func_T && func)
+{
+#ifdef _OPENMP
+   #pragma omp parallel if (openmp)
+#endif
+   {
+      MinimumImageAccessor ac(prototype);
+#ifdef _OPENMP
+      #pragma omp for schedule(static)
+#endif
+      for(int64_t i = 0; i < int64_c(ca.size()); ++i)
+      {
+         size_t c = size_t(i);
+         ac.setImage(ca.getId1(c), ca.getId2(c));
+         func(c, ca, ac);
+      }
+   }
+}
+
+/*
+ * Linked cells over the whole (periodic) domain of a single process.
+ * Each pair of neighboring cells is visited once, with periodic wrap-around of the cell indices,
+ * infinite particles (walls) are paired with the particles of their boundary cells (see WallCells).
+ * Directions with less than 3 cells are not subdivided, to avoid visiting a cell pair twice.
+ */
+class PeriodicLinkedCells
+{
+public:
+   PeriodicLinkedCells(const MinimumImage & minimumImage, real_t minCellWidth)
+   {
+      const auto & domain = minimumImage.getDomain();
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         real_t length = domain.max(i) - domain.min(i);
+         int numCells = std::max(1, int(std::floor(length / minCellWidth)));
+         if(numCells < 3) numCells = 1;
+         numCells_[i] = numCells;
+         cellWidth_[i] = length / real_c(numCells);
+         domainMin_[i] = domain.min(i);
+         isPeriodic_[i] = minimumImage.isPeriodic()[i];
+      }
+      wallCells_.setGrid(Vec3(domainMin_[0], domainMin_[1], domainMin_[2]), Vec3(cellWidth_[0], cellWidth_[1], cellWidth_[2]),
+                         {{numCells_[0], numCells_[1], numCells_[2]}});
+
+      // unique neighbor cells with larger index, per cell
+      cellNeighbors_.resize(size_t(numCells_[0] * numCells_[1] * numCells_[2]));
+      for(int z = 0; z < numCells_[2]; ++z)
+         for(int y = 0; y < numCells_[1]; ++y)
+            for(int x = 0; x < numCells_[0]; ++x)
+            {
+               int cell = getCellIndex(x, y, z);
+               auto & neighbors = cellNeighbors_[size_t(cell)];
+               for(int dz = -1; dz <= 1; ++dz)
+                  for(int dy = -1; dy <= 1; ++dy)
+                     for(int dx = -1; dx <= 1; ++dx)
+                     {
+                        int n[3] = {x + dx, y + dy, z + dz};
+                        bool isValid = true;
+                        for(uint_t i = 0; i < 3; ++i)
+                        {
+                           if(n[i] >= 0 && n[i] < numCells_[i]) continue;
+                           if(isPeriodic_[i]) n[i] = (n[i] + numCells_[i]) % numCells_[i];
+                           else isValid = false;
+                        }
+                        if(!isValid) continue;
+                        int neighbor = getCellIndex(n[0], n[1], n[2]);
+                        if(neighbor > cell && std::find(neighbors.begin(), neighbors.end(), neighbor) == neighbors.end()) neighbors.push_back(neighbor);
+                     }
+            }
+   }
+
+   // reachScaling: ratio of the radius used by the pair kernel to the interaction radius, for the wall cell lists
+   template<typename Accessor_T>
+   void build(Accessor_T & ac, real_t reachScaling = real_t(1))
+   {
+      build(ac, reachScaling, [](size_t, Accessor_T &){ return true; });
+   }
+
+   // only finite particles accepted by select(idx, ac) are inserted
+   template<typename Accessor_T, typename Select_T>
+   void build(Accessor_T & ac, real_t reachScaling, Select_T && select)
+   {
+      cellHeads_.assign(cellNeighbors_.size(), -1);
+      next_.assign(ac.size(), -1);
+      wallCells_.clearWalls();
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE))
+         {
+            wallCells_.addWall(idx);
+            continue;
+         }
+         if(!select(idx, ac)) continue;
+         wallCells_.addParticleRadius(ac.getInteractionRadius(idx));
+         const Vec3 & p = ac.getPosition(idx);
+         int c[3];
+         for(uint_t i = 0; i < 3; ++i) c[i] = std::min(numCells_[i] - 1, std::max(0, int(std::floor((p[i] - domainMin_[i]) / cellWidth_[i]))));
+         int cell = getCellIndex(c[0], c[1], c[2]);
+         next_[idx] = cellHeads_[size_t(cell)];
+         cellHeads_[size_t(cell)] = int64_c(idx);
+      }
+      wallCells_.refresh(ac, reachScaling);
+   }
+
+   // func(idx1, idx2, ac) for all pairs of finite particles, with ac presenting idx2 at its minimum image
+   template<typename Func_T>
+   void forEachParticlePairHalf(bool openmp, const MinimumImageAccessor & prototype, Func_T && func) const
+   {
+      const int numCells = int(cellNeighbors_.size());
+#ifdef _OPENMP
+      #pragma omp parallel if (openmp)
+#endif
+      {
+         MinimumImageAccessor ac(prototype);
+#ifdef _OPENMP
+         #pragma omp for schedule(dynamic, 16)
+#endif
+         for(int cell = 0; cell < numCells; ++cell)
+         {
+            for(int64_t p1 = cellHeads_[size_t(cell)]; p1 >= 0; p1 = next_[size_t(p1)])
+            {
+               for(int64_t p2 = next_[size_t(p1)]; p2 >= 0; p2 = next_[size_t(p2)]) callPair(size_t(p1), size_t(p2), ac, func);
+               for(int neighbor : cellNeighbors_[size_t(cell)])
+               {
+                  for(int64_t p2 = cellHeads_[size_t(neighbor)]; p2 >= 0; p2 = next_[size_t(p2)]) callPair(size_t(p1), size_t(p2), ac, func);
+               }
+            }
+         }
+      }
+   }
+
+   // func(particleIdx, wallIdx, ac) for the particles in the boundary cells of each wall
+   template<typename Func_T>
+   void forEachWallPair(bool openmp, const MinimumImageAccessor & prototype, Func_T && func) const
+   {
+      wallCells_.forEachWall([&](size_t wall, const std::vector<int> & cells){
+         const int64_t numWallCells = int64_c(cells.size());
+#ifdef _OPENMP
+         #pragma omp parallel if (openmp)
+#endif
+         {
+            MinimumImageAccessor ac(prototype);
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic, 16)
+#endif
+            for(int64_t i = 0; i < numWallCells; ++i)
+            {
+               for(int64_t p1 = cellHeads_[size_t(cells[size_t(i)])]; p1 >= 0; p1 = next_[size_t(p1)]) callPair(size_t(p1), wall, ac, func);
+            }
+         }
+      });
+   }
+
+   const WallCells & getWallCells() const { return wallCells_; }
+
+private:
+   int getCellIndex(int x, int y, int z) const { return x + numCells_[0] * (y + numCells_[1] * z); }
+
+   template<typename Func_T>
+   static void callPair(size_t idx1, size_t idx2, MinimumImageAccessor & ac, Func_T & func)
+   {
+      ac.setImage(idx1, idx2);
+      func(idx1, idx2, ac);
+   }
+
+   int numCells_[3];
+   real_t cellWidth_[3];
+   real_t domainMin_[3];
+   bool isPeriodic_[3];
+   std::vector<std::vector<int>> cellNeighbors_;
+   std::vector<int64_t> cellHeads_;
+   std::vector<int64_t> next_;
+   WallCells wallCells_;
+};
+
+// contact history handling of ReduceContactHistory without ghost particles: the new history becomes the old one
+template<typename Accessor_T>
+inline void swapContactHistory(size_t idx, Accessor_T & ac)
+{
+   ac.getOldContactHistoryRef(idx).swap(ac.getNewContactHistoryRef(idx));
+   ac.getNewContactHistoryRef(idx).clear();
+}
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,245 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   MixedPrecisionContactDetection.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/ParticleAccessorWithBaseShape.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+struct MixedPrecisionParameters
+{
+   real_t relativeMargin = real_t(1e-4); // safety margin of the single precision tests, relative to the sum of the interaction radii
+   bool validate = false; // repeat the tests in double precision and count the pairs wrongly rejected in single precision
+
+   static MixedPrecisionParameters fromConfig(const Config::BlockHandle & mixedPrecisionConf)
+   {
+      MixedPrecisionParameters parameters;
+      parameters.relativeMargin = mixedPrecisionConf.getParameter<real_t>("relativeMargin", parameters.relativeMargin);
+      parameters.validate = mixedPrecisionConf.getParameter<bool>("validate", parameters.validate);
+      WALBERLA_CHECK_GREATER_EQUAL(parameters.relativeMargin, real_t(1e-6), "Mixed precision: margin too small for single precision.");
+      return parameters;
+   }
+};
+
+/*
+ * Single precision candidate test in front of the double precision fine contact detection.
+ * A pair is rejected if it is separated
+ * - by the bounding spheres (interaction radii), or
+ * - along the line of centers, using the support functions of the shapes (spheres, ellipsoids, convex polyhedra).
+ * Both are conservative tests with a safety margin, all pairs that pass are handed to the unchanged double precision
+ * contact detection, which computes contact point, normal and penetration depth. The contacts are thus identical to the
+ * pure double precision run, only the expensive GJK/EPA or ellipsoid root searches for separated pairs are skipped.
+ * It is therefore only applied in front of these kernels, not in front of the analytic sphere and sphere clump kernels.
+ * The distance vector is computed from the (accessor) positions in double precision and only then converted,
+ * i.e. all single precision quantities are relative to the first particle of the pair, which also handles periodic images.
+ * update() caches single precision rotations, radii and shape data (vertices, semi-axes) per particle index and has to be
+ * called before each contact detection, after all changes of the particle storage.
+ */
+class MixedPrecisionPrefilter
+{
+public:
+   MixedPrecisionPrefilter(const MixedPrecisionParameters & parameters, bool useShapeSupport)
+      : parameters_(parameters), useShapeSupport_(useShapeSupport)
+   {
+#ifdef _OPENMP
+      counters_.resize(size_t(omp_get_max_threads()));
+#else
+      counters_.resize(1);
+#endif
+   }
+
+   void update(data::ParticleAccessorWithBaseShape & ac)
+   {
+      const size_t numParticles = ac.size();
+      particles_.resize(numParticles);
+      for(auto & entry : shapes_) entry.second.isUsed = false;
+      for(size_t idx = 0; idx < numParticles; ++idx)
+      {
+         auto & particle = particles_[idx];
+         particle.interactionRadius = float(ac.getInteractionRadius(idx));
+         particle.shape = nullptr;
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE) || !useShapeSupport_) continue;
+         const Mat3 & rotation = ac.getRotation(idx).getMatrix();
+         for(uint_t i = 0; i < 9; ++i) particle.rotation[i] = float(rotation[i]);
+         particle.shape = getShape(ac.getBaseShape(idx));
+      }
+      // drop the shapes of deleted particles, node-based map: the pointers to the remaining shapes stay valid
+      for(auto it = shapes_.begin(); it != shapes_.end();)
+      {
+         if(it->second.isUsed) ++it;
+         else it = shapes_.erase(it);
+      }
+   }
+
+   // thread-safe, false if the pair is certainly not in contact
+   template<typename Accessor_T>
+   bool isCandidate(size_t idx1, size_t idx2, Accessor_T & ac)
+   {
+      if(idx1 >= particles_.size() || idx2 >= particles_.size()) return true;
+      if(data::particle_flags::isSet(ac.getFlags(idx1), data::particle_flags::INFINITE) ||
+         data::particle_flags::isSet(ac.getFlags(idx2), data::particle_flags::INFINITE)) return true;
+
+      const Vec3 distance = ac.getPosition(idx2) - ac.getPosition(idx1);
+      const bool isCandidate = test<float>(idx1, idx2, std::array<float, 3>{float(distance[0]), float(distance[1]), float(distance[2])});
+      auto & counters = getCounters();
+      if(!isCandidate) ++counters.rejected;
+      if(parameters_.validate && !isCandidate && test<double>(idx1, idx2, std::array<double, 3>{double(distance[0]), double(distance[1]), double(distance[2])}))
+         ++counters.wronglyRejected;
+      return isCandidate;
+   }
+
+   bool isValidating() const { return parameters_.validate; }
+   uint64_t getNumberOfRejectedPairs() const { uint64_t sum = 0; for(const auto & c : counters_) sum += c.rejected; return sum; }
+   uint64_t getNumberOfWronglyRejectedPairs() const { uint64_t sum = 0; for(const auto & c : counters_) sum += c.wronglyRejected; return sum; }
+
+private:
+   struct Shape
+   {
+      enum Type { SPHERE, ELLIPSOID, POLYHEDRON, OTHER } type = OTHER;
+      std::array<float, 3> semiAxes{}; // radius for spheres
+      std::vector<std::array<float, 3>> vertices; // body frame
+      std::shared_ptr<data::BaseShape> owner; // keeps the address from being reused while cached
+      bool isUsed = false;
+   };
+
+   struct Particle
+   {
+      float interactionRadius = 0.f;
+      std::array<float, 9> rotation{};
+      const Shape * shape = nullptr; // nullptr: bounding sphere only
+   };
+
+   struct alignas(64) Counters
+   {
+      uint64_t rejected = 0;
+      uint64_t wronglyRejected = 0;
+   };
+
+   Counters & getCounters()
+   {
+#ifdef _OPENMP
+      return counters_[size_t(omp_get_thread_num())];
+#else
+      return counters_[0];
+#endif
+   }
+
+   const Shape * getShape(const std::shared_ptr<data::BaseShape> & baseShape)
+   {
+      auto it = shapes_.find(baseShape.get());
+      if(it == shapes_.end())
+      {
+         Shape shape;
+         shape.owner = baseShape;
+         if(baseShape->getShapeType() == data::Sphere::SHAPE_TYPE)
+         {
+            shape.type = Shape::SPHERE;
+            shape.semiAxes.fill(float(static_cast<const data::Sphere&>(*baseShape).getRadius()));
+         } else if(baseShape->getShapeType() == data::Ellipsoid::SHAPE_TYPE)
+         {
+            shape.type = Shape::ELLIPSOID;
+            const auto & semiAxes = static_cast<const data::Ellipsoid&>(*baseShape).getSemiAxes();
+            for(uint_t i = 0; i < 3; ++i) shape.semiAxes[i] = float(semiAxes[i]);
+         } else if(baseShape->getShapeType() == data::ConvexPolyhedron::SHAPE_TYPE)
+         {
+            shape.type = Shape::POLYHEDRON;
+            const auto & mesh = static_cast<const data::ConvexPolyhedron&>(*baseShape).getMesh();
+            for(auto vh : mesh.vertices())
+            {
+               const auto & point = mesh.point(vh);
+               shape.vertices.push_back({float(point[0]), float(point[1]), float(point[2])});
+            }
+         }
+         it = shapes_.emplace(baseShape.get(), std::move(shape)).first;
+      }
+      it->second.isUsed = true;
+      return &it->second;
+   }
+
+   // support function h(n) = max_{x in shape} x * n, relative to the center of mass, n in world frame
+   template<typename T>
+   static T support(const Particle & particle, const std::array<T, 3> & n)
+   {
+      const Shape & shape = *particle.shape;
+      if(shape.type == Shape::SPHERE) return T(shape.semiAxes[0]);
+      if(shape.type == Shape::OTHER) return T(particle.interactionRadius);
+      // body frame direction R^T n
+      std::array<T, 3> nBF;
+      for(uint_t i = 0; i < 3; ++i)
+         nBF[i] = T(particle.rotation[i]) * n[0] + T(particle.rotation[3 + i]) * n[1] + T(particle.rotation[6 + i]) * n[2];
+      if(shape.type == Shape::ELLIPSOID)
+      {
+         T sum = T(0);
+         for(uint_t i = 0; i < 3; ++i) sum += (T(shape.semiAxes[i]) * nBF[i]) * (T(shape.semiAxes[i]) * nBF[i]);
+         return std::sqrt(sum);
+      }
+      T maximum = -std::numeric_limits<T>::max();
+      for(const auto & v : shape.vertices) maximum = std::max(maximum, T(v[0]) * nBF[0] + T(v[1]) * nBF[1] + T(v[2]) * nBF[2]);
+      return maximum;
+   }
+
+   template<typename T>
+   bool test(size_t idx1, size_t idx2, const std::array<T, 3> & distance) const
+   {
+      const Particle & p1 = particles_[idx1];
+      const Particle & p2 = particles_[idx2];
+      const T radiusSum = T(p1.interactionRadius) + T(p2.interactionRadius);
+      const T margin = T(parameters_.relativeMargin) * radiusSum;
+      const T sqrDistance = distance[0] * distance[0] + distance[1] * distance[1] + distance[2] * distance[2];
+      if(sqrDistance > (radiusSum + margin) * (radiusSum + margin)) return false;
+      if(p1.shape == nullptr || p2.shape == nullptr || sqrDistance <= T(0)) return true;
+
+      const T length = std::sqrt(sqrDistance);
+      const std::array<T, 3> n{distance[0] / length, distance[1] / length, distance[2] / length};
+      const std::array<T, 3> minusN{-n[0], -n[1], -n[2]};
+      return length <= support(p1, n) + support(p2, minusN) + margin;
+   }
+
+   MixedPrecisionParameters parameters_;
+   bool useShapeSupport_;
+   std::vector<Particle> particles_;
+   std::unordered_map<const data::BaseShape*, Shape> shapes_;
+   std::vector<Counters> counters_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
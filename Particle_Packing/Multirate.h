@@ -0,0 +1,299 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   Multirate.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+#include "core/math/AABB.h"
+#include "core/math/Vector3.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+// marks particles that are advanced ballistically over the current large step, not used by mesa_pd itself
+constexpr data::particle_flags::FlagT::value_type FREE_FLIGHT = (1 << 7);
+static_assert((FREE_FLIGHT & (data::particle_flags::INFINITE | data::particle_flags::FIXED | data::particle_flags::GLOBAL |
+                              data::particle_flags::GHOST | data::particle_flags::NON_COMMUNICATING)) == 0,
+              "FREE_FLIGHT collides with a mesa_pd particle flag");
+
+inline bool isInFreeFlight(const data::particle_flags::FlagT & flags) { return data::particle_flags::isSet(flags, FREE_FLIGHT); }
+
+// particle selector for forEachParticle and the linked cells builds during the small steps
+struct SelectNotInFreeFlight
+{
+   template<typename Accessor_T>
+   bool operator()(const size_t idx, Accessor_T & ac) const { return !isInFreeFlight(ac.getFlags(idx)); }
+};
+
+struct MultirateParameters
+{
+   uint_t numSubcycles = uint_t(10); // large step = numSubcycles * dt
+   real_t safetyFactor = real_t(2); // on the distance a pair can close within the large step, based on the velocity limit
+
+   static MultirateParameters fromConfig(const Config::BlockHandle & multirateConf)
+   {
+      MultirateParameters parameters;
+      parameters.numSubcycles = multirateConf.getParameter<uint_t>("numSubcycles", parameters.numSubcycles);
+      parameters.safetyFactor = multirateConf.getParameter<real_t>("safetyFactor", parameters.safetyFactor);
+      WALBERLA_CHECK_GREATER(parameters.numSubcycles, uint_t(0));
+      WALBERLA_CHECK_GREATER_EQUAL(parameters.safetyFactor, real_t(1));
+      return parameters;
+   }
+};
+
+/*
+ * Multirate time stepping for the DEM during generation.
+ * At every numSubcycles-th time step (the large step), all particles take part in the contact detection and are classified:
+ * particles in contact, particles with another particle or a wall within the distance they can close during the large step,
+ * and particles close to the border of the local subdomain (whose neighbors might not be known) are active, all others are free.
+ * Free particles are flagged with FREE_FLIGHT and advanced analytically over the whole large step at once
+ * (ballistic motion under the given acceleration with velocity limiting, constant angular velocity).
+ * They are excluded from contact detection, force evaluation and integration during the following small steps,
+ * which only treat the active particles (and particles created in between).
+ *
+ * The neighborhood test uses a grid with cells of the linked cells width (>= max. particle diameter):
+ * without other particles in the 5x5x5 surrounding cells, the gap to any other particle is at least one cell width.
+ * Thus the large step is limited such that safetyFactor * 2 * velocityLimit * largeDt does not exceed the cell width.
+ */
+class MultirateScheduler
+{
+public:
+   MultirateScheduler(const MultirateParameters & parameters, real_t dt, real_t cellWidth, real_t velocityLimit)
+      : parameters_(parameters), dt_(dt), cellWidth_(cellWidth)
+   {
+      WALBERLA_CHECK_GREATER(velocityLimit, real_t(0), "Multirate time stepping requires limitVelocity, which bounds the distance a pair can close within the large step.");
+      uint_t maxSubcycles = std::max(uint_t(1), uint_c(std::floor(cellWidth / (parameters_.safetyFactor * real_t(2) * velocityLimit * dt))));
+      if(parameters_.numSubcycles > maxSubcycles)
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Multirate: reducing the number of sub-cycles from " << parameters_.numSubcycles << " to " << maxSubcycles
+                                      << ", as particles with the velocity limit would travel further than the cell width " << cellWidth << " m during the large step.");
+         parameters_.numSubcycles = maxSubcycles;
+      }
+   }
+
+   uint_t getNumberOfSubcycles() const { return parameters_.numSubcycles; }
+   real_t getLargeDt() const { return real_c(parameters_.numSubcycles) * dt_; }
+   bool isLargeStep(uint_t timestep) const { return timestep % parameters_.numSubcycles == 0; }
+
+   template<typename Accessor_T>
+   void releaseAll(Accessor_T & ac) const
+   {
+      for(size_t idx = 0; idx < ac.size(); ++idx) data::particle_flags::unset(ac.getFlagsRef(idx), FREE_FLIGHT);
+   }
+
+   // after the contact detection of a large step, flags the free local particles and returns their number
+   // isPeriodic only for the single process case, where all particles are local and the neighborhood wraps around
+   template<typename Accessor_T, typename ContactAccessor_T>
+   uint_t classify(Accessor_T & ac, ContactAccessor_T & ca, const math::AABB & localDomain, const math::AABB & simulationDomain,
+                   const Vector3<bool> & isPeriodic, bool isSingleProcess)
+   {
+      const size_t numParticles = ac.size();
+      isActive_.assign(numParticles, false);
+      walls_.clear();
+      for(size_t idx = 0; idx < numParticles; ++idx)
+      {
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE)) walls_.push_back(idx);
+      }
+      for(size_t c = 0; c < ca.size(); ++c)
+      {
+         isActive_[ca.getId1(c)] = true;
+         isActive_[ca.getId2(c)] = true;
+      }
+
+      buildGrid(ac, localDomain, isPeriodic, isSingleProcess);
+      const real_t reach = cellWidth_;
+
+      uint_t numFree = 0;
+      for(size_t idx = 0; idx < numParticles; ++idx)
+      {
+         const auto & flags = ac.getFlags(idx);
+         if(isActive_[idx] || data::particle_flags::isSet(flags, data::particle_flags::INFINITE) ||
+            data::particle_flags::isSet(flags, data::particle_flags::GHOST) || data::particle_flags::isSet(flags, data::particle_flags::FIXED)) continue;
+         const Vec3 & position = ac.getPosition(idx);
+         if(!isSingleProcess && isCloseToSubdomainBorder(position, localDomain, simulationDomain, isPeriodic, real_t(2) * cellWidth_)) continue;
+         if(isCloseToWall(idx, ac, reach)) continue;
+         if(hasNeighbor(particleCells_[idx], isPeriodic, isSingleProcess)) continue;
+         data::particle_flags::set(ac.getFlagsRef(idx), FREE_FLIGHT);
+         ++numFree;
+      }
+      return numFree;
+   }
+
+   // analytic update of the free particles over the large step, acceleration: constant acceleration of all particles
+   template<typename Accessor_T>
+   void advanceFreeParticles(Accessor_T & ac, const Vec3 & acceleration, real_t velocityLimit) const
+   {
+      const real_t largeDt = getLargeDt();
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         if(!isInFreeFlight(ac.getFlags(idx)) || data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::GHOST)) continue;
+         Vec3 velocity = ac.getLinearVelocity(idx);
+         Vec3 & position = ac.getPositionRef(idx);
+
+         // accelerated motion until the velocity limit is reached, then uniform motion
+         real_t acceleratedTime = velocityLimit > real_t(0) ? getTimeToVelocityLimit(velocity, acceleration, velocityLimit, largeDt) : largeDt;
+         position += velocity * acceleratedTime + real_t(0.5) * acceleration * acceleratedTime * acceleratedTime;
+         velocity += acceleration * acceleratedTime;
+         if(velocityLimit > real_t(0) && velocity.length() > velocityLimit) velocity *= velocityLimit / velocity.length();
+         position += velocity * (largeDt - acceleratedTime);
+         ac.setLinearVelocity(idx, velocity);
+
+         Rot3 rotation = ac.getRotation(idx);
+         rotation.rotate(ac.getAngularVelocity(idx) * largeDt);
+         ac.setRotation(idx, rotation);
+
+         ac.setForce(idx, Vec3(real_t(0)));
+         ac.setTorque(idx, Vec3(real_t(0)));
+      }
+   }
+
+private:
+   // smallest t in [0, maxTime] with |v + a t| = limit, or maxTime
+   static real_t getTimeToVelocityLimit(const Vec3 & v, const Vec3 & a, real_t limit, real_t maxTime)
+   {
+      if((v + a * maxTime).length() <= limit) return maxTime;
+      if(v.length() >= limit) return real_t(0);
+      const real_t qa = a * a;
+      const real_t qb = real_t(2) * (v * a);
+      const real_t qc = v * v - limit * limit;
+      const real_t t = (-qb + std::sqrt(std::max(real_t(0), qb * qb - real_t(4) * qa * qc))) / (real_t(2) * qa);
+      return std::min(maxTime, std::max(real_t(0), t));
+   }
+
+   static bool isCloseToSubdomainBorder(const Vec3 & position, const math::AABB & localDomain, const math::AABB & simulationDomain,
+                                        const Vector3<bool> & isPeriodic, real_t distance)
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         // borders of the simulation domain without periodicity are walls and handled separately
+         bool isMinPhysical = !isPeriodic[i] && localDomain.min(i) <= simulationDomain.min(i);
+         bool isMaxPhysical = !isPeriodic[i] && localDomain.max(i) >= simulationDomain.max(i);
+         if(!isMinPhysical && position[i] - localDomain.min(i) < distance) return true;
+         if(!isMaxPhysical && localDomain.max(i) - position[i] < distance) return true;
+      }
+      return false;
+   }
+
+   template<typename Accessor_T>
+   bool isCloseToWall(size_t idx, Accessor_T & ac, real_t reach) const
+   {
+      const Vec3 & position = ac.getPosition(idx);
+      const real_t radius = ac.getInteractionRadius(idx);
+      for(size_t wall : walls_)
+      {
+         const auto * shape = ac.getShape(wall);
+         real_t gap = std::numeric_limits<real_t>::max();
+         if(shape->getShapeType() == data::HalfSpace::SHAPE_TYPE)
+         {
+            gap = (position - ac.getPosition(wall)) * static_cast<const data::HalfSpace*>(shape)->getNormal() - radius;
+         } else if(shape->getShapeType() == data::CylindricalBoundary::SHAPE_TYPE)
+         {
+            const auto * cylinder = static_cast<const data::CylindricalBoundary*>(shape);
+            const Vec3 d = position - ac.getPosition(wall);
+            gap = cylinder->getRadius() - (d - (d * cylinder->getAxis()) * cylinder->getAxis()).length() - radius;
+         } else
+         {
+            return true; // unknown wall type: conservative
+         }
+         if(gap < reach) return true;
+      }
+      return false;
+   }
+
+   // counts of the finite particles per cell, over the local domain extended by two cells (ghost particles included)
+   template<typename Accessor_T>
+   void buildGrid(Accessor_T & ac, const math::AABB & localDomain, const Vector3<bool> & isPeriodic, bool isSingleProcess)
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         bool wraps = isSingleProcess && isPeriodic[i];
+         gridMin_[i] = wraps ? localDomain.min(i) : localDomain.min(i) - real_t(2) * cellWidth_;
+         real_t length = wraps ? localDomain.max(i) - localDomain.min(i) : localDomain.max(i) - localDomain.min(i) + real_t(4) * cellWidth_;
+         numCells_[i] = std::max(1, int(std::ceil(length / cellWidth_)));
+         // periodic wrap-around requires the 5x5x5 neighborhood to consist of distinct cells, otherwise the width is reduced
+         if(wraps) numCells_[i] = std::max(1, int(std::floor(length / cellWidth_)));
+      }
+      cellCounts_.assign(size_t(numCells_[0]) * size_t(numCells_[1]) * size_t(numCells_[2]), 0);
+      particleCells_.assign(ac.size(), {{0, 0, 0}});
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE)) continue;
+         const Vec3 & position = ac.getPosition(idx);
+         auto & cell = particleCells_[idx];
+         for(uint_t i = 0; i < 3; ++i) cell[i] = std::min(numCells_[i] - 1, std::max(0, int(std::floor((position[i] - gridMin_[i]) / cellWidth_))));
+         ++cellCounts_[getCellIndex(cell[0], cell[1], cell[2])];
+      }
+   }
+
+   bool hasNeighbor(const std::array<int, 3> & cell, const Vector3<bool> & isPeriodic, bool isSingleProcess) const
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         if(isSingleProcess && isPeriodic[i] && numCells_[i] < 5) return true; // neighborhood is not unique, conservative
+      }
+      uint_t count = 0;
+      for(int dz = -2; dz <= 2; ++dz)
+         for(int dy = -2; dy <= 2; ++dy)
+            for(int dx = -2; dx <= 2; ++dx)
+            {
+               int n[3] = {cell[0] + dx, cell[1] + dy, cell[2] + dz};
+               bool isValid = true;
+               for(uint_t i = 0; i < 3; ++i)
+               {
+                  if(n[i] >= 0 && n[i] < numCells_[i]) continue;
+                  if(isSingleProcess && isPeriodic[i]) n[i] = (n[i] + numCells_[i]) % numCells_[i];
+                  else isValid = false;
+               }
+               if(!isValid) continue;
+               count += cellCounts_[getCellIndex(n[0], n[1], n[2])];
+               if(count > 1) return true;
+            }
+      return false;
+   }
+
+   size_t getCellIndex(int x, int y, int z) const { return size_t(x) + size_t(numCells_[0]) * (size_t(y) + size_t(numCells_[1]) * size_t(z)); }
+
+   MultirateParameters parameters_;
+   real_t dt_;
+   real_t cellWidth_;
+
+   std::vector<bool> isActive_;
+   std::vector<size_t> walls_;
+   real_t gridMin_[3];
+   int numCells_[3];
+   std::vector<uint_t> cellCounts_;
+   std::vector<std::array<int, 3>> particleCells_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,282 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   PackingAnalysis.cpp
+//
+//======================================================================================================================
+
+#include "core/Environment.h"
+#include "core/math/all.h"
+#include "core/timing/TimingTree.h"
+
+#include "sqlite/SQLite.h"
+#include "sqlite/sqlite3.h"
+
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include "PackingAnalysis.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+namespace {
+
+// space separated values, for storing profiles and histograms as string properties
+template<typename Container_T>
+std::string toString(const Container_T & values)
+{
+   std::ostringstream stream;
+   stream << std::setprecision(8);
+   bool isFirst = true;
+   for(const auto & value : values)
+   {
+      if(!isFirst) stream << " ";
+      stream << value;
+      isFirst = false;
+   }
+   return stream.str();
+}
+
+// runId of the run with the given file identifier, -1 if not found
+int64_t findRunId(const std::string & dbFile, const std::string & fileIdentifier)
+{
+   sqlite3 * db = nullptr;
+   if(sqlite3_open(dbFile.c_str(), &db) != SQLITE_OK)
+   {
+      sqlite3_close(db);
+      WALBERLA_ABORT("Could not open sqlite data base " << dbFile);
+   }
+   int64_t runId = -1;
+   sqlite3_stmt * statement = nullptr;
+   if(sqlite3_prepare_v2(db, "SELECT runId FROM runs WHERE file_identifier = ?", -1, &statement, nullptr) == SQLITE_OK)
+   {
+      sqlite3_bind_text(statement, 1, fileIdentifier.c_str(), -1, SQLITE_TRANSIENT);
+      if(sqlite3_step(statement) == SQLITE_ROW) runId = int64_c(sqlite3_column_int64(statement, 0));
+   }
+   sqlite3_finalize(statement);
+   sqlite3_close(db);
+   return runId;
+}
+
+} // namespace
+
+/*
+ * Post-processing of a finished packing, separate from the (expensive) generation run and thus repeatable with other parameters.
+ *
+ * Input is the packing snapshot of the run (evaluation.writePackingSnapshot), which holds the exact geometry of all particles
+ * including the meshes of the polyhedral ones. Without a snapshot, the particle info output of the run (or any particle file with
+ * positions and volume-equivalent diameters) is read: with shape id and rotation columns and the mesh library of the run,
+ * the particles get the convex hulls of their meshes, otherwise they are evaluated as sphere-equivalent particles.
+ * The packing is replicated on all processes, the statistics are distributed over the processes (see PackingAnalyzer).
+ *
+ * The results are stored in the table PackingAnalysis of the sqlite data base, for the run with the given file identifier
+ * (the first part of the run's output file names), and the g(r) and wall profiles additionally as text files next to the run's output.
+ *
+ * Usage: PackingAnalysis PackingAnalysis.cfg
+ */
+int main(int argc, char **argv)
+{
+   Environment env(argc, argv);
+   auto cfg = env.config();
+   if (cfg == nullptr) WALBERLA_ABORT("No config specified!");
+   WALBERLA_LOG_INFO_ON_ROOT(*cfg);
+   const Config::BlockHandle analysisConf = cfg->getBlock("PackingAnalysis");
+
+   std::string fileIdentifier = analysisConf.getParameter<std::string>("fileIdentifier");
+   std::string sqlDBFileName = analysisConf.getParameter<std::string>("sqlDBFileName", "db_ParticlePacking.sqlite");
+   std::string porosityProfileFolder = analysisConf.getParameter<std::string>("porosityProfileFolder", "porosity_profiles");
+   auto parameters = PackingAnalysisParameters::fromConfig(analysisConf);
+
+   WcTimingTree timing;
+
+   timing.start("Load packing");
+   AnalysisPacking packing;
+   std::string input = "packingSnapshot";
+   if(analysisConf.isDefined("packingFile") || !analysisConf.isDefined("particleFile"))
+   {
+      std::string packingFile = analysisConf.getParameter<std::string>("packingFile", porosityProfileFolder + "/" + fileIdentifier + "_packing.bin");
+      WALBERLA_LOG_INFO_ON_ROOT("Reading packing snapshot " << packingFile);
+      packing = AnalysisPacking::fromSnapshot(readPackingSnapshot(packingFile));
+   } else
+   {
+      std::string particleFile = analysisConf.getParameter<std::string>("particleFile");
+      AnalysisPacking::ParticleFileColumns columns;
+      columns.position = analysisConf.getParameter<Vector3<uint_t>>("positionColumns", columns.position);
+      columns.diameter = analysisConf.getParameter<uint_t>("diameterColumn", columns.diameter);
+      columns.shapeId = analysisConf.getParameter<int>("shapeIdColumn", columns.shapeId);
+      columns.rotation = analysisConf.getParameter<int>("rotationColumn", columns.rotation);
+
+      // mesh library of the run, the shape id is the index into the mesh files of all given paths in this order
+      ShapeLibraryCache shapeLibraryCache;
+      std::vector<const PreprocessedShape*> meshes;
+      if(columns.shapeId >= 0)
+      {
+         std::istringstream meshPaths(analysisConf.getParameter<std::string>("meshPaths"));
+         std::vector<std::string> meshFileNames;
+         std::string meshPath;
+         while(meshPaths >> meshPath)
+         {
+            auto pathMeshFileNames = getMeshFilesFromPath(meshPath);
+            meshFileNames.insert(meshFileNames.end(), pathMeshFileNames.begin(), pathMeshFileNames.end());
+         }
+         WALBERLA_CHECK(!meshFileNames.empty(), "Packing analysis: no meshes found in meshPaths.");
+         shapeLibraryCache.load(analysisConf.getParameter<std::string>("shapeCacheFile", ""), meshFileNames);
+         for(const auto & meshFileName : meshFileNames) meshes.push_back(&shapeLibraryCache.get(meshFileName));
+         input = "particleInfoWithMeshes";
+      } else
+      {
+         input = "sphereEquivalent";
+      }
+
+      WALBERLA_LOG_INFO_ON_ROOT("Reading particle file " << particleFile << ((columns.shapeId >= 0) ? " with " + std::to_string(meshes.size()) + " meshes"
+                                                                                                    : std::string(" (sphere-equivalent particles)")));
+      auto domainWidth = analysisConf.getParameter<real_t>("domainWidth");
+      auto domainWidthY = analysisConf.getParameter<real_t>("domainWidthY", domainWidth);
+      auto domainHeight = analysisConf.getParameter<real_t>("domainHeight");
+      auto domainSetup = analysisConf.getParameter<std::string>("domainSetup", "container");
+      WALBERLA_CHECK(domainSetup == "container" || domainSetup == "periodic", "Unknown domain setup " << domainSetup);
+      math::AABB domain(-real_t(0.5) * domainWidth, -real_t(0.5) * domainWidthY, real_t(0),
+                        real_t(0.5) * domainWidth, real_t(0.5) * domainWidthY, domainHeight);
+      packing = AnalysisPacking::fromTextFile(particleFile, columns, meshes, domain, domainSetup == "container");
+   }
+   timing.stop("Load packing");
+
+   WALBERLA_LOG_INFO_ON_ROOT("Analyzing " << packing.particles.size() << " particles with " << packing.shapes.size() << " shapes in "
+                             << (packing.isContainer ? "container" : "periodic") << " setup on "
+                             << walberla::mpi::MPIManager::instance()->numProcesses() << " processes.");
+
+   timing.start("Spatial index");
+   PackingAnalyzer analyzer(packing, parameters);
+   timing.stop("Spatial index");
+
+   timing.start("Radial distribution");
+   auto rdf = analyzer.computeRadialDistribution();
+   timing.stop("Radial distribution");
+
+   timing.start("Orientation distribution");
+   auto orientation = analyzer.computeOrientationDistribution();
+   timing.stop("Orientation distribution");
+
+   timing.start("Local porosity");
+   auto localPorosity = analyzer.computeLocalPorosityVariance();
+   timing.stop("Local porosity");
+
+   timing.start("Wall profiles");
+   auto bottomWallProfile = analyzer.computeBottomWallProfile();
+   std::vector<double> sideWallProfile;
+   if(packing.isContainer) sideWallProfile = analyzer.computeSideWallProfile();
+   timing.stop("Wall profiles");
+
+   auto reducedTT = timing.getReduced();
+   WALBERLA_LOG_INFO_ON_ROOT(reducedTT);
+
+   WALBERLA_ROOT_SECTION()
+   {
+      const real_t meanDiameter = analyzer.getMeanDiameter();
+      const real_t bedHeight = packing.getBedHeight() - packing.domain.zMin();
+      const real_t bedVolume = packing.isContainer ? math::pi * real_t(0.25) * packing.domain.xSize() * packing.domain.xSize() * bedHeight
+                                                   : packing.domain.xSize() * packing.domain.ySize() * bedHeight;
+      const real_t porosity = real_t(1) - packing.getTotalSolidVolume() / bedVolume;
+
+      // first peak of g(r)
+      size_t peakBin = 0;
+      for(size_t b = 1; b < rdf.size(); ++b) if(rdf[b] > rdf[peakBin]) peakBin = b;
+      const double rdfBinWidth = double(parameters.rdfMaxDistance) / double(parameters.rdfBins);
+
+      WALBERLA_LOG_INFO("Mean volume-equivalent diameter = " << meanDiameter << ", bulk porosity = " << porosity);
+      WALBERLA_LOG_INFO("g(r): first peak " << rdf[peakBin] << " at r / d = " << (double(peakBin) + 0.5) * rdfBinWidth);
+      if(analyzer.getNumberOfOrientedParticles() > 0)
+         WALBERLA_LOG_INFO("Orientation: <a_z^2> = " << orientation[parameters.orientationBins + 2] << " (isotropic: 1/3) of "
+                           << analyzer.getNumberOfOrientedParticles() << " non-spherical particles");
+      for(size_t w = 0; w < localPorosity.size(); ++w)
+         WALBERLA_LOG_INFO("Local porosity in windows of " << parameters.porosityWindowSizes[w] << " d: mean " << localPorosity[w][0]
+                           << ", variance " << localPorosity[w][1] << " (" << localPorosity[w][2] << " windows)");
+
+      std::string rdfFileName = porosityProfileFolder + "/" + fileIdentifier + "_rdf.txt";
+      std::ofstream rdfFile(rdfFileName.c_str());
+      rdfFile << "# r/d g(r)\n" << std::setprecision(8);
+      for(size_t b = 0; b < rdf.size(); ++b) rdfFile << (double(b) + 0.5) * rdfBinWidth << " " << rdf[b] << "\n";
+
+      std::string wallFileName = porosityProfileFolder + "/" + fileIdentifier + "_wall_profiles.txt";
+      std::ofstream wallFile(wallFileName.c_str());
+      wallFile << "# distance_to_wall/d porosity_bottom_wall" << (packing.isContainer ? " porosity_side_wall" : "") << "\n" << std::setprecision(8);
+      for(size_t b = 0; b < bottomWallProfile.size(); ++b)
+      {
+         wallFile << (double(b) + 0.5) * double(parameters.wallProfileBinWidth) << " " << bottomWallProfile[b];
+         if(packing.isContainer) wallFile << " " << sideWallProfile[b];
+         wallFile << "\n";
+      }
+      WALBERLA_LOG_INFO("Wrote " << rdfFileName << " and " << wallFileName);
+
+      auto runId = findRunId(sqlDBFileName, fileIdentifier);
+      if(runId < 0)
+      {
+         WALBERLA_LOG_WARNING("No run with file identifier " << fileIdentifier << " in " << sqlDBFileName << ", results are not stored in the data base.");
+      } else
+      {
+         std::map< std::string, int64_t > sql_integerProperties;
+         std::map< std::string, double > sql_realProperties;
+         std::map< std::string, std::string > sql_stringProperties;
+
+         sql_integerProperties["numParticles"] = int64_c(packing.particles.size());
+         sql_integerProperties["numProcesses"] = int64_c(walberla::mpi::MPIManager::instance()->numProcesses());
+         sql_integerProperties["numOrientedParticles"] = int64_c(analyzer.getNumberOfOrientedParticles());
+         sql_stringProperties["input"] = input;
+         sql_realProperties["meanDiameter"] = double(meanDiameter);
+         sql_realProperties["bulkPorosity"] = double(porosity);
+         sql_realProperties["analyzedBedHeight"] = double(analyzer.getBedTop() - packing.domain.zMin());
+
+         sql_realProperties["rdf_maxDistance"] = double(parameters.rdfMaxDistance);
+         sql_integerProperties["rdf_numCenters"] = int64_c(analyzer.getNumberOfRdfCenters());
+         sql_realProperties["rdf_firstPeakPosition"] = (double(peakBin) + 0.5) * rdfBinWidth;
+         sql_realProperties["rdf_firstPeakValue"] = rdf[peakBin];
+         sql_stringProperties["rdf"] = toString(rdf);
+
+         sql_stringProperties["orientation_cosineHistogram"] = toString(std::vector<double>(orientation.begin(), orientation.begin() + int64_c(parameters.orientationBins)));
+         const char * tensorNames[6] = {"xx", "yy", "zz", "xy", "xz", "yz"};
+         for(uint_t k = 0; k < 6; ++k) sql_realProperties[std::string("orientation_") + tensorNames[k]] = orientation[parameters.orientationBins + k];
+
+         sql_stringProperties["localPorosity_windowSizes"] = toString(parameters.porosityWindowSizes);
+         std::vector<double> means, variances;
+         for(const auto & result : localPorosity) { means.push_back(result[0]); variances.push_back(result[1]); }
+         sql_stringProperties["localPorosity_mean"] = toString(means);
+         sql_stringProperties["localPorosity_variance"] = toString(variances);
+         sql_integerProperties["localPorosity_samplesPerDiameter"] = int64_c(parameters.samplesPerDiameter);
+
+         sql_realProperties["wall_binWidth"] = double(parameters.wallProfileBinWidth);
+         sql_stringProperties["wall_bottomProfile"] = toString(bottomWallProfile);
+         if(packing.isContainer) sql_stringProperties["wall_sideProfile"] = toString(sideWallProfile);
+
+         double totalTime = 0.0;
+         for(const auto & timerName : {"Load packing", "Spatial index", "Radial distribution", "Orientation distribution", "Local porosity", "Wall profiles"})
+            totalTime += reducedTT[timerName].total();
+         sql_realProperties["wallTime"] = totalTime;
+
+         sqlite::storeAdditionalRunInfoInSqliteDB(runId, sqlDBFileName, "PackingAnalysis", sql_integerProperties, sql_stringProperties, sql_realProperties);
+         WALBERLA_LOG_INFO("Stored results for run " << runId << " in " << sqlDBFileName);
+      }
+   }
+
+   return EXIT_SUCCESS;
+}
+
+} // namespace mesa_pd
+} // namespace walberla
+
+int main( int argc, char* argv[] ) {
+   return walberla::mesa_pd::main( argc, argv );
+}
@@ -0,0 +1,672 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   PackingAnalysis.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/math/AABB.h"
+#include "core/math/Constants.h"
+#include "core/mpi/Broadcast.h"
+#include "core/mpi/MPIManager.h"
+#include "core/mpi/Reduce.h"
+
+#include "mesa_pd/data/DataTypes.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "PackingTiling.h"
+#include "ShapeLibraryCache.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Geometry of a finished packing for the post-processing, replicated on all processes.
+ * Shapes are spheres, ellipsoids or convex polyhedra (given by their face planes in the body frame).
+ */
+class AnalysisPacking
+{
+public:
+   struct Shape
+   {
+      PackingSnapshot::ShapeType type = PackingSnapshot::SPHERE;
+      Vec3 semiAxes;                         // radius in all components for spheres
+      std::vector<std::pair<Vec3, real_t>> planes; // outward normal and offset, convex polyhedra only
+      real_t volume = real_t(0);
+      real_t boundingRadius = real_t(0);
+      Vec3 longAxis;                         // body frame
+      bool hasOrientation = false;
+   };
+
+   struct Particle
+   {
+      uint32_t shape;
+      Vec3 position;
+      Mat3 rotation;
+   };
+
+   // zero-based columns of a whitespace separated particle file (e.g. the particle info output), negative: not contained
+   struct ParticleFileColumns
+   {
+      Vector3<uint_t> position = Vector3<uint_t>(0, 1, 2);
+      uint_t diameter = uint_t(3); // volume-equivalent diameter
+      int shapeId = -1;            // index into the mesh library, particles with a negative id are spheres
+      int rotation = -1;           // first of the four quaternion components (r, i, j, k)
+   };
+
+   math::AABB domain;
+   Vector3<bool> isPeriodic = Vector3<bool>(false);
+   bool isContainer = false; // cylindrical container with the axis in the center of the domain and radius 0.5 * x-size
+   std::vector<Shape> shapes;
+   std::vector<Particle> particles;
+
+   static AnalysisPacking fromSnapshot(const PackingSnapshot & snapshot)
+   {
+      AnalysisPacking packing;
+      packing.domain = snapshot.domain;
+      packing.isPeriodic = Vector3<bool>(snapshot.isPeriodicX, snapshot.isPeriodicY, false);
+      packing.isContainer = !snapshot.isPeriodicX && !snapshot.isPeriodicY;
+      for(const auto & snapshotShape : snapshot.shapes)
+      {
+         Shape shape;
+         shape.type = snapshotShape.type;
+         if(shape.type == PackingSnapshot::SPHERE)
+         {
+            shape.semiAxes = Vec3(real_c(snapshotShape.parameters[0]));
+            shape.volume = real_t(4) / real_t(3) * math::pi * std::pow(shape.semiAxes[0], real_t(3));
+            shape.boundingRadius = shape.semiAxes[0];
+         } else if(shape.type == PackingSnapshot::ELLIPSOID)
+         {
+            shape.semiAxes = Vec3(real_c(snapshotShape.parameters[0]), real_c(snapshotShape.parameters[1]), real_c(snapshotShape.parameters[2]));
+            shape.volume = real_t(4) / real_t(3) * math::pi * shape.semiAxes[0] * shape.semiAxes[1] * shape.semiAxes[2];
+            shape.boundingRadius = std::max(shape.semiAxes[0], std::max(shape.semiAxes[1], shape.semiAxes[2]));
+            uint_t longAxis = 0;
+            for(uint_t i = 1; i < 3; ++i) if(shape.semiAxes[i] > shape.semiAxes[longAxis]) longAxis = i;
+            shape.longAxis = Vec3(real_t(0));
+            shape.longAxis[longAxis] = real_t(1);
+            shape.hasOrientation = true;
+         } else
+         {
+            initPolyhedron(snapshotShape, shape);
+         }
+         packing.shapes.push_back(shape);
+      }
+      for(const auto & snapshotParticle : snapshot.particles)
+      {
+         packing.particles.push_back({snapshotParticle.shape, snapshotParticle.position + snapshot.domain.minCorner(),
+                                      Rot3(snapshotParticle.rotation).getMatrix()});
+      }
+      return packing;
+   }
+
+   // packing from a whitespace separated text file (e.g. the particle info output), lines starting with '#' are skipped;
+   // particles with a shape id get the convex hull of this mesh of the library, scaled to their volume-equivalent diameter,
+   // all other particles are sphere-equivalent
+   static AnalysisPacking fromTextFile(const std::string & fileName, const ParticleFileColumns & columns, const std::vector<const PreprocessedShape*> & meshes,
+                                       const math::AABB & domain, bool isContainer)
+   {
+      WALBERLA_CHECK(columns.shapeId < 0 || columns.rotation >= 0, "Packing analysis: mesh particles require the rotation columns.");
+      const size_t valuesPerParticle = 9; // x, y, z, d, shape id, quaternion
+      std::vector<double> values;
+      WALBERLA_ROOT_SECTION()
+      {
+         std::ifstream file(fileName);
+         if(!file) WALBERLA_ABORT("Could not open particle file " << fileName);
+         uint_t maxColumn = std::max(columns.diameter, std::max(columns.position[0], std::max(columns.position[1], columns.position[2])));
+         if(columns.shapeId >= 0) maxColumn = std::max(maxColumn, uint_c(columns.shapeId));
+         if(columns.rotation >= 0) maxColumn = std::max(maxColumn, uint_c(columns.rotation) + uint_t(3));
+         std::string line;
+         while(std::getline(file, line))
+         {
+            if(line.empty() || line[0] == '#') continue;
+            std::istringstream stream(line);
+            std::vector<double> lineValues;
+            double value;
+            while(stream >> value) lineValues.push_back(value);
+            if(lineValues.size() <= maxColumn) continue;
+            for(uint_t i = 0; i < 3; ++i) values.push_back(lineValues[columns.position[i]]);
+            values.push_back(lineValues[columns.diameter]);
+            values.push_back((columns.shapeId >= 0) ? lineValues[size_t(columns.shapeId)] : -1.0);
+            for(uint_t i = 0; i < 4; ++i) values.push_back((columns.rotation >= 0) ? lineValues[size_t(columns.rotation) + i] : ((i == 0) ? 1.0 : 0.0));
+         }
+      }
+      walberla::mpi::broadcastObject(values);
+
+      AnalysisPacking packing;
+      packing.domain = domain;
+      packing.isContainer = isContainer;
+      packing.isPeriodic = isContainer ? Vector3<bool>(false) : Vector3<bool>(true, true, false);
+      for(size_t i = 0; i + valuesPerParticle <= values.size(); i += valuesPerParticle)
+      {
+         const real_t diameter = real_c(values[i + 3]);
+         const int64_t shapeId = int64_c(std::round(values[i + 4]));
+         Shape shape;
+         Mat3 rotation = Mat3::makeIdentityMatrix();
+         if(shapeId < 0)
+         {
+            shape.semiAxes = Vec3(real_t(0.5) * diameter);
+            shape.volume = real_t(4) / real_t(3) * math::pi * std::pow(shape.semiAxes[0], real_t(3));
+            shape.boundingRadius = shape.semiAxes[0];
+         } else
+         {
+            if(size_t(shapeId) >= meshes.size()) WALBERLA_ABORT("Packing analysis: shape id " << shapeId << " not in the mesh library of " << meshes.size() << " meshes.");
+            const PreprocessedShape & mesh = *meshes[size_t(shapeId)];
+            const double scaling = double(diameter) / mesh.getVolumeEquivalentDiameter();
+            PackingSnapshot::Shape hull;
+            hull.type = PackingSnapshot::CONVEX_POLYHEDRON;
+            for(const auto & vertex : mesh.vertices)
+               for(uint_t d = 0; d < 3; ++d) hull.parameters.push_back(scaling * vertex[d]);
+            hull.faces = mesh.faces;
+            shape.type = PackingSnapshot::CONVEX_POLYHEDRON;
+            initPolyhedron(hull, shape);
+            rotation = Rot3(Quat(real_c(values[i + 5]), real_c(values[i + 6]), real_c(values[i + 7]), real_c(values[i + 8]))).getMatrix();
+         }
+         packing.shapes.push_back(shape);
+         packing.particles.push_back({uint32_t(packing.shapes.size() - 1), Vec3(real_c(values[i]), real_c(values[i + 1]), real_c(values[i + 2])), rotation});
+      }
+      return packing;
+   }
+
+   real_t getMaxBoundingRadius() const
+   {
+      real_t radius = real_t(0);
+      for(const auto & shape : shapes) radius = std::max(radius, shape.boundingRadius);
+      return radius;
+   }
+
+   real_t getMeanVolumeEquivalentDiameter() const
+   {
+      real_t sum = real_t(0);
+      for(const auto & p : particles) sum += std::cbrt(real_t(6) * shapes[p.shape].volume / math::pi);
+      return particles.empty() ? real_t(0) : sum / real_c(particles.size());
+   }
+
+   real_t getTotalSolidVolume() const
+   {
+      real_t volume = real_t(0);
+      for(const auto & p : particles) volume += shapes[p.shape].volume;
+      return volume;
+   }
+
+   real_t getBedHeight() const
+   {
+      real_t height = domain.zMin();
+      for(const auto & p : particles) height = std::max(height, p.position[2] + shapes[p.shape].boundingRadius);
+      return height;
+   }
+
+   // minimum image for the periodic directions
+   Vec3 getDistanceVector(const Vec3 & from, const Vec3 & to) const
+   {
+      Vec3 d = to - from;
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         if(!isPeriodic[i]) continue;
+         const real_t length = domain.max(i) - domain.min(i);
+         d[i] -= length * std::round(d[i] / length);
+      }
+      return d;
+   }
+
+   bool isPointInside(const Particle & p, const Vec3 & point) const
+   {
+      const auto & shape = shapes[p.shape];
+      const Vec3 d = getDistanceVector(p.position, point);
+      if(d.sqrLength() > shape.boundingRadius * shape.boundingRadius) return false;
+      if(shape.type == PackingSnapshot::SPHERE) return true;
+      const Vec3 pBF = p.rotation.getTranspose() * d;
+      if(shape.type == PackingSnapshot::ELLIPSOID)
+      {
+         real_t sum = real_t(0);
+         for(uint_t i = 0; i < 3; ++i) sum += (pBF[i] / shape.semiAxes[i]) * (pBF[i] / shape.semiAxes[i]);
+         return sum <= real_t(1);
+      }
+      for(const auto & plane : shape.planes)
+      {
+         if(plane.first * pBF > plane.second) return false;
+      }
+      return true;
+   }
+
+private:
+   static void initPolyhedron(const PackingSnapshot::Shape & snapshotShape, Shape & shape)
+   {
+      std::vector<Vec3> vertices;
+      for(size_t i = 0; i + 2 < snapshotShape.parameters.size(); i += 3)
+         vertices.emplace_back(real_c(snapshotShape.parameters[i]), real_c(snapshotShape.parameters[i + 1]), real_c(snapshotShape.parameters[i + 2]));
+      // vertices are given relative to the center of mass, which lies inside the convex hull
+      real_t volume = real_t(0);
+      for(size_t f = 0; f + 2 < snapshotShape.faces.size(); f += 3)
+      {
+         const Vec3 & a = vertices[snapshotShape.faces[f]];
+         const Vec3 & b = vertices[snapshotShape.faces[f + 1]];
+         const Vec3 & c = vertices[snapshotShape.faces[f + 2]];
+         Vec3 normal = (b - a) % (c - a);
+         if(normal.sqrLength() <= real_t(0)) continue;
+         normal = normal.getNormalized();
+         real_t offset = normal * a;
+         if(offset < real_t(0)) { normal = -normal; offset = -offset; }
+         shape.planes.emplace_back(normal, offset);
+         volume += std::abs(a * (b % c)) / real_t(6);
+      }
+      shape.volume = volume;
+      Mat3 covariance(real_t(0));
+      for(const auto & v : vertices)
+      {
+         shape.boundingRadius = std::max(shape.boundingRadius, v.length());
+         for(uint_t i = 0; i < 3; ++i)
+            for(uint_t j = 0; j < 3; ++j) covariance(i, j) += v[i] * v[j];
+      }
+      // long axis: dominant eigenvector of the vertex covariance by power iteration
+      Vec3 axis = Vec3(real_t(1), real_t(0.7), real_t(0.3)).getNormalized();
+      for(uint_t iteration = 0; iteration < 100; ++iteration)
+      {
+         Vec3 next = covariance * axis;
+         if(next.sqrLength() <= real_t(0)) break;
+         axis = next.getNormalized();
+      }
+      shape.longAxis = axis;
+      shape.hasOrientation = true;
+   }
+};
+
+/*
+ * Uniform cell grid over all particles of an AnalysisPacking, with periodic wrap-around of the cell indices.
+ * The cells are at least as wide as the given interaction distance, so all particles within this distance
+ * of a point are found in the 27 surrounding cells.
+ */
+class AnalysisCellGrid
+{
+public:
+   AnalysisCellGrid(const AnalysisPacking & packing, real_t minCellWidth) : packing_(packing)
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         const real_t length = packing.domain.max(i) - packing.domain.min(i);
+         numCells_[i] = std::max(uint_t(1), uint_c(std::floor(length / minCellWidth)));
+         // without periodicity, particles may protrude: clamped into the boundary cells
+         cellWidth_[i] = length / real_c(numCells_[i]);
+      }
+      cellBegin_.assign(numCells_[0] * numCells_[1] * numCells_[2] + 1, 0);
+      std::vector<size_t> cellOfParticle(packing.particles.size());
+      for(size_t p = 0; p < packing.particles.size(); ++p)
+      {
+         cellOfParticle[p] = getCell(packing.particles[p].position);
+         ++cellBegin_[cellOfParticle[p] + 1];
+      }
+      for(size_t c = 1; c < cellBegin_.size(); ++c) cellBegin_[c] += cellBegin_[c - 1];
+      particles_.resize(packing.particles.size());
+      std::vector<size_t> fill(cellBegin_.begin(), cellBegin_.end() - 1);
+      for(size_t p = 0; p < packing.particles.size(); ++p) particles_[fill[cellOfParticle[p]]++] = p;
+   }
+
+   // calls func(particleIdx) for all particles in the cells around the point, each particle once
+   template<typename Func_T>
+   void forEachParticleNear(const Vec3 & point, Func_T && func) const
+   {
+      int64_t center[3];
+      getCellCoordinates(point, center);
+      int64_t range[3][2];
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         // with less than 3 cells, the neighborhood covers all cells of this direction exactly once
+         if(numCells_[i] < 3) { range[i][0] = 0; range[i][1] = int64_c(numCells_[i]) - 1; }
+         else { range[i][0] = center[i] - 1; range[i][1] = center[i] + 1; }
+      }
+      for(int64_t x = range[0][0]; x <= range[0][1]; ++x)
+      {
+         for(int64_t y = range[1][0]; y <= range[1][1]; ++y)
+         {
+            for(int64_t z = range[2][0]; z <= range[2][1]; ++z)
+            {
+               int64_t cell[3] = {x, y, z};
+               bool isValid = true;
+               for(uint_t i = 0; i < 3; ++i)
+               {
+                  if(numCells_[i] < 3) continue;
+                  const int64_t n = int64_c(numCells_[i]);
+                  if(packing_.isPeriodic[i]) cell[i] = (cell[i] + n) % n;
+                  else if(cell[i] < 0 || cell[i] >= n) isValid = false;
+               }
+               if(!isValid) continue;
+               const size_t c = size_t(cell[0]) + numCells_[0] * (size_t(cell[1]) + numCells_[1] * size_t(cell[2]));
+               for(size_t i = cellBegin_[c]; i < cellBegin_[c + 1]; ++i) func(particles_[i]);
+            }
+         }
+      }
+   }
+
+   bool isSolid(const Vec3 & point) const
+   {
+      bool isInside = false;
+      forEachParticleNear(point, [&](size_t p){ if(!isInside && packing_.isPointInside(packing_.particles[p], point)) isInside = true; });
+      return isInside;
+   }
+
+private:
+   void getCellCoordinates(const Vec3 & point, int64_t (&cell)[3]) const
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         int64_t c = int64_c(std::floor((point[i] - packing_.domain.min(i)) / cellWidth_[i]));
+         const int64_t n = int64_c(numCells_[i]);
+         if(packing_.isPeriodic[i]) c = ((c % n) + n) % n;
+         else c = std::max(int64_t(0), std::min(n - 1, c));
+         cell[i] = c;
+      }
+   }
+
+   size_t getCell(const Vec3 & point) const
+   {
+      int64_t cell[3];
+      getCellCoordinates(point, cell);
+      return size_t(cell[0]) + numCells_[0] * (size_t(cell[1]) + numCells_[1] * size_t(cell[2]));
+   }
+
+   const AnalysisPacking & packing_;
+   uint_t numCells_[3];
+   real_t cellWidth_[3];
+   std::vector<size_t> cellBegin_;
+   std::vector<size_t> particles_;
+};
+
+struct PackingAnalysisParameters
+{
+   // lengths in units of the mean volume-equivalent diameter
+   real_t rdfMaxDistance = real_t(5);
+   uint_t rdfBins = uint_t(200);
+   uint_t orientationBins = uint_t(18);
+   std::vector<real_t> porosityWindowSizes = {real_t(1), real_t(2), real_t(4), real_t(8)};
+   uint_t samplesPerDiameter = uint_t(10);
+   real_t wallProfileDistance = real_t(5);
+   real_t wallProfileBinWidth = real_t(0.05);
+   real_t surfaceMargin = real_t(2); // excluded below the bed surface, which is not resolved by the statistics
+
+   static PackingAnalysisParameters fromConfig(const Config::BlockHandle & analysisConf)
+   {
+      PackingAnalysisParameters parameters;
+      parameters.rdfMaxDistance = analysisConf.getParameter<real_t>("rdfMaxDistance", parameters.rdfMaxDistance);
+      parameters.rdfBins = analysisConf.getParameter<uint_t>("rdfBins", parameters.rdfBins);
+      parameters.orientationBins = analysisConf.getParameter<uint_t>("orientationBins", parameters.orientationBins);
+      if(analysisConf.isDefined("porosityWindowSizes"))
+      {
+         parameters.porosityWindowSizes.clear();
+         std::istringstream stream(analysisConf.getParameter<std::string>("porosityWindowSizes"));
+         real_t size;
+         while(stream >> size) parameters.porosityWindowSizes.push_back(size);
+      }
+      parameters.samplesPerDiameter = analysisConf.getParameter<uint_t>("samplesPerDiameter", parameters.samplesPerDiameter);
+      parameters.wallProfileDistance = analysisConf.getParameter<real_t>("wallProfileDistance", parameters.wallProfileDistance);
+      parameters.wallProfileBinWidth = analysisConf.getParameter<real_t>("wallProfileBinWidth", parameters.wallProfileBinWidth);
+      parameters.surfaceMargin = analysisConf.getParameter<real_t>("surfaceMargin", parameters.surfaceMargin);
+      WALBERLA_CHECK(parameters.rdfBins > 0 && parameters.orientationBins > 0 && parameters.samplesPerDiameter > 0);
+      return parameters;
+   }
+};
+
+/*
+ * Statistics of a finished packing, computed in parallel: each process evaluates every numProcesses-th
+ * particle, window or sample slice and the partial sums are reduced to root.
+ * - radial distribution function g(r) of the particle centers (centers at least rdfMaxDistance away from the bed boundaries,
+ *   thus the analyzed bed has to be higher than 2 rdfMaxDistance, otherwise g(r) is zero and a warning is issued),
+ * - distribution of |cos| of the angle between the particles' long axes and the vertical, and the orientation tensor,
+ * - mean and variance of the porosity in cubic windows of several sizes within the bed,
+ * - porosity profiles over the distance to the bottom wall and, for the container, to the side wall.
+ * All results are valid on root only.
+ */
+class PackingAnalyzer
+{
+public:
+   PackingAnalyzer(const AnalysisPacking & packing, const PackingAnalysisParameters & parameters)
+      : packing_(packing), parameters_(parameters), meanDiameter_(packing.getMeanVolumeEquivalentDiameter()),
+        bedTop_(packing.getBedHeight() - parameters.surfaceMargin * meanDiameter_),
+        grid_(packing, real_t(2) * packing.getMaxBoundingRadius()),
+        rdfGrid_(packing, std::max(real_t(2) * packing.getMaxBoundingRadius(), parameters.rdfMaxDistance * meanDiameter_)),
+        rank_(uint_c(walberla::mpi::MPIManager::instance()->rank())), numProcesses_(uint_c(walberla::mpi::MPIManager::instance()->numProcesses()))
+   {
+      WALBERLA_CHECK_GREATER(meanDiameter_, real_t(0), "Packing analysis: no particles.");
+      WALBERLA_CHECK_GREATER(bedTop_, packing.domain.zMin(), "Packing analysis: bed too shallow for the surface margin.");
+   }
+
+   real_t getMeanDiameter() const { return meanDiameter_; }
+   real_t getBedTop() const { return bedTop_; }
+
+   // collective, g(r) at the bin centers r / mean diameter
+   std::vector<double> computeRadialDistribution()
+   {
+      const real_t rMax = parameters_.rdfMaxDistance * meanDiameter_;
+      const real_t binWidth = rMax / real_c(parameters_.rdfBins);
+      std::vector<double> histogram(parameters_.rdfBins + 1, 0.0); // last entry: number of centers
+      for(size_t i = rank_; i < packing_.particles.size(); i += numProcesses_)
+      {
+         const Vec3 & center = packing_.particles[i].position;
+         if(distanceToBoundary(center) < rMax) continue;
+         histogram.back() += 1.0;
+         rdfGrid_.forEachParticleNear(center, [&](size_t j){
+            if(j == i) return;
+            const real_t distance = packing_.getDistanceVector(center, packing_.particles[j].position).length();
+            if(distance < rMax) histogram[size_t(distance / binWidth)] += 1.0;
+         });
+      }
+      walberla::mpi::reduceInplace(histogram, walberla::mpi::SUM);
+      numRdfCenters_ = uint_c(histogram.back());
+      if(numRdfCenters_ == 0)
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Packing analysis: no particle center is at least rdfMaxDistance = " << parameters_.rdfMaxDistance
+                                      << " d away from the bed boundaries, g(r) is zero. The analyzed bed height is " << (bedTop_ - packing_.domain.zMin()) / meanDiameter_
+                                      << " d, at least 2 rdfMaxDistance is required, reduce rdfMaxDistance or surfaceMargin.");
+      }
+
+      std::vector<double> rdf(parameters_.rdfBins, 0.0);
+      const double numberDensity = double(packing_.particles.size()) / double(getBedVolume(packing_.getBedHeight()));
+      for(uint_t b = 0; b < parameters_.rdfBins && histogram.back() > 0.0; ++b)
+      {
+         const double r0 = double(b) * double(binWidth);
+         const double r1 = r0 + double(binWidth);
+         const double shellVolume = 4.0 / 3.0 * math::pi * (r1 * r1 * r1 - r0 * r0 * r0);
+         rdf[b] = histogram[b] / (histogram.back() * numberDensity * shellVolume);
+      }
+      return rdf;
+   }
+
+   // collective, fraction of oriented particles per |cos(angle to vertical)| bin, followed by the orientation tensor (xx yy zz xy xz yz)
+   std::vector<double> computeOrientationDistribution()
+   {
+      std::vector<double> values(parameters_.orientationBins + 7, 0.0); // bins, tensor, count
+      for(size_t i = rank_; i < packing_.particles.size(); i += numProcesses_)
+      {
+         const auto & p = packing_.particles[i];
+         const auto & shape = packing_.shapes[p.shape];
+         if(!shape.hasOrientation) continue;
+         const Vec3 axis = p.rotation * shape.longAxis;
+         const real_t cosine = std::min(real_t(1), std::abs(axis[2]));
+         values[std::min(parameters_.orientationBins - 1, uint_c(cosine * real_c(parameters_.orientationBins)))] += 1.0;
+         const double tensor[6] = {axis[0] * axis[0], axis[1] * axis[1], axis[2] * axis[2], axis[0] * axis[1], axis[0] * axis[2], axis[1] * axis[2]};
+         for(uint_t k = 0; k < 6; ++k) values[parameters_.orientationBins + k] += tensor[k];
+         values.back() += 1.0;
+      }
+      walberla::mpi::reduceInplace(values, walberla::mpi::SUM);
+      numOriented_ = uint_c(values.back());
+      if(values.back() > 0.0)
+      {
+         for(size_t k = 0; k + 1 < values.size(); ++k) values[k] /= values.back();
+      }
+      values.pop_back();
+      return values;
+   }
+
+   uint_t getNumberOfOrientedParticles() const { return numOriented_; }
+   uint_t getNumberOfRdfCenters() const { return numRdfCenters_; }
+
+   // collective, per window size: mean porosity, porosity variance, number of windows
+   std::vector<std::array<double, 3>> computeLocalPorosityVariance()
+   {
+      std::vector<std::array<double, 3>> results;
+      const real_t spacing = meanDiameter_ / real_c(parameters_.samplesPerDiameter);
+      for(real_t relativeSize : parameters_.porosityWindowSizes)
+      {
+         const real_t size = relativeSize * meanDiameter_;
+         // windows tile the inscribed box of the bed region
+         math::AABB region = getInscribedBedBox();
+         uint_t numWindows[3];
+         for(uint_t i = 0; i < 3; ++i) numWindows[i] = uint_c(std::floor((region.max(i) - region.min(i)) / size));
+         const uint_t totalWindows = numWindows[0] * numWindows[1] * numWindows[2];
+         const uint_t samplesPerEdge = std::max(uint_t(1), uint_c(std::round(size / spacing)));
+         std::vector<double> sums(3, 0.0); // porosity, porosity^2, windows
+         for(uint_t w = rank_; w < totalWindows; w += numProcesses_)
+         {
+            const uint_t wx = w % numWindows[0];
+            const uint_t wy = (w / numWindows[0]) % numWindows[1];
+            const uint_t wz = w / (numWindows[0] * numWindows[1]);
+            const Vec3 corner = region.minCorner() + Vec3(real_c(wx), real_c(wy), real_c(wz)) * size;
+            uint_t numSolid = 0;
+            for(uint_t x = 0; x < samplesPerEdge; ++x)
+               for(uint_t y = 0; y < samplesPerEdge; ++y)
+                  for(uint_t z = 0; z < samplesPerEdge; ++z)
+                  {
+                     const Vec3 point = corner + (Vec3(real_c(x), real_c(y), real_c(z)) + Vec3(real_t(0.5))) * (size / real_c(samplesPerEdge));
+                     if(grid_.isSolid(point)) ++numSolid;
+                  }
+            const double porosity = 1.0 - double(numSolid) / double(samplesPerEdge * samplesPerEdge * samplesPerEdge);
+            sums[0] += porosity;
+            sums[1] += porosity * porosity;
+            sums[2] += 1.0;
+         }
+         walberla::mpi::reduceInplace(sums, walberla::mpi::SUM);
+         const double mean = (sums[2] > 0.0) ? sums[0] / sums[2] : 0.0;
+         const double variance = (sums[2] > 1.0) ? std::max(0.0, (sums[1] - sums[2] * mean * mean) / (sums[2] - 1.0)) : 0.0;
+         results.push_back({mean, variance, sums[2]});
+      }
+      return results;
+   }
+
+   // collective, porosity over the distance to the bottom wall, in bins of wallProfileBinWidth up to wallProfileDistance
+   std::vector<double> computeBottomWallProfile()
+   {
+      const real_t binWidth = parameters_.wallProfileBinWidth * meanDiameter_;
+      const uint_t numBins = uint_c(std::ceil(parameters_.wallProfileDistance / parameters_.wallProfileBinWidth));
+      const real_t spacing = meanDiameter_ / real_c(parameters_.samplesPerDiameter);
+      math::AABB region = getInscribedBedBox();
+      const uint_t nx = std::max(uint_t(1), uint_c((region.xMax() - region.xMin()) / spacing));
+      const uint_t ny = std::max(uint_t(1), uint_c((region.yMax() - region.yMin()) / spacing));
+      std::vector<double> solid(numBins, 0.0);
+      for(uint_t b = rank_; b < numBins; b += numProcesses_)
+      {
+         const real_t z = packing_.domain.zMin() + (real_c(b) + real_t(0.5)) * binWidth;
+         uint_t numSolid = 0;
+         for(uint_t x = 0; x < nx; ++x)
+            for(uint_t y = 0; y < ny; ++y)
+            {
+               const Vec3 point(region.xMin() + (real_c(x) + real_t(0.5)) * (region.xMax() - region.xMin()) / real_c(nx),
+                                region.yMin() + (real_c(y) + real_t(0.5)) * (region.yMax() - region.yMin()) / real_c(ny), z);
+               if(grid_.isSolid(point)) ++numSolid;
+            }
+         solid[b] = double(numSolid) / double(nx * ny);
+      }
+      walberla::mpi::reduceInplace(solid, walberla::mpi::SUM);
+      for(auto & value : solid) value = 1.0 - value;
+      return solid;
+   }
+
+   // collective, container only: porosity over the distance to the side wall
+   std::vector<double> computeSideWallProfile()
+   {
+      const real_t binWidth = parameters_.wallProfileBinWidth * meanDiameter_;
+      const uint_t numBins = uint_c(std::ceil(parameters_.wallProfileDistance / parameters_.wallProfileBinWidth));
+      const real_t spacing = meanDiameter_ / real_c(parameters_.samplesPerDiameter);
+      const real_t radius = real_t(0.5) * packing_.domain.xSize();
+      const Vec3 axis = packing_.domain.center();
+      const real_t zBegin = packing_.domain.zMin() + parameters_.wallProfileDistance * meanDiameter_;
+      const uint_t nz = std::max(uint_t(1), uint_c((bedTop_ - zBegin) / spacing));
+      std::vector<double> solid(numBins, 0.0);
+      for(uint_t b = rank_; b < numBins; b += numProcesses_)
+      {
+         const real_t r = radius - (real_c(b) + real_t(0.5)) * binWidth;
+         if(r <= real_t(0)) continue;
+         const uint_t numAngles = std::max(uint_t(8), uint_c(real_t(2) * math::pi * r / spacing));
+         uint_t numSolid = 0;
+         for(uint_t a = 0; a < numAngles; ++a)
+         {
+            const real_t angle = real_t(2) * math::pi * real_c(a) / real_c(numAngles);
+            for(uint_t z = 0; z < nz; ++z)
+            {
+               const Vec3 point(axis[0] + r * std::cos(angle), axis[1] + r * std::sin(angle), zBegin + (real_c(z) + real_t(0.5)) * (bedTop_ - zBegin) / real_c(nz));
+               if(grid_.isSolid(point)) ++numSolid;
+            }
+         }
+         solid[b] = double(numSolid) / double(numAngles * nz);
+      }
+      walberla::mpi::reduceInplace(solid, walberla::mpi::SUM);
+      for(auto & value : solid) value = 1.0 - value;
+      return solid;
+   }
+
+private:
+   // distance of a point to the bottom wall, the excluded surface region and the side wall (container)
+   real_t distanceToBoundary(const Vec3 & point) const
+   {
+      real_t distance = std::min(point[2] - packing_.domain.zMin(), bedTop_ - point[2]);
+      if(packing_.isContainer)
+      {
+         const Vec3 center = packing_.domain.center();
+         const real_t radialDistance = std::sqrt((point[0] - center[0]) * (point[0] - center[0]) + (point[1] - center[1]) * (point[1] - center[1]));
+         distance = std::min(distance, real_t(0.5) * packing_.domain.xSize() - radialDistance);
+      }
+      return distance;
+   }
+
+   real_t getBedVolume(real_t height) const
+   {
+      const real_t bedHeight = height - packing_.domain.zMin();
+      if(packing_.isContainer) return math::pi * real_t(0.25) * packing_.domain.xSize() * packing_.domain.xSize() * bedHeight;
+      return packing_.domain.xSize() * packing_.domain.ySize() * bedHeight;
+   }
+
+   // bed region without the bed surface, inscribed into the container cross section
+   math::AABB getInscribedBedBox() const
+   {
+      const real_t zMin = packing_.domain.zMin();
+      if(!packing_.isContainer) return math::AABB(packing_.domain.xMin(), packing_.domain.yMin(), zMin, packing_.domain.xMax(), packing_.domain.yMax(), bedTop_);
+      const real_t halfWidth = real_t(0.5) * packing_.domain.xSize() / std::sqrt(real_t(2));
+      const Vec3 center = packing_.domain.center();
+      return math::AABB(center[0] - halfWidth, center[1] - halfWidth, zMin, center[0] + halfWidth, center[1] + halfWidth, bedTop_);
+   }
+
+   const AnalysisPacking & packing_;
+   PackingAnalysisParameters parameters_;
+   real_t meanDiameter_;
+   real_t bedTop_;
+   AnalysisCellGrid grid_;    // point-in-particle queries
+   AnalysisCellGrid rdfGrid_; // pair distances up to rdfMaxDistance
+   uint_t rank_;
+   uint_t numProcesses_;
+   uint_t numOriented_ = 0;
+   uint_t numRdfCenters_ = 0;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,461 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   PackingTiling.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+#include "core/math/AABB.h"
+#include "core/math/Constants.h"
+#include "core/math/Random.h"
+#include "core/math/Vector3.h"
+#include "core/mpi/Broadcast.h"
+#include "core/mpi/Gatherv.h"
+#include "core/mpi/MPIManager.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/ParticleStorage.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+#include "mesa_pd/domain/IDomain.h"
+
+#include "mesh_common/TriangleMeshes.h"
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "TimeLoopConfiguration.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Final state of a packing (geometry only) for the import by the tiling mode.
+ * File layout: binary doubles, [version, domain (6), isPeriodic x/y, porosity, #shapes, shapes, #particles, particles]
+ * with shapes [0, radius] (sphere), [1, semi axes] (ellipsoid), [2, #vertices, vertices, #faces, vertex indices] (convex polyhedron)
+ * and particles [shape index, position relative to the domain minimum, rotation quaternion (r,i,j,k), interaction radius].
+ */
+struct PackingSnapshot
+{
+   static constexpr double version = 1.0;
+
+   enum ShapeType { SPHERE = 0, ELLIPSOID = 1, CONVEX_POLYHEDRON = 2 };
+
+   struct Shape
+   {
+      ShapeType type;
+      std::vector<double> parameters; // radius, semi axes or vertices
+      std::vector<uint32_t> faces;
+   };
+
+   struct Particle
+   {
+      uint32_t shape;
+      Vec3 position;
+      Quat rotation;
+      real_t interactionRadius;
+   };
+
+   math::AABB domain;
+   bool isPeriodicX = false;
+   bool isPeriodicY = false;
+   double porosity = 0.0;
+   std::vector<Shape> shapes;
+   std::vector<Particle> particles;
+
+   real_t getHeight() const
+   {
+      real_t height = real_t(0);
+      for(const auto & p : particles) height = std::max(height, p.position[2] + p.interactionRadius);
+      return height;
+   }
+};
+
+namespace internal {
+
+inline void encodeShape(const data::BaseShape & shape, std::vector<double> & buffer)
+{
+   if(shape.getShapeType() == data::Sphere::SHAPE_TYPE)
+   {
+      buffer.push_back(double(PackingSnapshot::SPHERE));
+      buffer.push_back(double(static_cast<const data::Sphere&>(shape).getRadius()));
+   } else if(shape.getShapeType() == data::Ellipsoid::SHAPE_TYPE)
+   {
+      const auto & semiAxes = static_cast<const data::Ellipsoid&>(shape).getSemiAxes();
+      buffer.push_back(double(PackingSnapshot::ELLIPSOID));
+      for(uint_t i = 0; i < 3; ++i) buffer.push_back(double(semiAxes[i]));
+   } else if(shape.getShapeType() == data::ConvexPolyhedron::SHAPE_TYPE)
+   {
+      const auto & mesh = static_cast<const data::ConvexPolyhedron&>(shape).getMesh();
+      buffer.push_back(double(PackingSnapshot::CONVEX_POLYHEDRON));
+      buffer.push_back(double(mesh.n_vertices()));
+      for(auto vh : mesh.vertices())
+      {
+         const auto & point = mesh.point(vh);
+         for(uint_t i = 0; i < 3; ++i) buffer.push_back(double(point[i]));
+      }
+      buffer.push_back(double(mesh.n_faces()));
+      for(auto fh : mesh.faces())
+      {
+         for(auto vh : mesh.fv_range(fh)) buffer.push_back(double(vh.idx()));
+      }
+   } else
+   {
+      WALBERLA_ABORT("Packing snapshot: unsupported shape type " << shape.getShapeType());
+   }
+}
+
+// parses one shape at 'pos' and advances 'pos'
+inline PackingSnapshot::Shape decodeShape(const std::vector<double> & buffer, size_t & pos)
+{
+   PackingSnapshot::Shape shape;
+   shape.type = static_cast<PackingSnapshot::ShapeType>(int(buffer[pos++]));
+   if(shape.type == PackingSnapshot::SPHERE)
+   {
+      shape.parameters.assign(buffer.begin() + int64_c(pos), buffer.begin() + int64_c(pos + 1));
+      pos += 1;
+   } else if(shape.type == PackingSnapshot::ELLIPSOID)
+   {
+      shape.parameters.assign(buffer.begin() + int64_c(pos), buffer.begin() + int64_c(pos + 3));
+      pos += 3;
+   } else
+   {
+      size_t numVertices = size_t(buffer[pos++]);
+      shape.parameters.assign(buffer.begin() + int64_c(pos), buffer.begin() + int64_c(pos + 3 * numVertices));
+      pos += 3 * numVertices;
+      size_t numFaces = size_t(buffer[pos++]);
+      for(size_t i = 0; i < 3 * numFaces; ++i) shape.faces.push_back(uint32_t(buffer[pos++]));
+   }
+   return shape;
+}
+
+} // namespace internal
+
+// collective, the file is written by the root process
+inline void writePackingSnapshot(const std::string & fileName, data::ParticleStorage & ps, const math::AABB & domain,
+                                 const Vector3<bool> & isPeriodic, real_t porosity)
+{
+   // per process: [#shapes, shapes, #particles, particles], shapes shared by several particles are stored once
+   std::vector<double> shapeBuffer;
+   std::vector<double> particleBuffer;
+   std::map<const data::BaseShape*, uint32_t> shapeIndices;
+   uint32_t numParticles = 0;
+   for(auto p : ps)
+   {
+      if(data::particle_flags::isSet(p.getFlags(), data::particle_flags::INFINITE) ||
+         data::particle_flags::isSet(p.getFlags(), data::particle_flags::GHOST)) continue;
+      auto it = shapeIndices.find(p.getBaseShape().get());
+      if(it == shapeIndices.end())
+      {
+         it = shapeIndices.emplace(p.getBaseShape().get(), uint32_t(shapeIndices.size())).first;
+         internal::encodeShape(*p.getBaseShape(), shapeBuffer);
+      }
+      Vec3 position = p.getPosition();
+      for(uint_t i = 0; i < 2; ++i)
+      {
+         const real_t length = domain.max(i) - domain.min(i);
+         if(isPeriodic[i]) position[i] -= length * std::floor((position[i] - domain.min(i)) / length);
+      }
+      const auto & q = p.getRotation().getQuaternion();
+      particleBuffer.push_back(double(it->second));
+      for(uint_t i = 0; i < 3; ++i) particleBuffer.push_back(double(position[i] - domain.min(i)));
+      for(uint_t i = 0; i < 4; ++i) particleBuffer.push_back(double(q[i]));
+      particleBuffer.push_back(double(p.getInteractionRadius()));
+      ++numParticles;
+   }
+   std::vector<double> localBuffer;
+   localBuffer.push_back(double(shapeIndices.size()));
+   localBuffer.insert(localBuffer.end(), shapeBuffer.begin(), shapeBuffer.end());
+   localBuffer.push_back(double(numParticles));
+   localBuffer.insert(localBuffer.end(), particleBuffer.begin(), particleBuffer.end());
+
+   auto gathered = walberla::mpi::gatherv(localBuffer);
+
+   WALBERLA_ROOT_SECTION()
+   {
+      // merge the per-process shape tables
+      std::vector<double> shapes;
+      std::vector<double> particles;
+      size_t numShapes = 0;
+      size_t numTotalParticles = 0;
+      size_t pos = 0;
+      while(pos < gathered.size())
+      {
+         size_t offset = numShapes;
+         size_t numLocalShapes = size_t(gathered[pos++]);
+         for(size_t s = 0; s < numLocalShapes; ++s)
+         {
+            size_t begin = pos;
+            internal::decodeShape(gathered, pos);
+            shapes.insert(shapes.end(), gathered.begin() + int64_c(begin), gathered.begin() + int64_c(pos));
+         }
+         numShapes += numLocalShapes;
+         size_t numLocalParticles = size_t(gathered[pos++]);
+         for(size_t i = 0; i < numLocalParticles; ++i)
+         {
+            particles.push_back(gathered[pos++] + double(offset));
+            particles.insert(particles.end(), gathered.begin() + int64_c(pos), gathered.begin() + int64_c(pos + 8));
+            pos += 8;
+         }
+         numTotalParticles += numLocalParticles;
+      }
+
+      std::vector<double> buffer = {PackingSnapshot::version,
+                                    double(domain.xMin()), double(domain.yMin()), double(domain.zMin()),
+                                    double(domain.xMax()), double(domain.yMax()), double(domain.zMax()),
+                                    isPeriodic[0] ? 1.0 : 0.0, isPeriodic[1] ? 1.0 : 0.0, double(porosity), double(numShapes)};
+      buffer.insert(buffer.end(), shapes.begin(), shapes.end());
+      buffer.push_back(double(numTotalParticles));
+      buffer.insert(buffer.end(), particles.begin(), particles.end());
+
+      std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+      if(!file) WALBERLA_ABORT("Could not open packing snapshot file " << fileName);
+      file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(double)));
+   }
+}
+
+// collective, read by the root process and broadcast
+inline PackingSnapshot readPackingSnapshot(const std::string & fileName)
+{
+   std::vector<double> buffer;
+   WALBERLA_ROOT_SECTION()
+   {
+      std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+      if(!file) WALBERLA_ABORT("Could not open packing snapshot file " << fileName);
+      auto size = file.tellg();
+      file.seekg(0);
+      buffer.resize(size_t(size) / sizeof(double));
+      file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(double)));
+      if(buffer.empty() || buffer[0] != PackingSnapshot::version) WALBERLA_ABORT("Unsupported packing snapshot file " << fileName);
+   }
+   walberla::mpi::broadcastObject(buffer);
+
+   PackingSnapshot snapshot;
+   snapshot.domain = math::AABB(real_c(buffer[1]), real_c(buffer[2]), real_c(buffer[3]), real_c(buffer[4]), real_c(buffer[5]), real_c(buffer[6]));
+   snapshot.isPeriodicX = buffer[7] > 0.5;
+   snapshot.isPeriodicY = buffer[8] > 0.5;
+   snapshot.porosity = buffer[9];
+   size_t pos = 10;
+   size_t numShapes = size_t(buffer[pos++]);
+   for(size_t s = 0; s < numShapes; ++s) snapshot.shapes.push_back(internal::decodeShape(buffer, pos));
+   size_t numParticles = size_t(buffer[pos++]);
+   snapshot.particles.resize(numParticles);
+   for(auto & p : snapshot.particles)
+   {
+      p.shape = uint32_t(buffer[pos]);
+      p.position = Vec3(real_c(buffer[pos+1]), real_c(buffer[pos+2]), real_c(buffer[pos+3]));
+      p.rotation = Quat(real_c(buffer[pos+4]), real_c(buffer[pos+5]), real_c(buffer[pos+6]), real_c(buffer[pos+7]));
+      p.interactionRadius = real_c(buffer[pos+8]);
+      pos += 9;
+   }
+   return snapshot;
+}
+
+struct TilingParameters
+{
+   std::string packingFile;
+   Vector3<uint_t> tiles = Vector3<uint_t>(2, 2, 1); // lateral replication (x, y) and vertical stacking (z)
+   bool randomShift = true;       // random lateral (periodic) shift per stacked layer
+   bool randomRotation = true;    // random rotation about the vertical axis per stacked layer (multiples of 90 deg for square tiles, else 180 deg)
+   real_t relaxationDuration = real_t(0.05); // upper limit of the simulated relaxation time, earlier termination by the usual convergence criteria
+   uint_t seed = uint_t(42);
+
+   static TilingParameters fromConfig(const Config::BlockHandle & tilingConf)
+   {
+      TilingParameters parameters;
+      parameters.packingFile = tilingConf.getParameter<std::string>("packingFile");
+      parameters.tiles = tilingConf.getParameter<Vector3<uint_t>>("tiles", parameters.tiles);
+      parameters.randomShift = tilingConf.getParameter<bool>("randomShift", parameters.randomShift);
+      parameters.randomRotation = tilingConf.getParameter<bool>("randomRotation", parameters.randomRotation);
+      parameters.relaxationDuration = tilingConf.getParameter<real_t>("relaxationDuration", parameters.relaxationDuration);
+      parameters.seed = tilingConf.getParameter<uint_t>("seed", parameters.seed);
+      return parameters;
+   }
+};
+
+/*
+ * Builds a large bed from a converged, horizontally periodic packing:
+ * the packing is replicated tiles[0] x tiles[1] times laterally, which is seamless due to its periodicity,
+ * and stacked tiles[2] times vertically. Each stacked layer is shifted (periodically) and rotated about the vertical axis at random,
+ * which keeps the layer periodic but avoids a vertically repeating structure. Layers are placed on top of each other without overlap,
+ * the remaining gaps (seams) are closed by a short relaxation of the bed.
+ */
+class PackingTiler
+{
+public:
+   PackingTiler(const PackingSnapshot & snapshot, const TilingParameters & parameters) : snapshot_(snapshot), parameters_(parameters)
+   {
+      if(!snapshot_.isPeriodicX || !snapshot_.isPeriodicY) WALBERLA_ABORT("Tiling requires a horizontally periodic packing.");
+      tileSize_ = Vec3(snapshot_.domain.xSize(), snapshot_.domain.ySize(), snapshot_.getHeight());
+   }
+
+   real_t getDomainWidthX() const { return real_c(parameters_.tiles[0]) * tileSize_[0]; }
+   real_t getDomainWidthY() const { return real_c(parameters_.tiles[1]) * tileSize_[1]; }
+   real_t getBedHeight() const { return real_c(parameters_.tiles[2]) * tileSize_[2]; }
+   size_t getNumberOfParticles() const { return snapshot_.particles.size() * parameters_.tiles[0] * parameters_.tiles[1] * parameters_.tiles[2]; }
+
+   // the shape family of the time loop has to support all imported shapes
+   void checkShapeFamily(ShapeFamily shapeFamily) const
+   {
+      for(const auto & shape : snapshot_.shapes)
+      {
+         bool isSupported = true;
+         if(shapeFamily == ShapeFamily::Sphere) isSupported = shape.type == PackingSnapshot::SPHERE;
+         if(shapeFamily == ShapeFamily::AnalyticEllipsoid) isSupported = shape.type != PackingSnapshot::CONVEX_POLYHEDRON;
+         if(shapeFamily == ShapeFamily::SphereClump) isSupported = shape.type == PackingSnapshot::CONVEX_POLYHEDRON;
+         if(!isSupported) WALBERLA_ABORT("Tiling: the imported packing contains shapes that are not supported by the configured particle shape.");
+      }
+   }
+
+   // creates the particles located in the local subdomain, the domain is the one of the tiled bed (minimum corner = origin of the first tile)
+   void createParticles(data::ParticleStorage & ps, const domain::IDomain & domain, const math::AABB & simulationDomain, real_t density) const
+   {
+      // shapes are shared by all copies of a particle
+      std::vector<std::shared_ptr<data::BaseShape>> shapes;
+      for(const auto & shape : snapshot_.shapes) shapes.push_back(createShape(shape, density));
+
+      // random transformation per stacked layer, identical on all processes
+      std::mt19937 gen(static_cast<unsigned long>(parameters_.seed));
+      const bool isSquare = std::abs(tileSize_[0] - tileSize_[1]) <= real_t(1e-9) * tileSize_[0];
+      const uint_t numRotations = isSquare ? 4 : 2;
+
+      for(uint_t k = 0; k < parameters_.tiles[2]; ++k)
+      {
+         Vec3 shift(real_t(0));
+         uint_t rotation = 0;
+         if(parameters_.randomShift && k > 0) shift = Vec3(math::realRandom(real_t(0), tileSize_[0], gen), math::realRandom(real_t(0), tileSize_[1], gen), real_t(0));
+         if(parameters_.randomRotation && k > 0) rotation = uint_c(math::intRandom(0, int(numRotations) - 1, gen)) * (4 / numRotations);
+         const Quat layerRotation(Vec3(real_t(0), real_t(0), real_t(1)), real_c(rotation) * real_t(0.5) * math::pi);
+
+         for(const auto & particle : snapshot_.particles)
+         {
+            Vec3 tilePosition = transform(particle.position, shift, rotation);
+            for(uint_t i = 0; i < parameters_.tiles[0]; ++i)
+            {
+               for(uint_t j = 0; j < parameters_.tiles[1]; ++j)
+               {
+                  Vec3 position = simulationDomain.minCorner() + tilePosition
+                                  + Vec3(real_c(i) * tileSize_[0], real_c(j) * tileSize_[1], real_c(k) * tileSize_[2]);
+                  if(!domain.isContainedInLocalSubdomain(position, real_t(0))) continue;
+
+                  auto p = ps.create();
+                  p->setPosition(position);
+                  p->setRotation(Rot3(layerRotation * particle.rotation));
+                  p->setBaseShape(shapes[particle.shape]);
+                  p->setInteractionRadius(particle.interactionRadius);
+                  p->setOwner(walberla::mpi::MPIManager::instance()->rank());
+                  p->setType(0);
+               }
+            }
+         }
+      }
+   }
+
+   // creates the particles of the source packing once, e.g. on root only, to compare its statistics with the ones of the tiled bed
+   void createSourceParticles(data::ParticleStorage & ps, real_t density) const
+   {
+      std::vector<std::shared_ptr<data::BaseShape>> shapes;
+      for(const auto & shape : snapshot_.shapes) shapes.push_back(createShape(shape, density));
+      for(const auto & particle : snapshot_.particles)
+      {
+         auto p = ps.create();
+         p->setPosition(particle.position);
+         p->setRotation(Rot3(particle.rotation));
+         p->setBaseShape(shapes[particle.shape]);
+         p->setInteractionRadius(particle.interactionRadius);
+         p->setOwner(walberla::mpi::MPIManager::instance()->rank());
+         p->setType(0);
+      }
+   }
+
+   const PackingSnapshot & getSnapshot() const { return snapshot_; }
+
+private:
+   // periodic shift within the tile, then rotation about the vertical tile axis by rotation x 90 deg
+   Vec3 transform(const Vec3 & position, const Vec3 & shift, uint_t rotation) const
+   {
+      Vec3 p = position + shift;
+      p[0] -= tileSize_[0] * std::floor(p[0] / tileSize_[0]);
+      p[1] -= tileSize_[1] * std::floor(p[1] / tileSize_[1]);
+      const real_t x = p[0];
+      const real_t y = p[1];
+      switch(rotation % 4)
+      {
+         case 1: p[0] = tileSize_[1] - y; p[1] = x; break;                 // only for square tiles
+         case 2: p[0] = tileSize_[0] - x; p[1] = tileSize_[1] - y; break;
+         case 3: p[0] = y; p[1] = tileSize_[0] - x; break;                 // only for square tiles
+         default: break;
+      }
+      return p;
+   }
+
+   static std::shared_ptr<data::BaseShape> createShape(const PackingSnapshot::Shape & shape, real_t density)
+   {
+      std::shared_ptr<data::BaseShape> baseShape;
+      if(shape.type == PackingSnapshot::SPHERE)
+      {
+         baseShape = std::make_shared<data::Sphere>(real_c(shape.parameters[0]));
+      } else if(shape.type == PackingSnapshot::ELLIPSOID)
+      {
+         baseShape = std::make_shared<data::Ellipsoid>(Vec3(real_c(shape.parameters[0]), real_c(shape.parameters[1]), real_c(shape.parameters[2])));
+      } else
+      {
+         mesh::TriangleMesh hull;
+         std::vector<mesh::TriangleMesh::VertexHandle> handles;
+         for(size_t v = 0; v + 2 < shape.parameters.size(); v += 3)
+         {
+            handles.push_back(hull.add_vertex(mesh::TriangleMesh::Point(real_c(shape.parameters[v]), real_c(shape.parameters[v+1]), real_c(shape.parameters[v+2]))));
+         }
+         for(size_t f = 0; f + 2 < shape.faces.size(); f += 3) hull.add_face(handles[shape.faces[f]], handles[shape.faces[f+1]], handles[shape.faces[f+2]]);
+         baseShape = std::make_shared<data::ConvexPolyhedron>(hull);
+      }
+      baseShape->updateMassAndInertia(density);
+      return baseShape;
+   }
+
+   PackingSnapshot snapshot_;
+   TilingParameters parameters_;
+   Vec3 tileSize_;
+};
+
+// total variation distance of two histograms on the same bins after normalization, 0 for identical distributions, 1 for disjoint ones
+template<typename Histogram_T>
+real_t getHistogramDistance(const Histogram_T & histogram1, const Histogram_T & histogram2)
+{
+   WALBERLA_CHECK_EQUAL(histogram1.size(), histogram2.size(), "Histograms with different binning can not be compared.");
+   real_t sum1 = real_t(0);
+   real_t sum2 = real_t(0);
+   for(size_t i = 0; i < histogram1.size(); ++i) { sum1 += real_c(histogram1[i]); sum2 += real_c(histogram2[i]); }
+   if(sum1 <= real_t(0) || sum2 <= real_t(0)) return (sum1 <= real_t(0) && sum2 <= real_t(0)) ? real_t(0) : real_t(1);
+   real_t distance = real_t(0);
+   for(size_t i = 0; i < histogram1.size(); ++i) distance += std::abs(real_c(histogram1[i]) / sum1 - real_c(histogram2[i]) / sum2);
+   return real_t(0.5) * distance;
+}
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -26,6 +26,7 @@
 #include "core/grid_generator/HCPIterator.h"
 #include "core/math/all.h"
 #include "core/timing/TimingTree.h"
+#include "core/waLBerlaBuildInfo.h"
 #include "vtk/VTKOutput.h"
 
 #include "mesa_pd/collision_detection/AnalyticContactDetection.h"
@@ -33,8 +34,6 @@
 
 #include "mesa_pd/common/ParticleFunctions.h"
 
-#include "mesa_pd/data/ContactStorage.h"
-#include "mesa_pd/data/ContactAccessor.h"
 #include "mesa_pd/data/ParticleAccessorWithBaseShape.h"
 #include "mesa_pd/data/ParticleStorage.h"
 #include "mesa_pd/data/HashGrids.h"
@@ -44,7 +43,6 @@
 #include "mesa_pd/kernel/AssocToBlock.h"
 #include "mesa_pd/kernel/InsertParticleIntoLinkedCells.h"
 #include "mesa_pd/kernel/ParticleSelector.h"
-#include "mesa_pd/kernel/DetectAndStoreContacts.h"
 #include "mesa_pd/kernel/InitContactsForHCSITS.h"
 #include "mesa_pd/kernel/InitParticlesForHCSITS.h"
 #include "mesa_pd/kernel/IntegrateParticlesHCSITS.h"
@@ -75,11 +73,35 @@
 #include <iostream>
 #include <random>
 #include <chrono>
+#include <algorithm>
+#include <map>
+#include <tuple>
 
 #include "Utility.h"
 #include "Evaluation.h"
 #include "DiameterDistribution.h"
 #include "ShapeGeneration.h"
+#include "EllipsoidContactDetection.h"
+#include "AutoTuning.h"
+#include "CompactionControl.h"
+#include "ContactNetworkEvaluation.h"
+#include "ContactPool.h"
+#include "DeltaGhostSync.h"
+#include "DistributedStatistics.h"
+#include "GeometricPrePacking.h"
+#include "MinimumImage.h"
+#include "MixedPrecisionContactDetection.h"
+#include "Multirate.h"
+#include "PackingTiling.h"
+#include "PerformanceMonitoring.h"
+#include "PermeabilityEstimation.h"
+#include "ParticleStorageLayout.h"
+#include "ProxySettling.h"
+#include "ShapeLibraryCache.h"
+#include "TimeSeriesStore.h"
+#include "SphereClumps.h"
+#include "TimeLoopConfiguration.h"
+#include "WallCells.h"
 
 namespace walberla {
 namespace mesa_pd {
@@ -188,6 +210,10 @@ void addConfigToDatabase(Config & config,
    integerProperties["numBlocksY"] = int64_c(numBlocksPerDirection[1]);
    integerProperties["numBlocksZ"] = int64_c(numBlocksPerDirection[2]);
    integerProperties["useHashGrids"] = (mainConf.getParameter<bool>("useHashGrids")) ? 1 : 0;
+   integerProperties["particleSortingSpacing"] = int64_c(mainConf.getParameter<int>("particleSortingSpacing"));
+   realProperties["linkedCellWidthFactor"] = mainConf.getParameter<double>("linkedCellWidthFactor", 1.01);
+   integerProperties["singleProcessFastPath"] = (mainConf.getParameter<bool>("singleProcessFastPath", true)) ? 1 : 0;
+   integerProperties["useAnalyticEllipsoidContact"] = (mainConf.getParameter<bool>("useAnalyticEllipsoidContact", true)) ? 1 : 0;
    integerProperties["scaleGenerationSpacingWithForm"] = (mainConf.getParameter<bool>("scaleGenerationSpacingWithForm")) ? 1 : 0;
    stringProperties["domainSetup"] = mainConf.getParameter<std::string>("domainSetup");
    stringProperties["particleDistribution"] = mainConf.getParameter<std::string>("particleDistribution");
@@ -224,6 +250,12 @@ void addConfigToDatabase(Config & config,
    const Config::BlockHandle solverDEMConf = solverConf.getBlock("DEM");
    realProperties["dem_collisionTimeNonDim"] = solverDEMConf.getParameter<double>("collisionTime") / solverConf.getParameter<double>("dt");
    realProperties["dem_poissonsRatio"] = solverDEMConf.getParameter<double>("poissonsRatio");
+   const Config::BlockHandle solverHybridConf = solverConf.getBlock("Hybrid");
+   if(solverHybridConf)
+   {
+      realProperties["hybrid_dtHCSITS"] = solverHybridConf.getParameter<double>("dtHCSITS");
+      stringProperties["hybrid_demFromPhase"] = solverHybridConf.getParameter<std::string>("demFromPhase");
+   }
 
    const Config::BlockHandle distributionConf = config.getBlock("Distribution");
    integerProperties["distribution_randomSeed"] = distributionConf.getParameter<int64_t>("randomSeed");
@@ -240,8 +272,112 @@ void addConfigToDatabase(Config & config,
    stringProperties["distribution_sievingCurve_massFractions"] = sievingConf.getParameter<std::string>("massFractions");
    integerProperties["distribution_sievingCurve_useDiscreteForm"] = (sievingConf.getParameter<bool>("useDiscreteForm")) ? 1 : 0;
 
+   const Config::BlockHandle prePackingConf = config.getBlock("PrePacking");
+   integerProperties["prePacking_enabled"] = (prePackingConf && prePackingConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(prePackingConf)
+   {
+      realProperties["prePacking_settlingStepRatio"] = prePackingConf.getParameter<double>("settlingStepRatio", 0.1);
+      realProperties["prePacking_overlapTolerance"] = prePackingConf.getParameter<double>("overlapTolerance", 0.01);
+      realProperties["prePacking_proxyRadiusScaling"] = prePackingConf.getParameter<double>("proxyRadiusScaling", 1.0);
+   }
+
+   const Config::BlockHandle tilingConf = config.getBlock("Tiling");
+   integerProperties["tiling_enabled"] = (tilingConf && tilingConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(tilingConf && tilingConf.getParameter<bool>("enabled"))
+   {
+      auto tilingParameters = TilingParameters::fromConfig(tilingConf);
+      stringProperties["tiling_packingFile"] = tilingParameters.packingFile;
+      integerProperties["tiling_tilesX"] = int64_c(tilingParameters.tiles[0]);
+      integerProperties["tiling_tilesY"] = int64_c(tilingParameters.tiles[1]);
+      integerProperties["tiling_tilesZ"] = int64_c(tilingParameters.tiles[2]);
+      integerProperties["tiling_randomShift"] = tilingParameters.randomShift ? 1 : 0;
+      integerProperties["tiling_randomRotation"] = tilingParameters.randomRotation ? 1 : 0;
+      realProperties["tiling_relaxationDuration"] = double(tilingParameters.relaxationDuration);
+      integerProperties["tiling_seed"] = int64_c(tilingParameters.seed);
+   }
+
+   const Config::BlockHandle autoTuningConf = config.getBlock("AutoTuning");
+   integerProperties["autoTuning_enabled"] = (autoTuningConf && autoTuningConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(autoTuningConf && autoTuningConf.getParameter<bool>("enabled"))
+   {
+      const auto autoTuningParameters = AutoTuningParameters::fromConfig(autoTuningConf);
+      integerProperties["autoTuning_probeSteps"] = int64_c(autoTuningParameters.probeSteps);
+      integerProperties["autoTuning_probeRounds"] = int64_c(autoTuningParameters.probeRounds);
+      stringProperties["autoTuning_cellWidthFactors"] = autoTuningConf.getParameter<std::string>("cellWidthFactors", "");
+      stringProperties["autoTuning_sortingSpacings"] = autoTuningConf.getParameter<std::string>("sortingSpacings", "");
+   }
+
+   const Config::BlockHandle ghostSyncConf = config.getBlock("GhostSync");
+   integerProperties["deltaSync_enabled"] = (ghostSyncConf && ghostSyncConf.getParameter<bool>("deltaSync")) ? 1 : 0;
+   integerProperties["ghostSync_leanLayout"] = (ghostSyncConf && ghostSyncConf.getParameter<bool>("leanLayout", false)) ? 1 : 0;
+   if(ghostSyncConf && (ghostSyncConf.getParameter<bool>("deltaSync") || ghostSyncConf.getParameter<bool>("leanLayout", false)))
+   {
+      auto ghostSyncParameters = DeltaGhostSyncParameters::fromConfig(ghostSyncConf);
+      realProperties["deltaSync_skin"] = double(ghostSyncParameters.skin);
+      integerProperties["deltaSync_maxStepsBetweenFullSyncs"] = int64_c(ghostSyncParameters.maxStepsBetweenFullSyncs);
+      realProperties["deltaSync_positionResolution"] = double(ghostSyncParameters.positionResolution);
+      realProperties["deltaSync_velocityResolution"] = double(ghostSyncParameters.velocityResolution);
+      realProperties["deltaSync_rotationResolution"] = double(ghostSyncParameters.rotationResolution);
+   }
+
+   const Config::BlockHandle multirateConf = config.getBlock("Multirate");
+   integerProperties["multirate_enabled"] = (multirateConf && multirateConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(multirateConf && multirateConf.getParameter<bool>("enabled"))
+   {
+      auto multirateParameters = MultirateParameters::fromConfig(multirateConf);
+      integerProperties["multirate_requestedSubcycles"] = int64_c(multirateParameters.numSubcycles);
+      realProperties["multirate_safetyFactor"] = double(multirateParameters.safetyFactor);
+   }
+
+   const Config::BlockHandle mixedPrecisionConf = config.getBlock("MixedPrecision");
+   integerProperties["mixedPrecision_enabled"] = (mixedPrecisionConf && mixedPrecisionConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(mixedPrecisionConf && mixedPrecisionConf.getParameter<bool>("enabled"))
+   {
+      auto mixedPrecisionParameters = MixedPrecisionParameters::fromConfig(mixedPrecisionConf);
+      realProperties["mixedPrecision_relativeMargin"] = double(mixedPrecisionParameters.relativeMargin);
+      integerProperties["mixedPrecision_validate"] = mixedPrecisionParameters.validate ? 1 : 0;
+   }
+
+   const Config::BlockHandle permeabilityConf = config.getBlock("Permeability");
+   integerProperties["permeability_enabled"] = (permeabilityConf && permeabilityConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(permeabilityConf && permeabilityConf.getParameter<bool>("enabled"))
+   {
+      auto permeabilityParameters = PermeabilityParameters::fromConfig(permeabilityConf);
+      realProperties["permeability_cellSize"] = double(permeabilityParameters.cellSize);
+      realProperties["permeability_relaxationTime"] = double(permeabilityParameters.relaxationTime);
+      realProperties["permeability_forceDensity"] = double(permeabilityParameters.forceDensity);
+      integerProperties["permeability_maxTimesteps"] = int64_c(permeabilityParameters.maxTimesteps);
+      realProperties["permeability_convergenceThreshold"] = double(permeabilityParameters.convergenceThreshold);
+      realProperties["permeability_evaluationRegionBegin"] = double(permeabilityParameters.evaluationRegionBegin);
+      realProperties["permeability_evaluationRegionEnd"] = double(permeabilityParameters.evaluationRegionEnd);
+   }
+
    const Config::BlockHandle shapeConf = config.getBlock("Shape");
    stringProperties["shape_scaleMode"] = shapeConf.getParameter<std::string>("scaleMode");
+   integerProperties["shape_useShapeCache"] = (shapeConf.getParameter<bool>("useShapeCache", false)) ? 1 : 0;
+   const Config::BlockHandle hullSimplificationConf = shapeConf.getBlock("HullSimplification");
+   if(hullSimplificationConf)
+   {
+      integerProperties["shape_hullSimplification_targetNumberOfVertices"] = int64_c(hullSimplificationConf.getParameter<uint_t>("targetNumberOfVertices"));
+      realProperties["shape_hullSimplification_maxRelativeHausdorffError"] = double(hullSimplificationConf.getParameter<real_t>("maxRelativeHausdorffError"));
+   }
+   const Config::BlockHandle sphereClumpsConf = shapeConf.getBlock("SphereClumps");
+   integerProperties["shape_sphereClumps_enabled"] = (sphereClumpsConf && sphereClumpsConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(sphereClumpsConf)
+   {
+      integerProperties["shape_sphereClumps_maxNumberOfSpheres"] = int64_c(sphereClumpsConf.getParameter<uint_t>("maxNumberOfSpheres", 32));
+      realProperties["shape_sphereClumps_maxVolumeError"] = sphereClumpsConf.getParameter<double>("maxVolumeError", 0.1);
+      realProperties["shape_sphereClumps_maxSurfaceError"] = sphereClumpsConf.getParameter<double>("maxSurfaceError", 0.02);
+   }
+   const Config::BlockHandle proxySettlingConf = shapeConf.getBlock("ProxySettling");
+   integerProperties["shape_proxySettling_enabled"] = (proxySettlingConf && proxySettlingConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(proxySettlingConf)
+   {
+      stringProperties["shape_proxySettling_proxy"] = proxySettlingConf.getParameter<std::string>("proxy");
+      stringProperties["shape_proxySettling_switchPhase"] = proxySettlingConf.getParameter<std::string>("switchPhase");
+      realProperties["shape_proxySettling_relaxationDuration"] = proxySettlingConf.getParameter<double>("relaxationDuration");
+      realProperties["shape_proxySettling_relaxationVelocityLimit"] = proxySettlingConf.getParameter<double>("relaxationVelocityLimit");
+   }
 
    const Config::BlockHandle ellipsoidConf = shapeConf.getBlock("Ellipsoid");
    Vec3 ellipsoid_semiAxes = ellipsoidConf.getParameter< Vec3 >("semiAxes");
@@ -269,6 +405,11 @@ void addConfigToDatabase(Config & config,
    const Config::BlockHandle evaluationConf = config.getBlock("evaluation");
    stringProperties["evaluation_histogramBins"] = evaluationConf.getParameter<std::string>("histogramBins");
    realProperties["evaluation_layerHeight"] = evaluationConf.getParameter<real_t>("layerHeight");
+   integerProperties["evaluation_contactNetwork"] = evaluationConf.getParameter<bool>("contactNetwork", false) ? 1 : 0;
+   const Config::BlockHandle timeSeriesConf = evaluationConf.getBlock("TimeSeries");
+   integerProperties["evaluation_timeSeries"] = (timeSeriesConf && timeSeriesConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(timeSeriesConf && timeSeriesConf.getParameter<bool>("enabled"))
+      stringProperties["evaluation_timeSeries_format"] = TimeSeriesParameters::fromConfig(timeSeriesConf).format;
 
    integerProperties["shaking"] = (mainConf.getParameter<bool>("shaking")) ? 1 : 0;
    const Config::BlockHandle shakingConf = config.getBlock("Shaking");
@@ -276,6 +417,19 @@ void addConfigToDatabase(Config & config,
    realProperties["shaking_period"] = shakingConf.getParameter<double>("period");
    realProperties["shaking_duration"] = shakingConf.getParameter<double>("duration");
    integerProperties["shaking_activeFromBeginning"] = (shakingConf.getParameter<bool>("activeFromBeginning")) ? 1 : 0;
+   const Config::BlockHandle compactionControlConf = shakingConf.getBlock("CompactionControl");
+   integerProperties["shaking_control_enabled"] = (compactionControlConf && compactionControlConf.getParameter<bool>("enabled")) ? 1 : 0;
+   if(compactionControlConf && compactionControlConf.getParameter<bool>("enabled"))
+   {
+      auto controlParameters = CompactionControlParameters::fromConfig(compactionControlConf);
+      realProperties["shaking_control_rateThreshold"] = double(controlParameters.rateThreshold);
+      integerProperties["shaking_control_windowPeriods"] = int64_c(controlParameters.windowPeriods);
+      realProperties["shaking_control_minDuration"] = double(controlParameters.minDuration);
+      realProperties["shaking_control_maxDuration"] = double(controlParameters.maxDuration);
+      integerProperties["shaking_control_annealing"] = controlParameters.annealing ? 1 : 0;
+      realProperties["shaking_control_annealingFactor"] = double(controlParameters.annealingFactor);
+      realProperties["shaking_control_minAmplitudeRatio"] = double(controlParameters.minAmplitudeRatio);
+   }
 
 }
 
@@ -309,6 +463,7 @@ public:
  * Simulation process:
  * - Generation phase: continuous generation in upper part of domain and settling due to gravity
  * - Shaking phase (optional, can also be active during generation phase): Shaking in a horizontal direction to compactify packing
+ *   for a fixed duration or, with compaction control, until the estimated porosity has plateaued
  * - Termination phase: Run until converged state is reached
  *
  * See corresponding publication by C. Rettinger for more infos
@@ -351,6 +506,13 @@ int main(int argc, char **argv) {
    real_t infoSpacingInSeconds = mainConf.getParameter<real_t>("infoSpacing");
    real_t loggingSpacingInSeconds = mainConf.getParameter<real_t>("loggingSpacing");
    Vector3<uint_t> numBlocksPerDirection = mainConf.getParameter< Vector3<uint_t> >("numBlocksPerDirection");
+   // on a single process, the block/ghost machinery is replaced by periodic wrapping and minimum image evaluation (see MinimumImage.h)
+   bool useSingleProcessFastPath = mainConf.getParameter<bool>("singleProcessFastPath", true) && walberla::mpi::MPIManager::instance()->numProcesses() == 1;
+   if(useSingleProcessFastPath)
+   {
+      WALBERLA_LOG_INFO_ON_ROOT("Single process: using one block with minimum image periodicity instead of ghost particles");
+      numBlocksPerDirection = Vector3<uint_t>(1);
+   }
    real_t terminalVelocity = mainConf.getParameter<real_t>("terminalVelocity");
    real_t terminalRelativeHeightChange = mainConf.getParameter<real_t>("terminalRelativeHeightChange");
    real_t terminationCheckingSpacing = mainConf.getParameter<real_t>("terminationCheckingSpacing");
@@ -358,10 +520,13 @@ int main(int argc, char **argv) {
    real_t velocityDampingCoefficient = mainConf.getParameter<real_t>("velocityDampingCoefficient");
 
    bool useHashGrids = mainConf.getParameter<bool>("useHashGrids");
+   bool useAnalyticEllipsoidContact = mainConf.getParameter<bool>("useAnalyticEllipsoidContact", true);
 
    std::string solver = mainConf.getParameter<std::string>("solver");
 
    int particleSortingSpacing = mainConf.getParameter< int >("particleSortingSpacing");
+   real_t linkedCellWidthFactor = mainConf.getParameter<real_t>("linkedCellWidthFactor", 1.01_r); // relative to the max. particle diameter
+   WALBERLA_CHECK_GREATER_EQUAL(linkedCellWidthFactor, 1_r, "The linked cells width has to cover the max. particle diameter.");
 
 
    const Config::BlockHandle solverConf = cfg->getBlock("Solver");
@@ -370,9 +535,23 @@ int main(int argc, char **argv) {
    real_t frictionCoefficientStatic = solverConf.getParameter<real_t>("frictionCoefficientStatic");
    real_t coefficientOfRestitution = solverConf.getParameter<real_t>("coefficientOfRestitution");
 
-   uint_t visSpacing = uint_c(visSpacingInSeconds / dt);
-   uint_t infoSpacing = uint_c(infoSpacingInSeconds / dt);
-   uint_t loggingSpacing = uint_c(loggingSpacingInSeconds / dt);
+   // Hybrid: HCSITS (with its own, larger time step size) during generation, DEM afterwards
+   bool isHybrid = (solver == "Hybrid");
+   real_t hcsits_dt = dt;
+   std::string hybrid_demFromPhase = "shaking";
+   if(isHybrid)
+   {
+      const Config::BlockHandle solverHybridConf = solverConf.getBlock("Hybrid");
+      hcsits_dt = solverHybridConf.getParameter<real_t>("dtHCSITS");
+      hybrid_demFromPhase = solverHybridConf.getParameter<std::string>("demFromPhase");
+      WALBERLA_CHECK(hybrid_demFromPhase == "shaking" || hybrid_demFromPhase == "damping", "Unknown phase " << hybrid_demFromPhase << " for switching to DEM.");
+      WALBERLA_LOG_INFO_ON_ROOT("Hybrid solver: HCSITS with dt = " << hcsits_dt << " s until " << hybrid_demFromPhase << " phase, then DEM with dt = " << dt << " s.");
+   }
+   real_t initialDt = isHybrid ? hcsits_dt : dt;
+
+   uint_t visSpacing = uint_c(visSpacingInSeconds / initialDt);
+   uint_t infoSpacing = uint_c(infoSpacingInSeconds / initialDt);
+   uint_t loggingSpacing = uint_c(loggingSpacingInSeconds / initialDt);
    WALBERLA_LOG_INFO_ON_ROOT("VTK spacing = " << visSpacing << ", info spacing = " << infoSpacing << ", logging spacing = " << loggingSpacing);
 
    const Config::BlockHandle solverHCSITSConf = solverConf.getBlock("HCSITS");
@@ -393,6 +572,8 @@ int main(int argc, char **argv) {
    real_t shaking_period = shakingConf.getParameter<real_t>("period");
    real_t shaking_duration = shakingConf.getParameter<real_t>("duration");
    bool shaking_activeFromBeginning = shakingConf.getParameter<bool>("activeFromBeginning");
+   const Config::BlockHandle compactionControlConf = shakingConf.getBlock("CompactionControl");
+   bool useCompactionControl = shaking && compactionControlConf && compactionControlConf.getParameter<bool>("enabled");
 
    const Config::BlockHandle evaluationConf = cfg->getBlock("evaluation");
    auto evaluationHistogramBins = parseStringToVector<real_t>(evaluationConf.getParameter<std::string>("histogramBins"));
@@ -402,14 +583,107 @@ int main(int argc, char **argv) {
    std::string vtkOutputFolder = evaluationConf.getParameter<std::string>("vtkFolder");
    std::string vtkFinalFolder = evaluationConf.getParameter<std::string>("vtkFinalFolder");
    std::string sqlDBFileName = evaluationConf.getParameter<std::string>("sqlDBFileName");
+   bool writePackingSnapshotFile = evaluationConf.getParameter<bool>("writePackingSnapshot", false);
+
+   // benchmark mode: run a fixed number of time steps and store throughput of the main kernels
+   const Config::BlockHandle benchmarkConf = cfg->getBlock("Benchmark");
+   uint_t benchmarkTimeSteps = (benchmarkConf) ? benchmarkConf.getParameter<uint_t>("timeSteps") : uint_t(0);
+   std::string benchmarkScenario = (benchmarkConf) ? benchmarkConf.getParameter<std::string>("scenario") : std::string("");
+   if(benchmarkTimeSteps > 0) WALBERLA_LOG_INFO_ON_ROOT("Benchmark mode: running scenario '" << benchmarkScenario << "' for " << benchmarkTimeSteps << " time steps.");
+
+   const Config::BlockHandle profilingConf = cfg->getBlock("Profiling");
+   bool profiling_useCounters = (profilingConf) ? profilingConf.getParameter<bool>("counters") : false;
+   real_t profiling_reportSpacingInSeconds = (profilingConf) ? profilingConf.getParameter<real_t>("reportSpacing") : real_t(0);
+   int profiling_traceSpacing = (profilingConf) ? profilingConf.getParameter<int>("traceSpacing") : 0;
+   uint_t profiling_reportSpacing = uint_c(std::max(real_t(0), profiling_reportSpacingInSeconds) / initialDt);
 
    const Config::BlockHandle shapeConf = cfg->getBlock("Shape");
    ScaleMode shapeScaleMode = str_to_scaleMode(shapeConf.getParameter<std::string>("scaleMode"));
+   bool useShapeCache = shapeConf.getParameter<bool>("useShapeCache", false);
+   std::string shapeCacheFile = shapeConf.getParameter<std::string>("cacheFile", "");
+   HullSimplificationParameters hullSimplification;
+   const Config::BlockHandle hullSimplificationConf = shapeConf.getBlock("HullSimplification");
+   if(hullSimplificationConf)
+   {
+      hullSimplification.targetNumberOfVertices = hullSimplificationConf.getParameter<uint_t>("targetNumberOfVertices");
+      hullSimplification.maxRelativeError = hullSimplificationConf.getParameter<real_t>("maxRelativeHausdorffError");
+      if(hullSimplification.isActive() && !useShapeCache) WALBERLA_LOG_WARNING_ON_ROOT("Hull simplification requires the shape cache (Shape.useShapeCache), using original meshes.");
+   }
+   // tiling mode: the bed is built from a converged periodic packing instead of being generated, see PackingTiling.h
+   const Config::BlockHandle tilingConf = cfg->getBlock("Tiling");
+   bool useTiling = tilingConf && tilingConf.getParameter<bool>("enabled");
+   TilingParameters tilingParameters;
+   std::unique_ptr<PackingTiler> packingTiler;
+   real_t domainWidthY = domainWidth;
+   if(useTiling)
+   {
+      WALBERLA_CHECK(domainSetup == "periodic", "Tiling requires the periodic domain setup.");
+      tilingParameters = TilingParameters::fromConfig(tilingConf);
+      packingTiler = std::make_unique<PackingTiler>(readPackingSnapshot(tilingParameters.packingFile), tilingParameters);
+      domainWidth = packingTiler->getDomainWidthX();
+      domainWidthY = packingTiler->getDomainWidthY();
+      domainHeight = std::max(domainHeight, 1.1_r * packingTiler->getBedHeight());
+      WALBERLA_LOG_INFO_ON_ROOT("Tiling: " << packingTiler->getSnapshot().particles.size() << " particles from " << tilingParameters.packingFile << " replicated "
+                                << tilingParameters.tiles[0] << " x " << tilingParameters.tiles[1] << " x " << tilingParameters.tiles[2]
+                                << " times to a bed of " << domainWidth << " x " << domainWidthY << " x " << packingTiler->getBedHeight() << " m");
+      if(shaking)
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Shaking is not available in tiling mode, the tiled bed is only relaxed.");
+         shaking = false;
+         useCompactionControl = false;
+      }
+   }
+
+   // multi-fidelity settling: particles are simulated as proxies (sphere or equivalent ellipsoid) until the given phase, then as meshes
+   const Config::BlockHandle proxySettlingConf = shapeConf.getBlock("ProxySettling");
+   bool useProxySettling = proxySettlingConf && proxySettlingConf.getParameter<bool>("enabled");
+   ProxyType proxyType = ProxyType::Sphere;
+   std::string proxy_switchPhase = "shaking";
+   real_t proxy_relaxationDuration = real_t(0);
+   real_t proxy_relaxationVelocityLimit = real_t(0);
+   if(useProxySettling && useTiling)
+   {
+      WALBERLA_LOG_WARNING_ON_ROOT("Proxy settling is not available in tiling mode, the imported shapes are used throughout.");
+      useProxySettling = false;
+   }
+   if(useProxySettling)
+   {
+      if(!useShapeCache || !(particleShape == "UnscaledMeshesPerFraction" || (particleShape == "Mesh" && shapeScaleMode == ScaleMode::sphereEquivalent)))
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Proxy settling requires the shape cache and Mesh (sphereEquivalent) or UnscaledMeshesPerFraction shapes, simulating the original shapes throughout.");
+         useProxySettling = false;
+      } else
+      {
+         proxyType = proxyTypeFromString(proxySettlingConf.getParameter<std::string>("proxy"));
+         proxy_switchPhase = proxySettlingConf.getParameter<std::string>("switchPhase");
+         WALBERLA_CHECK(proxy_switchPhase == "shaking" || proxy_switchPhase == "damping", "Unknown phase " << proxy_switchPhase << " for switching to meshes.");
+         proxy_relaxationDuration = proxySettlingConf.getParameter<real_t>("relaxationDuration");
+         proxy_relaxationVelocityLimit = proxySettlingConf.getParameter<real_t>("relaxationVelocityLimit");
+         WALBERLA_LOG_INFO_ON_ROOT("Proxy settling: " << proxySettlingConf.getParameter<std::string>("proxy") << " proxies until " << proxy_switchPhase
+                                   << " phase, then meshes with relaxation for " << proxy_relaxationDuration << " s.");
+      }
+   }
+   // contact detection on rigid sphere clumps instead of GJK/EPA on the hulls
+   const Config::BlockHandle sphereClumpsConf = shapeConf.getBlock("SphereClumps");
+   bool useSphereClumps = sphereClumpsConf && sphereClumpsConf.getParameter<bool>("enabled");
+   SphereClumpParameters sphereClumpParameters;
+   if(useSphereClumps)
+   {
+      if(!useShapeCache || !(particleShape == "UnscaledMeshesPerFraction" || (particleShape == "Mesh" && shapeScaleMode == ScaleMode::sphereEquivalent)))
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Sphere clumps require the shape cache and Mesh (sphereEquivalent) or UnscaledMeshesPerFraction shapes, using GJK/EPA on the meshes.");
+         useSphereClumps = false;
+      } else
+      {
+         sphereClumpParameters = SphereClumpParameters::fromConfig(sphereClumpsConf);
+      }
+   }
+   auto shapeFamily = useSphereClumps ? ShapeFamily::SphereClump : shapeFamilyFromString(particleShape, useAnalyticEllipsoidContact);
    const Config::BlockHandle distributionConf = cfg->getBlock("Distribution");
 
    /// BlockForest
-   math::AABB simulationDomain(-0.5_r*domainWidth, -0.5_r*domainWidth, 0_r,
-                               0.5_r*domainWidth, 0.5_r*domainWidth, domainHeight);
+   math::AABB simulationDomain(-0.5_r*domainWidth, -0.5_r*domainWidthY, 0_r,
+                               0.5_r*domainWidth, 0.5_r*domainWidthY, domainHeight);
    Vector3<bool> isPeriodic = (domainSetup == "container") ? Vector3<bool>(false) : Vector3<bool>(true, true, false);
 
    WALBERLA_LOG_INFO_ON_ROOT("Creating domain of size " << simulationDomain);
@@ -419,12 +693,16 @@ int main(int argc, char **argv) {
 
    /// MESAPD Data
    auto particleStorage = std::make_shared<data::ParticleStorage>(1);
-   auto contactStorage = std::make_shared<data::ContactStorage>(1);
+   // refilled in each time step, keeps its capacity and only holds the HCSITS properties if required, see ContactPool
+   auto contactStorage = std::make_shared<ContactPool>(isHybrid || solver == "HCSITS");
    data::ParticleAccessorWithBaseShape particleAccessor(particleStorage);
-   data::ContactAccessor contactAccessor(contactStorage);
+   ContactPoolAccessor contactAccessor(contactStorage);
 
    // configure shape creation
+   ShapeLibraryCache shapeLibraryCache;
    shared_ptr<ShapeGenerator> shapeGenerator;
+   shared_ptr<ProxyMeshesGenerator> proxyMeshesGenerator;
+   std::unique_ptr<SphereClumpLibrary> sphereClumpLibrary;
    if(particleShape == "Sphere")
    {
       shapeGenerator = make_shared<SphereGenerator>();
@@ -441,7 +719,15 @@ int main(int argc, char **argv) {
       std::string meshPath = ellipsoidConfig.getParameter<std::string>("path");
 
       auto meshFileNames = getMeshFilesFromPath(meshPath);
-      auto semiAxes = extractSemiAxesFromMeshFiles(meshFileNames);
+      std::vector<Vec3> semiAxes;
+      if(useShapeCache)
+      {
+         shapeLibraryCache.load(shapeCacheFile, meshFileNames);
+         semiAxes = shapeLibraryCache.getSemiAxes(meshFileNames);
+      } else
+      {
+         semiAxes = extractSemiAxesFromMeshFiles(meshFileNames);
+      }
       shared_ptr<NormalizedFormGenerator> normalizedFormGenerator = make_shared<SampleFormGenerator>(semiAxes, shapeScaleMode);
 
       shapeGenerator = make_shared<EllipsoidGenerator>(normalizedFormGenerator);
@@ -463,9 +749,23 @@ int main(int argc, char **argv) {
       std::string meshPath = meshConfig.getParameter<std::string>("path");
 
       auto meshFileNames = getMeshFilesFromPath(meshPath);
-      shared_ptr<NormalizedFormGenerator> normalizedFormGenerator = make_shared<ConstFormGenerator>();
-
-      shapeGenerator = make_shared<MeshesGenerator>(meshFileNames, shapeScaleMode, normalizedFormGenerator);
+      if(useShapeCache && shapeScaleMode == ScaleMode::sphereEquivalent)
+      {
+         shapeLibraryCache.load(shapeCacheFile, meshFileNames, hullSimplification);
+         if(useSphereClumps) sphereClumpLibrary = std::make_unique<SphereClumpLibrary>(shapeLibraryCache, meshFileNames, sphereClumpParameters);
+         if(useProxySettling)
+         {
+            proxyMeshesGenerator = make_shared<ProxyMeshesGenerator>(proxyType, shapeLibraryCache, meshFileNames);
+            shapeGenerator = proxyMeshesGenerator;
+         } else
+         {
+            shapeGenerator = make_shared<CachedMeshesGenerator>(shapeLibraryCache, meshFileNames);
+         }
+      } else
+      {
+         shared_ptr<NormalizedFormGenerator> normalizedFormGenerator = make_shared<ConstFormGenerator>();
+         shapeGenerator = make_shared<MeshesGenerator>(meshFileNames, shapeScaleMode, normalizedFormGenerator);
+      }
    } else if(particleShape == "MeshFormDistribution")
    {
       auto meshConfig = shapeConf.getBlock("MeshFormDistribution");
@@ -476,12 +776,38 @@ int main(int argc, char **argv) {
       auto flatnessStdDev = meshConfig.getParameter<real_t>("flatnessStdDev");
 
       auto meshFileNames = getMeshFilesFromPath(meshPath);
+      if(hullSimplification.isActive()) WALBERLA_LOG_WARNING_ON_ROOT("Hull simplification is not available for MeshFormDistribution, using original meshes.");
       shared_ptr<NormalizedFormGenerator> normalizedFormGenerator = make_shared<DistributionFormGenerator>(elongationMean, elongationStdDev, flatnessMean, flatnessStdDev, shapeScaleMode);
 
       shapeGenerator = make_shared<MeshesGenerator>(meshFileNames, shapeScaleMode, normalizedFormGenerator);
    } else if(particleShape == "UnscaledMeshesPerFraction")
    {
-      shapeGenerator = make_shared<UnscaledMeshesPerFractionGenerator>(shapeConf,  parseStringToVector<real_t>(distributionConf.getBlock("DiameterMassFractions").getParameter<std::string>("massFractions")));
+      auto massFractions = parseStringToVector<real_t>(distributionConf.getBlock("DiameterMassFractions").getParameter<std::string>("massFractions"));
+      if(useShapeCache)
+      {
+         std::string meshFolder = shapeConf.getBlock("UnscaledMeshesPerFraction").getParameter<std::string>("folder");
+         std::vector<std::vector<std::string>> meshFileNamesPerFraction(massFractions.size());
+         std::vector<std::string> allMeshFileNames;
+         for(uint_t i = 0; i < massFractions.size(); ++i)
+         {
+            if(massFractions[i] <= real_t(0)) continue;
+            meshFileNamesPerFraction[i] = getMeshFilesFromPath(meshFolder + "/" + std::to_string(i));
+            allMeshFileNames.insert(allMeshFileNames.end(), meshFileNamesPerFraction[i].begin(), meshFileNamesPerFraction[i].end());
+         }
+         shapeLibraryCache.load(shapeCacheFile, allMeshFileNames, hullSimplification);
+         if(useSphereClumps) sphereClumpLibrary = std::make_unique<SphereClumpLibrary>(shapeLibraryCache, allMeshFileNames, sphereClumpParameters);
+         if(useProxySettling)
+         {
+            proxyMeshesGenerator = make_shared<ProxyMeshesGenerator>(proxyType, shapeLibraryCache, meshFileNamesPerFraction, massFractions);
+            shapeGenerator = proxyMeshesGenerator;
+         } else
+         {
+            shapeGenerator = make_shared<CachedMeshesGenerator>(shapeLibraryCache, meshFileNamesPerFraction, massFractions);
+         }
+      } else
+      {
+         shapeGenerator = make_shared<UnscaledMeshesPerFractionGenerator>(shapeConf, massFractions);
+      }
    } else
    {
       WALBERLA_ABORT("Unknown shape " << particleShape);
@@ -490,6 +816,15 @@ int main(int argc, char **argv) {
    WALBERLA_LOG_INFO_ON_ROOT(" - maximum diameter scaling of " << shapeGenerator->getMaxDiameterScalingFactor());
    WALBERLA_LOG_INFO_ON_ROOT(" - normal volume " << shapeGenerator->getNormalVolume());
    WALBERLA_LOG_INFO_ON_ROOT(" - " << (shapeGenerator->generatesSingleShape() ? "single shape" : "multiple shapes"));
+   if(useSphereClumps)
+   {
+      WALBERLA_LOG_INFO_ON_ROOT(" - sphere clumps for contact detection with on average " << sphereClumpLibrary->getAverageNumberOfSpheres() << " spheres, volume error "
+                                << sphereClumpLibrary->getAverageVolumeError() << ", surface error " << sphereClumpLibrary->getAverageSurfaceError());
+   }
+
+   // all ellipsoid shape modes only contain ellipsoids and boundaries -> dedicated contact detection instead of GJK/EPA
+   bool useEllipsoidContactDetection = useAnalyticEllipsoidContact && particleShape.find("Ellipsoid") != std::string::npos;
+   if(useEllipsoidContactDetection) WALBERLA_LOG_INFO_ON_ROOT("Using analytic ellipsoid contact detection.");
 
    // configure size creation
    int randomSeedFromConfig = distributionConf.getParameter<int>("randomSeed");
@@ -613,24 +948,29 @@ int main(int argc, char **argv) {
    if(domainSetup == "periodic")
    {
       // avoid that two large particles are next to each other and would, due to periodic mapping, have 2 different contact points with each other |( p1 () p2 ()| p1  )
-      maximumAllowedInteractionRadius = 0.25_r * domainWidth; // max diameter = domainWidth / 2
+      maximumAllowedInteractionRadius = 0.25_r * std::min(domainWidth, domainWidthY); // max diameter = domainWidth / 2
       WALBERLA_LOG_INFO_ON_ROOT("Periodic case: the maximum interaction radius is restricted to " << maximumAllowedInteractionRadius << " to ensure valid periodic interaction" );
-      if(numBlocksPerDirection[0] < 3 || numBlocksPerDirection[1] < 3) WALBERLA_LOG_INFO_ON_ROOT("Warning: At least 3 blocks per periodic direction required for proper simulation!")
+      if(!useSingleProcessFastPath && (numBlocksPerDirection[0] < 3 || numBlocksPerDirection[1] < 3)) WALBERLA_LOG_INFO_ON_ROOT("Warning: At least 3 blocks per periodic direction required for proper simulation!")
    }
 
    // fill domain with particles initially
    real_t maxGenerationHeight = simulationDomain.zMax() - generationSpacing;
    real_t minGenerationHeight = generationSpacing;
    ParticleCreator particleCreator(particleStorage, domain, simulationDomain, domainSetup, particleDensity, scaleGenerationSpacingWithForm);
-   particleCreator.createParticles(std::max(minGenerationHeight, initialGenerationHeightRatioStart * simulationDomain.zMax()),
-                                   std::min(maxGenerationHeight, initialGenerationHeightRatioEnd * simulationDomain.zMax()),
-                                   generationSpacing, diameterGenerator, shapeGenerator, initialVelocity, maximumAllowedInteractionRadius );
-
-   math::DistributedSample diameterSample;
-   particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                    [&diameterSample](const size_t idx, data::ParticleAccessorWithBaseShape& ac){diameterSample.insert(real_c(2)*ac.getInteractionRadius(idx));}, particleAccessor);
+   if(useTiling)
+   {
+      packingTiler->checkShapeFamily(shapeFamily);
+      packingTiler->createParticles(*particleStorage, *domain, simulationDomain, particleDensity);
+   } else
+   {
+      particleCreator.createParticles(std::max(minGenerationHeight, initialGenerationHeightRatioStart * simulationDomain.zMax()),
+                                      std::min(maxGenerationHeight, initialGenerationHeightRatioEnd * simulationDomain.zMax()),
+                                      generationSpacing, diameterGenerator, shapeGenerator, initialVelocity, maximumAllowedInteractionRadius );
+   }
 
-   diameterSample.mpiAllGather();
+   // fixed-size sketch instead of gathering the diameters of all particles on all processes
+   auto diameterSample = evaluateDistributedQuantileSketch(*particleStorage, kernel::SelectLocal(), particleAccessor,
+                                                           [](const size_t idx, data::ParticleAccessorWithBaseShape& ac){ return real_c(2)*ac.getInteractionRadius(idx); });
    WALBERLA_LOG_INFO_ON_ROOT("Statistics of initially created particles' interaction diameters: " << diameterSample.format());
 
    real_t maxParticleDiameter = maxGenerationParticleDiameter * shapeGenerator->getMaxDiameterScalingFactor();
@@ -649,34 +989,141 @@ int main(int argc, char **argv) {
 
    WALBERLA_LOG_INFO_ON_ROOT("Sync info: maximum expected interaction diameter = " << maxParticleDiameter << " and smallest block size = " << smallestBlockSize);
 
+   // delta ghost sync: the ghost layer is built with an additional skin and only rebuilt when required, in between only changed properties are sent
+   // lean layout: the per-step ghost updates only carry the properties used by the solver and shape family, sent by the delta ghost sync
+   const Config::BlockHandle ghostSyncConf = cfg->getBlock("GhostSync");
+   const std::vector<SolverType> layoutSolvers = isHybrid ? std::vector<SolverType>{SolverType::HCSITS, SolverType::DEM} : std::vector<SolverType>{solverTypeFromString(solver)};
+   bool useLeanLayout = ghostSyncConf && ghostSyncConf.getParameter<bool>("leanLayout", false);
+   const GhostSyncLayout ghostSyncLayout = useLeanLayout ? getGhostSyncLayout(layoutSolvers, shapeFamily, frictionCoefficientStatic > 0_r || frictionCoefficientDynamic > 0_r)
+                                                         : getFullGhostSyncLayout(layoutSolvers);
+   std::unique_ptr<DeltaGhostSync> deltaGhostSync;
+   if(ghostSyncConf && (ghostSyncConf.getParameter<bool>("deltaSync") || useLeanLayout))
+   {
+      auto ghostSyncParameters = DeltaGhostSyncParameters::fromConfig(ghostSyncConf);
+      if(useSingleProcessFastPath || !useNextNeighborSync)
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Delta ghost sync requires the next neighbor sync - disabled.");
+      } else if(0.5_r * maxParticleDiameter + ghostSyncParameters.skin * maxParticleDiameter >= smallestBlockSize)
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Delta ghost sync: ghost layer with skin exceeds the smallest block size - disabled.");
+      } else
+      {
+         deltaGhostSync = std::make_unique<DeltaGhostSync>(ghostSyncParameters, maxParticleDiameter, ghostSyncLayout);
+         WALBERLA_LOG_INFO_ON_ROOT("Using delta ghost sync with ghost layer skin = " << deltaGhostSync->getSkin() << ", ghost updates: " << ghostSyncLayout.toString());
+      }
+   }
+   if(useLeanLayout && !deltaGhostSync)
+   {
+      WALBERLA_LOG_WARNING_ON_ROOT("Lean particle layout requires the delta ghost sync, the regular sync sends all properties.");
+      useLeanLayout = false;
+   }
+
    // sync functionality
    kernel::AssocToBlock associateToBlock(forest);
+   mpi::SyncNextNeighborsBlockForest syncNextNeighborsFunc;
+   mpi::SyncGhostOwners syncGhostOwnersFunc;
+   MinimumImage minimumImage(simulationDomain, isPeriodic);
    std::function<void(void)> syncCall;
-   if(useNextNeighborSync)
+   if(useSingleProcessFastPath)
+   {
+      syncCall = [&particleStorage,&particleAccessor,&minimumImage,useOpenMP](){
+         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                          [&minimumImage](size_t idx, data::ParticleAccessorWithBaseShape &ac){minimumImage.wrap(ac.getPositionRef(idx));}, particleAccessor);
+      };
+   } else if(useNextNeighborSync)
    {
       WALBERLA_LOG_INFO_ON_ROOT("Using next neighbor sync!");
-      syncCall = [&particleStorage,&forest,&domain](){
-         mpi::SyncNextNeighborsBlockForest syncParticles;
-         syncParticles(*particleStorage, forest, domain);
+      syncCall = [&particleStorage,&forest,&domain,&syncNextNeighborsFunc,&deltaGhostSync](){
+         syncNextNeighborsFunc(*particleStorage, forest, domain);
+         if(deltaGhostSync) deltaGhostSync->invalidate(); // ghost layer without skin
       };
    } else {
       WALBERLA_LOG_INFO_ON_ROOT("Using ghost owner sync!");
-      syncCall = [&particleStorage,&domain](){
-         mpi::SyncGhostOwners syncGhostOwnersFunc;
+      syncCall = [&particleStorage,&domain,&syncGhostOwnersFunc](){
          syncGhostOwnersFunc(*particleStorage, *domain);
       };
    }
 
    // initial sync
    particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor, associateToBlock, particleAccessor);
-   if(useNextNeighborSync){ syncCall(); }
+   if(useNextNeighborSync || useSingleProcessFastPath){ syncCall(); }
    else { for(uint_t i = 0; i < uint_c(std::ceil(maxParticleDiameter/smallestBlockSize)); ++i) syncCall(); }
 
+   auto particleMemoryReport = evaluateParticleMemory(*particleStorage, layoutSolvers, shapeFamily,
+                                                      useSingleProcessFastPath ? int64_t(0) : (useNextNeighborSync ? syncNextNeighborsFunc.getBytesSent() : syncGhostOwnersFunc.getBytesSent()),
+                                                      useLeanLayout ? ghostSyncLayout : getFullGhostSyncLayout(layoutSolvers), useLeanLayout);
+   WALBERLA_LOG_INFO_ON_ROOT(particleMemoryReport.toString());
+
 
    // create linked cells data structure
-   real_t linkedCellWidth = 1.01_r * maxParticleDiameter;
+   real_t linkedCellWidth = linkedCellWidthFactor * maxParticleDiameter;
    WALBERLA_LOG_INFO_ON_ROOT("Using linked cells with cell width = " << linkedCellWidth);
-   data::LinkedCells linkedCells(domain->getUnionOfLocalAABBs().getExtended(linkedCellWidth), linkedCellWidth );
+   std::unique_ptr<data::LinkedCells> linkedCells;
+   std::unique_ptr<LinkedCellsWithWalls> linkedCellsWithWalls;
+   std::unique_ptr<PeriodicLinkedCells> periodicLinkedCells; // only used in the single process fast path
+   real_t currentLinkedCellWidth = real_t(0);
+   auto setupLinkedCells = [&](real_t cellWidth){
+      if(cellWidth == currentLinkedCellWidth) return;
+      linkedCellsWithWalls.reset();
+      linkedCells = std::make_unique<data::LinkedCells>(domain->getUnionOfLocalAABBs().getExtended(cellWidth), cellWidth);
+      linkedCellsWithWalls = std::make_unique<LinkedCellsWithWalls>(*linkedCells);
+      periodicLinkedCells = std::make_unique<PeriodicLinkedCells>(minimumImage, cellWidth);
+      currentLinkedCellWidth = cellWidth;
+   };
+   setupLinkedCells(linkedCellWidth);
+   MinimumImageAccessor imageAccessor(particleStorage, minimumImage);
+
+   // multirate DEM during generation: contact-free particles are advanced with a large step, see Multirate.h
+   const Config::BlockHandle multirateConf = cfg->getBlock("Multirate");
+   bool useMultirate = multirateConf && multirateConf.getParameter<bool>("enabled");
+   // the hybrid solver generates with HCSITS and only switches to DEM afterwards, i.e. outside of the multirate window
+   if(useMultirate && (isHybrid || solverTypeFromString(solver) != SolverType::DEM))
+   {
+      WALBERLA_LOG_WARNING_ON_ROOT("Multirate time stepping is only available for the generation with the DEM solver - disabled.");
+      useMultirate = false;
+   }
+   std::unique_ptr<MultirateScheduler> multirateScheduler;
+   if(useMultirate)
+   {
+      multirateScheduler = std::make_unique<MultirateScheduler>(MultirateParameters::fromConfig(multirateConf), dt, linkedCellWidth, limitVelocity);
+      WALBERLA_LOG_INFO_ON_ROOT("Multirate: contact-free particles are advanced with dt = " << multirateScheduler->getLargeDt()
+                                << " s (" << multirateScheduler->getNumberOfSubcycles() << " sub-cycles) during generation.");
+   }
+   // single precision candidate test in front of the double precision fine contact detection, see MixedPrecisionContactDetection.h
+   const Config::BlockHandle mixedPrecisionConf = cfg->getBlock("MixedPrecision");
+   bool useMixedPrecision = mixedPrecisionConf && mixedPrecisionConf.getParameter<bool>("enabled");
+   MixedPrecisionPrefilter mixedPrecision(useMixedPrecision ? MixedPrecisionParameters::fromConfig(mixedPrecisionConf) : MixedPrecisionParameters(),
+                                          shapeFamily != ShapeFamily::SphereClump);
+   if(useMixedPrecision) WALBERLA_LOG_INFO_ON_ROOT("Using single precision candidate tests before the ellipsoid and GJK/EPA contact detection.");
+
+   // feedback-controlled duration (and amplitude) of the shaking after the generation, see CompactionControl.h
+   std::unique_ptr<CompactionController> compactionController;
+   if(useCompactionControl)
+   {
+      const real_t crossSectionArea = (domainSetup == "container") ? 0.25_r * math::pi * domainWidth * domainWidth : domainWidth * domainWidthY;
+      compactionController = std::make_unique<CompactionController>(CompactionControlParameters::fromConfig(compactionControlConf), shaking_period,
+                                                                    shaking_amplitude, crossSectionArea, simulationDomain.zMin());
+      WALBERLA_LOG_INFO_ON_ROOT("Compaction control: shaking after the generation ends once the compaction has plateaued, the fixed duration is not used.");
+   }
+   // auto-tuning of the runtime-switchable contact detection setup on the first time steps, see AutoTuning.h
+   const Config::BlockHandle autoTuningConf = cfg->getBlock("AutoTuning");
+   std::unique_ptr<AutoTuner> autoTuner;
+   if(autoTuningConf && autoTuningConf.getParameter<bool>("enabled"))
+   {
+      autoTuner = std::make_unique<AutoTuner>(AutoTuningParameters::fromConfig(autoTuningConf), !useSingleProcessFastPath);
+      WALBERLA_LOG_INFO_ON_ROOT("Auto-tuning: probing " << autoTuner->getCandidates().size() << " contact detection setups for "
+                                << autoTuner->getNumberOfProbeSteps() << " time steps.");
+   }
+   auto applyTuningCandidate = [&](const TuningCandidate & candidate){
+      useHashGrids = candidate.useHashGrids;
+      if(candidate.useHashGrids) return;
+      particleSortingSpacing = candidate.sortingSpacing;
+      setupLinkedCells(candidate.cellWidthFactor * maxParticleDiameter);
+   };
+
+   bool isMultirateWindowActive = false; // free particles exist until the end of the current large step
+   bool isGenerating = true;
+   uint64_t numFreeFlightParticleSteps = 0;
 
    {
       auto info = evaluateParticleInfo(particleAccessor);
@@ -709,23 +1156,26 @@ int main(int argc, char **argv) {
    particleVtkOutput->setParticleSelector(vtkParticleSelector);
    auto particleVtkWriter = walberla::vtk::createVTKOutput_PointData(particleVtkOutput, "particles", visSpacing, vtkOutputFolder, "simulation_step");
 
-   mesa_pd::MeshParticleVTKOutput< mesh::PolyMesh > meshParticleVTK(particleStorage, "mesh", visSpacing, vtkOutputFolder);
-   meshParticleVTK.addFaceOutput< data::SelectParticleUid >("UID");
-   meshParticleVTK.addVertexOutput< data::SelectParticleInteractionRadius >("InteractionRadius");
-   meshParticleVTK.addFaceOutput< data::SelectParticleLinearVelocity >("LinearVelocity");
-   meshParticleVTK.addVertexOutput< data::SelectParticlePosition >("Position");
-   meshParticleVTK.addVertexOutput< data::SelectParticleNumContacts >("numContacts");
    auto surfaceVelDataSource = make_shared<mesa_pd::SurfaceVelocityVertexDataSource< mesh::PolyMesh, data::ParticleAccessorWithBaseShape > >("SurfaceVelocity", particleAccessor);
-   meshParticleVTK.setParticleSelector(vtkParticleSelector);
-   meshParticleVTK.addVertexDataSource(surfaceVelDataSource);
+   auto createMeshParticleVTK = [&](const std::string & identifier, uint_t writeFrequency){
+      auto meshVTK = std::make_unique<mesa_pd::MeshParticleVTKOutput< mesh::PolyMesh >>(particleStorage, identifier, writeFrequency, vtkOutputFolder);
+      meshVTK->addFaceOutput< data::SelectParticleUid >("UID");
+      meshVTK->addVertexOutput< data::SelectParticleInteractionRadius >("InteractionRadius");
+      meshVTK->addFaceOutput< data::SelectParticleLinearVelocity >("LinearVelocity");
+      meshVTK->addVertexOutput< data::SelectParticlePosition >("Position");
+      meshVTK->addVertexOutput< data::SelectParticleNumContacts >("numContacts");
+      meshVTK->setParticleSelector(vtkParticleSelector);
+      meshVTK->addVertexDataSource(surfaceVelDataSource);
+      return meshVTK;
+   };
+   auto meshParticleVTK = createMeshParticleVTK("mesh", visSpacing);
 
 
    /// MESAPD kernels
 
    //collision detection
    data::HashGrids hashGrids;
-   kernel::InsertParticleIntoLinkedCells initializeLinkedCells;
-   kernel::DetectAndStoreContacts detectAndStore(*contactStorage);
+   collision_detection::EllipsoidContactWarmStart ellipsoidWarmStart;
 
    //DEM
    kernel::SemiImplicitEuler dem_integration( dt );
@@ -750,8 +1200,113 @@ int main(int argc, char **argv) {
    mpi::BroadcastProperty broadcastKernel;
    mpi::ReduceProperty reductionKernel;
 
+   // geometric pre-packing: the particles are settled into a bed by collective rearrangement of their bounding spheres,
+   // layer by layer until the total particle mass is reached, instead of simulating the free fall
+   const Config::BlockHandle prePackingConf = cfg->getBlock("PrePacking");
+   bool usePrePacking = !useTiling && prePackingConf && prePackingConf.getParameter<bool>("enabled");
+   double prePackingWallTime = 0.0;
+   uint_t prePackingIterations = 0;
+   if(usePrePacking)
+   {
+      GeometricPrePacking prePacking(GeometricPrePacking::parametersFromConfig(prePackingConf));
+      WALBERLA_LOG_INFO_ON_ROOT("Geometric pre-packing with settling step ratio " << prePacking.getParameters().settlingStepRatio
+                                << " and overlap tolerance " << prePacking.getParameters().overlapTolerance);
+      WcTimer prePackingTimer;
+      prePackingTimer.start();
+
+      // returns the maximum relative overlap before the iteration
+      auto rearrange = [&](bool settle)
+      {
+         prePacking.resetMaximumOverlap();
+         if(useSingleProcessFastPath)
+         {
+            auto rearrangePair = [&prePacking](size_t idx1, size_t idx2, MinimumImageAccessor &ac){ prePacking(idx1, idx2, ac); };
+            periodicLinkedCells->build(particleAccessor, prePacking.getParameters().proxyRadiusScaling);
+            periodicLinkedCells->forEachParticlePairHalf(useOpenMP, imageAccessor, rearrangePair);
+            periodicLinkedCells->forEachWallPair(useOpenMP, imageAccessor, rearrangePair);
+         } else
+         {
+            auto rearrangePair = [&prePacking, domain](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){ prePacking(idx1, idx2, ac, *domain); };
+            linkedCellsWithWalls->build(particleAccessor, prePacking.getParameters().proxyRadiusScaling);
+            linkedCells->forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor, rearrangePair, particleAccessor);
+            linkedCellsWithWalls->forEachWallPair(particleAccessor, rearrangePair);
+            reductionKernel.operator()<ForceTorqueNotification>(*particleStorage);
+         }
+         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                          [&prePacking, settle](size_t idx, data::ParticleAccessorWithBaseShape &ac){
+                                             prePacking.move(idx, ac, settle);
+                                          }, particleAccessor);
+         syncCall();
+         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                          associateToBlock, particleAccessor);
+         ++prePackingIterations;
+         return walberla::mpi::allReduce(prePacking.getMaximumOverlap(), walberla::mpi::MAX);
+      };
+
+      auto settleLayer = [&]()
+      {
+         // settle until the mass center drops by less than one settling step of an average particle within the check interval
+         const uint_t checkInterval = 50;
+         real_t previousHeight = evaluateParticleInfo(particleAccessor).heightOfMass;
+         for(uint_t i = 1; i <= prePacking.getParameters().maxIterations; ++i)
+         {
+            rearrange(true);
+            if(i % checkInterval != 0) continue;
+            auto info = evaluateParticleInfo(particleAccessor);
+            real_t averageDiameter = diameterFromSphereVolume(info.particleVolume / real_c(info.numParticles));
+            if(previousHeight - info.heightOfMass < prePacking.getParameters().settlingStepRatio * 0.5_r * averageDiameter) break;
+            previousHeight = info.heightOfMass;
+         }
+         // remove remaining overlaps without settling
+         real_t maxOverlap = real_t(0);
+         for(uint_t i = 0; i < prePacking.getParameters().maxIterations; ++i)
+         {
+            maxOverlap = rearrange(false);
+            if(maxOverlap < prePacking.getParameters().overlapTolerance) break;
+         }
+         return maxOverlap;
+      };
+
+      real_t maxOverlap = settleLayer();
+      auto info = evaluateParticleInfo(particleAccessor);
+      real_t layerHeight = (initialGenerationHeightRatioEnd - initialGenerationHeightRatioStart) * simulationDomain.zMax();
+      while(info.particleVolume * particleDensity < totalParticleMass)
+      {
+         real_t zMin = std::max(minGenerationHeight, info.maximumHeight + generationSpacing);
+         real_t zMax = std::min(maxGenerationHeight, zMin + layerHeight);
+         if(zMin >= zMax)
+         {
+            WALBERLA_LOG_INFO_ON_ROOT("Pre-packing: no space left for further layers, remaining particles are created during the simulation.");
+            break;
+         }
+         particleCreator.createParticles(zMin, zMax, generationSpacing, diameterGenerator, shapeGenerator, initialVelocity, maximumAllowedInteractionRadius);
+         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor, associateToBlock, particleAccessor);
+         if(useNextNeighborSync || useSingleProcessFastPath){ syncCall(); }
+         else { for(uint_t i = 0; i < uint_c(std::ceil(maxParticleDiameter/smallestBlockSize)); ++i) syncCall(); }
+
+         maxOverlap = settleLayer();
+         info = evaluateParticleInfo(particleAccessor);
+         WALBERLA_LOG_INFO_ON_ROOT("Pre-packing: " << info.particleVolume * particleDensity << " kg settled after " << prePackingIterations << " iterations");
+      }
+
+      prePackingTimer.end();
+      prePackingWallTime = prePackingTimer.total();
+      WALBERLA_LOG_INFO_ON_ROOT("Pre-packing finished after " << prePackingIterations << " iterations and " << prePackingWallTime << " s, max. relative overlap = " << maxOverlap);
+      WALBERLA_LOG_INFO_ON_ROOT(info);
+   }
+
    uint_t timestep = 0;
+
+   // time step size and output spacings of the current solver stage, only changed by the switch in hybrid mode
+   real_t stageDt = initialDt;
+   real_t stageBeginTime = real_t(0);
+   uint_t stageBeginTimestep = 0;
    WALBERLA_LOG_INFO_ON_ROOT("Starting simulation in domain of volume " << domainVolume << " m^3.");
+   if(useTiling)
+   {
+      totalParticleMass = real_t(0); // no generation, the tiled bed is only relaxed
+      WALBERLA_LOG_INFO_ON_ROOT("Tiling: relaxation of the tiled bed for at most " << tilingParameters.relaxationDuration << " s.");
+   }
    WALBERLA_LOG_INFO_ON_ROOT("Will terminate generation when particle mass is above " << totalParticleMass << " kg.");
 
    real_t velocityDampingFactor = std::pow(velocityDampingCoefficient, dt);
@@ -773,6 +1328,7 @@ int main(int argc, char **argv) {
    }
    real_t timeEndShaking = real_t(-1);
    real_t timeBeginDamping = real_t(-1);
+   real_t proxy_relaxationEndTime = real_t(-1);
 
    if(limitVelocity > 0_r) WALBERLA_LOG_INFO_ON_ROOT("Will apply limiting of translational particle velocity to maximal magnitude of " << limitVelocity);
 
@@ -805,10 +1361,71 @@ int main(int argc, char **argv) {
 
    PorosityPerHorizontalLayerEvaluator porosityEvaluator(evaluationLayerHeight, simulationDomain, domainSetup);
 
+   real_t tiling_initialPorosity = real_t(0);
+   // size and shape statistics of the source packing, compared with the ones of the tiled bed at the end
+   std::unique_ptr<ParticleHistogram> tiling_sourceHistogram;
+   auto getTilingHistogramDeviations = [&]()
+   {
+      std::vector<std::pair<std::string, real_t>> deviations;
+      deviations.emplace_back("massFraction", getHistogramDistance(particleHistogram.getMassFractionHistogram(), tiling_sourceHistogram->getMassFractionHistogram()));
+      deviations.emplace_back("number", getHistogramDistance(particleHistogram.getNumberHistogram(), tiling_sourceHistogram->getNumberHistogram()));
+      for(uint_t i = 0; i < particleHistogram.getNumberOfShapeEvaluators(); ++i)
+         deviations.emplace_back(std::get<0>(particleHistogram.getShapeEvaluator(i)), getHistogramDistance(particleHistogram.getShapeHistogram(i), tiling_sourceHistogram->getShapeHistogram(i)));
+      return deviations;
+   };
+   if(useTiling)
+   {
+      auto sourceStorage = std::make_shared<data::ParticleStorage>(packingTiler->getSnapshot().particles.size());
+      WALBERLA_ROOT_SECTION() { packingTiler->createSourceParticles(*sourceStorage, particleDensity); }
+      data::ParticleAccessorWithBaseShape sourceAccessor(sourceStorage);
+      tiling_sourceHistogram = std::make_unique<ParticleHistogram>(evaluationHistogramBins, particleSizeEvaluator, particleShapeBins, particleShapeEvaluators);
+      sourceStorage->forEachParticle(false, kernel::SelectLocal(), sourceAccessor, *tiling_sourceHistogram, sourceAccessor);
+      tiling_sourceHistogram->evaluate();
+      WALBERLA_LOG_INFO_ON_ROOT("Tiling: particle statistics of the source packing:\n" << *tiling_sourceHistogram);
+      for(const auto & deviation : getTilingHistogramDeviations())
+         WALBERLA_LOG_INFO_ON_ROOT("Tiling: deviation of the " << deviation.first << " histogram of the tiled bed from the source packing = " << deviation.second);
+
+      particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                       porosityEvaluator, particleAccessor);
+      porosityEvaluator.evaluate();
+      tiling_initialPorosity = porosityEvaluator.estimateTotalPorosity();
+      porosityEvaluator.clear();
+      WALBERLA_LOG_INFO_ON_ROOT("Tiling: estimated porosity of the tiled bed = " << tiling_initialPorosity
+                                << ", of the source packing = " << packingTiler->getSnapshot().porosity);
+   }
+
    std::string loggingFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_logging.txt";
    WALBERLA_LOG_INFO_ON_ROOT("Writing logging file to " << loggingFileName);
    LoggingWriter loggingWriter(loggingFileName);
 
+   // typed time series of the logging steps, timings and histograms, buffered on root, see TimeSeriesStore.h
+   const Config::BlockHandle timeSeriesConf = evaluationConf.getBlock("TimeSeries");
+   std::unique_ptr<TimeSeriesRecorder> timeSeries;
+   if(timeSeriesConf && timeSeriesConf.getParameter<bool>("enabled"))
+   {
+      auto timeSeriesParameters = TimeSeriesParameters::fromConfig(timeSeriesConf);
+      std::string timeSeriesFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_timeseries.bin";
+      WALBERLA_LOG_INFO_ON_ROOT("Recording time series to " << ((timeSeriesParameters.format == "sqlite") ? sqlDBFileName : timeSeriesFileName));
+      timeSeries = std::make_unique<TimeSeriesRecorder>(timeSeriesParameters, uniqueFileIdentifier, sqlDBFileName, timeSeriesFileName);
+   }
+   auto recordParticleHistograms = [&](real_t time){
+      if(!timeSeries) return;
+      timeSeries->recordHistogram(time, "massFraction", particleHistogram.getMassFractionHistogram());
+      timeSeries->recordHistogram(time, "number", particleHistogram.getNumberHistogram());
+      for(uint_t i = 0; i < particleHistogram.getNumberOfShapeEvaluators(); ++i)
+         timeSeries->recordHistogram(time, std::get<0>(particleHistogram.getShapeEvaluator(i)), particleHistogram.getShapeHistogram(i));
+   };
+
+   // contact network time series at the logging steps, accumulated in the contact loop of the solver
+   std::unique_ptr<ContactNetworkEvaluator> contactNetworkEvaluator;
+   if(evaluationConf.getParameter<bool>("contactNetwork", false) && loggingSpacing > 0)
+   {
+      std::string contactNetworkFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_contact_network.txt";
+      WALBERLA_LOG_INFO_ON_ROOT("Writing contact network time series to " << contactNetworkFileName);
+      contactNetworkEvaluator = std::make_unique<ContactNetworkEvaluator>(evaluationLayerHeight, simulationDomain, contactNetworkFileName,
+                                                                          porosityProfileFolder + "/" +  uniqueFileIdentifier + "_contact_network_layers.txt");
+   }
+
 
 
    //particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
@@ -818,377 +1435,886 @@ int main(int argc, char **argv) {
    //std::string fileName = "rank" + std::to_string(walberla::mpi::MPIManager::instance()->rank()) + ".txt";
    //file.open( fileName.c_str() );
 
-   WcTimingTree timing;
+   TracingTimingTree timing;
+   PhaseProfiler phaseProfiler(profiling_useCounters);
+   auto switchPhase = [&phaseProfiler, &timing](const std::string & phase){
+      if(phase == phaseProfiler.getCurrentPhase()) return;
+      timing.addInstantEvent("Begin " + phase);
+      phaseProfiler.switchPhase(phase, timing.getTree());
+   };
+   switchPhase((shaking && shaking_activeFromBeginning) ? "generation+shaking" : "generation");
+   std::string performanceFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_performance.txt";
+   if(profiling_reportSpacing > 0) WALBERLA_LOG_INFO_ON_ROOT("Writing per-process performance reports to " << performanceFileName);
+   if(profiling_traceSpacing > 0) WALBERLA_LOG_INFO_ON_ROOT("Recording every " << profiling_traceSpacing << ". time step for Chrome trace output.");
+   uint64_t accumulatedParticleTimeSteps = 0; // sum over all time steps of the number of particles, used to compute the throughput
 
    timing.start("Simulation");
 
    bool terminateSimulation = false;
-   while (!terminateSimulation) {
 
-      real_t currentTime = dt * real_c(timestep);
+   // the simulation runs in stages, a stage ends when the solver (hybrid mode) or the shape family (proxy settling) has to change
+   // phases after the generation: shaking (if enabled, 'shaking' is reset once it is finished), then damping
+   auto isPhaseReached = [&](const std::string & phase){
+      if(isGenerating) return false;
+      return phase == "shaking" || !shaking;
+   };
+   auto isHybridSwitchDue = [&](SolverType stageSolver){ return isHybrid && stageSolver == SolverType::HCSITS && isPhaseReached(hybrid_demFromPhase); };
+   auto isProxySwitchDue = [&](ShapeFamily stageShape){ return useProxySettling && stageShape != shapeFamily && isPhaseReached(proxy_switchPhase); };
+
+   // the time loop is instantiated for each combination of solver, shape family and sync variant, see TimeLoopConfiguration
+   auto timeLoop = [&](auto loopConfiguration) {
+      using LoopConfig_T = decltype(loopConfiguration);
+
+      // of all sync calls since the last counter update, a time step can contain several sync calls
+      uint64_t syncBytesSent = 0;
+      uint64_t numSyncCalls = 0;
+      uint64_t numFullSyncs = 0;
+      auto sync = [&](){
+         ++numSyncCalls;
+         if constexpr (LoopConfig_T::sync == SyncType::NextNeighbors)
+         {
+            if(!deltaGhostSync) syncNextNeighborsFunc(*particleStorage, forest, domain);
+            else if(deltaGhostSync->isFullSyncRequired(*particleStorage))
+            {
+               timing.start("Full sync");
+               syncNextNeighborsFunc(*particleStorage, forest, domain, deltaGhostSync->getSkin());
+               deltaGhostSync->resetReferenceState(*particleStorage, syncNextNeighborsFunc.getBytesSent());
+               timing.stop("Full sync");
+            } else
+            {
+               timing.start("Delta sync");
+               (*deltaGhostSync)(*particleStorage);
+               timing.stop("Delta sync");
+            }
+         }
+         else if constexpr (LoopConfig_T::sync == SyncType::GhostOwners) syncGhostOwnersFunc(*particleStorage, *domain);
+         else syncCall();
 
-      timing.start("Sorting");
-      if(particleSortingSpacing > 0 && timestep % uint_c(particleSortingSpacing) == 0 && !useHashGrids)
-      {
-         sorting::LinearizedCompareFunctor linearSorting(linkedCells.domain_, linkedCells.numCellsPerDim_);
-         particleStorage->sort(linearSorting);
-      }
-      timing.stop("Sorting");
+         if constexpr (LoopConfig_T::sync == SyncType::NextNeighbors)
+         {
+            syncBytesSent += uint64_c(deltaGhostSync ? deltaGhostSync->getBytesSent() : syncNextNeighborsFunc.getBytesSent());
+            if(deltaGhostSync && deltaGhostSync->lastSyncWasFull()) ++numFullSyncs;
+         }
+         else if constexpr (LoopConfig_T::sync == SyncType::GhostOwners) syncBytesSent += uint64_c(syncGhostOwnersFunc.getBytesSent());
+      };
 
-      timing.start("VTK");
-      if(particleShape.find("Mesh") != std::string::npos) meshParticleVTK(particleAccessor);
-      else particleVtkWriter->write();
-      timing.stop("VTK");
+      while (!terminateSimulation) {
 
+         uint_t stageTimestep = timestep - stageBeginTimestep;
+         const bool isLoggingStep = loggingSpacing > 0 && stageTimestep % loggingSpacing == 0;
+         const bool isContactNetworkStep = contactNetworkEvaluator && isLoggingStep;
+         real_t currentTime = stageBeginTime + stageDt * real_c(stageTimestep);
+         timing.setTracing(profiling_traceSpacing > 0 && timestep % uint_c(profiling_traceSpacing) == 0);
+         uint64_t numCandidatePairs = 0;
+         uint64_t numGJKCalls = 0;
 
-      contactStorage->clear();
+         if(autoTuner && autoTuner->isProbing())
+         {
+            if(autoTuner->isFirstStep()) applyTuningCandidate(autoTuner->getCurrentCandidate());
+            autoTuner->beginStep();
+         }
 
-      if(useHashGrids)
-      {
-         timing.start("Hash grid");
-         hashGrids.clearAll();
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor, hashGrids, particleAccessor);
-         timing.stop("Hash grid");
-
-         timing.start("Contact detection");
-         hashGrids.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
-                                           [domain, contactStorage](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
-                                              kernel::DoubleCast double_cast;
-                                              mpi::ContactFilter contact_filter;
-                                              collision_detection::GeneralContactDetection contactDetection;
-                                              //Attention: does not use contact threshold in general case (GJK)
-
-                                              if (double_cast(idx1, idx2, ac, contactDetection, ac)) {
-                                                 if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
-                                                    auto c = contactStorage->create();
-                                                    c->setId1(contactDetection.getIdx1());
-                                                    c->setId2(contactDetection.getIdx2());
-                                                    c->setDistance(contactDetection.getPenetrationDepth());
-                                                    c->setNormal(contactDetection.getContactNormal());
-                                                    c->setPosition(contactDetection.getContactPoint());
-                                                 }
-                                              }
-                                              }, particleAccessor);
-         timing.stop("Contact detection");
+         timing.start("Sorting");
+         // during the auto-tuning, sorting candidates only sort in the warm-up step of each visit, see AutoTuner
+         bool isSortingDue = (autoTuner && autoTuner->isProbing()) ? autoTuner->requiresSorting()
+                                                                   : particleSortingSpacing > 0 && timestep % uint_c(particleSortingSpacing) == 0;
+         if(isSortingDue && !useHashGrids)
+         {
+            WcTimer sortingTimer;
+            sortingTimer.start();
+            sorting::LinearizedCompareFunctor linearSorting(linkedCells->domain_, linkedCells->numCellsPerDim_);
+            particleStorage->sort(linearSorting);
+            sortingTimer.end();
+            if(autoTuner && autoTuner->isProbing()) autoTuner->addSortingTime(sortingTimer.total());
+         }
+         timing.stop("Sorting");
 
-      } else
-      {
-         // use linked cells
+         timing.start("VTK");
+         if constexpr (LoopConfig_T::writesMeshVTK) (*meshParticleVTK)(particleAccessor);
+         else particleVtkWriter->write();
+         timing.stop("VTK");
+
+
+         // after the swap of proxies for meshes, overlaps are resolved with a stricter velocity limit
+         real_t velocityLimit = (currentTime < proxy_relaxationEndTime) ? proxy_relaxationVelocityLimit : limitVelocity;
 
-         timing.start("Linked cells");
-         linkedCells.clear();
-         particleStorage->forEachParticle(useOpenMP,kernel::SelectAll(),particleAccessor,
-                                          initializeLinkedCells, particleAccessor, linkedCells);
-         timing.stop("Linked cells");
+         bool isMultirateLargeStep = false;
+         if constexpr (LoopConfig_T::isDEM)
+         {
+            if(useMultirate && multirateScheduler->isLargeStep(stageTimestep))
+            {
+               // all particles are synchronous again and take part in the contact detection
+               if(isMultirateWindowActive) multirateScheduler->releaseAll(particleAccessor);
+               isMultirateWindowActive = isGenerating && !isShakingActive;
+               isMultirateLargeStep = isMultirateWindowActive;
+            }
+         }
 
-         timing.start("Contact detection");
-         if(particleShape == "Sphere")
+         const uint_t numContactAllocations = contactStorage->getNumberOfAllocations();
+         contactStorage->clear();
+         if constexpr (LoopConfig_T::shape == ShapeFamily::AnalyticEllipsoid) ellipsoidWarmStart.swap();
+         if constexpr (LoopConfig_T::shape == ShapeFamily::SphereClump)
          {
-            collision_detection::AnalyticContactDetection contactDetection;
-            //acd.getContactThreshold() = contactThreshold;
-            linkedCells.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
-                                                detectAndStore, particleAccessor, *domain, contactDetection);
+            timing.start("Clump assignment");
+            sphereClumpLibrary->update(particleAccessor);
+            timing.stop("Clump assignment");
+         }
+         // only in front of the ellipsoid and GJK/EPA kernels, the analytic sphere kernels are not more expensive than the prefilter
+         if constexpr (LoopConfig_T::shape != ShapeFamily::Sphere && LoopConfig_T::shape != ShapeFamily::SphereClump)
+         {
+            if(useMixedPrecision)
+            {
+               timing.start("Mixed precision cache");
+               mixedPrecision.update(particleAccessor);
+               timing.stop("Mixed precision cache");
+            }
+         }
 
-         } else
+         // particle-wall pairs are only formed for the boundary cells of each wall (see WallCells) and use analytic kernels for all shape families
+         auto detectWallContact = [&](size_t idx1, size_t idx2, auto &ac){
+            ++numCandidatePairs;
+            auto createContact = [&](size_t id1, size_t id2, const Vec3 & contactPoint, const Vec3 & contactNormal, real_t penetrationDepth){
+               if constexpr (LoopConfig_T::sync != SyncType::None)
+               {
+                  mpi::ContactFilter contact_filter;
+                  if (!contact_filter(id1, id2, ac, contactPoint, *domain)) return;
+               }
+               contactStorage->append(id1, id2, penetrationDepth, contactNormal, contactPoint);
+            };
+            if constexpr (LoopConfig_T::shape == ShapeFamily::SphereClump)
+            {
+               sphereClumpLibrary->forEachContact(idx1, idx2, ac, LoopConfig_T::isDEM, createContact);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::Sphere)
+            {
+               collision_detection::AnalyticContactDetection contactDetection;
+               if (collision_detection::detectSphereContact(idx1, idx2, ac, contactDetection))
+                  createContact(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getContactPoint(), contactDetection.getContactNormal(), contactDetection.getPenetrationDepth());
+            } else
+            {
+               kernel::DoubleCast double_cast;
+               collision_detection::WallContactDetection contactDetection;
+               if (double_cast(idx1, idx2, ac, contactDetection, ac))
+                  createContact(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getContactPoint(), contactDetection.getContactNormal(), contactDetection.getPenetrationDepth());
+            }
+         };
+
+         // analytic ellipsoid kernels, shared by all contact detection variants
+         auto detectEllipsoidContact = [&](size_t idx1, size_t idx2, auto &ac){
+            ++numCandidatePairs;
+            if(useMixedPrecision && !mixedPrecision.isCandidate(idx1, idx2, ac)) return;
+            collision_detection::EllipsoidContactDetection contactDetection(&ellipsoidWarmStart);
+            // coarse collision detection via interaction radii, only the remaining pairs reach the Perram-Wertheim root search
+            data::Sphere sp1(ac.getInteractionRadius(idx1));
+            data::Sphere sp2(ac.getInteractionRadius(idx2));
+            if(!contactDetection(idx1, idx2, sp1, sp2, ac)) return;
+            kernel::DoubleCast double_cast;
+            if(!double_cast(idx1, idx2, ac, contactDetection, ac)) return;
+            // analytic kernels are cheap and deterministic, thus the usual order of fine detection and contact filtering is used
+            if constexpr (LoopConfig_T::sync != SyncType::None)
+            {
+               mpi::ContactFilter contact_filter;
+               if(!contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) return;
+            }
+            contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+         };
+
+         if constexpr (LoopConfig_T::sync == SyncType::None)
          {
-            linkedCells.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
-                                                [domain, contactStorage](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+            // single process: all pairs are evaluated at their minimum image, no contact filtering required
+            timing.start("Linked cells");
+            periodicLinkedCells->build(particleAccessor, real_t(1), SelectNotInFreeFlight());
+            timing.stop("Linked cells");
 
-                                                   collision_detection::GeneralContactDetection contactDetection;
-                                                   //Attention: does not use contact threshold in general case (GJK)
+            timing.start("Contact detection");
+            if constexpr (LoopConfig_T::shape == ShapeFamily::Sphere)
+            {
+               periodicLinkedCells->forEachParticlePairHalf(useOpenMP, imageAccessor,
+                                                           [contactStorage, &numCandidatePairs](size_t idx1, size_t idx2, MinimumImageAccessor &ac){
+                                                              ++numCandidatePairs;
+                                                              collision_detection::AnalyticContactDetection contactDetection;
+                                                              if (collision_detection::detectSphereContact(idx1, idx2, ac, contactDetection)) {
+                                                                 contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+                                                              }});
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::AnalyticEllipsoid)
+            {
+               periodicLinkedCells->forEachParticlePairHalf(useOpenMP, imageAccessor, detectEllipsoidContact);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::SphereClump)
+            {
+               periodicLinkedCells->forEachParticlePairHalf(useOpenMP, imageAccessor,
+                                                           [contactStorage, &sphereClumpLibrary, &numCandidatePairs](size_t idx1, size_t idx2, MinimumImageAccessor &ac){
+                                                              ++numCandidatePairs;
+                                                              sphereClumpLibrary->forEachContact(idx1, idx2, ac, LoopConfig_T::isDEM, [&](size_t id1, size_t id2, const Vec3 & contactPoint, const Vec3 & contactNormal, real_t penetrationDepth){
+                                                                 contactStorage->append(id1, id2, penetrationDepth, contactNormal, contactPoint);
+                                                              });
+                                                              });
+            } else
+            {
+               periodicLinkedCells->forEachParticlePairHalf(useOpenMP, imageAccessor,
+                                                           [contactStorage, &numCandidatePairs, &numGJKCalls, useMixedPrecision, &mixedPrecision](size_t idx1, size_t idx2, MinimumImageAccessor &ac){
+                                                              ++numCandidatePairs;
+                                                              if(useMixedPrecision && !mixedPrecision.isCandidate(idx1, idx2, ac)) return;
+                                                              collision_detection::GeneralContactDetection contactDetection;
+                                                              // coarse collision detection via interaction radii, see below
+                                                              data::Sphere sp1(ac.getInteractionRadius(idx1));
+                                                              data::Sphere sp2(ac.getInteractionRadius(idx2));
+                                                              if(contactDetection(idx1, idx2, sp1, sp2, ac)) {
+                                                                 kernel::DoubleCast double_cast;
+                                                                 ++numGJKCalls;
+                                                                 if (double_cast(idx1, idx2, ac, contactDetection, ac)) {
+                                                                    contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+                                                                 }
+                                                              }});
+            }
+            periodicLinkedCells->forEachWallPair(useOpenMP, imageAccessor, detectWallContact);
+            timing.stop("Contact detection");
 
-                                                   // coarse collision detection via interaction radii
-                                                   data::Sphere sp1(ac.getInteractionRadius(idx1));
-                                                   data::Sphere sp2(ac.getInteractionRadius(idx2));
-                                                   if(contactDetection(idx1, idx2, sp1, sp2, ac)) {
-                                                      //NOTE: this works also for infinite particles ( plane, cylindrical boundary) since contact_detection return true
-                                                      // and the following contact_filter treats all local-global interactions independently of contact detection result, which would be non-sense for this interaction
+         } else if(useHashGrids)
+         {
+            timing.start("Hash grid");
+            hashGrids.clearAll();
+            particleStorage->forEachParticle(useOpenMP, SelectNotInFreeFlight(), particleAccessor, hashGrids, particleAccessor);
+            timing.stop("Hash grid");
 
+            timing.start("Contact detection");
+            if constexpr (LoopConfig_T::shape == ShapeFamily::Sphere)
+            {
+               collision_detection::AnalyticContactDetection contactDetection;
+               hashGrids.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                 [domain, contactStorage, &contactDetection, &numCandidatePairs](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                    ++numCandidatePairs;
+                                                    mpi::ContactFilter contact_filter;
+                                                    if (collision_detection::detectSphereContact(idx1, idx2, ac, contactDetection)) {
+                                                       if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
+                                                          contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+                                                       }
+                                                    }
+                                                    }, particleAccessor);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::AnalyticEllipsoid)
+            {
+               hashGrids.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor, detectEllipsoidContact, particleAccessor);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::SphereClump)
+            {
+               // DEM: one aggregated contact per particle pair, as the tangential contact history is stored per pair; HCSITS: one contact per touching sphere pair
+               hashGrids.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                 [domain, contactStorage, &sphereClumpLibrary, &numCandidatePairs](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                    ++numCandidatePairs;
+                                                    sphereClumpLibrary->forEachContact(idx1, idx2, ac, LoopConfig_T::isDEM, [&](size_t id1, size_t id2, const Vec3 & contactPoint, const Vec3 & contactNormal, real_t penetrationDepth){
+                                                       mpi::ContactFilter contact_filter;
+                                                       if (contact_filter(id1, id2, ac, contactPoint, *domain)) {
+                                                          contactStorage->append(id1, id2, penetrationDepth, contactNormal, contactPoint);
+                                                       }
+                                                    });
+                                                    }, particleAccessor);
+            } else
+            {
+               hashGrids.forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                 [domain, contactStorage, &numCandidatePairs, &numGJKCalls, useMixedPrecision, &mixedPrecision](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                    ++numCandidatePairs;
+                                                    if(useMixedPrecision && !mixedPrecision.isCandidate(idx1, idx2, ac)) return;
+                                                    kernel::DoubleCast double_cast;
+                                                    mpi::ContactFilter contact_filter;
+                                                    collision_detection::GeneralContactDetection contactDetection;
+                                                    //Attention: does not use contact threshold in general case (GJK)
+
+                                                    // coarse collision detection via interaction radii, only the remaining pairs reach GJK/EPA
+                                                    data::Sphere sp1(ac.getInteractionRadius(idx1));
+                                                    data::Sphere sp2(ac.getInteractionRadius(idx2));
+                                                    if (!contactDetection(idx1, idx2, sp1, sp2, ac)) return;
+                                                    ++numGJKCalls;
+                                                    if (double_cast(idx1, idx2, ac, contactDetection, ac)) {
+                                                       if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
+                                                          contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+                                                       }
+                                                    }
+                                                    }, particleAccessor);
+            }
+            timing.stop("Contact detection");
+
+         } else
+         {
+            // use linked cells
+
+            timing.start("Linked cells");
+            linkedCellsWithWalls->build(particleAccessor, real_t(1), SelectNotInFreeFlight());
+            timing.stop("Linked cells");
+
+            timing.start("Contact detection");
+            if constexpr (LoopConfig_T::shape == ShapeFamily::Sphere)
+            {
+               collision_detection::AnalyticContactDetection contactDetection;
+               //acd.getContactThreshold() = contactThreshold;
+               linkedCells->forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                   [domain, contactStorage, &contactDetection, &numCandidatePairs](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                      ++numCandidatePairs;
                                                       mpi::ContactFilter contact_filter;
-                                                      if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
-                                                         //NOTE: usually we first do fine collision detection and then the exact contact location determines the process that handles this contact
-                                                         // however, along periodic boundaries, the GJK/EPA for meshes seems to be numerical unstable and yields (sometimes) different contact points for the same interaction pair (but periodically transformed)
-                                                         // as a result, the same contact appears twice and potentially handled by two processes simultaneously.
-                                                         // thus we change the ordering and do the contact filtering according to the result of the coarse collision detection, i.e. the bounding sphere check
-                                                         kernel::DoubleCast double_cast;
-                                                         if (double_cast(idx1, idx2, ac, contactDetection, ac)) {
-                                                            auto c = contactStorage->create();
-                                                            c->setId1(contactDetection.getIdx1());
-                                                            c->setId2(contactDetection.getIdx2());
-                                                            c->setDistance(contactDetection.getPenetrationDepth());
-                                                            c->setNormal(contactDetection.getContactNormal());
-                                                            c->setPosition(contactDetection.getContactPoint());
+                                                      if (collision_detection::detectSphereContact(idx1, idx2, ac, contactDetection)) {
+                                                         if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
+                                                            contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
                                                          }
-                                                      }
-                                                   }}, particleAccessor);
-         }
+                                                      }}, particleAccessor);
 
-         timing.stop("Contact detection");
-      }
-
-      timing.start("Contact eval");
-      particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
-                                       [](size_t p_idx, data::ParticleAccessorWithBaseShape& ac){ac.setNumContacts(p_idx,0);}, particleAccessor);
-      contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
-                                     [](size_t c, data::ContactAccessor &ca, data::ParticleAccessorWithBaseShape &pa) {
-                                        auto idx1 = ca.getId1(c);
-                                        auto idx2 = ca.getId2(c);
-                                        pa.getNumContactsRef(idx1)++;
-                                        pa.getNumContactsRef(idx2)++;
-                                     }, contactAccessor, particleAccessor);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::AnalyticEllipsoid)
+            {
+               linkedCells->forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor, detectEllipsoidContact, particleAccessor);
+            } else if constexpr (LoopConfig_T::shape == ShapeFamily::SphereClump)
+            {
+               linkedCells->forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                   [domain, contactStorage, &sphereClumpLibrary, &numCandidatePairs](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                      ++numCandidatePairs;
+                                                      sphereClumpLibrary->forEachContact(idx1, idx2, ac, LoopConfig_T::isDEM, [&](size_t id1, size_t id2, const Vec3 & contactPoint, const Vec3 & contactNormal, real_t penetrationDepth){
+                                                         mpi::ContactFilter contact_filter;
+                                                         if (contact_filter(id1, id2, ac, contactPoint, *domain)) {
+                                                            contactStorage->append(id1, id2, penetrationDepth, contactNormal, contactPoint);
+                                                         }
+                                                      });
+                                                      }, particleAccessor);
+            } else
+            {
+               linkedCells->forEachParticlePairHalf(useOpenMP, kernel::ExcludeInfiniteInfinite(), particleAccessor,
+                                                   [domain, contactStorage, &numCandidatePairs, &numGJKCalls, useMixedPrecision, &mixedPrecision](size_t idx1, size_t idx2, data::ParticleAccessorWithBaseShape &ac){
+                                                      ++numCandidatePairs;
+                                                      if(useMixedPrecision && !mixedPrecision.isCandidate(idx1, idx2, ac)) return;
+
+                                                      collision_detection::GeneralContactDetection contactDetection;
+                                                      //Attention: does not use contact threshold in general case (GJK)
+
+                                                      // coarse collision detection via interaction radii
+                                                      data::Sphere sp1(ac.getInteractionRadius(idx1));
+                                                      data::Sphere sp2(ac.getInteractionRadius(idx2));
+                                                      if(contactDetection(idx1, idx2, sp1, sp2, ac)) {
+                                                         mpi::ContactFilter contact_filter;
+                                                         if (contact_filter(contactDetection.getIdx1(), contactDetection.getIdx2(), ac, contactDetection.getContactPoint(), *domain)) {
+                                                            //NOTE: usually we first do fine collision detection and then the exact contact location determines the process that handles this contact
+                                                            // however, along periodic boundaries, the GJK/EPA for meshes seems to be numerical unstable and yields (sometimes) different contact points for the same interaction pair (but periodically transformed)
+                                                            // as a result, the same contact appears twice and potentially handled by two processes simultaneously.
+                                                            // thus we change the ordering and do the contact filtering according to the result of the coarse collision detection, i.e. the bounding sphere check
+                                                            kernel::DoubleCast double_cast;
+                                                            ++numGJKCalls;
+                                                            if (double_cast(idx1, idx2, ac, contactDetection, ac)) {
+                                                               contactStorage->append(contactDetection.getIdx1(), contactDetection.getIdx2(), contactDetection.getPenetrationDepth(), contactDetection.getContactNormal(), contactDetection.getContactPoint());
+                                                            }
+                                                         }
+                                                      }}, particleAccessor);
+            }
+            linkedCellsWithWalls->forEachWallPair(particleAccessor, detectWallContact);
 
-      reductionKernel.operator()<NumContactNotification>(*particleStorage);
-      timing.stop("Contact eval");
+            timing.stop("Contact detection");
+         }
 
+         contactStorage->finalize();
 
-      timing.start("Shaking");
-      if(isShakingActive)
-      {
-         real_t shaking_common_term = 2_r * math::pi / shaking_period;
-         real_t shakingAcceleration = shaking_amplitude * std::sin((currentTime - timeBeginShaking) * shaking_common_term) * shaking_common_term * shaking_common_term;
-         if(solver == "DEM")
+         if(isMultirateLargeStep)
          {
-            particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                             [shakingAcceleration](const size_t idx, auto &ac){addForceAtomic(idx, ac, Vec3(shakingAcceleration,0_r,0_r) / ac.getInvMass(idx));}, particleAccessor);
-         } else
-         {
-            hcsits_initParticles.setGlobalAcceleration(Vector3<real_t>(shakingAcceleration,0_r,-reducedGravitationalAcceleration));
+            timing.start("Multirate");
+            uint_t numFree = multirateScheduler->classify(particleAccessor, contactAccessor,
+                                                          useSingleProcessFastPath ? simulationDomain : domain->getUnionOfLocalAABBs(),
+                                                          simulationDomain, isPeriodic, useSingleProcessFastPath);
+            multirateScheduler->advanceFreeParticles(particleAccessor, Vec3(0_r,0_r,-reducedGravitationalAcceleration), velocityLimit);
+            numFreeFlightParticleSteps += uint64_c(numFree) * uint64_c(multirateScheduler->getNumberOfSubcycles());
+            timing.stop("Multirate");
          }
-      }
-      timing.stop("Shaking");
 
-      if(solver == "HCSITS")
-      {
-         timing.start("HCSITS");
+         phaseProfiler.count("candidatePairs", numCandidatePairs);
+         phaseProfiler.count("gjkCalls", numGJKCalls);
+         phaseProfiler.count("contacts", contactStorage->size());
+         phaseProfiler.count("contactAllocations", contactStorage->getNumberOfAllocations() - numContactAllocations);
 
-         timing.start("Init contacts");
-         contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
-                                        hcsits_initContacts, contactAccessor, particleAccessor);
-         timing.stop("Init contacts");
-         timing.start("Init particles");
+         timing.start("Contact eval");
+         // numContacts is a particle property, also read outside the VTK output, thus it is updated in each time step
          particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
-                                          hcsits_initParticles, particleAccessor, dt);
-         timing.stop("Init particles");
-
-         timing.start("Velocity update");
-         VelocityUpdateNotification::Parameters::relaxationParam = real_t(1.0); // must be set to 1.0 such that dv and dw caused by external forces and torques are not falsely altered
-         reductionKernel.operator()<VelocityCorrectionNotification>(*particleStorage);
-         broadcastKernel.operator()<VelocityUpdateNotification>(*particleStorage);
-         timing.stop("Velocity update");
-
-         VelocityUpdateNotification::Parameters::relaxationParam = hcsits_relaxationParameter;
-         for(uint_t i = uint_t(0); i < hcsits_numberOfIterations; i++){
-            timing.start("Relaxation step");
-            contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
-                                           hcsits_relaxationStep, contactAccessor, particleAccessor, dt);
-            timing.stop("Relaxation step");
-            timing.start("Velocity update");
-            reductionKernel.operator()<VelocityCorrectionNotification>(*particleStorage);
-            broadcastKernel.operator()<VelocityUpdateNotification>(*particleStorage);
-            timing.stop("Velocity update");
-         }
-         timing.start("Integration");
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
-                                          hcsits_integration, particleAccessor, dt);
-         timing.stop("Integration");
-         timing.stop("HCSITS");
-      }
-      else if(solver == "DEM")
-      {
-         timing.start("DEM");
-         timing.start("Collision");
+                                          [](size_t p_idx, data::ParticleAccessorWithBaseShape& ac){ac.setNumContacts(p_idx,0);}, particleAccessor);
          contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
-                                        [&dem_collision, coefficientOfRestitution, dem_collisionTime, dem_kappa, dt](size_t c, data::ContactAccessor &ca, data::ParticleAccessorWithBaseShape &pa){
+                                        [](size_t c, ContactPoolAccessor &ca, data::ParticleAccessorWithBaseShape &pa) {
                                            auto idx1 = ca.getId1(c);
                                            auto idx2 = ca.getId2(c);
-                                           auto meff = real_t(1) / (pa.getInvMass(idx1) + pa.getInvMass(idx2));
+                                           pa.getNumContactsRef(idx1)++;
+                                           pa.getNumContactsRef(idx2)++;
+                                        }, contactAccessor, particleAccessor);
 
-                                           /*
-                                           // if given stiffness
-                                           dem_collision.setStiffnessN(0,0,dem_stiffnessNormal);
-                                           dem_collision.setStiffnessT(0,0,dem_kappa*dem_stiffnessNormal);
+         if constexpr (LoopConfig_T::sync != SyncType::None) reductionKernel.operator()<NumContactNotification>(*particleStorage);
+         timing.stop("Contact eval");
 
-                                           // Wachs 2019, given stiffness and cor, we can compute damping (but formula in Wachs is probably wrong...)
-                                           auto log_en = std::log(coefficientOfRestitution);
-                                           auto dampingN = - 2_r * std::sqrt(dem_stiffnessNormal * meff) * log_en / (log_en*log_en+math::pi*math::pi);
-                                           dem_collision.setDampingN(0,0,dampingN);
-                                           dem_collision.setDampingT(0,0,std::sqrt(dem_kappa) * dampingN);
-                                            */
 
-                                           dem_collision.setStiffnessAndDamping(0,0,coefficientOfRestitution, dem_collisionTime, dem_kappa, meff);
+         timing.start("Shaking");
+         if(isShakingActive)
+         {
+            real_t shaking_common_term = 2_r * math::pi / shaking_period;
+            real_t shakingAcceleration = shaking_amplitude * std::sin((currentTime - timeBeginShaking) * shaking_common_term) * shaking_common_term * shaking_common_term;
+            if constexpr (LoopConfig_T::isDEM)
+            {
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                [shakingAcceleration](const size_t idx, auto &ac){
+                                                   if(isInFreeFlight(ac.getFlags(idx))) return;
+                                                   addForceAtomic(idx, ac, Vec3(shakingAcceleration,0_r,0_r) / ac.getInvMass(idx));}, particleAccessor);
+            } else
+            {
+               hcsits_initParticles.setGlobalAcceleration(Vector3<real_t>(shakingAcceleration,0_r,-reducedGravitationalAcceleration));
+            }
+         }
+         timing.stop("Shaking");
 
-                                           dem_collision(idx1, idx2, pa, ca.getPosition(c), ca.getNormal(c), ca.getDistance(c), dt);
-                                        },
-                                        contactAccessor, particleAccessor);
-         timing.stop("Collision");
+         if constexpr (LoopConfig_T::isHCSITS)
+         {
+            timing.start("HCSITS");
 
+            timing.start("Init contacts");
+            if constexpr (LoopConfig_T::sync == SyncType::None)
+            {
+               forEachContactAtMinimumImage(useOpenMP, contactAccessor, imageAccessor,
+                                            [&hcsits_initContacts](size_t c, ContactPoolAccessor &ca, MinimumImageAccessor &pa){ hcsits_initContacts(c, ca, pa); });
+            } else
+            {
+               contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
+                                              hcsits_initContacts, contactAccessor, particleAccessor);
+            }
+            timing.stop("Init contacts");
+            timing.start("Init particles");
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
+                                             hcsits_initParticles, particleAccessor, hcsits_dt);
+            timing.stop("Init particles");
 
-         timing.start("Apply gravity");
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                             [reducedGravitationalAcceleration](const size_t idx, auto &ac){addForceAtomic(idx, ac, Vec3(0_r,0_r,-reducedGravitationalAcceleration) / ac.getInvMass(idx));}, particleAccessor);
-         timing.stop("Apply gravity");
+            timing.start("Velocity update");
+            VelocityUpdateNotification::Parameters::relaxationParam = real_t(1.0); // must be set to 1.0 such that dv and dw caused by external forces and torques are not falsely altered
+            reductionKernel.operator()<VelocityCorrectionNotification>(*particleStorage);
+            broadcastKernel.operator()<VelocityUpdateNotification>(*particleStorage);
+            timing.stop("Velocity update");
 
-         timing.start("Reduce");
-         reduceAndSwapContactHistory(*particleStorage);
-         reductionKernel.operator()<ForceTorqueNotification>(*particleStorage);
-         timing.stop("Reduce");
+            VelocityUpdateNotification::Parameters::relaxationParam = hcsits_relaxationParameter;
+            for(uint_t i = uint_t(0); i < hcsits_numberOfIterations; i++){
+               timing.start("Relaxation step");
+               contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
+                                              hcsits_relaxationStep, contactAccessor, particleAccessor, hcsits_dt);
+               timing.stop("Relaxation step");
+               timing.start("Velocity update");
+               reductionKernel.operator()<VelocityCorrectionNotification>(*particleStorage);
+               broadcastKernel.operator()<VelocityUpdateNotification>(*particleStorage);
+               timing.stop("Velocity update");
+            }
+            if(isContactNetworkStep)
+            {
+               // p is the contact reaction force in the contact frame (normal, t, o)
+               contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor,
+                                              [&contactNetworkEvaluator](size_t c, ContactPoolAccessor &ca, data::ParticleAccessorWithBaseShape &pa){
+                                                 contactNetworkEvaluator->addContact(ca.getId1(c), ca.getId2(c), pa, ca.getNormal(c), std::abs(ca.getP(c)[0]));
+                                              }, contactAccessor, particleAccessor);
+            }
+            timing.start("Integration");
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
+                                             hcsits_integration, particleAccessor, hcsits_dt);
+            timing.stop("Integration");
+            timing.stop("HCSITS");
+         }
+         else
+         {
+            timing.start("DEM");
+            timing.start("Collision");
+            auto demCollision = [&dem_collision, coefficientOfRestitution, dem_collisionTime, dem_kappa, dt, &contactNetworkEvaluator, isContactNetworkStep](size_t c, ContactPoolAccessor &ca, auto &pa){
+               auto idx1 = ca.getId1(c);
+               auto idx2 = ca.getId2(c);
+               auto meff = real_t(1) / (pa.getInvMass(idx1) + pa.getInvMass(idx2));
+
+               /*
+               // if given stiffness
+               dem_collision.setStiffnessN(0,0,dem_stiffnessNormal);
+               dem_collision.setStiffnessT(0,0,dem_kappa*dem_stiffnessNormal);
+
+               // Wachs 2019, given stiffness and cor, we can compute damping (but formula in Wachs is probably wrong...)
+               auto log_en = std::log(coefficientOfRestitution);
+               auto dampingN = - 2_r * std::sqrt(dem_stiffnessNormal * meff) * log_en / (log_en*log_en+math::pi*math::pi);
+               dem_collision.setDampingN(0,0,dampingN);
+               dem_collision.setDampingT(0,0,std::sqrt(dem_kappa) * dampingN);
+                */
+
+               dem_collision.setStiffnessAndDamping(0,0,coefficientOfRestitution, dem_collisionTime, dem_kappa, meff);
+
+               dem_collision(idx1, idx2, pa, ca.getPosition(c), ca.getNormal(c), ca.getDistance(c), dt);
+
+               if(isContactNetworkStep && ca.getDistance(c) < 0_r)
+               {
+                  // normal force of the linear spring dashpot model, -k delta + gamma v_n as in kernel::LinearSpringDashpot
+                  const Vec3 relVel = getVelocityAtWFPoint(idx2, pa, ca.getPosition(c)) - getVelocityAtWFPoint(idx1, pa, ca.getPosition(c));
+                  const real_t normalForce = std::abs(-dem_collision.getStiffnessN(0,0) * ca.getDistance(c) + dem_collision.getDampingN(0,0) * (relVel * ca.getNormal(c)));
+                  contactNetworkEvaluator->addContact(idx1, idx2, pa, ca.getNormal(c), normalForce);
+               }
+            };
+            if constexpr (LoopConfig_T::sync == SyncType::None) forEachContactAtMinimumImage(useOpenMP, contactAccessor, imageAccessor, demCollision);
+            else contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), contactAccessor, demCollision, contactAccessor, particleAccessor);
+            timing.stop("Collision");
 
-         timing.start("Integration");
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                          dem_integration, particleAccessor);
-         timing.stop("Integration");
 
-         timing.stop("DEM");
+            timing.start("Apply gravity");
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                [reducedGravitationalAcceleration](const size_t idx, auto &ac){
+                                   if(isInFreeFlight(ac.getFlags(idx))) return; // already advanced over the large step
+                                   addForceAtomic(idx, ac, Vec3(0_r,0_r,-reducedGravitationalAcceleration) / ac.getInvMass(idx));}, particleAccessor);
+            timing.stop("Apply gravity");
 
-      }
+            timing.start("Reduce");
+            if constexpr (LoopConfig_T::sync == SyncType::None)
+            {
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                [](size_t idx, data::ParticleAccessorWithBaseShape &ac){ swapContactHistory(idx, ac); }, particleAccessor);
+            } else
+            {
+               reduceAndSwapContactHistory(*particleStorage);
+               reductionKernel.operator()<ForceTorqueNotification>(*particleStorage);
+            }
+            timing.stop("Reduce");
 
-      if(limitVelocity > 0_r)
-      {
-         timing.start("Velocity limiting");
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                          [limitVelocity](const size_t idx, auto &ac){
-                                             auto velMagnitude = ac.getLinearVelocity(idx).length();
-                                             if(velMagnitude > limitVelocity) ac.getLinearVelocityRef(idx) *= (limitVelocity / velMagnitude );
-                                          }, particleAccessor);
-         timing.stop("Velocity limiting");
-      }
+            timing.start("Integration");
+            if(isMultirateWindowActive)
+            {
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                [&dem_integration](const size_t idx, auto &ac){ if(!isInFreeFlight(ac.getFlags(idx))) dem_integration(idx, ac); }, particleAccessor);
+            } else
+            {
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                dem_integration, particleAccessor);
+            }
+            timing.stop("Integration");
 
+            timing.stop("DEM");
 
-      timing.start("Sync");
-      syncCall();
-      particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                       associateToBlock, particleAccessor);
-      timing.stop("Sync");
+         }
 
-      timing.start("Evaluate particles");
-      auto particleInfo = evaluateParticleInfo(particleAccessor);
+         if(velocityLimit > 0_r)
+         {
+            timing.start("Velocity limiting");
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                             [velocityLimit](const size_t idx, auto &ac){
+                                                auto velMagnitude = ac.getLinearVelocity(idx).length();
+                                                if(velMagnitude > velocityLimit) ac.getLinearVelocityRef(idx) *= (velocityLimit / velMagnitude );
+                                             }, particleAccessor);
+            timing.stop("Velocity limiting");
+         }
 
-      if(particleInfo.particleVolume * particleDensity < totalParticleMass)
-      {
 
-         timing.start("Generation");
-         // check if generation
-         if(particleInfo.maximumHeight < generationHeightRatioStart * simulationDomain.zSize() - generationSpacing || currentTime - timeLastCreation > maximumTimeBetweenCreation)
+         timing.start("Sync");
+         sync();
+         // between full syncs, the ownership and thus the block association is unchanged
+         if(LoopConfig_T::sync != SyncType::None && (!deltaGhostSync || deltaGhostSync->lastSyncWasFull()))
          {
-            particleCreator.createParticles( std::max(minGenerationHeight, generationHeightRatioStart * simulationDomain.zMax()),
-                                             std::min(maxGenerationHeight, generationHeightRatioEnd * simulationDomain.zMax()),
-                                             generationSpacing, diameterGenerator, shapeGenerator, initialVelocity, maximumAllowedInteractionRadius);
-
             particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
                                              associateToBlock, particleAccessor);
+         }
+         timing.stop("Sync");
 
-            if(useNextNeighborSync){ syncCall(); }
-            else { for(uint_t i = 0; i < uint_c(std::ceil(maxParticleDiameter/smallestBlockSize)); ++i) syncCall(); }
+         if(phaseProfiler.useCounters())
+         {
+            phaseProfiler.count("bytesSent", syncBytesSent);
+            phaseProfiler.count("syncCalls", numSyncCalls);
+            if(deltaGhostSync) phaseProfiler.count("fullSyncs", numFullSyncs);
+            syncBytesSent = 0;
+            numSyncCalls = 0;
+            numFullSyncs = 0;
+            uint64_t numGhostParticles = 0;
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
+                                             [&numGhostParticles](size_t idx, data::ParticleAccessorWithBaseShape &ac){
+                                                if(isSet(ac.getFlags(idx), data::particle_flags::GHOST)) ++numGhostParticles;}, particleAccessor);
+            phaseProfiler.count("ghostParticles", numGhostParticles);
+         }
 
-            timeLastCreation = currentTime;
+         timing.start("Evaluate particles");
+         auto particleInfo = evaluateParticleInfo(particleAccessor);
+         accumulatedParticleTimeSteps += uint64_c(particleInfo.numParticles);
 
-            // write current particle distribution info
-            particleHistogram.clear();
-            particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                             particleHistogram, particleAccessor);
-            particleHistogram.evaluate();
-            WALBERLA_LOG_INFO_ON_ROOT(particleHistogram);
-         }
-         timing.stop("Generation");
-      } else if(shaking)
-      {
-         timing.start("Shaking");
-         // apply shaking
-         if(timeEndShaking < 0_r){
-            if(!isShakingActive)
+         isGenerating = particleInfo.particleVolume * particleDensity < totalParticleMass;
+         // the solver and shape family are decided right after the generation check, such that the following phase
+         // (beginning of shaking or damping) is already simulated in the new stage
+         const bool isStageSwitchDue = isHybridSwitchDue(LoopConfig_T::solver) || isProxySwitchDue(LoopConfig_T::shape);
+         if(isStageSwitchDue)
+         {
+            // the phase begins with the first time step of the next stage
+         } else if(isGenerating)
+         {
+
+            switchPhase(isShakingActive ? "generation+shaking" : "generation");
+            timing.start("Generation");
+            // check if generation
+            if(particleInfo.maximumHeight < generationHeightRatioStart * simulationDomain.zSize() - generationSpacing || currentTime - timeLastCreation > maximumTimeBetweenCreation)
+            {
+               particleCreator.createParticles( std::max(minGenerationHeight, generationHeightRatioStart * simulationDomain.zMax()),
+                                                std::min(maxGenerationHeight, generationHeightRatioEnd * simulationDomain.zMax()),
+                                                generationSpacing, diameterGenerator, shapeGenerator, initialVelocity, maximumAllowedInteractionRadius);
+
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                associateToBlock, particleAccessor);
+
+               if constexpr (LoopConfig_T::sync != SyncType::GhostOwners){ sync(); }
+               else { for(uint_t i = 0; i < uint_c(std::ceil(maxParticleDiameter/smallestBlockSize)); ++i) sync(); }
+
+               timeLastCreation = currentTime;
+
+               // write current particle distribution info
+               particleHistogram.clear();
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                particleHistogram, particleAccessor);
+               particleHistogram.evaluate();
+               WALBERLA_LOG_INFO_ON_ROOT(particleHistogram);
+               recordParticleHistograms(currentTime);
+            }
+            timing.stop("Generation");
+         } else if(shaking)
+         {
+            switchPhase("shaking");
+            timing.start("Shaking");
+            // apply shaking
+            if(timeEndShaking < 0_r){
+               if(compactionController)
+               {
+                  if(!isShakingActive)
+                  {
+                     isShakingActive = true;
+                     timeBeginShaking = currentTime;
+                  }
+                  compactionController->begin(currentTime, timeBeginShaking);
+                  timeEndShaking = std::numeric_limits<real_t>::max(); // ended by the controller
+                  WALBERLA_LOG_INFO_ON_ROOT("Beginning of controlled shaking at time " << currentTime << " s.");
+               } else if(!isShakingActive)
+               {
+                  isShakingActive = true;
+                  timeBeginShaking = currentTime;
+                  timeEndShaking = currentTime + shaking_duration;
+                  WALBERLA_LOG_INFO_ON_ROOT("Beginning of shaking at time " << currentTime << " s for " << shaking_duration << " s.");
+               } else {
+                  //timeEndShaking = real_c(std::ceil((currentTime + shaking_duration) / shaking_period)) * shaking_period; // make sure to shake only full periods
+                  timeEndShaking = currentTime + shaking_duration; // since its unclear if full periods are really necessary and actually "improve" results, we skip this here
+                  WALBERLA_LOG_INFO_ON_ROOT("Continue of shaking at time " << currentTime << " s until time " << timeEndShaking << " s.");
+               }
+            }
+
+            bool isShakingFinished = currentTime > timeEndShaking;
+            if(compactionController)
             {
-               isShakingActive = true;
-               timeBeginShaking = currentTime;
-               timeEndShaking = currentTime + shaking_duration;
-               WALBERLA_LOG_INFO_ON_ROOT("Beginning of shaking at time " << currentTime << " s for " << shaking_duration << " s.");
-            } else {
-               //timeEndShaking = real_c(std::ceil((currentTime + shaking_duration) / shaking_period)) * shaking_period; // make sure to shake only full periods
-               timeEndShaking = currentTime + shaking_duration; // since its unclear if full periods are really necessary and actually "improve" results, we skip this here
-               WALBERLA_LOG_INFO_ON_ROOT("Continue of shaking at time " << currentTime << " s until time " << timeEndShaking << " s.");
+               isShakingFinished = compactionController->update(currentTime, particleInfo.heightOfMass, particleInfo.particleVolume);
+               shaking_amplitude = compactionController->getAmplitude();
             }
-         }
 
-         if(currentTime > timeEndShaking)
+            if(isShakingFinished)
+            {
+               WALBERLA_LOG_INFO_ON_ROOT("Ending of shaking at time " << currentTime << " s.");
+               shaking = false;
+               isShakingActive = false;
+            }
+            timing.stop("Shaking");
+
+         } else
          {
-            WALBERLA_LOG_INFO_ON_ROOT("Ending of shaking at time " << currentTime << " s.");
-            shaking = false;
-            isShakingActive = false;
-         }
-         timing.stop("Shaking");
+            switchPhase("damping");
+            timing.start("Damping");
 
-      } else
-      {
-         timing.start("Damping");
+            if(timeBeginDamping < 0_r){
+               // after the swap of proxies for meshes, convergence is checked after the relaxation only
+               timeBeginDamping = std::max(currentTime, proxy_relaxationEndTime);
+               WALBERLA_LOG_INFO_ON_ROOT("Beginning of damping at time " << currentTime << " s with damping factor " << velocityDampingFactor << " until convergence");
+            }
 
-         if(timeBeginDamping < 0_r){
-            timeBeginDamping = currentTime;
-            WALBERLA_LOG_INFO_ON_ROOT("Beginning of damping at time " << timeBeginDamping << " s with damping factor " << velocityDampingFactor << " until convergence");
-         }
+            // apply damping
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
+                                             [velocityDampingFactor](size_t idx, data::ParticleAccessorWithBaseShape &ac){
+                                                ac.getLinearVelocityRef(idx) *= velocityDampingFactor;
+                                                ac.getAngularVelocityRef(idx) *= velocityDampingFactor;},
+                                              particleAccessor);
 
-         // apply damping
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
-                                          [velocityDampingFactor](size_t idx, data::ParticleAccessorWithBaseShape &ac){
-                                             ac.getLinearVelocityRef(idx) *= velocityDampingFactor;
-                                             ac.getAngularVelocityRef(idx) *= velocityDampingFactor;},
-                                           particleAccessor);
+            if(useTiling && currentTime - timeBeginDamping >= tilingParameters.relaxationDuration)
+            {
+               WALBERLA_LOG_INFO_ON_ROOT("Reached maximal relaxation time of the tiled bed - terminating.");
+               terminateSimulation = true;
+            }
 
-         // check if termination
-         if(currentTime - timeBeginDamping > minimalTerminalRunTime)
-         {
-            if(currentTime - timeLastTerminationCheck > terminationCheckingSpacing)
+            // check if termination
+            if(currentTime - timeBeginDamping > minimalTerminalRunTime)
             {
-               if(particleInfo.maximumVelocity < terminalVelocity)
+               if(currentTime - timeLastTerminationCheck > terminationCheckingSpacing)
                {
-                  WALBERLA_LOG_INFO_ON_ROOT("Reached terminal max velocity - terminating.");
-                  terminateSimulation = true;
+                  if(particleInfo.maximumVelocity < terminalVelocity)
+                  {
+                     WALBERLA_LOG_INFO_ON_ROOT("Reached terminal max velocity - terminating.");
+                     terminateSimulation = true;
+                  }
+
+                  real_t relDiffAvgHeight = std::abs(particleInfo.heightOfMass - oldAvgParticleHeight) / oldAvgParticleHeight;
+                  real_t relDiffMaxHeight = std::abs(particleInfo.maximumHeight - oldMaxParticleHeight) / oldMaxParticleHeight;
+                  if(relDiffMaxHeight < 10_r * terminalRelativeHeightChange && relDiffAvgHeight < terminalRelativeHeightChange)
+                  {
+                     // check of max height has to be included to avoid early termination if only little mass is created per generation step
+                     WALBERLA_LOG_INFO_ON_ROOT("Reached converged maximum and mass-averaged height - terminating.");
+                     terminateSimulation = true;
+                  }
+
+                  oldAvgParticleHeight = particleInfo.heightOfMass;
+                  oldMaxParticleHeight = particleInfo.maximumHeight;
+                  timeLastTerminationCheck = currentTime;
                }
+            }
+            timing.stop("Damping");
+         }
+         timing.stop("Evaluate particles");
+
+         if(( infoSpacing > 0 && stageTimestep % infoSpacing == 0) || isLoggingStep)
+         {
+            timing.start("Evaluate infos");
+            auto contactInfo = evaluateContactInfo(contactAccessor);
 
-               real_t relDiffAvgHeight = std::abs(particleInfo.heightOfMass - oldAvgParticleHeight) / oldAvgParticleHeight;
-               real_t relDiffMaxHeight = std::abs(particleInfo.maximumHeight - oldMaxParticleHeight) / oldMaxParticleHeight;
-               if(relDiffMaxHeight < 10_r * terminalRelativeHeightChange && relDiffAvgHeight < terminalRelativeHeightChange)
+            porosityEvaluator.clear();
+            particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                             porosityEvaluator, particleAccessor);
+            porosityEvaluator.evaluate();
+            real_t estimatedPorosity = porosityEvaluator.estimateTotalPorosity();
+
+
+            if(isLoggingStep)
+            {
+               loggingWriter(currentTime, particleInfo, contactInfo, estimatedPorosity);
+               if(timeSeries)
                {
-                  // check of max height has to be included to avoid early termination if only little mass is created per generation step
-                  WALBERLA_LOG_INFO_ON_ROOT("Reached converged maximum and mass-averaged height - terminating.");
-                  terminateSimulation = true;
+                  timeSeries->recordStep(currentTime, timestep, phaseProfiler.getCurrentPhase(), particleInfo, contactInfo, estimatedPorosity);
+                  timeSeries->recordTimings(currentTime, phaseProfiler.getCurrentPhase(), timing.getTree());
                }
+            }
 
-               oldAvgParticleHeight = particleInfo.heightOfMass;
-               oldMaxParticleHeight = particleInfo.maximumHeight;
-               timeLastTerminationCheck = currentTime;
+            if(isContactNetworkStep)
+            {
+               particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
+                                                [&contactNetworkEvaluator](size_t idx, data::ParticleAccessorWithBaseShape &ac){ (*contactNetworkEvaluator)(idx, ac); }, particleAccessor);
+               contactNetworkEvaluator->evaluate(currentTime);
             }
-         }
-         timing.stop("Damping");
-      }
-      timing.stop("Evaluate particles");
 
-      if(( infoSpacing > 0 && timestep % infoSpacing == 0) || (loggingSpacing > 0 && timestep % loggingSpacing == 0))
-      {
-         timing.start("Evaluate infos");
-         auto contactInfo = evaluateContactInfo(contactAccessor);
+            if(infoSpacing > 0 && stageTimestep % infoSpacing == 0) {
+               WALBERLA_LOG_INFO_ON_ROOT("t = " << timestep << " = " << currentTime << " s");
+               WALBERLA_LOG_INFO_ON_ROOT(particleInfo << " => " << particleInfo.particleVolume * particleDensity << " kg" << ", current porosity = " << estimatedPorosity);
+               real_t ensembleAverageDiameter = diameterFromSphereVolume(particleInfo.particleVolume / real_c(particleInfo.numParticles));
+               WALBERLA_LOG_INFO_ON_ROOT(contactInfo << " => " << contactInfo.maximumPenetrationDepth / ensembleAverageDiameter * real_t(100) << "% of avg diameter " << ensembleAverageDiameter);
+            }
 
-         porosityEvaluator.clear();
-         particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
-                                          porosityEvaluator, particleAccessor);
-         porosityEvaluator.evaluate();
-         real_t estimatedPorosity = porosityEvaluator.estimateTotalPorosity();
+            timing.stop("Evaluate infos");
+         }
 
+         if(profiling_reportSpacing > 0 && stageTimestep % profiling_reportSpacing == 0)
+         {
+            auto performanceReport = phaseProfiler.getReport(timing.getTree());
+            WALBERLA_ROOT_SECTION()
+            {
+               std::ofstream file(performanceFileName, std::ofstream::app);
+               file << "t = " << currentTime << " s, time step " << timestep << "\n" << performanceReport << "\n";
+            }
+         }
 
-         if(loggingSpacing > 0 && timestep % loggingSpacing == 0)
+         if(autoTuner && autoTuner->isProbing() && autoTuner->endStep())
          {
-            loggingWriter(currentTime, particleInfo, contactInfo, estimatedPorosity);
+            WALBERLA_LOG_INFO_ON_ROOT(autoTuner->getReport());
+            const auto & best = autoTuner->getBest();
+            applyTuningCandidate(best);
+            WALBERLA_LOG_INFO_ON_ROOT("Auto-tuning selected " << best.getName() << " after " << autoTuner->getNumberOfProbeSteps()
+                                      << " probe time steps. To reuse without probing, set useHashGrids " << (best.useHashGrids ? "true" : "false")
+                                      << (best.useHashGrids ? "" : "; linkedCellWidthFactor " + std::to_string(best.cellWidthFactor) + "; particleSortingSpacing " + std::to_string(best.sortingSpacing))
+                                      << "; and disable AutoTuning.");
          }
 
-         if(infoSpacing > 0 && timestep % infoSpacing == 0) {
-            WALBERLA_LOG_INFO_ON_ROOT("t = " << timestep << " = " << currentTime << " s");
-            WALBERLA_LOG_INFO_ON_ROOT(particleInfo << " => " << particleInfo.particleVolume * particleDensity << " kg" << ", current porosity = " << estimatedPorosity);
-            real_t ensembleAverageDiameter = diameterFromSphereVolume(particleInfo.particleVolume / real_c(particleInfo.numParticles));
-            WALBERLA_LOG_INFO_ON_ROOT(contactInfo << " => " << contactInfo.maximumPenetrationDepth / ensembleAverageDiameter * real_t(100) << "% of avg diameter " << ensembleAverageDiameter);
+         ++timestep;
+
+         if(benchmarkTimeSteps > 0 && timestep >= benchmarkTimeSteps)
+         {
+            WALBERLA_LOG_INFO_ON_ROOT("Reached number of benchmark time steps - terminating.");
+            terminateSimulation = true;
          }
 
-         timing.stop("Evaluate infos");
+         if(isStageSwitchDue) break;
+      }
+   };
+
+   auto syncType = useSingleProcessFastPath ? SyncType::None : (useNextNeighborSync ? SyncType::NextNeighbors : SyncType::GhostOwners);
+   // wall-clock time, time steps and simulated time per solver, accumulated over all stages
+   std::map<std::string, std::tuple<double, uint_t, real_t>> solverStages;
+   double proxyStageWallTime = 0.0;
+   auto runSolverStage = [&](SolverType stageSolver, ShapeFamily stageShape)
+   {
+      WcTimer stageTimer;
+      uint_t stageBegin = timestep;
+      stageTimer.start();
+      dispatchTimeLoop(stageSolver, stageShape, syncType, timeLoop);
+      stageTimer.end();
+      auto & stage = solverStages[(stageSolver == SolverType::DEM) ? "DEM" : "HCSITS"];
+      std::get<0>(stage) += stageTimer.total();
+      std::get<1>(stage) += timestep - stageBegin;
+      std::get<2>(stage) += stageDt * real_c(timestep - stageBegin);
+      if(stageShape != shapeFamily) proxyStageWallTime += stageTimer.total();
+   };
+
+   SolverType stageSolver = isHybrid ? SolverType::HCSITS : solverTypeFromString(solver);
+   ShapeFamily stageShape = useProxySettling ? getProxyShapeFamily(proxyType, useAnalyticEllipsoidContact) : shapeFamily;
+   double proxySwapWallTime = 0.0;
+   real_t proxySwapTime = real_t(-1);
+   while(true)
+   {
+      runSolverStage(stageSolver, stageShape);
+      if(isMultirateWindowActive)
+      {
+         multirateScheduler->releaseAll(particleAccessor);
+         isMultirateWindowActive = false;
+      }
+      if(terminateSimulation) break;
+      real_t switchTime = stageBeginTime + stageDt * real_c(timestep - stageBeginTimestep);
+
+      if(isHybridSwitchDue(stageSolver))
+      {
+         WALBERLA_LOG_INFO_ON_ROOT("Switching from HCSITS to DEM at time " << switchTime << " s (time step " << timestep << ").");
+
+         // HCSITS leaves no tangential contact history and may leave velocity corrections and forces behind:
+         // start DEM from a clean state on all particles (local and ghost), such that all contacts begin with zero tangential spring displacement
+         particleStorage->forEachParticle(useOpenMP, kernel::SelectAll(), particleAccessor,
+                                          [](size_t idx, data::ParticleAccessorWithBaseShape &ac){
+                                             ac.getOldContactHistoryRef(idx).clear();
+                                             ac.getNewContactHistoryRef(idx).clear();
+                                             ac.setForce(idx, Vec3(0_r));
+                                             ac.setTorque(idx, Vec3(0_r));
+                                             ac.setDv(idx, Vec3(0_r));
+                                             ac.setDw(idx, Vec3(0_r));
+                                          }, particleAccessor);
+         auto contactInfo = evaluateContactInfo(contactAccessor);
+         WALBERLA_LOG_INFO_ON_ROOT("Contacts at handover: " << contactInfo);
+
+         stageBeginTime = switchTime;
+         stageBeginTimestep = timestep;
+         stageDt = dt;
+         visSpacing = uint_c(visSpacingInSeconds / dt);
+         infoSpacing = uint_c(infoSpacingInSeconds / dt);
+         loggingSpacing = uint_c(loggingSpacingInSeconds / dt);
+         profiling_reportSpacing = uint_c(std::max(real_t(0), profiling_reportSpacingInSeconds) / dt);
+         // the write frequency is given in time steps, thus a new output series with the DEM time step size
+         particleVtkWriter = walberla::vtk::createVTKOutput_PointData(particleVtkOutput, "particles_DEM", visSpacing, vtkOutputFolder, "simulation_step");
+         meshParticleVTK = createMeshParticleVTK("mesh_DEM", visSpacing);
+         stageSolver = SolverType::DEM;
       }
 
-      ++timestep;
+      if(isProxySwitchDue(stageShape))
+      {
+         WALBERLA_LOG_INFO_ON_ROOT("Replacing proxies by meshes at time " << switchTime << " s (time step " << timestep << ").");
+         WcTimer swapTimer;
+         swapTimer.start();
+         // the mesh is recovered from the proxy geometry, such that owner and ghosts are swapped consistently without communication
+         // contact histories refer to the proxy geometry and are discarded
+         particleStorage->forEachParticle(false, kernel::SelectAll(), particleAccessor,
+                                          [&](size_t idx, data::ParticleAccessorWithBaseShape &ac){
+                                             if(!proxyMeshesGenerator->replaceProxyByMesh(idx, ac, particleDensity, maximumAllowedInteractionRadius)) return;
+                                             ac.getOldContactHistoryRef(idx).clear();
+                                             ac.getNewContactHistoryRef(idx).clear();
+                                          }, particleAccessor);
+         // larger interaction radii may require additional ghost particles
+         if(useNextNeighborSync || useSingleProcessFastPath){ syncCall(); }
+         else { for(uint_t i = 0; i < uint_c(std::ceil(maxParticleDiameter/smallestBlockSize)); ++i) syncCall(); }
+         swapTimer.end();
+         proxySwapWallTime = swapTimer.total();
+         proxySwapTime = switchTime;
+
+         auto info = evaluateParticleInfo(particleAccessor);
+         WALBERLA_LOG_INFO_ON_ROOT("Particles after swap: " << info);
+
+         proxy_relaxationEndTime = switchTime + proxy_relaxationDuration;
+         // convergence is checked after the relaxation only, if the damping has not begun yet, this is done at its beginning
+         if(timeBeginDamping >= 0_r) timeBeginDamping = proxy_relaxationEndTime;
+         stageShape = shapeFamily;
+      }
    }
 
    if(timing.isTimerRunning("Evaluate particles")) timing.stop("Evaluate particles");
@@ -1200,6 +2326,16 @@ int main(int argc, char **argv) {
                                     particleHistogram, particleAccessor);
    particleHistogram.evaluate();
    WALBERLA_LOG_INFO_ON_ROOT(particleHistogram);
+   recordParticleHistograms(stageBeginTime + stageDt * real_c(timestep - stageBeginTimestep));
+   if(timeSeries) timeSeries->flush();
+
+   std::vector<std::pair<std::string, real_t>> tiling_histogramDeviations;
+   if(useTiling)
+   {
+      tiling_histogramDeviations = getTilingHistogramDeviations();
+      for(const auto & deviation : tiling_histogramDeviations)
+         WALBERLA_LOG_INFO_ON_ROOT("Tiling: deviation of the " << deviation.first << " histogram of the final bed from the source packing = " << deviation.second);
+   }
 
    porosityEvaluator.clear();
    particleStorage->forEachParticle(useOpenMP, kernel::SelectLocal(), particleAccessor,
@@ -1212,6 +2348,13 @@ int main(int argc, char **argv) {
    WALBERLA_LOG_INFO_ON_ROOT("Writing porosity profile file to " << porosityFileName);
    porosityEvaluator.printToFile(porosityFileName);
 
+   if(writePackingSnapshotFile)
+   {
+      std::string packingFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_packing.bin";
+      WALBERLA_LOG_INFO_ON_ROOT("Writing packing snapshot to " << packingFileName);
+      writePackingSnapshot(packingFileName, *particleStorage, simulationDomain, isPeriodic, estimatedFinalPorosity);
+   }
+
    ContactInfoPerHorizontalLayerEvaluator contactEvaluator(evaluationLayerHeight, simulationDomain);
    contactStorage->forEachContact(useOpenMP, kernel::SelectAll(), particleAccessor,
                                   contactEvaluator, contactAccessor);
@@ -1220,9 +2363,52 @@ int main(int argc, char **argv) {
    WALBERLA_LOG_INFO_ON_ROOT("Writing contact info profile file to " << contactInfoFileName);
    contactEvaluator.printToFile(contactInfoFileName);
 
+   const Config::BlockHandle permeabilityConf = cfg->getBlock("Permeability");
+   bool usePermeabilityEstimation = permeabilityConf && permeabilityConf.getParameter<bool>("enabled");
+   PermeabilityResult permeabilityResult;
+   if(usePermeabilityEstimation)
+   {
+      if(domainSetup != "periodic")
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Permeability estimation requires the periodic domain setup - skipping.");
+         usePermeabilityEstimation = false;
+      } else
+      {
+         timing.start("Permeability");
+         PermeabilityEstimator permeabilityEstimator(forest, PermeabilityParameters::fromConfig(permeabilityConf));
+         permeabilityResult = permeabilityEstimator.run(particleAccessor, simulationDomain, isPeriodic);
+         timing.stop("Permeability");
+         WALBERLA_LOG_INFO_ON_ROOT("Permeability = " << permeabilityResult.permeability << " m^2 (porosity of voxelized bed region = " << permeabilityResult.evaluationPorosity
+                                   << ", Re = " << permeabilityResult.reynoldsNumber << ", " << permeabilityResult.timesteps << " time steps"
+                                   << (permeabilityResult.converged ? "" : ", not converged") << ")");
+         std::string permeabilityFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_lbm_layers.txt";
+         WALBERLA_LOG_INFO_ON_ROOT("Writing flow profile file to " << permeabilityFileName);
+         permeabilityResult.printToFile(permeabilityFileName);
+      }
+   }
+
    auto reducedTT = timing.getReduced();
    WALBERLA_LOG_INFO_ON_ROOT(reducedTT);
 
+   uint64_t contactPoolMemory = uint64_c(contactStorage->getMemory());
+   uint64_t contactPoolAllocations = uint64_c(contactStorage->getNumberOfAllocations());
+   walberla::mpi::reduceInplace(contactPoolMemory, walberla::mpi::MAX);
+   walberla::mpi::reduceInplace(contactPoolAllocations, walberla::mpi::MAX);
+   WALBERLA_LOG_INFO_ON_ROOT("Contact storage (max. over processes): " << real_c(contactPoolMemory) / 1e6_r << " MB, "
+                             << contactPoolAllocations << " allocations" << (contactStorage->hasHCSITSFields() ? ", with HCSITS properties" : ""));
+
+   PhaseProfiler::ReducedData reducedPhaseTimes;
+   PhaseProfiler::ReducedData reducedPhaseCounters;
+   phaseProfiler.reduce(timing.getTree(), reducedPhaseTimes, reducedPhaseCounters);
+   WALBERLA_LOG_INFO_ON_ROOT("Per-process timing and load imbalance per phase:\n" << phaseProfiler.getReport(reducedPhaseTimes, reducedPhaseCounters));
+
+   if(profiling_traceSpacing > 0)
+   {
+      std::string traceFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_trace.json";
+      WALBERLA_LOG_INFO_ON_ROOT("Writing Chrome trace file to " << traceFileName);
+      timing.writeTrace(traceFileName);
+   }
+
    bool logToProcessLocalFiles = false;
    std::string particleInfoFileName = porosityProfileFolder + "/" +  uniqueFileIdentifier + "_particle_info";
    if(logToProcessLocalFiles)
@@ -1240,6 +2426,29 @@ int main(int argc, char **argv) {
    // write to sqlite data base
    auto particleInfo = evaluateParticleInfo(particleAccessor);
    auto contactInfo = evaluateContactInfo(contactAccessor);
+   walberla::mpi::reduceInplace(numFreeFlightParticleSteps, walberla::mpi::SUM);
+   int64_t deltaSyncBytesFull = deltaGhostSync ? deltaGhostSync->getBytesSentByFullSyncs() : int64_t(0);
+   int64_t deltaSyncBytesDelta = deltaGhostSync ? deltaGhostSync->getBytesSentByDeltaSyncs() : int64_t(0);
+   walberla::mpi::reduceInplace(deltaSyncBytesFull, walberla::mpi::SUM);
+   walberla::mpi::reduceInplace(deltaSyncBytesDelta, walberla::mpi::SUM);
+   if(deltaGhostSync)
+   {
+      const uint_t numSyncs = deltaGhostSync->getNumberOfFullSyncs() + deltaGhostSync->getNumberOfDeltaSyncs();
+      WALBERLA_LOG_INFO_ON_ROOT("Delta ghost sync: " << deltaGhostSync->getNumberOfFullSyncs() << " full and " << deltaGhostSync->getNumberOfDeltaSyncs()
+                                << " delta syncs, avg. bytes sent per sync (all processes): full = " << ((deltaGhostSync->getNumberOfFullSyncs() > 0) ? double(deltaSyncBytesFull) / double(deltaGhostSync->getNumberOfFullSyncs()) : 0.0)
+                                << ", delta = " << ((deltaGhostSync->getNumberOfDeltaSyncs() > 0) ? double(deltaSyncBytesDelta) / double(deltaGhostSync->getNumberOfDeltaSyncs()) : 0.0)
+                                << ", overall = " << ((numSyncs > 0) ? double(deltaSyncBytesFull + deltaSyncBytesDelta) / double(numSyncs) : 0.0));
+   }
+
+   uint64_t mixedPrecisionRejectedPairs = mixedPrecision.getNumberOfRejectedPairs();
+   uint64_t mixedPrecisionWronglyRejectedPairs = mixedPrecision.getNumberOfWronglyRejectedPairs();
+   walberla::mpi::reduceInplace(mixedPrecisionRejectedPairs, walberla::mpi::SUM);
+   walberla::mpi::reduceInplace(mixedPrecisionWronglyRejectedPairs, walberla::mpi::SUM);
+   if(useMixedPrecision)
+   {
+      WALBERLA_LOG_INFO_ON_ROOT("Mixed precision: " << mixedPrecisionRejectedPairs << " candidate pairs rejected in single precision"
+                                << (mixedPrecision.isValidating() ? ", " + std::to_string(mixedPrecisionWronglyRejectedPairs) + " of them not rejected in double precision" : std::string()));
+   }
 
    WALBERLA_ROOT_SECTION() {
       std::map<std::string, walberla::int64_t> sql_integerProperties;
@@ -1260,6 +2469,48 @@ int main(int argc, char **argv) {
       // other info
       sql_realProperties["simulationTime"] = double(reducedTT["Simulation"].total());
       sql_integerProperties["numProcesses"] = int64_c(walberla::mpi::MPIManager::instance()->numProcesses());
+      sql_integerProperties["usedSingleProcessFastPath"] = useSingleProcessFastPath ? 1 : 0;
+      sql_integerProperties["contactPool_maxMemory"] = int64_c(contactPoolMemory);
+      sql_integerProperties["contactPool_maxAllocations"] = int64_c(contactPoolAllocations);
+      if(useMixedPrecision)
+      {
+         sql_integerProperties["mixedPrecision_rejectedPairs"] = int64_c(mixedPrecisionRejectedPairs);
+         if(mixedPrecision.isValidating()) sql_integerProperties["mixedPrecision_wronglyRejectedPairs"] = int64_c(mixedPrecisionWronglyRejectedPairs);
+      }
+      if(compactionController)
+      {
+         sql_realProperties["shaking_control_duration"] = double(compactionController->getDuration());
+         sql_realProperties["shaking_control_finalAmplitude"] = double(compactionController->getAmplitude());
+         sql_realProperties["shaking_control_estimatedPorosity"] = double(compactionController->getEstimatedPorosity());
+         sql_realProperties["shaking_control_compactionRate"] = double(compactionController->getCompactionRate());
+         sql_integerProperties["shaking_control_annealingSteps"] = int64_c(compactionController->getNumberOfAnnealingSteps());
+         sql_stringProperties["shaking_control_stopReason"] = compactionController->getStopReason();
+      }
+      if(autoTuner)
+      {
+         sql_integerProperties["autoTuning_completed"] = autoTuner->isProbing() ? 0 : 1;
+         if(!autoTuner->isProbing())
+         {
+            const auto & best = autoTuner->getBest();
+            sql_integerProperties["autoTuning_useHashGrids"] = best.useHashGrids ? 1 : 0;
+            sql_realProperties["autoTuning_linkedCellWidthFactor"] = double(best.cellWidthFactor);
+            sql_integerProperties["autoTuning_particleSortingSpacing"] = int64_c(best.sortingSpacing);
+            sql_realProperties["autoTuning_timePerStep"] = autoTuner->getBestTimePerStep();
+         }
+      }
+      sql_integerProperties["multirate_enabled"] = useMultirate ? 1 : 0; // effective, disabled for solvers other than DEM
+      if(useMultirate)
+      {
+         sql_integerProperties["multirate_numSubcycles"] = int64_c(multirateScheduler->getNumberOfSubcycles());
+         sql_realProperties["multirate_freeFlightFraction"] = (accumulatedParticleTimeSteps > 0) ? double(numFreeFlightParticleSteps) / double(accumulatedParticleTimeSteps) : 0.0;
+      }
+      if(deltaGhostSync)
+      {
+         sql_integerProperties["deltaSync_numFullSyncs"] = int64_c(deltaGhostSync->getNumberOfFullSyncs());
+         sql_integerProperties["deltaSync_numDeltaSyncs"] = int64_c(deltaGhostSync->getNumberOfDeltaSyncs());
+         sql_integerProperties["deltaSync_bytesSentFull"] = deltaSyncBytesFull;
+         sql_integerProperties["deltaSync_bytesSentDelta"] = deltaSyncBytesDelta;
+      }
       sql_integerProperties["timesteps"] = int64_c(timestep);
       sql_stringProperties["file_identifier"] = uniqueFileIdentifier;
       sql_realProperties["generationSpacing"] = double(generationSpacing);
@@ -1271,6 +2522,87 @@ int main(int argc, char **argv) {
       sql_stringProperties["evaluation_numberHistogramData"] = numberHistogramData;
       sql_integerProperties["singleShape"] = (shapeGenerator->generatesSingleShape()) ? 1 : 0;
       sql_realProperties["maxAllowedInteractionRadius"] = double(maximumAllowedInteractionRadius);
+      sql_stringProperties["gitSHA1"] = core::buildinfo::gitSHA1();
+      sql_stringProperties["buildType"] = core::buildinfo::buildType();
+      for(const auto & stage : solverStages)
+      {
+         sql_realProperties["wallTime_" + stage.first] = std::get<0>(stage.second);
+         sql_integerProperties["timesteps_" + stage.first] = int64_c(std::get<1>(stage.second));
+         sql_realProperties["simulatedTime_" + stage.first] = double(std::get<2>(stage.second));
+      }
+      if(usePermeabilityEstimation)
+      {
+         sql_realProperties["permeability"] = double(permeabilityResult.permeability);
+         sql_realProperties["permeability_superficialVelocity"] = double(permeabilityResult.superficialVelocity);
+         sql_realProperties["permeability_evaluationPorosity"] = double(permeabilityResult.evaluationPorosity);
+         sql_realProperties["permeability_reynoldsNumber"] = double(permeabilityResult.reynoldsNumber);
+         sql_realProperties["permeability_bedHeight"] = double(permeabilityResult.bedHeight);
+         sql_integerProperties["permeability_timesteps"] = int64_c(permeabilityResult.timesteps);
+         sql_integerProperties["permeability_converged"] = permeabilityResult.converged ? 1 : 0;
+         sql_realProperties["permeability_wallTime"] = double(reducedTT["Permeability"].total());
+         std::string layerVelocities = "";
+         for (auto v : permeabilityResult.layerVelocities) layerVelocities += std::to_string(v) + " ";
+         sql_stringProperties["permeability_layerVelocities"] = layerVelocities;
+         std::string layerPorosities = "";
+         for (auto v : permeabilityResult.layerPorosities) layerPorosities += std::to_string(v) + " ";
+         sql_stringProperties["permeability_layerPorosities"] = layerPorosities;
+      }
+      if(useTiling)
+      {
+         sql_realProperties["tiling_sourcePorosity"] = double(packingTiler->getSnapshot().porosity);
+         sql_realProperties["tiling_initialPorosity"] = double(tiling_initialPorosity);
+         sql_integerProperties["tiling_numSourceParticles"] = int64_c(packingTiler->getSnapshot().particles.size());
+         for(const auto & deviation : tiling_histogramDeviations) sql_realProperties["tiling_histogramDeviation_" + deviation.first] = double(deviation.second);
+      }
+      if(usePrePacking)
+      {
+         sql_realProperties["prePacking_wallTime"] = prePackingWallTime;
+         sql_integerProperties["prePacking_iterations"] = int64_c(prePackingIterations);
+      }
+      if(useSphereClumps)
+      {
+         sql_realProperties["sphereClumps_avgNumberOfSpheres"] = double(sphereClumpLibrary->getAverageNumberOfSpheres());
+         sql_realProperties["sphereClumps_avgVolumeError"] = double(sphereClumpLibrary->getAverageVolumeError());
+         sql_realProperties["sphereClumps_avgSurfaceError"] = double(sphereClumpLibrary->getAverageSurfaceError());
+      }
+      if(useProxySettling)
+      {
+         sql_realProperties["proxySettling_proxyWallTime"] = proxyStageWallTime;
+         sql_realProperties["proxySettling_swapWallTime"] = proxySwapWallTime;
+         sql_realProperties["proxySettling_swapTime"] = double(proxySwapTime);
+      }
+      sql_realProperties["memory_bytesPerParticleCarried"] = particleMemoryReport.bytesPerParticleCarried;
+      sql_realProperties["memory_bytesPerParticleUsed"] = particleMemoryReport.bytesPerParticleUsed;
+      sql_realProperties["memory_heapBytesPerParticle"] = particleMemoryReport.heapBytesPerParticle;
+      sql_realProperties["memory_syncBytesPerGhostParticle"] = particleMemoryReport.syncBytesPerGhostParticle;
+      sql_integerProperties["memory_leanLayout"] = particleMemoryReport.isLeanLayout ? 1 : 0;
+      sql_integerProperties["memory_ghostUpdateBytesPerParticle"] = int64_c(particleMemoryReport.ghostSyncLayout.getBytesPerUpdate());
+      sql_stringProperties["memory_ghostUpdateProperties"] = particleMemoryReport.ghostSyncLayout.toString();
+      if(hullSimplification.isActive() && useShapeCache)
+      {
+         auto simplificationError = shapeLibraryCache.getMaximumSimplificationError();
+         sql_realProperties["hullSimplification_maxHausdorffError"] = simplificationError.hausdorffError;
+         sql_realProperties["hullSimplification_maxVolumeError"] = simplificationError.volumeError;
+         sql_realProperties["hullSimplification_maxFormError"] = simplificationError.formError;
+      }
+
+      // throughput in particles * time steps / second of the main parts, to be compared between commits
+      sql_integerProperties["particleTimeSteps"] = int64_c(accumulatedParticleTimeSteps);
+      if(benchmarkTimeSteps > 0)
+      {
+         sql_stringProperties["benchmark_scenario"] = benchmarkScenario;
+         for(const std::string & timerName : {"Contact detection", "Linked cells", "Hash grid", "DEM", "HCSITS", "Sync", "VTK"})
+         {
+            std::string timerPath = "Simulation." + timerName;
+            if(!reducedTT.timerExists(timerPath)) continue;
+            double timerTotal = reducedTT[timerPath].total();
+            std::string propertyName = "throughput_" + timerName;
+            std::replace(propertyName.begin(), propertyName.end(), ' ', '_');
+            sql_realProperties[propertyName] = (timerTotal > 0.0) ? double(accumulatedParticleTimeSteps) / timerTotal : 0.0;
+            WALBERLA_LOG_INFO_ON_ROOT("Throughput of " << timerName << ": " << sql_realProperties[propertyName] << " particle time steps / s");
+         }
+         sql_realProperties["throughput_Simulation"] = double(accumulatedParticleTimeSteps) / reducedTT["Simulation"].total();
+      }
 
       for(uint_t i = 0; i < particleHistogram.getNumberOfShapeEvaluators(); ++i)
       {
@@ -1286,6 +2618,7 @@ int main(int argc, char **argv) {
       WALBERLA_LOG_INFO_ON_ROOT("Storing run and timing data in sql database file " << sqlDBFileName);
       auto sql_runID = sqlite::storeRunInSqliteDB(sqlDBFileName, sql_integerProperties, sql_stringProperties, sql_realProperties);
       sqlite::storeTimingTreeInSqliteDB(sqlDBFileName, sql_runID, reducedTT, "Timing");
+      PhaseProfiler::storeInSqliteDB(sqlDBFileName, sql_runID, reducedPhaseTimes, reducedPhaseCounters);
    }
 
    if(!vtkFinalFolder.empty())
@@ -0,0 +1,247 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   ParticleStorageLayout.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/logging/Logging.h"
+#include "core/mpi/Reduce.h"
+
+#include "mesa_pd/data/ContactHistory.h"
+#include "mesa_pd/data/ParticleStorage.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "TimeLoopConfiguration.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Description of the per-particle properties of the (generated) mesa_pd ParticleStorage and of the subset
+ * that the packing simulation actually reads or writes for a given solver and shape family.
+ * The storage itself is structure-of-arrays already, but carries all properties for all solvers.
+ * This description is used to report the per-particle memory that is used vs. carried, i.e. what a
+ * regenerated, solver-specific storage would save. The ghost updates are restricted to the used properties
+ * by the lean GhostSyncLayout below.
+ */
+struct ParticleProperty
+{
+   enum Usage { ALWAYS, DEM, HCSITS, GJK, UNUSED };
+
+   std::string name;
+   size_t bytes; // size of the array element, heap memory of containers is accounted separately
+   Usage usage;
+
+   bool isUsed(const std::vector<SolverType> & solvers, ShapeFamily shape) const
+   {
+      for(auto solver : solvers) if(isUsed(solver, shape)) return true;
+      return false;
+   }
+
+   bool isUsed(SolverType solver, ShapeFamily shape) const
+   {
+      switch(usage)
+      {
+         case ALWAYS: return true;
+         case DEM: return solver == SolverType::DEM;
+         case HCSITS: return solver == SolverType::HCSITS;
+         case GJK: return shape == ShapeFamily::ConvexGJK || shape == ShapeFamily::Mesh;
+         case UNUSED: return false;
+      }
+      return true;
+   }
+};
+
+#define PARTICLE_PROPERTY(NAME, GETTER, USAGE) \
+   ParticleProperty{NAME, sizeof(std::remove_reference_t<decltype(std::declval<data::ParticleStorage&>().GETTER(0))>), ParticleProperty::USAGE}
+
+inline std::vector<ParticleProperty> getParticleStorageLayout()
+{
+   return {
+      PARTICLE_PROPERTY("uid", getUidRef, ALWAYS),
+      PARTICLE_PROPERTY("position", getPositionRef, ALWAYS),
+      PARTICLE_PROPERTY("interactionRadius", getInteractionRadiusRef, ALWAYS),
+      PARTICLE_PROPERTY("flags", getFlagsRef, ALWAYS),
+      PARTICLE_PROPERTY("owner", getOwnerRef, ALWAYS),
+      PARTICLE_PROPERTY("ghostOwners", getGhostOwnersRef, ALWAYS),
+      PARTICLE_PROPERTY("baseShape", getBaseShapeRef, ALWAYS),
+      PARTICLE_PROPERTY("rotation", getRotationRef, ALWAYS), // only relevant for the geometry of non-spherical shapes, but integrated by both solvers
+      PARTICLE_PROPERTY("angularVelocity", getAngularVelocityRef, ALWAYS),
+      PARTICLE_PROPERTY("torque", getTorqueRef, ALWAYS),
+      PARTICLE_PROPERTY("linearVelocity", getLinearVelocityRef, ALWAYS),
+      PARTICLE_PROPERTY("invMass", getInvMassRef, ALWAYS),
+      PARTICLE_PROPERTY("force", getForceRef, ALWAYS),
+      PARTICLE_PROPERTY("oldForce", getOldForceRef, UNUSED),
+      PARTICLE_PROPERTY("oldTorque", getOldTorqueRef, UNUSED),
+      PARTICLE_PROPERTY("currentBlock", getCurrentBlockRef, ALWAYS),
+      PARTICLE_PROPERTY("type", getTypeRef, ALWAYS),
+      PARTICLE_PROPERTY("nextParticle", getNextParticleRef, ALWAYS),
+      PARTICLE_PROPERTY("oldContactHistory", getOldContactHistoryRef, DEM),
+      PARTICLE_PROPERTY("newContactHistory", getNewContactHistoryRef, DEM),
+      PARTICLE_PROPERTY("temperature", getTemperatureRef, UNUSED),
+      PARTICLE_PROPERTY("heatFlux", getHeatFluxRef, UNUSED),
+      PARTICLE_PROPERTY("numContacts", getNumContactsRef, ALWAYS),
+      PARTICLE_PROPERTY("dv", getDvRef, HCSITS),
+      PARTICLE_PROPERTY("dw", getDwRef, HCSITS),
+      PARTICLE_PROPERTY("hydrodynamicForce", getHydrodynamicForceRef, UNUSED),
+      PARTICLE_PROPERTY("hydrodynamicTorque", getHydrodynamicTorqueRef, UNUSED),
+      PARTICLE_PROPERTY("oldHydrodynamicForce", getOldHydrodynamicForceRef, UNUSED),
+      PARTICLE_PROPERTY("oldHydrodynamicTorque", getOldHydrodynamicTorqueRef, UNUSED)
+   };
+}
+
+#undef PARTICLE_PROPERTY
+
+/*
+ * Properties of a local particle that its ghost copies read in each time step, for the given solvers and shape families:
+ * - position and linear velocity: always,
+ * - rotation: only for non-spherical shapes, the contacts of spheres do not depend on it,
+ * - angular velocity: for non-spherical shapes and with friction, otherwise it never enters a contact,
+ * - (old) contact history: only for DEM, HCSITS does not keep a tangential history.
+ * With the lean layout, the per-step ghost updates only carry these properties, see DeltaGhostSync.
+ * Ghost creation and migration (full syncs) still send the complete record of the generated mesa_pd ParticleStorage.
+ */
+struct GhostSyncLayout
+{
+   bool rotation = true;
+   bool angularVelocity = true;
+   bool contactHistory = true;
+
+   // upper bound of a ghost update of one particle: uid, bit mask and the unquantized properties, without the contact history entries
+   size_t getBytesPerUpdate() const
+   {
+      return sizeof(walberla::id_t) + sizeof(uint8_t) + 2 * sizeof(Vec3) + (rotation ? sizeof(Quat) : 0) + (angularVelocity ? sizeof(Vec3) : 0);
+   }
+
+   std::string toString() const
+   {
+      std::ostringstream os;
+      os << "position, linearVelocity";
+      if(rotation) os << ", rotation";
+      if(angularVelocity) os << ", angularVelocity";
+      if(contactHistory) os << ", oldContactHistory";
+      return os.str();
+   }
+};
+
+inline GhostSyncLayout getGhostSyncLayout(const std::vector<SolverType> & solvers, ShapeFamily shape, bool hasFriction)
+{
+   GhostSyncLayout layout;
+   layout.rotation = shape != ShapeFamily::Sphere;
+   layout.angularVelocity = layout.rotation || hasFriction;
+   layout.contactHistory = std::find(solvers.begin(), solvers.end(), SolverType::DEM) != solvers.end();
+   return layout;
+}
+
+// all properties that are exchanged by the regular ghost updates
+inline GhostSyncLayout getFullGhostSyncLayout(const std::vector<SolverType> & solvers)
+{
+   GhostSyncLayout layout;
+   layout.contactHistory = std::find(solvers.begin(), solvers.end(), SolverType::DEM) != solvers.end();
+   return layout;
+}
+
+// heap memory of a shape, for convex polyhedra estimated from the half-edge data structure of OpenMesh
+inline size_t getShapeMemory(const data::BaseShape & shape)
+{
+   auto type = shape.getShapeType();
+   if(type == data::Sphere::SHAPE_TYPE) return sizeof(data::Sphere);
+   if(type == data::Ellipsoid::SHAPE_TYPE) return sizeof(data::Ellipsoid);
+   if(type == data::ConvexPolyhedron::SHAPE_TYPE)
+   {
+      const auto & mesh = static_cast<const data::ConvexPolyhedron &>(shape).getMesh();
+      return sizeof(data::ConvexPolyhedron) + mesh.n_vertices() * (sizeof(mesh::TriangleMesh::Point) + sizeof(int))
+             + mesh.n_halfedges() * 3 * sizeof(int) + mesh.n_faces() * (sizeof(int) + sizeof(mesh::TriangleMesh::Normal));
+   }
+   return sizeof(data::BaseShape);
+}
+
+struct ParticleMemoryReport
+{
+   double bytesPerParticleCarried = 0.0; // array elements of all properties
+   double bytesPerParticleUsed = 0.0;    // array elements of the properties used by the selected solver and shape
+   double heapBytesPerParticle = 0.0;    // container entries (ghost owners, contact histories) and shapes, shared shapes counted once
+   double syncBytesPerGhostParticle = 0.0;
+   std::vector<std::pair<std::string, size_t>> unusedProperties;
+   GhostSyncLayout ghostSyncLayout;
+   bool isLeanLayout = false;
+
+   std::string toString() const
+   {
+      std::ostringstream os;
+      os << "Memory per particle: " << bytesPerParticleCarried << " bytes in storage arrays, of which " << bytesPerParticleUsed
+         << " bytes are used by the selected solver and shape, plus " << heapBytesPerParticle << " bytes on the heap (shapes, containers)";
+      if(syncBytesPerGhostParticle > 0.0) os << "\n - approx. " << syncBytesPerGhostParticle << " bytes sent per ghost particle in sync";
+      os << "\n - " << (isLeanLayout ? "lean" : "full") << " ghost updates: " << ghostSyncLayout.toString()
+         << " (max. " << ghostSyncLayout.getBytesPerUpdate() << " bytes per particle without contact history)";
+      os << "\n - unused properties:";
+      for(const auto & p : unusedProperties) os << " " << p.first << " (" << p.second << ")";
+      return os.str();
+   }
+};
+
+// collective, result is only valid on root
+inline ParticleMemoryReport evaluateParticleMemory(data::ParticleStorage & ps, const std::vector<SolverType> & solvers, ShapeFamily shape, int64_t syncBytesSent,
+                                                   const GhostSyncLayout & ghostSyncLayout, bool isLeanLayout)
+{
+   ParticleMemoryReport report;
+   report.ghostSyncLayout = ghostSyncLayout;
+   report.isLeanLayout = isLeanLayout;
+   for(const auto & property : getParticleStorageLayout())
+   {
+      report.bytesPerParticleCarried += double(property.bytes);
+      if(property.isUsed(solvers, shape)) report.bytesPerParticleUsed += double(property.bytes);
+      else report.unusedProperties.emplace_back(property.name, property.bytes);
+   }
+
+   const double contactHistoryEntryBytes = double(sizeof(std::pair<const walberla::id_t, data::ContactHistory>) + 4 * sizeof(void*)); // incl. tree node overhead
+   std::set<const data::BaseShape*> shapes;
+   std::vector<double> values(4, 0.0); // particles, ghost particles, heap bytes, sync bytes
+   for(auto p : ps)
+   {
+      values[0] += 1.0;
+      if(data::particle_flags::isSet(p.getFlags(), data::particle_flags::GHOST)) values[1] += 1.0;
+      values[2] += double(p.getGhostOwners().size() * (sizeof(walberla::mpi::MPIRank) + 2 * sizeof(void*)));
+      values[2] += double(p.getOldContactHistory().size() + p.getNewContactHistory().size()) * contactHistoryEntryBytes;
+      if(shapes.insert(p.getBaseShape().get()).second) values[2] += double(getShapeMemory(*p.getBaseShape()));
+   }
+   values[3] = double(syncBytesSent);
+   walberla::mpi::reduceInplace(values, walberla::mpi::SUM);
+
+   WALBERLA_ROOT_SECTION()
+   {
+      report.heapBytesPerParticle = (values[0] > 0.0) ? values[2] / values[0] : 0.0;
+      report.syncBytesPerGhostParticle = (values[1] > 0.0) ? values[3] / values[1] : 0.0;
+   }
+   return report;
+}
+
+} // namespace mesa_pd
+} // namespace walberla
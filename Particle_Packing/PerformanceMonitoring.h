@@ -0,0 +1,301 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   PerformanceMonitoring.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/mpi/BufferDataTypeExtensions.h"
+#include "core/mpi/Broadcast.h"
+#include "core/mpi/MPIManager.h"
+#include "core/mpi/MPITextFile.h"
+#include "core/mpi/Reduce.h"
+#include "core/timing/TimingTree.h"
+
+#include "sqlite/SQLite.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Wrapper around WcTimingTree that can additionally record the begin and duration of all timed sections
+ * as events in the Chrome trace format (chrome://tracing, Perfetto), with one trace process per MPI rank.
+ * Recording is switched on and off per time step to keep the trace size manageable.
+ */
+class TracingTimingTree
+{
+public:
+   void start(const std::string & name)
+   {
+      tree_.start(name);
+      if(tracing_) openEvents_.emplace_back(name, timing::WcPolicy::getTimestamp());
+   }
+
+   void stop(const std::string & name)
+   {
+      tree_.stop(name);
+      // also close events that were opened while tracing was still active
+      for(auto it = openEvents_.rbegin(); it != openEvents_.rend(); ++it)
+      {
+         if(it->first != name) continue;
+         double end = timing::WcPolicy::getTimestamp();
+         addEvent(name, it->second, end - it->second);
+         openEvents_.erase(std::next(it).base());
+         break;
+      }
+   }
+
+   bool isTimerRunning(const std::string & name) const { return tree_.isTimerRunning(name); }
+   WcTimingTree getReduced() const { return tree_.getReduced(); }
+   const WcTimingTree & getTree() const { return tree_; }
+
+   void setTracing(bool tracing) { tracing_ = tracing; }
+   bool isTracing() const { return tracing_; }
+
+   void addInstantEvent(const std::string & name)
+   {
+      events_ << "{\"name\":\"" << name << "\",\"ph\":\"i\",\"s\":\"g\",\"ts\":" << toMicroSeconds(timing::WcPolicy::getTimestamp())
+              << ",\"pid\":" << rank() << ",\"tid\":0},\n";
+   }
+
+   // collective, trace file in JSON array format (closing bracket is optional in this format)
+   void writeTrace(const std::string & fileName) const
+   {
+      std::string processLocalPart = events_.str();
+      WALBERLA_ROOT_SECTION()
+      {
+         processLocalPart = "[\n" + processLocalPart;
+      }
+      walberla::mpi::writeMPITextFile(fileName, processLocalPart);
+   }
+
+private:
+   static int rank() { return walberla::mpi::MPIManager::instance()->rank(); }
+   double toMicroSeconds(double timestamp) const { return (timestamp - referenceTime_) * 1e6; }
+
+   void addEvent(const std::string & name, double begin, double duration)
+   {
+      events_ << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"ts\":" << std::fixed << std::setprecision(3) << toMicroSeconds(begin)
+              << ",\"dur\":" << duration * 1e6 << ",\"pid\":" << rank() << ",\"tid\":0},\n";
+   }
+
+   WcTimingTree tree_;
+   bool tracing_ = false;
+   double referenceTime_ = timing::WcPolicy::getTimestamp();
+   std::vector<std::pair<std::string, double>> openEvents_;
+   std::ostringstream events_;
+};
+
+inline void flattenTimingNode(const timing::TimingNode<timing::WcPolicy> & node, const std::string & prefix, std::map<std::string, double> & totals)
+{
+   for(const auto & child : node.tree_)
+   {
+      std::string path = prefix.empty() ? child.first : prefix + "." + child.first;
+      totals[path] = child.second.timer_.total();
+      flattenTimingNode(child.second, path, totals);
+   }
+}
+
+/*
+ * Accumulates the process-local time spent in each timer separately for each simulation phase (e.g. generation, shaking, damping),
+ * as well as event counters (candidate pairs, contacts, bytes sent,...).
+ * The reduction yields min/max/average over all processes and the load imbalance factor max/average.
+ */
+class PhaseProfiler
+{
+public:
+   struct Statistics
+   {
+      double min = 0.0;
+      double max = 0.0;
+      double sum = 0.0;
+      double avg() const { return sum / double(walberla::mpi::MPIManager::instance()->numProcesses()); }
+      double imbalance() const { return (avg() > 0.0) ? max / avg() : 1.0; }
+   };
+
+   // (phase, timer/counter name) -> statistics
+   using ReducedData = std::map<std::pair<std::string, std::string>, Statistics>;
+
+   explicit PhaseProfiler(bool useCounters) : useCounters_(useCounters) {}
+
+   void switchPhase(const std::string & phase, const WcTimingTree & timing)
+   {
+      if(phase == currentPhase_) return;
+      updateCurrentPhase(timing);
+      currentPhase_ = phase;
+      if(std::find(phases_.begin(), phases_.end(), phase) == phases_.end()) phases_.push_back(phase);
+   }
+
+   const std::string & getCurrentPhase() const { return currentPhase_; }
+   bool useCounters() const { return useCounters_; }
+
+   void count(const std::string & counter, uint64_t value)
+   {
+      if(useCounters_) phaseCounters_[currentPhase_][counter] += value;
+   }
+
+   // collective, result is only valid on root
+   void reduce(const WcTimingTree & timing, ReducedData & reducedTimes, ReducedData & reducedCounters)
+   {
+      updateCurrentPhase(timing);
+      reducedTimes = reduceData(phaseTimes_);
+      reducedCounters = reduceData(phaseCounters_);
+   }
+
+   // collective
+   std::string getReport(const WcTimingTree & timing)
+   {
+      ReducedData reducedTimes;
+      ReducedData reducedCounters;
+      reduce(timing, reducedTimes, reducedCounters);
+      return getReport(reducedTimes, reducedCounters);
+   }
+
+   // from the data of reduce(), not collective, empty on all processes but root
+   std::string getReport(const ReducedData & reducedTimes, const ReducedData & reducedCounters) const
+   {
+      std::ostringstream os;
+      WALBERLA_ROOT_SECTION()
+      {
+         os << std::setprecision(4);
+         for(const auto & phase : phases_)
+         {
+            os << "Phase '" << phase << "':\n";
+            os << "  " << std::left << std::setw(50) << "timer" << std::right << std::setw(12) << "min [s]" << std::setw(12) << "max [s]"
+               << std::setw(12) << "avg [s]" << std::setw(12) << "imbalance" << "\n";
+            for(const auto & entry : reducedTimes)
+            {
+               if(entry.first.first != phase || entry.second.max <= 0.0) continue;
+               os << "  " << std::left << std::setw(50) << entry.first.second << std::right << std::setw(12) << entry.second.min << std::setw(12) << entry.second.max
+                  << std::setw(12) << entry.second.avg() << std::setw(12) << entry.second.imbalance() << "\n";
+            }
+            for(const auto & entry : reducedCounters)
+            {
+               if(entry.first.first != phase) continue;
+               os << "  counter " << std::left << std::setw(42) << entry.first.second << std::right << " total = " << entry.second.sum
+                  << ", per process min = " << entry.second.min << ", max = " << entry.second.max << ", imbalance = " << entry.second.imbalance() << "\n";
+            }
+         }
+      }
+      return os.str();
+   }
+
+   // to be called on root with the reduced data
+   static void storeInSqliteDB(const std::string & dbFile, uint_t runId, const ReducedData & reducedTimes, const ReducedData & reducedCounters)
+   {
+      auto store = [&](const std::string & tableName, const ReducedData & data)
+      {
+         for(const auto & entry : data)
+         {
+            std::map<std::string, int64_t> integerProperties;
+            std::map<std::string, std::string> stringProperties;
+            std::map<std::string, double> realProperties;
+            stringProperties["phase"] = entry.first.first;
+            stringProperties["name"] = entry.first.second;
+            realProperties["min"] = entry.second.min;
+            realProperties["max"] = entry.second.max;
+            realProperties["avg"] = entry.second.avg();
+            realProperties["imbalance"] = entry.second.imbalance();
+            sqlite::storeAdditionalRunInfoInSqliteDB(runId, dbFile, tableName, integerProperties, stringProperties, realProperties);
+         }
+      };
+      store("PhaseTiming", reducedTimes);
+      store("PhaseCounters", reducedCounters);
+   }
+
+private:
+   void updateCurrentPhase(const WcTimingTree & timing)
+   {
+      std::map<std::string, double> totals;
+      flattenTimingNode(timing.getRawData(), "", totals);
+      if(!currentPhase_.empty())
+      {
+         auto & phaseTimes = phaseTimes_[currentPhase_];
+         for(const auto & entry : totals)
+         {
+            auto snapshotIt = snapshot_.find(entry.first);
+            double previous = (snapshotIt == snapshot_.end()) ? 0.0 : snapshotIt->second;
+            phaseTimes[entry.first] += entry.second - previous;
+         }
+      }
+      snapshot_ = totals;
+   }
+
+   template<typename T>
+   static ReducedData reduceData(const std::map<std::string, std::map<std::string, T>> & phaseData)
+   {
+      // the keys of the root process define the layout of the reduction buffers
+      std::vector<std::string> keys;
+      WALBERLA_ROOT_SECTION()
+      {
+         for(const auto & phase : phaseData)
+            for(const auto & entry : phase.second)
+               keys.push_back(phase.first + '\n' + entry.first);
+      }
+      walberla::mpi::broadcastObject(keys);
+
+      std::vector<double> values(keys.size(), 0.0);
+      for(size_t i = 0; i < keys.size(); ++i)
+      {
+         auto separator = keys[i].find('\n');
+         auto phaseIt = phaseData.find(keys[i].substr(0, separator));
+         if(phaseIt == phaseData.end()) continue;
+         auto entryIt = phaseIt->second.find(keys[i].substr(separator + 1));
+         if(entryIt != phaseIt->second.end()) values[i] = double(entryIt->second);
+      }
+
+      std::vector<double> minValues = values;
+      std::vector<double> maxValues = values;
+      std::vector<double> sumValues = values;
+      walberla::mpi::reduceInplace(minValues, walberla::mpi::MIN);
+      walberla::mpi::reduceInplace(maxValues, walberla::mpi::MAX);
+      walberla::mpi::reduceInplace(sumValues, walberla::mpi::SUM);
+
+      ReducedData reduced;
+      WALBERLA_ROOT_SECTION()
+      {
+         for(size_t i = 0; i < keys.size(); ++i)
+         {
+            auto separator = keys[i].find('\n');
+            auto & stats = reduced[std::make_pair(keys[i].substr(0, separator), keys[i].substr(separator + 1))];
+            stats.min = minValues[i];
+            stats.max = maxValues[i];
+            stats.sum = sumValues[i];
+         }
+      }
+      return reduced;
+   }
+
+   bool useCounters_;
+   std::string currentPhase_;
+   std::vector<std::string> phases_;
+   std::map<std::string, double> snapshot_;
+   std::map<std::string, std::map<std::string, double>> phaseTimes_;
+   std::map<std::string, std::map<std::string, uint64_t>> phaseCounters_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
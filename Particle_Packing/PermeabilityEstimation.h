@@ -0,0 +1,398 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   PermeabilityEstimation.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "blockforest/BlockForest.h"
+#include "blockforest/StructuredBlockForest.h"
+#include "blockforest/communication/UniformBufferedScheme.h"
+#include "boundary/BoundaryHandling.h"
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/cell/CellInterval.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+#include "core/math/AABB.h"
+#include "core/math/Vector3.h"
+#include "core/mpi/MPIManager.h"
+#include "core/mpi/Reduce.h"
+#include "field/AddToStorage.h"
+#include "field/FlagField.h"
+#include "lbm/boundary/NoSlip.h"
+#include "lbm/communication/PdfFieldPackInfo.h"
+#include "lbm/field/AddToStorage.h"
+#include "lbm/field/PdfField.h"
+#include "lbm/lattice_model/CollisionModel.h"
+#include "lbm/lattice_model/D3Q19.h"
+#include "lbm/lattice_model/ForceModel.h"
+#include "lbm/sweeps/CellwiseSweep.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+struct PermeabilityParameters
+{
+   real_t cellSize = real_t(0); // m, lattice spacing of the voxelized packing
+   real_t relaxationTime = real_t(1); // lattice units, TRT with magic parameter 3/16 (viscosity-independent bounce-back location)
+   real_t forceDensity = real_t(1e-6); // lattice units, driving pressure gradient, small to stay in the Stokes regime
+   uint_t maxTimesteps = uint_t(50000);
+   uint_t checkSpacing = uint_t(200); // time steps between convergence checks
+   real_t convergenceThreshold = real_t(1e-6); // relative change of the mean superficial velocity between two checks
+   real_t evaluationRegionBegin = real_t(0.2); // relative to the bed height, excludes the wall-affected bottom layers
+   real_t evaluationRegionEnd = real_t(0.8); // relative to the bed height, excludes the top layers
+
+   static PermeabilityParameters fromConfig(const Config::BlockHandle & permeabilityConf)
+   {
+      PermeabilityParameters parameters;
+      parameters.cellSize = permeabilityConf.getParameter<real_t>("cellSize");
+      parameters.relaxationTime = permeabilityConf.getParameter<real_t>("relaxationTime", parameters.relaxationTime);
+      parameters.forceDensity = permeabilityConf.getParameter<real_t>("forceDensity", parameters.forceDensity);
+      parameters.maxTimesteps = permeabilityConf.getParameter<uint_t>("maxTimesteps", parameters.maxTimesteps);
+      parameters.checkSpacing = permeabilityConf.getParameter<uint_t>("checkSpacing", parameters.checkSpacing);
+      parameters.convergenceThreshold = permeabilityConf.getParameter<real_t>("convergenceThreshold", parameters.convergenceThreshold);
+      parameters.evaluationRegionBegin = permeabilityConf.getParameter<real_t>("evaluationRegionBegin", parameters.evaluationRegionBegin);
+      parameters.evaluationRegionEnd = permeabilityConf.getParameter<real_t>("evaluationRegionEnd", parameters.evaluationRegionEnd);
+      WALBERLA_CHECK_GREATER(parameters.cellSize, real_t(0), "Permeability: cellSize has to be positive.");
+      WALBERLA_CHECK_GREATER(parameters.relaxationTime, real_t(0.5), "Permeability: relaxationTime has to be above 0.5.");
+      WALBERLA_CHECK_LESS(parameters.evaluationRegionBegin, parameters.evaluationRegionEnd, "Permeability: empty evaluation region.");
+      return parameters;
+   }
+};
+
+struct PermeabilityResult
+{
+   real_t permeability = real_t(0); // m^2, along x
+   real_t superficialVelocity = real_t(0); // lattice units, mean over the evaluation region
+   real_t evaluationPorosity = real_t(0); // of the voxelized packing, in the evaluation region
+   real_t reynoldsNumber = real_t(0); // based on the superficial velocity and the cell size
+   real_t bedHeight = real_t(0); // m
+   real_t cellSize = real_t(0); // m, along x
+   uint_t timesteps = uint_t(0);
+   bool converged = false;
+
+   // per horizontal cell layer
+   std::vector<real_t> layerHeights;
+   std::vector<real_t> layerPorosities;
+   std::vector<real_t> layerVelocities; // superficial velocity, relative to the mean in the evaluation region
+
+   void printToFile(const std::string & fileName) const
+   {
+      WALBERLA_ROOT_SECTION()
+      {
+         std::ofstream file;
+         file.open(fileName.c_str());
+         file << "# height porosity relative_superficial_velocity\n";
+         file << std::setprecision(8);
+         for(size_t i = 0; i < layerHeights.size(); ++i)
+         {
+            file << layerHeights[i] << " " << layerPorosities[i] << " " << layerVelocities[i] << "\n";
+         }
+         file.close();
+      }
+   }
+};
+
+namespace internal {
+
+// p in the world frame, for finite particles
+template<typename Accessor_T>
+bool isPointInsideParticle(size_t idx, Accessor_T & ac, const Vec3 & position, const Vec3 & p)
+{
+   const auto * shape = ac.getShape(idx);
+   const Vec3 pBF = ac.getRotation(idx).getMatrix().getTranspose() * (p - position);
+   if(shape->getShapeType() == data::Sphere::SHAPE_TYPE)
+   {
+      real_t radius = static_cast<const data::Sphere*>(shape)->getRadius();
+      return pBF.sqrLength() <= radius * radius;
+   }
+   if(shape->getShapeType() == data::Ellipsoid::SHAPE_TYPE)
+   {
+      const Vec3 & semiAxes = static_cast<const data::Ellipsoid*>(shape)->getSemiAxes();
+      real_t sum = real_t(0);
+      for(uint_t i = 0; i < 3; ++i) sum += (pBF[i] * pBF[i]) / (semiAxes[i] * semiAxes[i]);
+      return sum <= real_t(1);
+   }
+   if(shape->getShapeType() == data::ConvexPolyhedron::SHAPE_TYPE)
+   {
+      const auto & mesh = static_cast<const data::ConvexPolyhedron*>(shape)->getMesh();
+      for(auto fh : mesh.faces())
+      {
+         auto fv = mesh.cfv_iter(fh);
+         const auto & a = mesh.point(*fv);
+         const auto & b = mesh.point(*(++fv));
+         const auto & c = mesh.point(*(++fv));
+         Vec3 va(real_c(a[0]), real_c(a[1]), real_c(a[2]));
+         Vec3 normal = (Vec3(real_c(b[0]), real_c(b[1]), real_c(b[2])) - va) % (Vec3(real_c(c[0]), real_c(c[1]), real_c(c[2])) - va);
+         if((pBF - va) * normal > real_t(0)) return false;
+      }
+      return true;
+   }
+   WALBERLA_ABORT("Permeability: unsupported shape type " << shape->getShapeType());
+}
+
+} // namespace internal
+
+/*
+ * Permeability of the final packing by a lattice Boltzmann simulation on the BlockForest of the particle simulation.
+ * The particles (local, ghost and their periodic images) are voxelized directly into a flag field, without intermediate files.
+ * The fluid domain ranges from the bottom of the domain up to the top of the bed (both no-slip) and is periodic horizontally.
+ * The flow along x is driven by a constant body force, which is equivalent to a constant pressure gradient in the periodic domain,
+ * and simulated until the mean superficial velocity has converged.
+ * The permeability follows from Darcy's law in lattice units, k = nu * u_s / f, and is independent of the fluid properties.
+ * It is evaluated in the core region of the bed, away from the walls at the bottom and top.
+ */
+class PermeabilityEstimator
+{
+public:
+   using LatticeModel_T = lbm::D3Q19<lbm::collision_model::TRT, false, lbm::force_model::SimpleConstant>;
+   using Stencil_T = LatticeModel_T::Stencil;
+   using PdfField_T = lbm::PdfField<LatticeModel_T>;
+   using flag_t = walberla::uint8_t;
+   using FlagField_T = FlagField<flag_t>;
+   using NoSlip_T = lbm::NoSlip<LatticeModel_T, flag_t>;
+   using BoundaryHandling_T = BoundaryHandling<FlagField_T, Stencil_T, NoSlip_T>;
+
+   PermeabilityEstimator(const shared_ptr<BlockForest> & forest, const PermeabilityParameters & parameters) : forest_(forest), parameters_(parameters) {}
+
+   // collective
+   template<typename Accessor_T>
+   PermeabilityResult run(Accessor_T & ac, const math::AABB & simulationDomain, const Vector3<bool> & isPeriodic)
+   {
+      WALBERLA_CHECK(isPeriodic[0] && isPeriodic[1], "Permeability: a horizontally periodic domain is required.");
+
+      PermeabilityResult result;
+      result.bedHeight = getBedTop(ac) - simulationDomain.zMin();
+
+      // uniform cells on the existing blocks
+      const auto & blockAABB = forest_->begin()->getAABB();
+      uint_t cellsPerBlock[3];
+      real_t cellSizes[3];
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         real_t blockSize = blockAABB.max(i) - blockAABB.min(i);
+         cellsPerBlock[i] = std::max(uint_t(1), uint_c(std::round(blockSize / parameters_.cellSize)));
+         cellSizes[i] = blockSize / real_c(cellsPerBlock[i]);
+      }
+      if(std::abs(cellSizes[1] - cellSizes[0]) > real_t(0.01) * cellSizes[0] || std::abs(cellSizes[2] - cellSizes[0]) > real_t(0.01) * cellSizes[0])
+      {
+         WALBERLA_LOG_WARNING_ON_ROOT("Permeability: cells are not cubic (" << cellSizes[0] << ", " << cellSizes[1] << ", " << cellSizes[2] << " m), "
+                                      << "adapt cellSize or the domain size.");
+      }
+      result.cellSize = cellSizes[0];
+      auto blocks = make_shared<StructuredBlockForest>(forest_, cellsPerBlock[0], cellsPerBlock[1], cellsPerBlock[2]);
+      blocks->createCellBoundingBoxes();
+      WALBERLA_LOG_INFO_ON_ROOT("Permeability: " << blocks->getNumberOfXCells() << " x " << blocks->getNumberOfYCells() << " x " << blocks->getNumberOfZCells()
+                                << " cells with size " << result.cellSize << " m, bed height " << result.bedHeight << " m");
+
+      const real_t omega = real_t(1) / parameters_.relaxationTime;
+      LatticeModel_T latticeModel(lbm::collision_model::TRT::constructWithMagicNumber(omega),
+                                  lbm::force_model::SimpleConstant(Vector3<real_t>(parameters_.forceDensity, real_t(0), real_t(0))));
+      BlockDataID pdfFieldId = lbm::addPdfFieldToStorage(blocks, "pdf field (permeability)", latticeModel, Vector3<real_t>(real_t(0)), real_t(1));
+      BlockDataID flagFieldId = field::addFlagFieldToStorage<FlagField_T>(blocks, "flag field (permeability)");
+      BlockDataID boundaryHandlingId = blocks->addStructuredBlockData<BoundaryHandling_T>(BoundaryHandlingCreator(flagFieldId, pdfFieldId),
+                                                                                         "boundary handling (permeability)");
+
+      mapParticles(*blocks, boundaryHandlingId, ac, simulationDomain, isPeriodic, simulationDomain.zMin() + result.bedHeight);
+
+      blockforest::communication::UniformBufferedScheme<LatticeModel_T::CommunicationStencil> communication(blocks);
+      communication.addPackInfo(make_shared<lbm::PdfFieldPackInfo<LatticeModel_T>>(pdfFieldId));
+      auto boundarySweep = BoundaryHandling_T::getBlockSweep(boundaryHandlingId);
+      auto lbmSweep = lbm::makeCellwiseSweep<LatticeModel_T, FlagField_T>(pdfFieldId, flagFieldId, fluidFlagUID());
+
+      const uint_t numLayers = blocks->getNumberOfZCells();
+      const uint_t evaluationBegin = uint_c(std::floor(parameters_.evaluationRegionBegin * result.bedHeight / cellSizes[2]));
+      const uint_t evaluationEnd = std::min(numLayers, uint_c(std::ceil(parameters_.evaluationRegionEnd * result.bedHeight / cellSizes[2])));
+      const real_t cellsPerLayer = real_c(blocks->getNumberOfXCells() * blocks->getNumberOfYCells());
+      const real_t cellsInEvaluationRegion = cellsPerLayer * real_c(std::max(evaluationEnd, evaluationBegin + 1) - evaluationBegin);
+
+      std::vector<real_t> layerVelocities;
+      std::vector<real_t> layerFluidCells;
+      real_t oldVelocity = real_t(0);
+      for(uint_t t = 1; t <= parameters_.maxTimesteps; ++t)
+      {
+         communication();
+         for(auto blockIt = blocks->begin(); blockIt != blocks->end(); ++blockIt)
+         {
+            boundarySweep(&*blockIt);
+            (*lbmSweep)(&*blockIt);
+         }
+         result.timesteps = t;
+
+         if(t % parameters_.checkSpacing != 0 && t != parameters_.maxTimesteps) continue;
+         evaluateLayers(*blocks, pdfFieldId, boundaryHandlingId, numLayers, layerVelocities, layerFluidCells);
+         real_t velocity = real_t(0);
+         for(uint_t z = evaluationBegin; z < evaluationEnd; ++z) velocity += layerVelocities[z];
+         velocity /= cellsInEvaluationRegion;
+         result.superficialVelocity = velocity;
+         if(!(velocity == velocity)) WALBERLA_ABORT("Permeability: LBM simulation diverged.");
+         if(oldVelocity > real_t(0) && std::abs(velocity - oldVelocity) < parameters_.convergenceThreshold * oldVelocity)
+         {
+            result.converged = true;
+            break;
+         }
+         oldVelocity = velocity;
+      }
+      if(!result.converged) WALBERLA_LOG_WARNING_ON_ROOT("Permeability: not converged after " << result.timesteps << " time steps.");
+
+      const real_t viscosity = (parameters_.relaxationTime - real_t(0.5)) / real_t(3);
+      result.permeability = viscosity * result.superficialVelocity / parameters_.forceDensity * result.cellSize * result.cellSize;
+      result.reynoldsNumber = result.superficialVelocity / viscosity;
+
+      real_t fluidCells = real_t(0);
+      for(uint_t z = evaluationBegin; z < evaluationEnd; ++z) fluidCells += layerFluidCells[z];
+      result.evaluationPorosity = fluidCells / cellsInEvaluationRegion;
+      for(uint_t z = 0; z < numLayers; ++z)
+      {
+         result.layerHeights.push_back(simulationDomain.zMin() + (real_c(z) + real_t(0.5)) * cellSizes[2]);
+         result.layerPorosities.push_back(layerFluidCells[z] / cellsPerLayer);
+         result.layerVelocities.push_back((result.superficialVelocity > real_t(0)) ? layerVelocities[z] / cellsPerLayer / result.superficialVelocity : real_t(0));
+      }
+
+      forest_->clearBlockData(boundaryHandlingId);
+      forest_->clearBlockData(flagFieldId);
+      forest_->clearBlockData(pdfFieldId);
+      return result;
+   }
+
+private:
+   static FlagUID fluidFlagUID() { return FlagUID("Fluid"); }
+   static FlagUID noSlipFlagUID() { return FlagUID("NoSlip"); }
+
+   class BoundaryHandlingCreator
+   {
+   public:
+      BoundaryHandlingCreator(const BlockDataID & flagFieldId, const BlockDataID & pdfFieldId) : flagFieldId_(flagFieldId), pdfFieldId_(pdfFieldId) {}
+
+      BoundaryHandling_T * operator()(IBlock * const block, const StructuredBlockStorage * const /*storage*/) const
+      {
+         auto * flagField = block->getData<FlagField_T>(flagFieldId_);
+         auto * pdfField = block->getData<PdfField_T>(pdfFieldId_);
+         const auto fluid = flagField->flagExists(fluidFlagUID()) ? flagField->getFlag(fluidFlagUID()) : flagField->registerFlag(fluidFlagUID());
+         return new BoundaryHandling_T("boundary handling (permeability)", flagField, fluid,
+                                       NoSlip_T("NoSlip", noSlipFlagUID(), pdfField));
+      }
+
+   private:
+      BlockDataID flagFieldId_;
+      BlockDataID pdfFieldId_;
+   };
+
+   template<typename Accessor_T>
+   static real_t getBedTop(Accessor_T & ac)
+   {
+      real_t bedTop = -std::numeric_limits<real_t>::max();
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE) ||
+            data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::GHOST)) continue;
+         bedTop = std::max(bedTop, ac.getPosition(idx)[2] + ac.getInteractionRadius(idx));
+      }
+      return walberla::mpi::allReduce(bedTop, walberla::mpi::MAX);
+   }
+
+   // all cells, including the ghost layer, outside of [zMin, bedTop] or inside a particle become no-slip cells
+   template<typename Accessor_T>
+   static void mapParticles(StructuredBlockForest & blocks, const BlockDataID & boundaryHandlingId, Accessor_T & ac,
+                            const math::AABB & simulationDomain, const Vector3<bool> & isPeriodic, real_t bedTop)
+   {
+      for(auto blockIt = blocks.begin(); blockIt != blocks.end(); ++blockIt)
+      {
+         IBlock & block = *blockIt;
+         auto * handling = block.getData<BoundaryHandling_T>(boundaryHandlingId);
+         CellInterval blockCells = handling->getFlagField()->xyzSizeWithGhostLayer();
+
+         for(auto cell : blockCells)
+         {
+            real_t z = blocks.getBlockLocalCellCenter(block, cell)[2];
+            if(z < simulationDomain.zMin() || z > bedTop) handling->forceBoundary(noSlipFlagUID(), cell.x(), cell.y(), cell.z());
+         }
+
+         for(size_t idx = 0; idx < ac.size(); ++idx)
+         {
+            if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE)) continue;
+            const real_t radius = ac.getInteractionRadius(idx);
+            for(int sx = -1; sx <= 1; ++sx)
+            {
+               for(int sy = -1; sy <= 1; ++sy)
+               {
+                  if((sx != 0 && !isPeriodic[0]) || (sy != 0 && !isPeriodic[1])) continue;
+                  const Vec3 position = ac.getPosition(idx) + Vec3(real_c(sx) * simulationDomain.xSize(), real_c(sy) * simulationDomain.ySize(), real_t(0));
+                  CellInterval particleCells;
+                  blocks.getCellBBFromAABB(particleCells, math::AABB(position - Vec3(radius), position + Vec3(radius)));
+                  blocks.transformGlobalToBlockLocalCellInterval(particleCells, block);
+                  particleCells.intersect(blockCells);
+                  if(particleCells.empty()) continue;
+                  for(auto cell : particleCells)
+                  {
+                     if(internal::isPointInsideParticle(idx, ac, position, blocks.getBlockLocalCellCenter(block, cell)))
+                     {
+                        handling->forceBoundary(noSlipFlagUID(), cell.x(), cell.y(), cell.z());
+                     }
+                  }
+               }
+            }
+         }
+         handling->fillWithDomain(uint_t(1));
+      }
+   }
+
+   // per global cell layer: sum of the x-velocities and number of fluid cells, reduced on all processes
+   static void evaluateLayers(StructuredBlockForest & blocks, const BlockDataID & pdfFieldId, const BlockDataID & boundaryHandlingId, uint_t numLayers,
+                              std::vector<real_t> & layerVelocities, std::vector<real_t> & layerFluidCells)
+   {
+      layerVelocities.assign(numLayers, real_t(0));
+      layerFluidCells.assign(numLayers, real_t(0));
+      for(auto blockIt = blocks.begin(); blockIt != blocks.end(); ++blockIt)
+      {
+         IBlock & block = *blockIt;
+         auto * pdfField = block.getData<PdfField_T>(pdfFieldId);
+         auto * handling = block.getData<BoundaryHandling_T>(boundaryHandlingId);
+         for(auto cell : pdfField->xyzSize())
+         {
+            if(!handling->isDomain(cell)) continue;
+            Cell globalCell;
+            blocks.transformBlockLocalToGlobalCell(globalCell, block, cell);
+            layerVelocities[uint_c(globalCell.z())] += pdfField->getVelocity(cell)[0];
+            layerFluidCells[uint_c(globalCell.z())] += real_t(1);
+         }
+      }
+      walberla::mpi::allReduceInplace(layerVelocities, walberla::mpi::SUM);
+      walberla::mpi::allReduceInplace(layerFluidCells, walberla::mpi::SUM);
+   }
+
+   shared_ptr<BlockForest> forest_;
+   PermeabilityParameters parameters_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,232 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   ProxySettling.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/math/Matrix3.h"
+#include "core/math/Vector3.h"
+
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/shape/Ellipsoid.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "ShapeLibraryCache.h"
+#include "TimeLoopConfiguration.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+enum class ProxyType
+{
+   Sphere,             // volume-equivalent sphere
+   EquivalentEllipsoid // ellipsoid with the same volume and principal moments of inertia
+};
+
+inline ProxyType proxyTypeFromString(const std::string & proxyType)
+{
+   if(proxyType == "Sphere") return ProxyType::Sphere;
+   if(proxyType == "EquivalentEllipsoid") return ProxyType::EquivalentEllipsoid;
+   WALBERLA_ABORT("Unknown proxy type " << proxyType);
+}
+
+// shape family of the time loop as long as the proxies are in use
+inline ShapeFamily getProxyShapeFamily(ProxyType proxyType, bool useAnalyticEllipsoidContact)
+{
+   if(proxyType == ProxyType::Sphere) return ShapeFamily::Sphere;
+   return useAnalyticEllipsoidContact ? ShapeFamily::AnalyticEllipsoid : ShapeFamily::ConvexGJK;
+}
+
+// principal axes of the hull as a proper rotation (the eigen decomposition may return a reflection)
+inline Matrix3<double> getPrincipalAxesRotation(const PreprocessedShape & shape)
+{
+   Matrix3<double> axes = shape.principalAxes;
+   if(axes.getDeterminant() < 0.0)
+   {
+      for(uint_t i = 0; i < 3; ++i) axes(i,2) = -axes(i,2);
+   }
+   return axes;
+}
+
+/*
+ * Multi-fidelity shape generator for the cached mesh modes ('Mesh' with sphereEquivalent scaling, 'UnscaledMeshesPerFraction').
+ * At creation, a mesh is selected as by CachedMeshesGenerator and the particle gets a cheap proxy shape of it:
+ * the volume-equivalent sphere or the inertia-equivalent ellipsoid (in the principal frame of the mesh).
+ * Once the bed has formed, replaceProxyByMesh() swaps the proxy for a mesh.
+ *
+ * The selected mesh is not stored (the particle storage has no slot for it), the mesh of the swap is recovered from the
+ * proxy geometry instead: the mesh with the closest semi-axes (ellipsoid proxies) or volume-equivalent diameter (unscaled
+ * meshes with sphere proxies), which is the selected one unless several meshes share these values.
+ * For scaled meshes with sphere proxies, the proxy carries no mesh information and the mesh is chosen by uid among all
+ * meshes, i.e. it is in general not the one selected at creation, only of the same diameter.
+ * Thus, owner and ghost copies select the same mesh without communication.
+ * Orientations are kept: ellipsoid proxies are replaced by the mesh rotated into its principal frame.
+ *
+ * The interaction radius of the proxy is the one of its own geometry, but the maximum diameter scaling
+ * (used for the sync and linked cells setup) is the one of the meshes.
+ */
+class ProxyMeshesGenerator : public CachedMeshesGenerator
+{
+public:
+   ProxyMeshesGenerator(ProxyType proxyType, const ShapeLibraryCache & cache, const std::vector<std::string> & meshFileNames)
+      : CachedMeshesGenerator(cache, meshFileNames), proxyType_(proxyType)
+   {
+      collectMeshes();
+   }
+
+   ProxyMeshesGenerator(ProxyType proxyType, const ShapeLibraryCache & cache, const std::vector<std::vector<std::string>> & meshFileNamesPerFraction,
+                        const std::vector<real_t> & massFractions)
+      : CachedMeshesGenerator(cache, meshFileNamesPerFraction, massFractions), proxyType_(proxyType)
+   {
+      collectMeshes();
+   }
+
+   void setShape(real_t diameter, real_t maximumAllowedInteractionRadius, std::shared_ptr<data::BaseShape> & shape, real_t & interactionRadius) override
+   {
+      real_t scaling;
+      const auto & s = selectShape(diameter, maximumAllowedInteractionRadius, scaling);
+      if(proxyType_ == ProxyType::Sphere)
+      {
+         interactionRadius = real_t(0.5) * scaling * real_c(s.getVolumeEquivalentDiameter());
+         shape = std::make_shared<data::Sphere>(interactionRadius);
+      } else
+      {
+         Vec3 semiAxes = scaling * Vec3(real_c(s.semiAxes[0]), real_c(s.semiAxes[1]), real_c(s.semiAxes[2]));
+         shape = std::make_shared<data::Ellipsoid>(semiAxes);
+         interactionRadius = std::max(semiAxes[0], std::max(semiAxes[1], semiAxes[2]));
+      }
+   }
+
+   ProxyType getProxyType() const { return proxyType_; }
+
+   // for local and ghost particles, not thread-safe (shared unscaled shapes)
+   // returns false if the particle does not carry a proxy shape
+   template<typename Accessor_T>
+   bool replaceProxyByMesh(size_t idx, Accessor_T & ac, real_t density, real_t maximumAllowedInteractionRadius)
+   {
+      if(isSet(ac.getFlags(idx), data::particle_flags::INFINITE)) return false;
+
+      const auto * proxy = ac.getShape(idx);
+      const PreprocessedShape * mesh = nullptr;
+      real_t scaling = real_t(1);
+      if(proxy->getShapeType() == data::Sphere::SHAPE_TYPE)
+      {
+         mesh = findMeshForSphere(real_t(2) * static_cast<const data::Sphere*>(proxy)->getRadius(), ac.getUid(idx), maximumAllowedInteractionRadius, scaling);
+      } else if(proxy->getShapeType() == data::Ellipsoid::SHAPE_TYPE)
+      {
+         mesh = findMeshForEllipsoid(static_cast<const data::Ellipsoid*>(proxy)->getSemiAxes(), scaling);
+      } else
+      {
+         return false;
+      }
+
+      std::shared_ptr<data::BaseShape> shape;
+      if(scaleToDiameter_)
+      {
+         shape = createMesh(*mesh, scaling);
+         shape->updateMassAndInertia(density);
+      } else
+      {
+         auto & sharedShape = unscaledShapes_[mesh];
+         if(!sharedShape)
+         {
+            sharedShape = createMesh(*mesh, real_t(1));
+            sharedShape->updateMassAndInertia(density);
+         }
+         shape = sharedShape;
+      }
+      ac.getBaseShapeRef(idx) = shape;
+      ac.setInteractionRadius(idx, scaling * real_c(mesh->getCircumscribedRadius()));
+      return true;
+   }
+
+private:
+   void collectMeshes()
+   {
+      for(const auto & fraction : fractions_) meshes_.insert(meshes_.end(), fraction.begin(), fraction.end());
+   }
+
+   std::shared_ptr<data::ConvexPolyhedron> createMesh(const PreprocessedShape & mesh, real_t scaling) const
+   {
+      if(proxyType_ == ProxyType::Sphere) return createConvexPolyhedron(mesh, scaling);
+      return createConvexPolyhedron(mesh, scaling, getPrincipalAxesRotation(mesh).getTranspose());
+   }
+
+   const PreprocessedShape * findMeshForSphere(real_t diameter, walberla::id_t uid, real_t maximumAllowedInteractionRadius, real_t & scaling) const
+   {
+      if(scaleToDiameter_)
+      {
+         // all meshes are scaled to the same diameter: deterministic choice by uid among the meshes that fit
+         for(size_t trial = 0; trial < meshes_.size(); ++trial)
+         {
+            const auto * mesh = meshes_[(size_t(uid) + trial) % meshes_.size()];
+            scaling = diameter / real_c(mesh->getVolumeEquivalentDiameter());
+            if(scaling * real_c(mesh->getCircumscribedRadius()) <= maximumAllowedInteractionRadius) return mesh;
+         }
+         WALBERLA_ABORT("No mesh found that fulfills the maximum allowed interaction radius of " << maximumAllowedInteractionRadius);
+      }
+
+      const PreprocessedShape * bestMesh = nullptr;
+      double minDeviation = std::numeric_limits<double>::max();
+      for(const auto * mesh : meshes_)
+      {
+         double deviation = std::abs(mesh->getVolumeEquivalentDiameter() - double(diameter));
+         if(deviation < minDeviation)
+         {
+            minDeviation = deviation;
+            bestMesh = mesh;
+         }
+      }
+      scaling = real_t(1);
+      return bestMesh;
+   }
+
+   const PreprocessedShape * findMeshForEllipsoid(const Vec3 & semiAxes, real_t & scaling) const
+   {
+      const PreprocessedShape * bestMesh = nullptr;
+      double bestScaling = 1.0;
+      double minDeviation = std::numeric_limits<double>::max();
+      for(const auto * mesh : meshes_)
+      {
+         double meshScaling = scaleToDiameter_ ? std::cbrt(double(semiAxes[0] * semiAxes[1] * semiAxes[2]) / (mesh->semiAxes[0] * mesh->semiAxes[1] * mesh->semiAxes[2])) : 1.0;
+         double deviation = 0.0;
+         for(uint_t i = 0; i < 3; ++i) deviation += std::abs(meshScaling * mesh->semiAxes[i] - double(semiAxes[i])) / double(semiAxes[i]);
+         if(deviation < minDeviation)
+         {
+            minDeviation = deviation;
+            bestMesh = mesh;
+            bestScaling = meshScaling;
+         }
+      }
+      scaling = real_c(bestScaling);
+      return bestMesh;
+   }
+
+   ProxyType proxyType_;
+   std::vector<const PreprocessedShape*> meshes_; // all fractions, in the (rank-independent) order of the mesh files
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,737 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   ShapeLibraryCache.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/math/Matrix3.h"
+#include "core/math/Vector3.h"
+#include "core/mpi/Broadcast.h"
+#include "core/mpi/MPIManager.h"
+#include "core/logging/Logging.h"
+
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+
+#include "mesh_common/MatrixVectorOperations.h"
+#include "mesh_common/MeshIO.h"
+#include "mesh_common/MeshOperations.h"
+#include "mesh_common/QHull.h"
+#include "mesh_common/TriangleMeshes.h"
+
+#include "ShapeGeneration.h"
+#include "HullSimplification.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace walberla {
+namespace mesa_pd {
+
+/*
+ * Shape data of a single mesh file that is expensive to compute and therefore cached:
+ * convex hull (centered at its centroid, in the original orientation), mass properties for unit density,
+ * semi-axes of the inertia-equivalent ellipsoid and the vertex adjacency of the hull (for hill-climbing support point search).
+ */
+struct PreprocessedShape
+{
+   std::string fileName;
+   uint64_t fileHash = 0;
+
+   double volume = 0.0;
+   Vector3<double> centroid;      // of the original mesh
+   Matrix3<double> inertia;       // w.r.t. centroid, unit density
+   Vector3<double> semiAxes;      // of the ellipsoid with the same volume and principal moments of inertia
+   Matrix3<double> principalAxes; // columns = principal axes, corresponding to semiAxes
+
+   std::vector<Vector3<double>> vertices; // of the convex hull, relative to centroid
+   std::vector<uint32_t> faces;           // triangles of the convex hull, 3 vertex indices each
+   std::vector<uint32_t> adjacencyOffsets; // CSR layout, size = #vertices + 1
+   std::vector<uint32_t> adjacency;
+
+   HullSimplificationError simplificationError; // only set for simplified hulls
+
+   double getCircumscribedRadius() const
+   {
+      double r2 = 0.0;
+      for(const auto & v : vertices) r2 = std::max(r2, v.sqrLength());
+      return std::sqrt(r2);
+   }
+
+   double getVolumeEquivalentDiameter() const { return std::cbrt(6.0 * volume / math::pi); }
+};
+
+// 64 bit FNV-1a hash of the file content
+inline uint64_t computeFileHash(const std::string & fileName)
+{
+   std::ifstream file(fileName, std::ios::binary);
+   if(!file) WALBERLA_ABORT("Could not open file " << fileName << " for hashing.");
+   uint64_t hash = 14695981039346656037ull;
+   std::vector<char> buffer(1 << 16);
+   while(file)
+   {
+      file.read(buffer.data(), std::streamsize(buffer.size()));
+      auto numRead = file.gcount();
+      for(std::streamsize i = 0; i < numRead; ++i)
+      {
+         hash ^= uint64_t(static_cast<unsigned char>(buffer[size_t(i)]));
+         hash *= 1099511628211ull;
+      }
+   }
+   return hash;
+}
+
+// Jacobi eigenvalue iteration for symmetric 3x3 matrices, eigenvectors are stored in the columns
+inline void computeSymmetricEigenDecomposition(Matrix3<double> A, Vector3<double> & eigenvalues, Matrix3<double> & eigenvectors)
+{
+   eigenvectors = Matrix3<double>(1,0,0, 0,1,0, 0,0,1);
+   for(uint_t sweep = 0; sweep < 50; ++sweep)
+   {
+      double offDiagonal = std::abs(A(0,1)) + std::abs(A(0,2)) + std::abs(A(1,2));
+      if(offDiagonal < 1e-15 * (std::abs(A(0,0)) + std::abs(A(1,1)) + std::abs(A(2,2)))) break;
+      for(uint_t p = 0; p < 2; ++p)
+      {
+         for(uint_t q = p + 1; q < 3; ++q)
+         {
+            if(std::abs(A(p,q)) <= 0.0) continue;
+            double theta = (A(q,q) - A(p,p)) / (2.0 * A(p,q));
+            double t = ((theta >= 0.0) ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+            double c = 1.0 / std::sqrt(t * t + 1.0);
+            double s = t * c;
+            for(uint_t k = 0; k < 3; ++k)
+            {
+               double akp = A(k,p);
+               double akq = A(k,q);
+               A(k,p) = c * akp - s * akq;
+               A(k,q) = s * akp + c * akq;
+            }
+            for(uint_t k = 0; k < 3; ++k)
+            {
+               double apk = A(p,k);
+               double aqk = A(q,k);
+               A(p,k) = c * apk - s * aqk;
+               A(q,k) = s * apk + c * aqk;
+            }
+            for(uint_t k = 0; k < 3; ++k)
+            {
+               double vkp = eigenvectors(k,p);
+               double vkq = eigenvectors(k,q);
+               eigenvectors(k,p) = c * vkp - s * vkq;
+               eigenvectors(k,q) = s * vkp + c * vkq;
+            }
+         }
+      }
+   }
+   eigenvalues = Vector3<double>(A(0,0), A(1,1), A(2,2));
+}
+
+inline void computeVertexAdjacency(PreprocessedShape & shape)
+{
+   std::vector<std::vector<uint32_t>> neighbors(shape.vertices.size());
+   auto addEdge = [&neighbors](uint32_t a, uint32_t b)
+   {
+      if(std::find(neighbors[a].begin(), neighbors[a].end(), b) == neighbors[a].end()) neighbors[a].push_back(b);
+      if(std::find(neighbors[b].begin(), neighbors[b].end(), a) == neighbors[b].end()) neighbors[b].push_back(a);
+   };
+   for(size_t f = 0; f + 2 < shape.faces.size(); f += 3)
+   {
+      addEdge(shape.faces[f], shape.faces[f+1]);
+      addEdge(shape.faces[f+1], shape.faces[f+2]);
+      addEdge(shape.faces[f+2], shape.faces[f]);
+   }
+   shape.adjacencyOffsets.assign(1, 0);
+   shape.adjacency.clear();
+   for(const auto & n : neighbors)
+   {
+      shape.adjacency.insert(shape.adjacency.end(), n.begin(), n.end());
+      shape.adjacencyOffsets.push_back(uint32_t(shape.adjacency.size()));
+   }
+}
+
+// mass properties and semi-axes from the (centered) hull vertices and faces
+inline void computeMassPropertiesOfHull(PreprocessedShape & shape)
+{
+   mesh::TriangleMesh hull;
+   std::vector<mesh::TriangleMesh::VertexHandle> handles;
+   for(const auto & v : shape.vertices) handles.push_back(hull.add_vertex(mesh::TriangleMesh::Point(real_c(v[0]), real_c(v[1]), real_c(v[2]))));
+   for(size_t f = 0; f + 2 < shape.faces.size(); f += 3) hull.add_face(handles[shape.faces[f]], handles[shape.faces[f+1]], handles[shape.faces[f+2]]);
+
+   shape.volume = double(mesh::computeVolume(hull));
+   auto inertia = mesh::computeInertiaTensor(hull);
+   for(uint_t i = 0; i < 9; ++i) shape.inertia[i] = double(inertia[i]);
+
+   Vector3<double> principalMoments;
+   computeSymmetricEigenDecomposition(shape.inertia, principalMoments, shape.principalAxes);
+   // ellipsoid with unit density: I_0 = V/5 (b^2 + c^2) etc.
+   for(uint_t i = 0; i < 3; ++i)
+   {
+      double sq = 5.0 / (2.0 * shape.volume) * (principalMoments[(i+1)%3] + principalMoments[(i+2)%3] - principalMoments[i]);
+      shape.semiAxes[i] = std::sqrt(std::max(sq, 0.0));
+   }
+}
+
+// shifts the hull vertices to the hull's centroid and recomputes all derived data
+inline void centerHullAndComputeProperties(PreprocessedShape & shape)
+{
+   mesh::TriangleMesh hull;
+   std::vector<mesh::TriangleMesh::VertexHandle> handles;
+   for(const auto & v : shape.vertices) handles.push_back(hull.add_vertex(mesh::TriangleMesh::Point(real_c(v[0]), real_c(v[1]), real_c(v[2]))));
+   for(size_t f = 0; f + 2 < shape.faces.size(); f += 3) hull.add_face(handles[shape.faces[f]], handles[shape.faces[f+1]], handles[shape.faces[f+2]]);
+   auto c = mesh::computeCentroid(hull);
+   Vector3<double> centroid(double(c[0]), double(c[1]), double(c[2]));
+   for(auto & v : shape.vertices) v -= centroid;
+   shape.centroid += centroid;
+
+   computeMassPropertiesOfHull(shape);
+   computeVertexAdjacency(shape);
+}
+
+inline Vector3<double> getSortedSemiAxes(const PreprocessedShape & shape)
+{
+   auto sorted = shape.semiAxes;
+   std::sort(sorted.data(), sorted.data() + 3);
+   return sorted;
+}
+
+// simplified version of an already preprocessed hull, including its deviations from the original
+inline PreprocessedShape simplifyPreprocessedShape(const PreprocessedShape & original, const HullSimplificationParameters & parameters)
+{
+   PreprocessedShape simplified = original;
+   simplified.fileName = original.fileName + parameters.getKeySuffix();
+
+   double maxAbsoluteError = (parameters.maxRelativeError > real_t(0)) ? double(parameters.maxRelativeError) * original.getVolumeEquivalentDiameter()
+                                                                       : std::numeric_limits<double>::max();
+   double hausdorffError = 0.0;
+   simplifyConvexHull(simplified.vertices, simplified.faces, parameters.targetNumberOfVertices, maxAbsoluteError, hausdorffError);
+   centerHullAndComputeProperties(simplified);
+
+   auto & error = simplified.simplificationError;
+   error.originalNumberOfVertices = uint32_t(original.vertices.size());
+   error.hausdorffError = hausdorffError / original.getVolumeEquivalentDiameter();
+   error.volumeError = (original.volume - simplified.volume) / original.volume;
+   auto axesOriginal = getSortedSemiAxes(original);
+   auto axesSimplified = getSortedSemiAxes(simplified);
+   double elongationOriginal = axesOriginal[1] / axesOriginal[2];
+   double flatnessOriginal = axesOriginal[0] / axesOriginal[1];
+   error.formError = std::max(std::abs(axesSimplified[1] / axesSimplified[2] - elongationOriginal) / elongationOriginal,
+                              std::abs(axesSimplified[0] / axesSimplified[1] - flatnessOriginal) / flatnessOriginal);
+   return simplified;
+}
+
+// reads the mesh file via OpenMesh and computes all cached data, only to be called on a single process
+inline PreprocessedShape preprocessMeshFile(const std::string & fileName, uint64_t fileHash)
+{
+   PreprocessedShape shape;
+   shape.fileName = fileName;
+   shape.fileHash = fileHash;
+
+   mesh::TriangleMesh mesh;
+   mesh::readFromFile<mesh::TriangleMesh>(fileName, mesh);
+
+   std::vector<Vector3<real_t>> points;
+   for(auto vh : mesh.vertices()) points.push_back(mesh::toWalberla(mesh.point(vh)));
+   auto hull = mesh::convexHull<mesh::TriangleMesh>(points);
+
+   auto centroid = mesh::computeCentroid(*hull);
+   shape.centroid = Vector3<double>(double(centroid[0]), double(centroid[1]), double(centroid[2]));
+   for(auto vh : hull->vertices())
+   {
+      auto pt = mesh::toWalberla(hull->point(vh)) - centroid;
+      shape.vertices.emplace_back(double(pt[0]), double(pt[1]), double(pt[2]));
+   }
+   for(auto fh : hull->faces())
+   {
+      for(auto fvIt = hull->cfv_iter(fh); fvIt.is_valid(); ++fvIt) shape.faces.push_back(uint32_t(fvIt->idx()));
+   }
+
+   computeMassPropertiesOfHull(shape);
+   computeVertexAdjacency(shape);
+   return shape;
+}
+
+namespace shape_cache_io {
+
+const uint32_t magicNumber = 0x50505343; // "PPSC"
+const uint32_t version = 2;
+
+inline void write(std::vector<uint8_t> & buffer, const void * data, size_t numBytes)
+{
+   auto ptr = static_cast<const uint8_t*>(data);
+   buffer.insert(buffer.end(), ptr, ptr + numBytes);
+}
+template<typename T> void write(std::vector<uint8_t> & buffer, const T & value) { write(buffer, &value, sizeof(T)); }
+template<typename T> void writeVector(std::vector<uint8_t> & buffer, const std::vector<T> & values)
+{
+   write(buffer, uint64_t(values.size()));
+   if(!values.empty()) write(buffer, values.data(), values.size() * sizeof(T));
+}
+
+class Reader
+{
+public:
+   Reader(const uint8_t * data, size_t size) : data_(data), size_(size) {}
+   void read(void * target, size_t numBytes)
+   {
+      if(pos_ + numBytes > size_) WALBERLA_ABORT("Corrupt shape cache: unexpected end of data.");
+      std::memcpy(target, data_ + pos_, numBytes);
+      pos_ += numBytes;
+   }
+   template<typename T> T read() { T value; read(&value, sizeof(T)); return value; }
+   template<typename T> void readVector(std::vector<T> & values)
+   {
+      values.resize(size_t(read<uint64_t>()));
+      if(!values.empty()) read(values.data(), values.size() * sizeof(T));
+   }
+   bool atEnd() const { return pos_ >= size_; }
+private:
+   const uint8_t * data_;
+   size_t size_;
+   size_t pos_ = 0;
+};
+
+inline void writeShape(std::vector<uint8_t> & buffer, const PreprocessedShape & shape)
+{
+   write(buffer, shape.fileHash);
+   writeVector(buffer, std::vector<char>(shape.fileName.begin(), shape.fileName.end()));
+   write(buffer, shape.volume);
+   write(buffer, shape.centroid);
+   write(buffer, shape.inertia);
+   write(buffer, shape.semiAxes);
+   write(buffer, shape.principalAxes);
+   writeVector(buffer, shape.vertices);
+   writeVector(buffer, shape.faces);
+   writeVector(buffer, shape.adjacencyOffsets);
+   writeVector(buffer, shape.adjacency);
+   write(buffer, shape.simplificationError);
+}
+
+inline PreprocessedShape readShape(Reader & reader)
+{
+   PreprocessedShape shape;
+   shape.fileHash = reader.read<uint64_t>();
+   std::vector<char> name;
+   reader.readVector(name);
+   shape.fileName = std::string(name.begin(), name.end());
+   shape.volume = reader.read<double>();
+   shape.centroid = reader.read<Vector3<double>>();
+   shape.inertia = reader.read<Matrix3<double>>();
+   shape.semiAxes = reader.read<Vector3<double>>();
+   shape.principalAxes = reader.read<Matrix3<double>>();
+   reader.readVector(shape.vertices);
+   reader.readVector(shape.faces);
+   reader.readVector(shape.adjacencyOffsets);
+   reader.readVector(shape.adjacency);
+   shape.simplificationError = reader.read<HullSimplificationError>();
+   return shape;
+}
+
+inline std::vector<uint8_t> serialize(const std::vector<PreprocessedShape> & shapes)
+{
+   std::vector<uint8_t> buffer;
+   write(buffer, magicNumber);
+   write(buffer, version);
+   write(buffer, uint64_t(shapes.size()));
+   for(const auto & shape : shapes) writeShape(buffer, shape);
+   return buffer;
+}
+
+inline std::vector<PreprocessedShape> deserialize(const uint8_t * data, size_t size)
+{
+   std::vector<PreprocessedShape> shapes;
+   if(size == 0) return shapes;
+   Reader reader(data, size);
+   if(reader.read<uint32_t>() != magicNumber || reader.read<uint32_t>() != version)
+   {
+      WALBERLA_LOG_WARNING("Shape cache has unknown format or version - will be rebuilt.");
+      return shapes;
+   }
+   auto numShapes = reader.read<uint64_t>();
+   for(uint64_t i = 0; i < numShapes; ++i) shapes.push_back(readShape(reader));
+   return shapes;
+}
+
+} // namespace shape_cache_io
+
+/*
+ * Binary cache of preprocessed mesh data, keyed by file name and content hash.
+ *
+ * load() is collective: only the root process memory-maps the cache file, validates the entries by hashing the mesh files
+ * and preprocesses missing or outdated meshes (then rewriting the cache file).
+ * The requested entries are then broadcasted in serialized form to all other processes.
+ * Thus, OpenMesh parsing and convex hull computation happen only once per mesh and not on every process.
+ * Optionally, the hulls are simplified (see simplifyConvexHull). Simplified hulls are cached as separate entries
+ * and replace the original ones in the lookup, their volume and form errors are reported.
+ */
+class ShapeLibraryCache
+{
+public:
+   void load(const std::string & cacheFileName, const std::vector<std::string> & meshFileNames,
+             const HullSimplificationParameters & simplification = HullSimplificationParameters())
+   {
+      std::vector<uint8_t> buffer;
+      WALBERLA_ROOT_SECTION()
+      {
+         std::map<std::string, PreprocessedShape> cachedShapes;
+         if(!cacheFileName.empty())
+         {
+            for(auto & shape : readCacheFile(cacheFileName)) cachedShapes[shape.fileName] = std::move(shape);
+         }
+
+         uint_t numPreprocessed = 0;
+         uint_t numSimplified = 0;
+         std::vector<PreprocessedShape> requestedShapes;
+         for(const auto & fileName : meshFileNames)
+         {
+            auto hash = computeFileHash(fileName);
+            auto it = cachedShapes.find(fileName);
+            if(it == cachedShapes.end() || it->second.fileHash != hash)
+            {
+               cachedShapes[fileName] = preprocessMeshFile(fileName, hash);
+               ++numPreprocessed;
+            }
+
+            if(simplification.isActive())
+            {
+               auto simplifiedKey = fileName + simplification.getKeySuffix();
+               auto simplifiedIt = cachedShapes.find(simplifiedKey);
+               if(simplifiedIt == cachedShapes.end() || simplifiedIt->second.fileHash != hash)
+               {
+                  cachedShapes[simplifiedKey] = simplifyPreprocessedShape(cachedShapes[fileName], simplification);
+                  ++numSimplified;
+               }
+               auto simplifiedShape = cachedShapes[simplifiedKey];
+               simplifiedShape.fileName = fileName; // replaces the original one in the lookup
+               requestedShapes.push_back(simplifiedShape);
+            } else
+            {
+               requestedShapes.push_back(cachedShapes[fileName]);
+            }
+         }
+         if(simplification.isActive()) logSimplificationErrors(requestedShapes);
+         WALBERLA_LOG_INFO("Shape cache: " << meshFileNames.size() - numPreprocessed << " of " << meshFileNames.size() << " meshes found in cache, "
+                           << numPreprocessed << " preprocessed, " << numSimplified << " simplified.");
+
+         if(numPreprocessed + numSimplified > 0 && !cacheFileName.empty())
+         {
+            std::vector<PreprocessedShape> allShapes;
+            for(const auto & entry : cachedShapes) allShapes.push_back(entry.second);
+            writeCacheFile(cacheFileName, allShapes);
+         }
+
+         buffer = shape_cache_io::serialize(requestedShapes);
+      }
+      walberla::mpi::broadcastObject(buffer);
+
+      for(auto & shape : shape_cache_io::deserialize(buffer.data(), buffer.size())) shapes_[shape.fileName] = std::move(shape);
+   }
+
+   // aggregated simplification errors of all loaded shapes, for the run record
+   HullSimplificationError getMaximumSimplificationError() const
+   {
+      HullSimplificationError maxError;
+      for(const auto & entry : shapes_)
+      {
+         const auto & error = entry.second.simplificationError;
+         maxError.originalNumberOfVertices = std::max(maxError.originalNumberOfVertices, error.originalNumberOfVertices);
+         maxError.hausdorffError = std::max(maxError.hausdorffError, error.hausdorffError);
+         maxError.volumeError = std::max(maxError.volumeError, error.volumeError);
+         maxError.formError = std::max(maxError.formError, error.formError);
+      }
+      return maxError;
+   }
+
+   bool contains(const std::string & fileName) const { return shapes_.find(fileName) != shapes_.end(); }
+
+   const PreprocessedShape & get(const std::string & fileName) const
+   {
+      auto it = shapes_.find(fileName);
+      if(it == shapes_.end()) WALBERLA_ABORT("Mesh " << fileName << " not found in shape cache.");
+      return it->second;
+   }
+
+   std::vector<Vec3> getSemiAxes(const std::vector<std::string> & meshFileNames) const
+   {
+      std::vector<Vec3> semiAxes;
+      for(const auto & fileName : meshFileNames)
+      {
+         const auto & s = get(fileName).semiAxes;
+         semiAxes.emplace_back(real_c(s[0]), real_c(s[1]), real_c(s[2]));
+      }
+      return semiAxes;
+   }
+
+private:
+   static void logSimplificationErrors(const std::vector<PreprocessedShape> & shapes)
+   {
+      double maxHausdorffError = 0.0;
+      double maxVolumeError = 0.0;
+      double maxFormError = 0.0;
+      double avgVolumeError = 0.0;
+      double avgFormError = 0.0;
+      double avgVerticesBefore = 0.0;
+      double avgVerticesAfter = 0.0;
+      for(const auto & shape : shapes)
+      {
+         const auto & error = shape.simplificationError;
+         WALBERLA_LOG_DETAIL("Simplified hull of " << shape.fileName << ": " << error.originalNumberOfVertices << " -> " << shape.vertices.size()
+                             << " vertices, Hausdorff error = " << error.hausdorffError << ", volume error = " << error.volumeError
+                             << ", form error = " << error.formError);
+         maxHausdorffError = std::max(maxHausdorffError, error.hausdorffError);
+         maxVolumeError = std::max(maxVolumeError, error.volumeError);
+         maxFormError = std::max(maxFormError, error.formError);
+         avgVolumeError += error.volumeError;
+         avgFormError += error.formError;
+         avgVerticesBefore += double(error.originalNumberOfVertices);
+         avgVerticesAfter += double(shape.vertices.size());
+      }
+      double numShapes = double(std::max(shapes.size(), size_t(1)));
+      WALBERLA_LOG_INFO("Hull simplification of " << shapes.size() << " meshes: avg. number of vertices " << avgVerticesBefore / numShapes << " -> " << avgVerticesAfter / numShapes);
+      WALBERLA_LOG_INFO(" - relative volume error: avg = " << avgVolumeError / numShapes << ", max = " << maxVolumeError);
+      WALBERLA_LOG_INFO(" - relative form error: avg = " << avgFormError / numShapes << ", max = " << maxFormError);
+      WALBERLA_LOG_INFO(" - max. relative Hausdorff error = " << maxHausdorffError);
+   }
+
+   static std::vector<PreprocessedShape> readCacheFile(const std::string & cacheFileName)
+   {
+      int fd = open(cacheFileName.c_str(), O_RDONLY);
+      if(fd < 0) return {};
+      struct stat fileStat;
+      if(fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) { close(fd); return {}; }
+      size_t size = size_t(fileStat.st_size);
+      void * mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(mapped == MAP_FAILED) return {};
+      auto shapes = shape_cache_io::deserialize(static_cast<const uint8_t*>(mapped), size);
+      munmap(mapped, size);
+      return shapes;
+   }
+
+   static void writeCacheFile(const std::string & cacheFileName, const std::vector<PreprocessedShape> & shapes)
+   {
+      auto buffer = shape_cache_io::serialize(shapes);
+      std::string tmpFileName = cacheFileName + ".tmp";
+      {
+         std::ofstream file(tmpFileName, std::ios::binary | std::ios::trunc);
+         file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size()));
+      }
+      std::rename(tmpFileName.c_str(), cacheFileName.c_str());
+      WALBERLA_LOG_INFO("Shape cache with " << shapes.size() << " entries written to " << cacheFileName);
+   }
+
+   std::map<std::string, PreprocessedShape> shapes_;
+};
+
+/*
+ * Convex polyhedron whose support function walks along the edges of the hull (hill climbing) instead of scanning all vertices.
+ * On a convex hull, a vertex without neighbor further along the search direction is the support vertex.
+ * The walk starts at the precomputed support vertex of the octant of the search direction,
+ * such that only a few steps are required even for hulls with many vertices.
+ * The shape type is the one of ConvexPolyhedron, so it is handled by all existing kernels.
+ * Ghost copies that are created by the synchronization are plain ConvexPolyhedrons.
+ */
+class HillClimbingConvexPolyhedron : public data::ConvexPolyhedron
+{
+public:
+   HillClimbingConvexPolyhedron(const mesh::TriangleMesh & hull, const std::vector<uint32_t> & adjacencyOffsets, const std::vector<uint32_t> & adjacency)
+      : data::ConvexPolyhedron(hull), adjacencyOffsets_(adjacencyOffsets), adjacency_(adjacency)
+   {
+      for(auto vh : hull.vertices()) vertices_.push_back(mesh::toWalberla(hull.point(vh)));
+      for(uint_t octant = 0; octant < 8; ++octant)
+      {
+         Vec3 d((octant & 1) ? 1_r : -1_r, (octant & 2) ? 1_r : -1_r, (octant & 4) ? 1_r : -1_r);
+         uint32_t best = 0;
+         for(uint32_t v = 1; v < vertices_.size(); ++v) if(vertices_[v] * d > vertices_[best] * d) best = v;
+         octantStartVertices_[octant] = best;
+      }
+   }
+
+   Vec3 support(const Vec3 & d) const override
+   {
+      uint32_t current = octantStartVertices_[(d[0] > 0_r ? 1 : 0) + (d[1] > 0_r ? 2 : 0) + (d[2] > 0_r ? 4 : 0)];
+      real_t currentValue = vertices_[current] * d;
+      bool improved = true;
+      while(improved)
+      {
+         improved = false;
+         for(uint32_t i = adjacencyOffsets_[current]; i < adjacencyOffsets_[current + 1]; ++i)
+         {
+            real_t value = vertices_[adjacency_[i]] * d;
+            if(value > currentValue)
+            {
+               current = adjacency_[i];
+               currentValue = value;
+               improved = true;
+            }
+         }
+      }
+      return vertices_[current];
+   }
+
+private:
+   std::vector<Vec3> vertices_;
+   std::vector<uint32_t> adjacencyOffsets_; // CSR layout, see PreprocessedShape
+   std::vector<uint32_t> adjacency_;
+   std::array<uint32_t, 8> octantStartVertices_;
+};
+
+// convex polyhedron of the cached hull, uniformly scaled and optionally rotated (vertex order, and thus adjacency, is kept)
+inline std::shared_ptr<data::ConvexPolyhedron> createConvexPolyhedron(const PreprocessedShape & shape, real_t scaling,
+                                                                     const Matrix3<double> & rotation = Matrix3<double>(1,0,0, 0,1,0, 0,0,1))
+{
+   mesh::TriangleMesh hull;
+   std::vector<mesh::TriangleMesh::VertexHandle> handles;
+   for(const auto & vertex : shape.vertices)
+   {
+      auto v = rotation * vertex;
+      handles.push_back(hull.add_vertex(mesh::TriangleMesh::Point(scaling * real_c(v[0]), scaling * real_c(v[1]), scaling * real_c(v[2]))));
+   }
+   for(size_t f = 0; f + 2 < shape.faces.size(); f += 3) hull.add_face(handles[shape.faces[f]], handles[shape.faces[f+1]], handles[shape.faces[f+2]]);
+   return std::make_shared<HillClimbingConvexPolyhedron>(hull, shape.adjacencyOffsets, shape.adjacency);
+}
+
+/*
+ * Shape generator for the 'Mesh' (sphere-equivalent scaling) and 'UnscaledMeshesPerFraction' modes based on cached convex hulls.
+ * Mesh: a random mesh is scaled to the given volume-equivalent diameter.
+ * UnscaledMeshesPerFraction: the fraction is drawn according to the mass fractions (converted to number fractions with
+ * the average mesh volume per fraction), then a random mesh of this fraction is used as is, the diameter is ignored.
+ */
+class CachedMeshesGenerator : public ShapeGenerator
+{
+public:
+   // single set of meshes that is scaled to the requested size
+   CachedMeshesGenerator(const ShapeLibraryCache & cache, const std::vector<std::string> & meshFileNames)
+      : scaleToDiameter_(true), gen_(static_cast<unsigned long>(walberla::mpi::MPIManager::instance()->rank()))
+   {
+      fractions_.emplace_back();
+      for(const auto & fileName : meshFileNames) fractions_[0].push_back(&cache.get(fileName));
+      fractionDistribution_ = std::discrete_distribution<uint_t>({1.0});
+      computeStatistics();
+   }
+
+   // unscaled meshes, one set per fraction
+   CachedMeshesGenerator(const ShapeLibraryCache & cache, const std::vector<std::vector<std::string>> & meshFileNamesPerFraction,
+                         const std::vector<real_t> & massFractions)
+      : scaleToDiameter_(false), gen_(static_cast<unsigned long>(walberla::mpi::MPIManager::instance()->rank()))
+   {
+      WALBERLA_CHECK_EQUAL(meshFileNamesPerFraction.size(), massFractions.size());
+      std::vector<double> numberFractions;
+      for(uint_t i = 0; i < massFractions.size(); ++i)
+      {
+         fractions_.emplace_back();
+         double avgVolume = 0.0;
+         for(const auto & fileName : meshFileNamesPerFraction[i])
+         {
+            fractions_[i].push_back(&cache.get(fileName));
+            avgVolume += cache.get(fileName).volume;
+         }
+         if(fractions_[i].empty() || massFractions[i] <= real_t(0))
+         {
+            numberFractions.push_back(0.0);
+            continue;
+         }
+         avgVolume /= double(fractions_[i].size());
+         numberFractions.push_back(double(massFractions[i]) / avgVolume);
+      }
+      fractionDistribution_ = std::discrete_distribution<uint_t>(numberFractions.begin(), numberFractions.end());
+      computeStatistics();
+   }
+
+   void setShape(real_t diameter, real_t maximumAllowedInteractionRadius, std::shared_ptr<data::BaseShape> & shape, real_t & interactionRadius) override
+   {
+      real_t scaling;
+      const auto & s = selectShape(diameter, maximumAllowedInteractionRadius, scaling);
+      if(scaleToDiameter_)
+      {
+         shape = createConvexPolyhedron(s, scaling);
+      } else
+      {
+         // unscaled hulls are identical for all particles using the same mesh, thus a single instance is shared
+         auto & sharedShape = unscaledShapes_[&s];
+         if(!sharedShape) sharedShape = createConvexPolyhedron(s, real_t(1));
+         shape = sharedShape;
+      }
+      interactionRadius = scaling * real_c(s.getCircumscribedRadius());
+   }
+
+   real_t getMaxDiameterScalingFactor() override { return maxDiameterScalingFactor_; }
+   real_t getNormalVolume() override { return normalVolume_; }
+   Vec3 getNormalFormParameters() override { return normalFormParameters_; }
+   bool generatesSingleShape() override { return fractions_.size() == 1 && fractions_[0].size() == 1; }
+
+protected:
+   // draws a random mesh (and its scaling) whose circumscribed radius does not exceed the allowed interaction radius
+   const PreprocessedShape & selectShape(real_t diameter, real_t maximumAllowedInteractionRadius, real_t & scaling)
+   {
+      for(uint_t trial = 0; trial < 100; ++trial)
+      {
+         const auto & fraction = fractions_[fractionDistribution_(gen_)];
+         const auto & s = *fraction[std::uniform_int_distribution<size_t>(0, fraction.size() - 1)(gen_)];
+         scaling = scaleToDiameter_ ? diameter / real_c(s.getVolumeEquivalentDiameter()) : real_t(1);
+         if(scaling * real_c(s.getCircumscribedRadius()) <= maximumAllowedInteractionRadius) return s;
+      }
+      WALBERLA_ABORT("No mesh found that fulfills the maximum allowed interaction radius of " << maximumAllowedInteractionRadius);
+   }
+
+   void computeStatistics()
+   {
+      uint_t numShapes = 0;
+      Vector3<double> avgSemiAxes(0.0);
+      double avgNormalVolume = 0.0;
+      for(const auto & fraction : fractions_)
+      {
+         for(const auto * s : fraction)
+         {
+            double d = s->getVolumeEquivalentDiameter();
+            maxDiameterScalingFactor_ = std::max(maxDiameterScalingFactor_, real_c(2.0 * s->getCircumscribedRadius() / d));
+            avgNormalVolume += s->volume / (d * d * d);
+            auto sorted = s->semiAxes;
+            std::sort(sorted.data(), sorted.data() + 3);
+            avgSemiAxes += sorted / sorted[1];
+            ++numShapes;
+         }
+      }
+      WALBERLA_CHECK_GREATER(numShapes, 0, "No meshes available for shape generation.");
+      normalVolume_ = real_c(avgNormalVolume / double(numShapes));
+      avgSemiAxes /= double(numShapes);
+      normalFormParameters_ = Vec3(real_c(avgSemiAxes[0]), real_c(avgSemiAxes[1]), real_c(avgSemiAxes[2]));
+   }
+
+   bool scaleToDiameter_;
+   std::vector<std::vector<const PreprocessedShape*>> fractions_;
+   std::discrete_distribution<uint_t> fractionDistribution_;
+   std::mt19937 gen_;
+   std::map<const PreprocessedShape*, std::shared_ptr<data::ConvexPolyhedron>> unscaledShapes_;
+
+   real_t maxDiameterScalingFactor_ = real_t(1);
+   real_t normalVolume_ = real_t(1);
+   Vec3 normalFormParameters_ = Vec3(1_r);
+};
+
+} // namespace mesa_pd
+} // namespace walberla
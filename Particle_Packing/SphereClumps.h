@@ -0,0 +1,460 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   SphereClumps.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+#include "core/math/Matrix3.h"
+#include "core/math/Vector3.h"
+#include "core/mpi/Broadcast.h"
+#include "core/mpi/MPIManager.h"
+
+#include "mesa_pd/collision_detection/AnalyticCollisionFunctions.h"
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+
+#include "mesh_common/MatrixVectorOperations.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ProxySettling.h"
+#include "ShapeLibraryCache.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+struct SphereClumpParameters
+{
+   uint_t maxNumberOfSpheres = uint_t(32);
+   real_t maxVolumeError = real_t(0.1);   // uncovered fraction of the hull volume
+   real_t maxSurfaceError = real_t(0.02); // mean distance of the hull surface to the clump, relative to the volume-equivalent diameter
+   uint_t resolution = uint_t(32);        // voxels along the largest extent of the hull
+
+   static SphereClumpParameters fromConfig(const Config::BlockHandle & clumpConf)
+   {
+      SphereClumpParameters parameters;
+      parameters.maxNumberOfSpheres = clumpConf.getParameter<uint_t>("maxNumberOfSpheres", parameters.maxNumberOfSpheres);
+      parameters.maxVolumeError = clumpConf.getParameter<real_t>("maxVolumeError", parameters.maxVolumeError);
+      parameters.maxSurfaceError = clumpConf.getParameter<real_t>("maxSurfaceError", parameters.maxSurfaceError);
+      parameters.resolution = clumpConf.getParameter<uint_t>("resolution", parameters.resolution);
+      return parameters;
+   }
+};
+
+// rigid clump of overlapping spheres, in the body frame of the unscaled hull
+struct SphereClump
+{
+   std::vector<Vector3<double>> centers;
+   std::vector<double> radii;
+   double volumeError = 0.0;
+   double surfaceError = 0.0;
+};
+
+/*
+ * Greedy sphere placement inside a convex hull on a voxel grid:
+ * the distance of an interior point to the boundary of a convex polytope is its smallest distance to the face planes,
+ * i.e. the radius of the largest inscribed sphere centered there. In each step, the uncovered voxel with the largest
+ * inscribed sphere becomes a new sphere, until volume and surface error are below the targets or the maximum number is reached.
+ * As all spheres are inscribed, the clump never exceeds the hull.
+ */
+inline SphereClump computeSphereClump(const PreprocessedShape & shape, const SphereClumpParameters & parameters)
+{
+   std::vector<Vector3<double>> faceNormals;
+   std::vector<double> faceOffsets;
+   std::vector<Vector3<double>> surfacePoints = shape.vertices;
+   for(size_t f = 0; f + 2 < shape.faces.size(); f += 3)
+   {
+      const auto & a = shape.vertices[shape.faces[f]];
+      const auto & b = shape.vertices[shape.faces[f+1]];
+      const auto & c = shape.vertices[shape.faces[f+2]];
+      Vector3<double> normal = (b - a) % (c - a);
+      if(normal.sqrLength() <= 0.0) continue;
+      normal = normal.getNormalized();
+      faceNormals.push_back(normal);
+      faceOffsets.push_back(normal * a);
+      surfacePoints.push_back((a + b + c) / 3.0);
+   }
+   auto distanceToBoundary = [&](const Vector3<double> & p){
+      double distance = std::numeric_limits<double>::max();
+      for(size_t f = 0; f < faceNormals.size(); ++f) distance = std::min(distance, faceOffsets[f] - faceNormals[f] * p);
+      return distance;
+   };
+
+   Vector3<double> minCorner(std::numeric_limits<double>::max());
+   Vector3<double> maxCorner(-std::numeric_limits<double>::max());
+   for(const auto & v : shape.vertices)
+   {
+      for(uint_t i = 0; i < 3; ++i)
+      {
+         minCorner[i] = std::min(minCorner[i], v[i]);
+         maxCorner[i] = std::max(maxCorner[i], v[i]);
+      }
+   }
+   double h = std::max(maxCorner[0] - minCorner[0], std::max(maxCorner[1] - minCorner[1], maxCorner[2] - minCorner[2])) / double(std::max(parameters.resolution, uint_t(4)));
+
+   std::vector<Vector3<double>> voxels;
+   std::vector<double> voxelDistances;
+   for(double x = minCorner[0] + 0.5 * h; x < maxCorner[0]; x += h)
+      for(double y = minCorner[1] + 0.5 * h; y < maxCorner[1]; y += h)
+         for(double z = minCorner[2] + 0.5 * h; z < maxCorner[2]; z += h)
+         {
+            Vector3<double> p(x, y, z);
+            double distance = distanceToBoundary(p);
+            if(distance <= 0.0) continue;
+            voxels.push_back(p);
+            voxelDistances.push_back(distance);
+         }
+   WALBERLA_CHECK(!voxels.empty(), "Voxelization of " << shape.fileName << " is empty, increase the clump resolution.");
+
+   SphereClump clump;
+   std::vector<bool> isCovered(voxels.size(), false);
+   size_t numCovered = 0;
+   const double diameter = shape.getVolumeEquivalentDiameter();
+   while(clump.radii.size() < parameters.maxNumberOfSpheres)
+   {
+      size_t best = voxels.size();
+      for(size_t v = 0; v < voxels.size(); ++v)
+      {
+         if(!isCovered[v] && (best == voxels.size() || voxelDistances[v] > voxelDistances[best])) best = v;
+      }
+      if(best == voxels.size()) break;
+
+      const auto center = voxels[best];
+      const double radius = voxelDistances[best];
+      clump.centers.push_back(center);
+      clump.radii.push_back(radius);
+      for(size_t v = 0; v < voxels.size(); ++v)
+      {
+         if(!isCovered[v] && (voxels[v] - center).sqrLength() <= radius * radius)
+         {
+            isCovered[v] = true;
+            ++numCovered;
+         }
+      }
+
+      clump.volumeError = 1.0 - double(numCovered) / double(voxels.size());
+      double surfaceDistance = 0.0;
+      for(const auto & q : surfacePoints)
+      {
+         double distance = std::numeric_limits<double>::max();
+         for(size_t s = 0; s < clump.radii.size(); ++s) distance = std::min(distance, (q - clump.centers[s]).length() - clump.radii[s]);
+         surfaceDistance += std::max(distance, 0.0);
+      }
+      clump.surfaceError = surfaceDistance / double(surfacePoints.size()) / diameter;
+      if(clump.volumeError <= double(parameters.maxVolumeError) && clump.surfaceError <= double(parameters.maxSurfaceError)) break;
+   }
+   return clump;
+}
+
+/*
+ * Sphere clumps of all meshes, computed once on root and broadcasted.
+ * The particles keep their convex hull (ConvexPolyhedron) as base shape: mass, inertia, VTK output and the
+ * synchronization are unchanged, ghost copies are regular hulls. The clump of a particle is identified by matching
+ * its hull vertices (vertex count, first vertices up to scaling) against the library, for the hull in the mesh frame
+ * and in the principal frame (as created by the ellipsoid proxy swap), and cached per shape instance.
+ * Contacts are computed between the spheres of the clumps (and walls) with the analytic sphere kernels, after a test of the
+ * bounding spheres of the clumps. For DEM, whose tangential contact history is stored per particle pair, the sphere contacts
+ * of a pair are aggregated to a single contact: deepest penetration, contact point and normal averaged with the penetration
+ * depths as weights. HCSITS gets one contact per touching sphere pair.
+ */
+class SphereClumpLibrary
+{
+public:
+   SphereClumpLibrary(const ShapeLibraryCache & cache, const std::vector<std::string> & meshFileNames, const SphereClumpParameters & parameters)
+   {
+      std::vector<double> buffer; // per mesh: #spheres, volume error, surface error, (center, radius) per sphere
+      WALBERLA_ROOT_SECTION()
+      {
+         for(const auto & fileName : meshFileNames)
+         {
+            auto clump = computeSphereClump(cache.get(fileName), parameters);
+            buffer.push_back(double(clump.radii.size()));
+            buffer.push_back(clump.volumeError);
+            buffer.push_back(clump.surfaceError);
+            for(size_t s = 0; s < clump.radii.size(); ++s)
+            {
+               buffer.insert(buffer.end(), {clump.centers[s][0], clump.centers[s][1], clump.centers[s][2], clump.radii[s]});
+            }
+         }
+      }
+      walberla::mpi::broadcastObject(buffer);
+
+      size_t pos = 0;
+      for(const auto & fileName : meshFileNames)
+      {
+         const auto & shape = cache.get(fileName);
+         SphereClump clump;
+         size_t numSpheres = size_t(buffer[pos++]);
+         clump.volumeError = buffer[pos++];
+         clump.surfaceError = buffer[pos++];
+         for(size_t s = 0; s < numSpheres; ++s, pos += 4)
+         {
+            clump.centers.emplace_back(buffer[pos], buffer[pos+1], buffer[pos+2]);
+            clump.radii.push_back(buffer[pos+3]);
+         }
+         addEntry(shape, clump, Matrix3<double>(1,0,0, 0,1,0, 0,0,1));
+         addEntry(shape, clump, getPrincipalAxesRotation(shape).getTranspose());
+         statistics_.push_back(clump);
+      }
+   }
+
+   // assigns the clumps to all particles (by index), to be called whenever indices or shapes may have changed (sorting, sync)
+   template<typename Accessor_T>
+   void update(Accessor_T & ac)
+   {
+      particleClumps_.assign(ac.size(), ParticleClump());
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         const auto & shapePtr = ac.getBaseShapeRef(idx);
+         if(shapePtr->getShapeType() != data::ConvexPolyhedron::SHAPE_TYPE) continue;
+         auto it = shapeClumps_.find(shapePtr.get());
+         if(it == shapeClumps_.end() || it->second.first.expired())
+         {
+            it = shapeClumps_.insert_or_assign(shapePtr.get(), std::make_pair(std::weak_ptr<data::BaseShape>(shapePtr),
+                                                                             identify(static_cast<const data::ConvexPolyhedron &>(*shapePtr)))).first;
+         }
+         particleClumps_[idx] = it->second.second;
+      }
+      if(shapeClumps_.size() > 2 * ac.size() + 64)
+      {
+         for(auto it = shapeClumps_.begin(); it != shapeClumps_.end();) it = it->second.first.expired() ? shapeClumps_.erase(it) : std::next(it);
+      }
+   }
+
+   // calls func(idx1, idx2, contactPoint, contactNormal, penetrationDepth) for each contact of the spheres of a candidate pair,
+   // or once with the aggregated contact, the normal points from particle 2 to particle 1, walls are always particle 2
+   template<typename Accessor_T, typename Func_T>
+   void forEachContact(size_t idx1, size_t idx2, Accessor_T & ac, bool aggregate, Func_T && func) const
+   {
+      const auto & clump1 = particleClumps_[idx1];
+      const auto & clump2 = particleClumps_[idx2];
+      if(clump1.entry == nullptr && clump2.entry == nullptr) return;
+      if(clump1.entry == nullptr) { forEachWallContact(idx2, idx1, ac, aggregate, func); return; }
+      if(clump2.entry == nullptr) { forEachWallContact(idx1, idx2, ac, aggregate, func); return; }
+
+      const Vec3 & position1 = ac.getPosition(idx1);
+      const Vec3 & position2 = ac.getPosition(idx2);
+      const auto rotation1 = ac.getRotation(idx1).getMatrix();
+      const auto rotation2 = ac.getRotation(idx2).getMatrix();
+      const Vec3 boundingCenter2 = position2 + rotation2 * (clump2.scaling * clump2.entry->boundingCenter);
+      const real_t boundingRadius2 = clump2.scaling * clump2.entry->boundingRadius;
+      const Vec3 boundingCenter1 = position1 + rotation1 * (clump1.scaling * clump1.entry->boundingCenter);
+      const real_t boundingRadius1 = clump1.scaling * clump1.entry->boundingRadius;
+      if((boundingCenter1 - boundingCenter2).sqrLength() > (boundingRadius1 + boundingRadius2) * (boundingRadius1 + boundingRadius2)) return;
+
+      thread_local std::vector<Vec3> centers2;
+      centers2.resize(clump2.entry->centers.size());
+      for(size_t s = 0; s < centers2.size(); ++s) centers2[s] = position2 + rotation2 * (clump2.scaling * clump2.entry->centers[s]);
+
+      ContactAggregate aggregation;
+      Vec3 contactPoint;
+      Vec3 contactNormal;
+      real_t penetrationDepth;
+      for(size_t s1 = 0; s1 < clump1.entry->centers.size(); ++s1)
+      {
+         Vec3 center1 = position1 + rotation1 * (clump1.scaling * clump1.entry->centers[s1]);
+         real_t radius1 = clump1.scaling * clump1.entry->radii[s1];
+         if((center1 - boundingCenter2).sqrLength() > (radius1 + boundingRadius2) * (radius1 + boundingRadius2)) continue;
+         for(size_t s2 = 0; s2 < centers2.size(); ++s2)
+         {
+            if(collision_detection::analytic::detectSphereSphereCollision(center1, radius1, centers2[s2], clump2.scaling * clump2.entry->radii[s2],
+                                                                          contactPoint, contactNormal, penetrationDepth, real_t(0)))
+            {
+               if(aggregate) aggregation.add(contactPoint, contactNormal, penetrationDepth);
+               else func(idx1, idx2, contactPoint, contactNormal, penetrationDepth);
+            }
+         }
+      }
+      if(aggregation.hasContact()) func(idx1, idx2, aggregation.getContactPoint(), aggregation.getContactNormal(), aggregation.getPenetrationDepth());
+   }
+
+   uint_t getNumberOfClumps() const { return uint_c(statistics_.size()); }
+   real_t getAverageNumberOfSpheres() const { return averageOf([](const SphereClump & c){ return double(c.radii.size()); }); }
+   real_t getAverageVolumeError() const { return averageOf([](const SphereClump & c){ return c.volumeError; }); }
+   real_t getAverageSurfaceError() const { return averageOf([](const SphereClump & c){ return c.surfaceError; }); }
+
+private:
+   struct Entry
+   {
+      std::vector<Vec3> centers; // in the frame of the hull vertices below
+      std::vector<real_t> radii;
+      Vec3 boundingCenter; // bounding sphere of all spheres
+      real_t boundingRadius = real_t(0);
+      std::vector<Vector3<double>> referenceVertices; // first hull vertices, for identification
+   };
+
+   // single contact from the sphere contacts of a particle pair
+   class ContactAggregate
+   {
+   public:
+      void add(const Vec3 & contactPoint, const Vec3 & contactNormal, real_t penetrationDepth)
+      {
+         const real_t weight = -penetrationDepth;
+         weightedPoint_ += weight * contactPoint;
+         weightedNormal_ += weight * contactNormal;
+         weightSum_ += weight;
+         if(penetrationDepth < penetrationDepth_)
+         {
+            penetrationDepth_ = penetrationDepth;
+            deepestPoint_ = contactPoint;
+            deepestNormal_ = contactNormal;
+         }
+      }
+
+      bool hasContact() const { return penetrationDepth_ < std::numeric_limits<real_t>::max(); }
+      real_t getPenetrationDepth() const { return penetrationDepth_; }
+      // touching spheres without overlap have zero weight, the deepest contact is used then
+      Vec3 getContactPoint() const { return (weightSum_ > real_t(0)) ? weightedPoint_ / weightSum_ : deepestPoint_; }
+      Vec3 getContactNormal() const
+      {
+         const real_t length = weightedNormal_.length();
+         return (weightSum_ > real_t(0) && length > real_t(0)) ? weightedNormal_ / length : deepestNormal_;
+      }
+
+   private:
+      Vec3 weightedPoint_;
+      Vec3 weightedNormal_;
+      real_t weightSum_ = real_t(0);
+      real_t penetrationDepth_ = std::numeric_limits<real_t>::max();
+      Vec3 deepestPoint_;
+      Vec3 deepestNormal_;
+   };
+
+   struct ParticleClump
+   {
+      const Entry * entry = nullptr;
+      real_t scaling = real_t(1);
+   };
+
+   static constexpr size_t numReferenceVertices = 4;
+
+   void addEntry(const PreprocessedShape & shape, const SphereClump & clump, const Matrix3<double> & rotation)
+   {
+      auto entry = std::make_unique<Entry>();
+      for(size_t s = 0; s < clump.radii.size(); ++s)
+      {
+         auto c = rotation * clump.centers[s];
+         entry->centers.emplace_back(real_c(c[0]), real_c(c[1]), real_c(c[2]));
+         entry->radii.push_back(real_c(clump.radii[s]));
+      }
+      for(const auto & center : entry->centers) entry->boundingCenter += center;
+      entry->boundingCenter /= real_c(std::max(entry->centers.size(), size_t(1)));
+      for(size_t s = 0; s < entry->centers.size(); ++s)
+         entry->boundingRadius = std::max(entry->boundingRadius, (entry->centers[s] - entry->boundingCenter).length() + entry->radii[s]);
+      for(size_t v = 0; v < std::min(numReferenceVertices, shape.vertices.size()); ++v) entry->referenceVertices.push_back(rotation * shape.vertices[v]);
+      entries_[shape.vertices.size()].push_back(std::move(entry));
+   }
+
+   ParticleClump identify(const data::ConvexPolyhedron & polyhedron) const
+   {
+      const auto & mesh = polyhedron.getMesh();
+      auto candidates = entries_.find(mesh.n_vertices());
+      WALBERLA_CHECK(candidates != entries_.end(), "No sphere clump for a hull with " << mesh.n_vertices() << " vertices.");
+
+      std::vector<Vector3<double>> vertices;
+      for(auto vh : mesh.vertices())
+      {
+         if(vertices.size() == numReferenceVertices) break;
+         auto p = mesh::toWalberla(mesh.point(vh));
+         vertices.emplace_back(double(p[0]), double(p[1]), double(p[2]));
+      }
+
+      ParticleClump best;
+      double minDeviation = std::numeric_limits<double>::max();
+      for(const auto & entry : candidates->second)
+      {
+         double referenceLength = entry->referenceVertices[0].length();
+         if(referenceLength <= 0.0) continue;
+         double scaling = vertices[0].length() / referenceLength;
+         double deviation = 0.0;
+         for(size_t v = 0; v < vertices.size(); ++v) deviation += (vertices[v] - scaling * entry->referenceVertices[v]).length() / (scaling * referenceLength);
+         if(deviation < minDeviation)
+         {
+            minDeviation = deviation;
+            best.entry = entry.get();
+            best.scaling = real_c(scaling);
+         }
+      }
+      WALBERLA_CHECK_LESS(minDeviation, 1e-3, "No matching sphere clump found for hull with " << mesh.n_vertices() << " vertices.");
+      return best;
+   }
+
+   template<typename Accessor_T, typename Func_T>
+   void forEachWallContact(size_t idxClump, size_t idxWall, Accessor_T & ac, bool aggregate, Func_T && func) const
+   {
+      const auto & clump = particleClumps_[idxClump];
+      const auto * wall = ac.getShape(idxWall);
+      const Vec3 & position = ac.getPosition(idxClump);
+      const auto rotation = ac.getRotation(idxClump).getMatrix();
+
+      Vec3 contactPoint;
+      Vec3 contactNormal;
+      real_t penetrationDepth;
+      auto detect = [&](const Vec3 & center, real_t radius)
+      {
+         if(wall->getShapeType() == data::HalfSpace::SHAPE_TYPE)
+         {
+            return collision_detection::analytic::detectSphereHalfSpaceCollision(center, radius, ac.getPosition(idxWall), static_cast<const data::HalfSpace*>(wall)->getNormal(),
+                                                                                contactPoint, contactNormal, penetrationDepth, real_t(0));
+         } else if(wall->getShapeType() == data::CylindricalBoundary::SHAPE_TYPE)
+         {
+            const auto * cylinder = static_cast<const data::CylindricalBoundary*>(wall);
+            return collision_detection::analytic::detectSphereCylindricalBoundaryCollision(center, radius, ac.getPosition(idxWall), cylinder->getRadius(), cylinder->getAxis(),
+                                                                                          contactPoint, contactNormal, penetrationDepth, real_t(0));
+         }
+         return false;
+      };
+      if(!detect(position + rotation * (clump.scaling * clump.entry->boundingCenter), clump.scaling * clump.entry->boundingRadius)) return;
+
+      ContactAggregate aggregation;
+      for(size_t s = 0; s < clump.entry->centers.size(); ++s)
+      {
+         if(!detect(position + rotation * (clump.scaling * clump.entry->centers[s]), clump.scaling * clump.entry->radii[s])) continue;
+         if(aggregate) aggregation.add(contactPoint, contactNormal, penetrationDepth);
+         else func(idxClump, idxWall, contactPoint, contactNormal, penetrationDepth);
+      }
+      if(aggregation.hasContact()) func(idxClump, idxWall, aggregation.getContactPoint(), aggregation.getContactNormal(), aggregation.getPenetrationDepth());
+   }
+
+   template<typename Func_T>
+   real_t averageOf(Func_T && func) const
+   {
+      double sum = 0.0;
+      for(const auto & clump : statistics_) sum += func(clump);
+      return real_c(sum / double(std::max(statistics_.size(), size_t(1))));
+   }
+
+   std::map<size_t, std::vector<std::unique_ptr<Entry>>> entries_; // by number of hull vertices
+   std::vector<SphereClump> statistics_;
+   std::map<const data::BaseShape*, std::pair<std::weak_ptr<data::BaseShape>, ParticleClump>> shapeClumps_;
+   std::vector<ParticleClump> particleClumps_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,159 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   TimeLoopConfiguration.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+
+#include "mesa_pd/collision_detection/AnalyticContactDetection.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+#include "mesa_pd/data/shape/Sphere.h"
+
+#include <string>
+
+namespace walberla {
+namespace mesa_pd {
+
+enum class SolverType { DEM, HCSITS };
+
+enum class ShapeFamily
+{
+   Sphere,            // analytic sphere kernels, no shape dispatch
+   AnalyticEllipsoid, // EllipsoidContactDetection
+   ConvexGJK,         // ellipsoids without analytic kernels, bounding sphere check + GJK/EPA
+   Mesh,              // convex polyhedra, bounding sphere check + GJK/EPA, mesh VTK output
+   SphereClump        // convex polyhedra represented by rigid clumps of spheres for contact detection, mesh VTK output
+};
+
+// the synchronization variant depends on the domain partitioning (block size vs. particle size)
+enum class SyncType
+{
+   NextNeighbors,
+   GhostOwners,
+   None           // single process: periodic wrapping and minimum image instead of ghost particles, see MinimumImage.h
+};
+
+inline SolverType solverTypeFromString(const std::string & solver)
+{
+   if(solver == "DEM") return SolverType::DEM;
+   if(solver == "HCSITS") return SolverType::HCSITS;
+   WALBERLA_ABORT("Unknown solver " << solver);
+}
+
+inline ShapeFamily shapeFamilyFromString(const std::string & particleShape, bool useAnalyticEllipsoidContact)
+{
+   if(particleShape == "Sphere") return ShapeFamily::Sphere;
+   if(particleShape.find("Mesh") != std::string::npos) return ShapeFamily::Mesh;
+   if(particleShape.find("Ellipsoid") != std::string::npos) return useAnalyticEllipsoidContact ? ShapeFamily::AnalyticEllipsoid : ShapeFamily::ConvexGJK;
+   WALBERLA_ABORT("Unknown shape " << particleShape);
+}
+
+/*
+ * Compile-time description of the time loop variant.
+ * The time loop is written as a generic lambda taking such a configuration, such that all decisions depending on
+ * solver, shape family and synchronization are resolved via 'if constexpr' and the concrete kernels are inlined.
+ */
+template<SolverType Solver_T, ShapeFamily Shape_T, SyncType Sync_T>
+struct TimeLoopConfiguration
+{
+   static constexpr SolverType solver = Solver_T;
+   static constexpr ShapeFamily shape = Shape_T;
+   static constexpr SyncType sync = Sync_T;
+
+   static constexpr bool isDEM = (Solver_T == SolverType::DEM);
+   static constexpr bool isHCSITS = (Solver_T == SolverType::HCSITS);
+   static constexpr bool usesGJK = (Shape_T == ShapeFamily::ConvexGJK || Shape_T == ShapeFamily::Mesh);
+   static constexpr bool writesMeshVTK = (Shape_T == ShapeFamily::Mesh || Shape_T == ShapeFamily::SphereClump);
+};
+
+namespace internal {
+template<SolverType Solver_T, ShapeFamily Shape_T, typename TimeLoop_T>
+void dispatchTimeLoopSync(SyncType sync, TimeLoop_T && timeLoop)
+{
+   switch(sync)
+   {
+      case SyncType::NextNeighbors: timeLoop(TimeLoopConfiguration<Solver_T, Shape_T, SyncType::NextNeighbors>()); break;
+      case SyncType::GhostOwners: timeLoop(TimeLoopConfiguration<Solver_T, Shape_T, SyncType::GhostOwners>()); break;
+      case SyncType::None: timeLoop(TimeLoopConfiguration<Solver_T, Shape_T, SyncType::None>()); break;
+   }
+}
+
+template<SolverType Solver_T, typename TimeLoop_T>
+void dispatchTimeLoopShape(ShapeFamily shape, SyncType sync, TimeLoop_T && timeLoop)
+{
+   switch(shape)
+   {
+      case ShapeFamily::Sphere: dispatchTimeLoopSync<Solver_T, ShapeFamily::Sphere>(sync, timeLoop); break;
+      case ShapeFamily::AnalyticEllipsoid: dispatchTimeLoopSync<Solver_T, ShapeFamily::AnalyticEllipsoid>(sync, timeLoop); break;
+      case ShapeFamily::ConvexGJK: dispatchTimeLoopSync<Solver_T, ShapeFamily::ConvexGJK>(sync, timeLoop); break;
+      case ShapeFamily::Mesh: dispatchTimeLoopSync<Solver_T, ShapeFamily::Mesh>(sync, timeLoop); break;
+      case ShapeFamily::SphereClump: dispatchTimeLoopSync<Solver_T, ShapeFamily::SphereClump>(sync, timeLoop); break;
+   }
+}
+} // namespace internal
+
+// selects the time loop instantiation once, at startup
+template<typename TimeLoop_T>
+void dispatchTimeLoop(SolverType solver, ShapeFamily shape, SyncType sync, TimeLoop_T && timeLoop)
+{
+   switch(solver)
+   {
+      case SolverType::DEM: internal::dispatchTimeLoopShape<SolverType::DEM>(shape, sync, timeLoop); break;
+      case SolverType::HCSITS: internal::dispatchTimeLoopShape<SolverType::HCSITS>(shape, sync, timeLoop); break;
+   }
+}
+
+namespace collision_detection {
+
+/*
+ * Fine contact detection for pure sphere packings without the double dispatch of DoubleCast:
+ * all finite particles are spheres, and only the type of the (at most one, see ExcludeInfiniteInfinite) wall has to be checked.
+ */
+template<typename Accessor_T>
+inline bool detectSphereContact(size_t idx1, size_t idx2, Accessor_T & ac, AnalyticContactDetection & contactDetection)
+{
+   using data::CylindricalBoundary;
+   using data::HalfSpace;
+   using data::Sphere;
+
+   const auto * shape1 = ac.getShape(idx1);
+   const auto * shape2 = ac.getShape(idx2);
+   const auto type1 = shape1->getShapeType();
+   const auto type2 = shape2->getShapeType();
+
+   if(type1 == Sphere::SHAPE_TYPE)
+   {
+      const auto & sphere1 = *static_cast<const Sphere*>(shape1);
+      if(type2 == Sphere::SHAPE_TYPE) return contactDetection(idx1, idx2, sphere1, *static_cast<const Sphere*>(shape2), ac);
+      if(type2 == HalfSpace::SHAPE_TYPE) return contactDetection(idx1, idx2, sphere1, *static_cast<const HalfSpace*>(shape2), ac);
+      if(type2 == CylindricalBoundary::SHAPE_TYPE) return contactDetection(idx1, idx2, sphere1, *static_cast<const CylindricalBoundary*>(shape2), ac);
+   } else if(type2 == Sphere::SHAPE_TYPE)
+   {
+      const auto & sphere2 = *static_cast<const Sphere*>(shape2);
+      if(type1 == HalfSpace::SHAPE_TYPE) return contactDetection(idx1, idx2, *static_cast<const HalfSpace*>(shape1), sphere2, ac);
+      if(type1 == CylindricalBoundary::SHAPE_TYPE) return contactDetection(idx1, idx2, *static_cast<const CylindricalBoundary*>(shape1), sphere2, ac);
+   }
+   WALBERLA_ABORT("Unsupported shape combination " << type1 << " / " << type2 << " in sphere contact detection.");
+}
+
+} // namespace collision_detection
+} // namespace mesa_pd
+} // namespace walberla
@@ -0,0 +1,305 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   TimeSeriesStore.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/Abort.h"
+#include "core/DataTypes.h"
+#include "core/config/Config.h"
+#include "core/logging/Logging.h"
+#include "core/mpi/MPIManager.h"
+#include "core/timing/TimingTree.h"
+
+#include "sqlite/sqlite3.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "PerformanceMonitoring.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+struct TimeSeriesParameters
+{
+   std::string format = "sqlite"; // sqlite: tables in the run data base, binary: <id>_timeseries.bin
+   uint_t flushRows = uint_t(10000); // buffered rows (all tables) before writing
+
+   static TimeSeriesParameters fromConfig(const Config::BlockHandle & timeSeriesConf)
+   {
+      TimeSeriesParameters parameters;
+      parameters.format = timeSeriesConf.getParameter<std::string>("format", parameters.format);
+      parameters.flushRows = timeSeriesConf.getParameter<uint_t>("flushRows", parameters.flushRows);
+      WALBERLA_CHECK(parameters.format == "sqlite" || parameters.format == "binary", "Unknown time series format " << parameters.format);
+      WALBERLA_CHECK_GREATER(parameters.flushRows, uint_t(0));
+      return parameters;
+   }
+};
+
+/*
+ * Buffered time series of a run, recorded on the root process only, in three typed tables:
+ * - steps: particle and contact statistics and the estimated porosity at the logging steps,
+ * - timings: root-local wall time per timer (full path in the timing tree) spent since the previous record, with the phase,
+ * - histograms: particle size and shape histograms as numeric arrays.
+ * Recording only appends to in-memory buffers, which are written once flushRows rows have accumulated and at the end.
+ * sqlite: one transaction per flush into the tables TimeSeriesSteps, TimeSeriesTimings and TimeSeriesHistograms
+ *         of the run data base (WAL journal), keyed by the file identifier of the run, histograms as BLOBs of doubles.
+ * binary: appended blocks of native doubles, each starting with (block type, number of records):
+ *         0 names: (id, length, characters padded to doubles), 1 steps: 12 values, 2 timings: (time, phase id, timer id, seconds),
+ *         3 histograms: (time, name id, size, values).
+ * Names (phases, timers, histograms) are stored as text in sqlite, in the binary format each flush begins with the names new since the last one.
+ */
+class TimeSeriesRecorder
+{
+public:
+   TimeSeriesRecorder(const TimeSeriesParameters & parameters, const std::string & fileIdentifier, const std::string & dbFile, const std::string & binaryFile)
+      : parameters_(parameters), fileIdentifier_(fileIdentifier), dbFile_(dbFile), binaryFile_(binaryFile)
+   {
+      WALBERLA_ROOT_SECTION()
+      {
+         steps_.reserve(parameters_.flushRows);
+         if(parameters_.format == "binary")
+         {
+            std::ofstream file(binaryFile_, std::ios::binary | std::ios::trunc);
+            if(!file) WALBERLA_ABORT("Could not open time series file " << binaryFile_);
+         }
+      }
+   }
+
+   ~TimeSeriesRecorder() { flush(); }
+
+   template<typename ParticleInfo_T, typename ContactInfo_T>
+   void recordStep(real_t time, uint_t timestep, const std::string & phase, const ParticleInfo_T & particleInfo, const ContactInfo_T & contactInfo, real_t porosity)
+   {
+      WALBERLA_NON_ROOT_SECTION() { return; }
+      steps_.push_back({double(time), double(timestep), double(getNameId(phase)), double(particleInfo.numParticles), double(particleInfo.particleVolume),
+                        double(particleInfo.maximumHeight), double(particleInfo.heightOfMass), double(particleInfo.maximumVelocity),
+                        double(contactInfo.numContacts), double(contactInfo.maximumPenetrationDepth), double(contactInfo.averagePenetrationDepth), double(porosity)});
+      flushIfFull();
+   }
+
+   void recordTimings(real_t time, const std::string & phase, const WcTimingTree & timing)
+   {
+      WALBERLA_NON_ROOT_SECTION() { return; }
+      std::map<std::string, double> totals;
+      flattenTimingNode(timing.getRawData(), "", totals);
+      const double phaseId = double(getNameId(phase));
+      for(const auto & entry : totals)
+      {
+         double & previous = previousTotals_[entry.first];
+         if(entry.second > previous) timings_.push_back({double(time), phaseId, double(getNameId(entry.first)), entry.second - previous});
+         previous = entry.second;
+      }
+      flushIfFull();
+   }
+
+   template<typename Container_T>
+   void recordHistogram(real_t time, const std::string & name, const Container_T & values)
+   {
+      WALBERLA_NON_ROOT_SECTION() { return; }
+      histograms_.push_back({double(time), double(getNameId(name)), double(values.size())});
+      for(const auto & value : values) histogramValues_.push_back(double(value));
+      flushIfFull();
+   }
+
+   // writes all buffered rows, only the root process writes
+   void flush()
+   {
+      WALBERLA_NON_ROOT_SECTION() { return; }
+      if(steps_.empty() && timings_.empty() && histograms_.empty()) return;
+      if(parameters_.format == "sqlite") flushToSqlite();
+      else flushToBinaryFile();
+      steps_.clear();
+      timings_.clear();
+      histograms_.clear();
+      histogramValues_.clear();
+      ++numFlushes_;
+   }
+
+   uint_t getNumberOfFlushes() const { return numFlushes_; }
+
+private:
+   using StepRow = std::array<double, 12>;
+   using TimingRow = std::array<double, 4>;
+   using HistogramRow = std::array<double, 3>;
+
+   uint32_t getNameId(const std::string & name)
+   {
+      auto it = nameIds_.find(name);
+      if(it != nameIds_.end()) return it->second;
+      names_.push_back(name);
+      return nameIds_.emplace(name, uint32_t(names_.size() - 1)).first->second;
+   }
+
+   void flushIfFull()
+   {
+      if(steps_.size() + timings_.size() + histograms_.size() >= parameters_.flushRows) flush();
+   }
+
+   void flushToBinaryFile()
+   {
+      std::vector<double> buffer;
+      auto beginBlock = [&buffer](double type, size_t count){ buffer.push_back(type); buffer.push_back(double(count)); };
+
+      beginBlock(0, names_.size() - numWrittenNames_);
+      for(size_t i = numWrittenNames_; i < names_.size(); ++i)
+      {
+         const std::string & name = names_[i];
+         buffer.push_back(double(i));
+         buffer.push_back(double(name.size()));
+         std::vector<double> characters((name.size() + sizeof(double) - 1) / sizeof(double), 0.0);
+         std::copy(name.begin(), name.end(), reinterpret_cast<char*>(characters.data()));
+         buffer.insert(buffer.end(), characters.begin(), characters.end());
+      }
+      numWrittenNames_ = names_.size();
+
+      beginBlock(1, steps_.size());
+      for(const auto & row : steps_) buffer.insert(buffer.end(), row.begin(), row.end());
+      beginBlock(2, timings_.size());
+      for(const auto & row : timings_) buffer.insert(buffer.end(), row.begin(), row.end());
+      beginBlock(3, histograms_.size());
+      size_t offset = 0;
+      for(const auto & row : histograms_)
+      {
+         buffer.insert(buffer.end(), row.begin(), row.end());
+         buffer.insert(buffer.end(), histogramValues_.begin() + int64_c(offset), histogramValues_.begin() + int64_c(offset + size_t(row[2])));
+         offset += size_t(row[2]);
+      }
+
+      std::ofstream file(binaryFile_, std::ios::binary | std::ios::app);
+      if(!file) WALBERLA_ABORT("Could not open time series file " << binaryFile_);
+      file.write(reinterpret_cast<const char*>(buffer.data()), std::streamsize(buffer.size() * sizeof(double)));
+   }
+
+   void flushToSqlite()
+   {
+      sqlite3 * db = nullptr;
+      if(sqlite3_open(dbFile_.c_str(), &db) != SQLITE_OK)
+      {
+         sqlite3_close(db);
+         WALBERLA_ABORT("Could not open sqlite data base " << dbFile_);
+      }
+      sqlite3_busy_timeout(db, 60000);
+      execute(db, "PRAGMA journal_mode=WAL;");
+      execute(db, "PRAGMA synchronous=NORMAL;");
+      execute(db, "CREATE TABLE IF NOT EXISTS TimeSeriesSteps (file_identifier TEXT, time REAL, timestep INTEGER, phase TEXT, numParticles INTEGER,"
+                  " particleVolume REAL, maximumHeight REAL, heightOfMass REAL, maximumVelocity REAL, numContacts INTEGER,"
+                  " maximumPenetrationDepth REAL, averagePenetrationDepth REAL, porosity REAL);");
+      execute(db, "CREATE TABLE IF NOT EXISTS TimeSeriesTimings (file_identifier TEXT, time REAL, phase TEXT, timer TEXT, seconds REAL);");
+      execute(db, "CREATE TABLE IF NOT EXISTS TimeSeriesHistograms (file_identifier TEXT, time REAL, name TEXT, size INTEGER, data BLOB);");
+      execute(db, "CREATE INDEX IF NOT EXISTS TimeSeriesSteps_file_identifier ON TimeSeriesSteps (file_identifier);");
+      execute(db, "CREATE INDEX IF NOT EXISTS TimeSeriesTimings_file_identifier ON TimeSeriesTimings (file_identifier);");
+      execute(db, "CREATE INDEX IF NOT EXISTS TimeSeriesHistograms_file_identifier ON TimeSeriesHistograms (file_identifier);");
+      execute(db, "BEGIN TRANSACTION;");
+
+      sqlite3_stmt * statement = prepare(db, "INSERT INTO TimeSeriesSteps VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?);");
+      for(const auto & row : steps_)
+      {
+         sqlite3_bind_text(statement, 1, fileIdentifier_.c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_double(statement, 2, row[0]);
+         sqlite3_bind_int64(statement, 3, sqlite3_int64(row[1]));
+         sqlite3_bind_text(statement, 4, names_[size_t(row[2])].c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_int64(statement, 5, sqlite3_int64(row[3]));
+         for(int i = 4; i < 8; ++i) sqlite3_bind_double(statement, i + 2, row[size_t(i)]);
+         sqlite3_bind_int64(statement, 10, sqlite3_int64(row[8]));
+         for(int i = 9; i < 12; ++i) sqlite3_bind_double(statement, i + 2, row[size_t(i)]);
+         step(db, statement);
+      }
+      sqlite3_finalize(statement);
+
+      statement = prepare(db, "INSERT INTO TimeSeriesTimings VALUES (?,?,?,?,?);");
+      for(const auto & row : timings_)
+      {
+         sqlite3_bind_text(statement, 1, fileIdentifier_.c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_double(statement, 2, row[0]);
+         sqlite3_bind_text(statement, 3, names_[size_t(row[1])].c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_text(statement, 4, names_[size_t(row[2])].c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_double(statement, 5, row[3]);
+         step(db, statement);
+      }
+      sqlite3_finalize(statement);
+
+      statement = prepare(db, "INSERT INTO TimeSeriesHistograms VALUES (?,?,?,?,?);");
+      size_t offset = 0;
+      for(const auto & row : histograms_)
+      {
+         const size_t size = size_t(row[2]);
+         sqlite3_bind_text(statement, 1, fileIdentifier_.c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_double(statement, 2, row[0]);
+         sqlite3_bind_text(statement, 3, names_[size_t(row[1])].c_str(), -1, SQLITE_STATIC);
+         sqlite3_bind_int64(statement, 4, sqlite3_int64(size));
+         sqlite3_bind_blob(statement, 5, histogramValues_.data() + offset, int(size * sizeof(double)), SQLITE_STATIC);
+         step(db, statement);
+         offset += size;
+      }
+      sqlite3_finalize(statement);
+
+      execute(db, "COMMIT;");
+      sqlite3_close(db);
+   }
+
+   static void execute(sqlite3 * db, const char * sql)
+   {
+      char * errorMessage = nullptr;
+      if(sqlite3_exec(db, sql, nullptr, nullptr, &errorMessage) != SQLITE_OK)
+      {
+         std::string message = (errorMessage != nullptr) ? errorMessage : "";
+         sqlite3_free(errorMessage);
+         WALBERLA_ABORT("Time series: sqlite error '" << message << "' in " << sql);
+      }
+   }
+
+   static sqlite3_stmt * prepare(sqlite3 * db, const char * sql)
+   {
+      sqlite3_stmt * statement = nullptr;
+      if(sqlite3_prepare_v2(db, sql, -1, &statement, nullptr) != SQLITE_OK) WALBERLA_ABORT("Time series: sqlite error '" << sqlite3_errmsg(db) << "' in " << sql);
+      return statement;
+   }
+
+   static void step(sqlite3 * db, sqlite3_stmt * statement)
+   {
+      if(sqlite3_step(statement) != SQLITE_DONE) WALBERLA_ABORT("Time series: sqlite error '" << sqlite3_errmsg(db) << "'");
+      sqlite3_reset(statement);
+      sqlite3_clear_bindings(statement);
+   }
+
+   TimeSeriesParameters parameters_;
+   std::string fileIdentifier_;
+   std::string dbFile_;
+   std::string binaryFile_;
+
+   std::vector<StepRow> steps_;
+   std::vector<TimingRow> timings_;
+   std::vector<HistogramRow> histograms_;
+   std::vector<double> histogramValues_;
+
+   std::vector<std::string> names_;
+   std::unordered_map<std::string, uint32_t> nameIds_;
+   size_t numWrittenNames_ = 0;
+   std::map<std::string, double> previousTotals_;
+   uint_t numFlushes_ = 0;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
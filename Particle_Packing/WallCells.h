@@ -0,0 +1,352 @@
+//======================================================================================================================
+//
+//  This file is part of waLBerla. waLBerla is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  waLBerla is distributed in the hope that it will be useful, but WITHOUT
+//  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+//  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+//  for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with waLBerla (see COPYING.txt). If not, see <http://www.gnu.org/licenses/>.
+//
+//! \file   WallCells.h
+//
+//======================================================================================================================
+
+#pragma once
+
+#include "core/DataTypes.h"
+#include "core/math/Vector3.h"
+
+#include "mesa_pd/data/DataTypes.h"
+#include "mesa_pd/data/Flags.h"
+#include "mesa_pd/data/LinkedCells.h"
+#include "mesa_pd/data/shape/ConvexPolyhedron.h"
+#include "mesa_pd/data/shape/CylindricalBoundary.h"
+#include "mesa_pd/data/shape/HalfSpace.h"
+#include "mesa_pd/kernel/InsertParticleIntoLinkedCells.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "EllipsoidContactDetection.h"
+
+namespace walberla {
+namespace mesa_pd {
+
+namespace collision_detection {
+
+/*
+ * Contact detection for particle-wall pairs without GJK/EPA:
+ * - convex polyhedron-HalfSpace: deepest vertex in normal direction (exact)
+ * - convex polyhedron-CylindricalBoundary: outermost vertex in radial direction, found by fixed-point iteration as for ellipsoids
+ * Spheres and ellipsoids use the analytic kernels of the base classes, all other combinations fall back to GJK/EPA.
+ */
+class WallContactDetection : public EllipsoidContactDetection
+{
+public:
+   using EllipsoidContactDetection::EllipsoidContactDetection;
+   using EllipsoidContactDetection::operator();
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::ConvexPolyhedron& geo1, const data::HalfSpace& geo2, Accessor& ac )
+   {
+      idx1_ = idx1;
+      idx2_ = idx2;
+
+      const Vec3& normal = geo2.getNormal();
+      const Vec3 deepestPoint = support(idx1, geo1, ac, -normal);
+
+      const real_t dist = (deepestPoint - ac.getPosition(idx2)) * normal;
+      if(dist >= contactThreshold_) return false;
+
+      contactNormal_ = normal;
+      penetrationDepth_ = dist;
+      contactPoint_ = deepestPoint - real_t(0.5) * dist * normal;
+      return true;
+   }
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::HalfSpace& geo1, const data::ConvexPolyhedron& geo2, Accessor& ac )
+   {
+      return operator()(idx2, idx1, geo2, geo1, ac);
+   }
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::ConvexPolyhedron& geo1, const data::CylindricalBoundary& geo2, Accessor& ac )
+   {
+      idx1_ = idx1;
+      idx2_ = idx2;
+
+      const Vec3& axis = geo2.getAxis();
+      const Vec3& cylinderPosition = ac.getPosition(idx2);
+      auto radialPart = [&](const Vec3& pt){ Vec3 d = pt - cylinderPosition; return d - (d * axis) * axis; };
+
+      Vec3 radialDirection = radialPart(ac.getPosition(idx1));
+      if(radialDirection.sqrLength() <= real_t(0))
+      {
+         radialDirection = (std::abs(axis[0]) < real_t(0.9)) ? Vec3(1_r,0_r,0_r) : Vec3(0_r,1_r,0_r);
+         radialDirection = radialDirection - (radialDirection * axis) * axis;
+      }
+      radialDirection = radialDirection.getNormalized();
+
+      Vec3 outermostPoint = support(idx1, geo1, ac, radialDirection);
+      for(uint_t i = uint_t(0); i < cylinderRefinementSteps; ++i)
+      {
+         Vec3 newDirection = radialPart(outermostPoint);
+         if(newDirection.sqrLength() <= real_t(0)) break;
+         newDirection = newDirection.getNormalized();
+         Vec3 newPoint = support(idx1, geo1, ac, newDirection);
+         if(newPoint == outermostPoint) break; // same vertex
+         radialDirection = newDirection;
+         outermostPoint = newPoint;
+      }
+
+      const real_t dist = geo2.getRadius() - radialPart(outermostPoint) * radialDirection;
+      if(dist >= contactThreshold_) return false;
+
+      contactNormal_ = -radialDirection;
+      penetrationDepth_ = dist;
+      contactPoint_ = outermostPoint + real_t(0.5) * dist * radialDirection;
+      return true;
+   }
+
+   template <typename Accessor>
+   bool operator()( const size_t idx1, const size_t idx2, const data::CylindricalBoundary& geo1, const data::ConvexPolyhedron& geo2, Accessor& ac )
+   {
+      return operator()(idx2, idx1, geo2, geo1, ac);
+   }
+
+private:
+   // support point in world frame direction 'dir'
+   template <typename Accessor>
+   static Vec3 support(const size_t idx, const data::ConvexPolyhedron& geo, Accessor& ac, const Vec3& dir)
+   {
+      const Mat3 rotationMatrix = ac.getRotation(idx).getMatrix();
+      return ac.getPosition(idx) + rotationMatrix * geo.support(rotationMatrix.getTranspose() * dir);
+   }
+};
+
+} // namespace collision_detection
+
+/*
+ * Cells of a regular cell grid (x fastest) that particles touching a wall (infinite particle) can occupy.
+ * A particle can only touch the wall if its center is closer to the wall than its interaction radius,
+ * thus all cells with a point within 'reach' of the wall are listed.
+ * The outermost cells extend to infinity, as particles outside of the grid are clamped into them.
+ */
+inline std::vector<int> getCellsTouchingWall(const data::BaseShape & wall, const Vec3 & wallPosition,
+                                             const Vec3 & gridMin, const Vec3 & cellWidth, const std::array<int,3> & numCells, real_t reach)
+{
+   std::vector<int> cells;
+   for(int z = 0; z < numCells[2]; ++z)
+      for(int y = 0; y < numCells[1]; ++y)
+         for(int x = 0; x < numCells[0]; ++x)
+         {
+            const int c[3] = {x, y, z};
+            Vec3 cellMin;
+            Vec3 cellMax;
+            bool isUnboundedBelow[3];
+            bool isUnboundedAbove[3];
+            for(uint_t i = 0; i < 3; ++i)
+            {
+               cellMin[i] = gridMin[i] + real_c(c[i]) * cellWidth[i];
+               cellMax[i] = cellMin[i] + cellWidth[i];
+               isUnboundedBelow[i] = (c[i] == 0);
+               isUnboundedAbove[i] = (c[i] == numCells[i] - 1);
+            }
+
+            bool isTouching = false;
+            if(wall.getShapeType() == data::HalfSpace::SHAPE_TYPE)
+            {
+               // minimum signed distance of the cell to the plane, attained at a corner
+               const Vec3 & normal = static_cast<const data::HalfSpace&>(wall).getNormal();
+               real_t minDistance = real_t(0);
+               for(uint_t i = 0; i < 3 && !isTouching; ++i)
+               {
+                  if(normal[i] > real_t(0))
+                  {
+                     if(isUnboundedBelow[i]) isTouching = true;
+                     else minDistance += normal[i] * (cellMin[i] - wallPosition[i]);
+                  } else if(normal[i] < real_t(0))
+                  {
+                     if(isUnboundedAbove[i]) isTouching = true;
+                     else minDistance += normal[i] * (cellMax[i] - wallPosition[i]);
+                  }
+               }
+               isTouching = isTouching || minDistance <= reach;
+            } else if(wall.getShapeType() == data::CylindricalBoundary::SHAPE_TYPE)
+            {
+               // maximum distance of the cell to the axis, attained at a corner (convex function)
+               const auto & cylinder = static_cast<const data::CylindricalBoundary&>(wall);
+               for(uint_t i = 0; i < 3; ++i)
+               {
+                  // unbounded perpendicular to the axis
+                  if((isUnboundedBelow[i] || isUnboundedAbove[i]) && std::abs(cylinder.getAxis()[i]) < real_t(1) - real_t(1e-6)) isTouching = true;
+               }
+               if(!isTouching)
+               {
+                  real_t maxRadialDistance = real_t(0);
+                  for(uint_t corner = 0; corner < 8; ++corner)
+                  {
+                     Vec3 d(((corner & 1u) ? cellMax[0] : cellMin[0]) - wallPosition[0],
+                            ((corner & 2u) ? cellMax[1] : cellMin[1]) - wallPosition[1],
+                            ((corner & 4u) ? cellMax[2] : cellMin[2]) - wallPosition[2]);
+                     maxRadialDistance = std::max(maxRadialDistance, (d - (d * cylinder.getAxis()) * cylinder.getAxis()).length());
+                  }
+                  isTouching = maxRadialDistance >= cylinder.getRadius() - reach;
+               }
+            } else
+            {
+               isTouching = true; // unknown wall type: all cells
+            }
+
+            if(isTouching) cells.push_back(x + numCells[0] * (y + numCells[1] * z));
+         }
+   return cells;
+}
+
+/*
+ * Boundary-cell lists of the walls for a cell grid.
+ * Walls are collected (by uid, the index changes with particle sorting) whenever the cells are rebuilt,
+ * their cell lists are only recomputed if the grid changes or a particle with a larger interaction radius appears.
+ */
+class WallCells
+{
+public:
+   void setGrid(const Vec3 & gridMin, const Vec3 & cellWidth, const std::array<int,3> & numCells)
+   {
+      if(gridMin == gridMin_ && cellWidth == cellWidth_ && numCells == numCells_) return;
+      gridMin_ = gridMin;
+      cellWidth_ = cellWidth;
+      numCells_ = numCells;
+      cellLists_.clear();
+   }
+
+   void clearWalls()
+   {
+      walls_.clear();
+      maxInteractionRadius_ = real_t(0);
+   }
+
+   void addWall(size_t idx) { walls_.push_back(idx); }
+
+   void addParticleRadius(real_t interactionRadius) { maxInteractionRadius_ = std::max(maxInteractionRadius_, interactionRadius); }
+
+   // to be called after all walls and particles have been added
+   template<typename Accessor_T>
+   void refresh(Accessor_T & ac, real_t reachScaling = real_t(1))
+   {
+      const real_t reach = reachScaling * maxInteractionRadius_;
+      wallCells_.clear();
+      for(size_t wall : walls_)
+      {
+         auto & list = cellLists_[ac.getUid(wall)];
+         if(list.cells.empty() || list.reach < reach)
+         {
+            list.reach = reach;
+            list.cells = getCellsTouchingWall(*ac.getShape(wall), ac.getPosition(wall), gridMin_, cellWidth_, numCells_, reach);
+         }
+         wallCells_.push_back(&list.cells);
+      }
+   }
+
+   // func(wallIdx, cells)
+   template<typename Func_T>
+   void forEachWall(Func_T && func) const
+   {
+      for(size_t i = 0; i < walls_.size(); ++i) func(walls_[i], *wallCells_[i]);
+   }
+
+   size_t getNumberOfWallCells() const
+   {
+      size_t numCells = 0;
+      for(const auto * cells : wallCells_) numCells += cells->size();
+      return numCells;
+   }
+
+private:
+   struct CellList
+   {
+      real_t reach = real_t(0);
+      std::vector<int> cells;
+   };
+
+   Vec3 gridMin_;
+   Vec3 cellWidth_;
+   std::array<int,3> numCells_ = {{0, 0, 0}};
+   std::map<walberla::id_t, CellList> cellLists_;
+
+   std::vector<size_t> walls_;
+   std::vector<const std::vector<int>*> wallCells_;
+   real_t maxInteractionRadius_ = real_t(0);
+};
+
+/*
+ * mesa_pd linked cells without infinite particles, which are instead paired with the particles of their boundary cells only.
+ * build() replaces the usual clear + InsertParticleIntoLinkedCells.
+ */
+class LinkedCellsWithWalls
+{
+public:
+   explicit LinkedCellsWithWalls(data::LinkedCells & linkedCells) : linkedCells_(linkedCells)
+   {
+      wallCells_.setGrid(linkedCells.domain_.minCorner(), linkedCells.cellDiameter_,
+                         {{int(linkedCells.numCellsPerDim_[0]), int(linkedCells.numCellsPerDim_[1]), int(linkedCells.numCellsPerDim_[2])}});
+   }
+
+   template<typename Accessor_T>
+   void build(Accessor_T & ac, real_t reachScaling = real_t(1))
+   {
+      build(ac, reachScaling, [](size_t, Accessor_T &){ return true; });
+   }
+
+   // only finite particles accepted by select(idx, ac) are inserted
+   template<typename Accessor_T, typename Select_T>
+   void build(Accessor_T & ac, real_t reachScaling, Select_T && select)
+   {
+      kernel::InsertParticleIntoLinkedCells insert;
+      linkedCells_.clear();
+      wallCells_.clearWalls();
+      for(size_t idx = 0; idx < ac.size(); ++idx)
+      {
+         if(data::particle_flags::isSet(ac.getFlags(idx), data::particle_flags::INFINITE))
+         {
+            wallCells_.addWall(idx);
+         } else if(select(idx, ac))
+         {
+            insert(idx, ac, linkedCells_);
+            wallCells_.addParticleRadius(ac.getInteractionRadius(idx));
+         }
+      }
+      wallCells_.refresh(ac, reachScaling);
+   }
+
+   // func(particleIdx, wallIdx, ac) for all particles in the boundary cells of each wall
+   template<typename Accessor_T, typename Func_T>
+   void forEachWallPair(Accessor_T & ac, Func_T && func) const
+   {
+      wallCells_.forEachWall([&](size_t wall, const std::vector<int> & cells){
+         for(int cell : cells)
+         {
+            for(int idx = linkedCells_.cells_[size_t(cell)]; idx != -1; idx = ac.getNextParticle(size_t(idx))) func(size_t(idx), wall, ac);
+         }
+      });
+   }
+
+   const WallCells & getWallCells() const { return wallCells_; }
+
+private:
+   data::LinkedCells & linkedCells_;
+   WallCells wallCells_;
+};
+
+} // namespace mesa_pd
+} // namespace walberla
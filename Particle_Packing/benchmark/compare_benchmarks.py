@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""
+Compares the throughput (particle time steps per second) of the ParticlePacking benchmark scenarios between two commits.
+
+Usage: compare_benchmarks.py <sqlite file> <git SHA1 reference> <git SHA1 new>
+"""
+
+import sqlite3
+import sys
+
+KERNELS = ["Simulation", "Contact_detection", "Linked_cells", "Hash_grid", "DEM", "HCSITS", "Sync", "VTK"]
+
+
+def load(cursor, sha):
+    columns = [row[1] for row in cursor.execute("PRAGMA table_info(runs)")]
+    throughput_columns = [c for c in ("throughput_" + k for k in KERNELS) if c in columns]
+    query = "SELECT benchmark_scenario, numProcesses, {} FROM runs WHERE gitSHA1 = ? AND benchmark_scenario IS NOT NULL".format(
+        ", ".join(throughput_columns))
+    results = {}
+    for row in cursor.execute(query, (sha,)):
+        # latest run per scenario and rank count wins
+        results[(row[0], row[1])] = dict(zip(throughput_columns, row[2:]))
+    return results
+
+
+def main():
+    if len(sys.argv) != 4:
+        print(__doc__)
+        sys.exit(1)
+
+    cursor = sqlite3.connect(sys.argv[1]).cursor()
+    reference = load(cursor, sys.argv[2])
+    new = load(cursor, sys.argv[3])
+
+    for key in sorted(set(reference) & set(new)):
+        print("{} on {} processes:".format(*key))
+        for kernel, ref_value in reference[key].items():
+            new_value = new[key].get(kernel)
+            if not ref_value or new_value is None:
+                continue
+            print("  {:30s} {:12.4g} -> {:12.4g} ({:+.1f}%)".format(kernel, ref_value, new_value, 100.0 * (new_value / ref_value - 1.0)))
+
+
+if __name__ == "__main__":
+    main()
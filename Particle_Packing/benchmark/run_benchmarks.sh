@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Runs the fixed-seed benchmark scenarios of ParticlePacking for strong and weak scaling.
+# All results (timing tree, throughput per kernel, git SHA1) are stored in the sqlite database given in the config
+# and can be compared between commits with compare_benchmarks.py.
+#
+# Usage: run_benchmarks.sh <path to ParticlePacking executable> [rank counts, default "1 4 16"]
+#        has to be called from the Particle_Packing folder such that mesh_collection is found
+#
+# The default configuration ParticlePacking.cfg is used, only the benchmark-specific parameters are overridden
+# by BENCHMARK_ARGS and the scenario/scaling arguments below (waLBerla command line syntax -Block.parameter=value).
+#
+# Environment: MPIEXEC (default mpirun), TIMESTEPS (default 2000)
+
+EXECUTABLE=${1:?"Path to ParticlePacking executable required"}
+RANK_COUNTS=${2:-"1 4 16"}
+MPIEXEC=${MPIEXEC:-mpirun}
+CONFIG=ParticlePacking.cfg
+
+# fixed number of time steps instead of the termination criteria, counters on, fixed seed, separate output and database
+BENCHMARK_ARGS="-Benchmark.timeSteps=2000 -Profiling.counters=true \
+   -ParticlePacking.visSpacing=0.0025 -ParticlePacking.infoSpacing=0.0025 -ParticlePacking.loggingSpacing=0.0025 \
+   -Distribution.randomSeed=41 -Distribution.Uniform.diameter=2.8e-3 \
+   -Evaluation.vtkFolder=vtk_benchmark -Evaluation.vtkFinalFolder=vtk_benchmark_final \
+   -Evaluation.sqlDBFileName=db_ParticlePackingBenchmark.sqlite"
+
+BASE_WIDTH=0.028
+BASE_MASS=0.02
+
+declare -A SCENARIOS
+SCENARIOS[sphere_mono_periodic]="-ParticlePacking.particleShape=Sphere -ParticlePacking.particleDistribution=Uniform -ParticlePacking.domainSetup=periodic"
+SCENARIOS[sphere_mono_container]="-ParticlePacking.particleShape=Sphere -ParticlePacking.particleDistribution=Uniform -ParticlePacking.domainSetup=container"
+SCENARIOS[sphere_sieving_periodic]="-ParticlePacking.particleShape=Sphere -ParticlePacking.particleDistribution=SievingCurve -ParticlePacking.domainSetup=periodic"
+SCENARIOS[ellipsoid_periodic]="-ParticlePacking.particleShape=EllipsoidFormDistribution -ParticlePacking.particleDistribution=Uniform -ParticlePacking.domainSetup=periodic"
+SCENARIOS[cylinder_mesh_periodic]="-ParticlePacking.particleShape=Mesh -Shape.Mesh.path=mesh_collection/0 -ParticlePacking.particleDistribution=Uniform -ParticlePacking.domainSetup=periodic"
+SCENARIOS[cylinder_mesh_container]="-ParticlePacking.particleShape=Mesh -Shape.Mesh.path=mesh_collection/0 -ParticlePacking.particleDistribution=Uniform -ParticlePacking.domainSetup=container"
+
+SOLVERS="DEM HCSITS"
+
+TIMESTEP_ARG=""
+if [ -n "$TIMESTEPS" ]; then TIMESTEP_ARG="-Benchmark.timeSteps=$TIMESTEPS"; fi
+
+for scenario in "${!SCENARIOS[@]}"; do
+   for solver in $SOLVERS; do
+      for ranks in $RANK_COUNTS; do
+         # strong scaling: fixed domain and particle mass
+         $MPIEXEC -np "$ranks" "$EXECUTABLE" "$CONFIG" $BENCHMARK_ARGS ${SCENARIOS[$scenario]} \
+            -ParticlePacking.solver="$solver" -Benchmark.scenario="${scenario}_${solver}_strong" $TIMESTEP_ARG
+
+         # weak scaling: domain area and particle mass grow with the number of ranks, blocks per rank stay constant
+         factor=$(python3 -c "import math; print(int(round(math.sqrt($ranks))))")
+         width=$(python3 -c "print($BASE_WIDTH * $factor)")
+         mass=$(python3 -c "print($BASE_MASS * $factor * $factor)")
+         blocks=$((3 * factor))
+         $MPIEXEC -np "$ranks" "$EXECUTABLE" "$CONFIG" $BENCHMARK_ARGS ${SCENARIOS[$scenario]} \
+            -ParticlePacking.solver="$solver" -Benchmark.scenario="${scenario}_${solver}_weak" $TIMESTEP_ARG \
+            -ParticlePacking.domainWidth="$width" -ParticlePacking.totalParticleMass="$mass" \
+            -ParticlePacking.numBlocksPerDirection="<$blocks,$blocks,4>"
+      done
+   done
+done